@@ -10,6 +10,7 @@
 
 /* This can be replaced by any BSD-like queue implementation. */
 #include "queue.h"
+#include "ebur128_kernels.h"
 
 #define CHECK_ERROR(condition, errorcode, goto_point)                          \
   if ((condition)) {                                                           \
@@ -23,22 +24,6 @@ struct ebur128_dq_entry {
   STAILQ_ENTRY(ebur128_dq_entry) entries;
 };
 
-#define ALMOST_ZERO 0.000001
-
-typedef struct {              /* Data structure for polyphase FIR interpolator */
-  unsigned int factor;        /* Interpolation factor of the interpolator */
-  unsigned int taps;          /* Taps (prefer odd to increase zero coeffs) */
-  unsigned int channels;      /* Number of channels */
-  unsigned int delay;         /* Size of delay buffer */
-  struct {
-    unsigned int count;       /* Number of coefficients in this subfilter */
-    unsigned int* index;      /* Delay index of corresponding filter coeff */
-    double* coeff;            /* List of subfilter coefficients */
-  }* filter;                  /* List of subfilters (one for each factor) */
-  float** z;                  /* List of delay buffers (one for each channel) */
-  unsigned int zi;            /* Current delay buffer index */
-} interpolator;
-
 struct ebur128_state_internal {
   /** Filtered audio data (used as ring buffer). */
   double* audio_data;
@@ -82,8 +67,8 @@ struct ebur128_state_internal {
   interpolator* interp;
   float* resampler_buffer_input;
   size_t resampler_buffer_input_frames;
-  float* resampler_buffer_output;
-  size_t resampler_buffer_output_frames;
+  /** Per channel sums used when calculating block energies. */
+  double* channel_energy;
   /** The maximum window duration in ms. */
   unsigned long window;
   unsigned long history;
@@ -96,104 +81,8 @@ static double relative_gate_factor;
 static double minus_twenty_decibels;
 static double histogram_energies[1000];
 static double histogram_energy_boundaries[1001];
-
-static interpolator* interp_create(unsigned int taps, unsigned int factor, unsigned int channels) {
-  interpolator* interp = calloc(1, sizeof(interpolator));
-  unsigned int j = 0;
-
-  interp->taps = taps;
-  interp->factor = factor;
-  interp->channels = channels;
-  interp->delay = (interp->taps + interp->factor - 1) / interp->factor;
-
-  /* Initialize the filter memory
-   * One subfilter per interpolation factor. */
-  interp->filter = calloc(interp->factor, sizeof(*interp->filter));
-  for (j = 0; j < interp->factor; j++) {
-    interp->filter[j].index = calloc(interp->delay, sizeof(unsigned int));
-    interp->filter[j].coeff = calloc(interp->delay, sizeof(double));
-  }
-  /* One delay buffer per channel. */
-  interp->z = calloc(interp->channels, sizeof(float*));
-  for (j = 0; j < interp->channels; j++) {
-    interp->z[j] = calloc( interp->delay, sizeof(float) );
-  }
-
-  /* Calculate the filter coefficients */
-  for (j = 0; j < interp->taps; j++) {
-    /* Calculate sinc */
-    double m = (double)j - (double)(interp->taps - 1) / 2.0;
-    double c = 1.0;
-    if (fabs(m) > ALMOST_ZERO) {
-      c = sin(m * M_PI / interp->factor) / (m * M_PI / interp->factor);
-    }
-    /* Apply Hanning window */
-    c *= 0.5 * (1 - cos(2 * M_PI * j / (interp->taps - 1)));
-
-    if (fabs(c) > ALMOST_ZERO) { /* Ignore any zero coeffs. */
-      /* Put the coefficient into the correct subfilter */
-      unsigned int f = j % interp->factor;
-      unsigned int t = interp->filter[f].count++;
-      interp->filter[f].coeff[t] = c;
-      interp->filter[f].index[t] = j / interp->factor;
-    }
-  }
-  return interp;
-}
-
-static void interp_destroy(interpolator* interp) {
-  unsigned int j = 0;
-  if (!interp) {
-    return;
-  }
-  for (j = 0; j < interp->factor; j++) {
-    free(interp->filter[j].index);
-    free(interp->filter[j].coeff);
-  }
-  free(interp->filter);
-  for (j = 0; j < interp->channels; j++) {
-    free(interp->z[j]);
-  }
-  free(interp->z);
-  free(interp);
-}
-
-static void interp_process(interpolator* interp, size_t frames, float* in, float* out) {
-  size_t frame = 0;
-  unsigned int chan = 0;
-  unsigned int f = 0;
-  unsigned int t = 0;
-  unsigned int out_stride = interp->channels * interp->factor;
-  float* outp = 0;
-  double acc = 0;
-  double c = 0;
-  for (frame = 0; frame < frames; frame++) {
-    for (chan = 0; chan < interp->channels; chan++) {
-      /* Add sample to delay buffer */
-      interp->z[chan][interp->zi] = *in++;
-      /* Apply coefficients */
-      outp = out + chan;
-      for (f = 0; f < interp->factor; f++) {
-        acc = 0.0;
-        for (t = 0; t < interp->filter[f].count; t++) {
-          int i = (int)interp->zi - (int)interp->filter[f].index[t];
-          if (i < 0) {
-            i += interp->delay;
-          }
-          c = interp->filter[f].coeff[t];
-          acc += interp->z[chan][i] * c;
-        }
-        *outp = (float)acc;
-        outp += interp->channels;
-      }
-    }
-    out += out_stride;
-    interp->zi++;
-    if (interp->zi == interp->delay) {
-      interp->zi = 0;
-    }
-  }
-}
+/* Inner loops of the float path, chosen for the CPU when initializing */
+static const ebur128_kernels* kernels;
 
 static void ebur128_init_filter(ebur128_state* st) {
   int i, j;
@@ -286,14 +175,13 @@ static int ebur128_init_resampler(ebur128_state* st) {
   int errcode = EBUR128_SUCCESS;
 
   if (st->samplerate < 96000) {
-    st->d->interp = interp_create(49, 4, st->channels);
+    st->d->interp = ebur128_interp_create(49, 4, st->channels);
     CHECK_ERROR(!st->d->interp, EBUR128_ERROR_NOMEM, exit)
   } else if (st->samplerate < 192000) {
-    st->d->interp = interp_create(49, 2, st->channels);
+    st->d->interp = ebur128_interp_create(49, 2, st->channels);
     CHECK_ERROR(!st->d->interp, EBUR128_ERROR_NOMEM, exit)
   } else {
     st->d->resampler_buffer_input = NULL;
-    st->d->resampler_buffer_output = NULL;
     st->d->interp = NULL;
     goto exit;
   }
@@ -304,23 +192,11 @@ static int ebur128_init_resampler(ebur128_state* st) {
                                       sizeof(float));
   CHECK_ERROR(!st->d->resampler_buffer_input, EBUR128_ERROR_NOMEM, free_interp)
 
-  st->d->resampler_buffer_output_frames =
-                                    st->d->resampler_buffer_input_frames *
-                                    st->d->interp->factor;
-  st->d->resampler_buffer_output = malloc
-                                      (st->d->resampler_buffer_output_frames *
-                                       st->channels *
-                                       sizeof(float));
-  CHECK_ERROR(!st->d->resampler_buffer_output, EBUR128_ERROR_NOMEM, free_input)
-
   return errcode;
 
 free_interp:
-  interp_destroy(st->d->interp);
+  ebur128_interp_destroy(st->d->interp);
   st->d->interp = NULL;
-free_input:
-  free(st->d->resampler_buffer_input);
-  st->d->resampler_buffer_input = NULL;
 exit:
   return errcode;
 }
@@ -328,9 +204,7 @@ exit:
 static void ebur128_destroy_resampler(ebur128_state* st) {
   free(st->d->resampler_buffer_input);
   st->d->resampler_buffer_input = NULL;
-  free(st->d->resampler_buffer_output);
-  st->d->resampler_buffer_output = NULL;
-  interp_destroy(st->d->interp);
+  ebur128_interp_destroy(st->d->interp);
   st->d->interp = NULL;
 }
 
@@ -370,6 +244,8 @@ ebur128_state* ebur128_init(unsigned int channels,
   CHECK_ERROR(!st->d->true_peak, 0, free_prev_sample_peak)
   st->d->prev_true_peak = (double*) malloc(channels * sizeof(double));
   CHECK_ERROR(!st->d->prev_true_peak, 0, free_true_peak)
+  st->d->channel_energy = (double*) malloc(channels * sizeof(double));
+  CHECK_ERROR(!st->d->channel_energy, 0, free_prev_true_peak)
   for (i = 0; i < channels; ++i) {
     st->d->sample_peak[i] = 0.0;
     st->d->prev_sample_peak[i] = 0.0;
@@ -387,7 +263,7 @@ ebur128_state* ebur128_init(unsigned int channels,
   } else if ((mode & EBUR128_MODE_M) == EBUR128_MODE_M) {
     st->d->window = 400;
   } else {
-    goto free_prev_true_peak;
+    goto free_channel_energy;
   }
   st->d->audio_data_frames = st->samplerate * st->d->window / 1000;
   if (st->d->audio_data_frames % st->d->samples_in_100ms) {
@@ -399,9 +275,9 @@ ebur128_state* ebur128_init(unsigned int channels,
   st->d->audio_data = (double*) malloc(st->d->audio_data_frames *
                                        st->channels *
                                        sizeof(double));
-  CHECK_ERROR(!st->d->audio_data, 0, free_true_peak)
+  CHECK_ERROR(!st->d->audio_data, 0, free_channel_energy)
   for (j = 0; j < st->d->audio_data_frames * st->channels; ++j) {
-    st->d->audio_data[i] = 0.0;
+    st->d->audio_data[j] = 0.0;
   }
 
   ebur128_init_filter(st);
@@ -441,6 +317,9 @@ ebur128_state* ebur128_init(unsigned int channels,
   st->d->audio_data_index = 0;
 
   /* initialize static constants */
+  if (!kernels) {
+    kernels = ebur128_kernels_select();
+  }
   relative_gate_factor = pow(10.0, relative_gate / 10.0);
   minus_twenty_decibels = pow(10.0, -20.0 / 10.0);
   histogram_energy_boundaries[0] = pow(10.0, (-70.0 + 0.691) / 10.0);
@@ -461,6 +340,8 @@ free_block_energy_histogram:
   free(st->d->block_energy_histogram);
 free_audio_data:
   free(st->d->audio_data);
+free_channel_energy:
+  free(st->d->channel_energy);
 free_prev_true_peak:
   free(st->d->prev_true_peak);
 free_true_peak:
@@ -489,6 +370,7 @@ void ebur128_destroy(ebur128_state** st) {
   free((*st)->d->prev_sample_peak);
   free((*st)->d->true_peak);
   free((*st)->d->prev_true_peak);
+  free((*st)->d->channel_energy);
   while (!STAILQ_EMPTY(&(*st)->d->block_list)) {
     entry = STAILQ_FIRST(&(*st)->d->block_list);
     STAILQ_REMOVE_HEAD(&(*st)->d->block_list, entries);
@@ -505,26 +387,6 @@ void ebur128_destroy(ebur128_state** st) {
   *st = NULL;
 }
 
-static void ebur128_check_true_peak(ebur128_state* st, size_t frames) {
-  size_t c, i;
-  interp_process(st->d->interp, frames, 
-                 st->d->resampler_buffer_input,
-                 st->d->resampler_buffer_output);
-  for (c = 0; c < st->channels; ++c) {
-    for (i = 0; i < st->d->resampler_buffer_output_frames; ++i) {
-      if (st->d->resampler_buffer_output[i * st->channels + c] >
-                                                         st->d->prev_true_peak[c]) {
-        st->d->prev_true_peak[c] =
-            st->d->resampler_buffer_output[i * st->channels + c];
-      } else if (-st->d->resampler_buffer_output[i * st->channels + c] >
-                                                         st->d->prev_true_peak[c]) {
-        st->d->prev_true_peak[c] =
-           -st->d->resampler_buffer_output[i * st->channels + c];
-      }
-    }
-  }
-}
-
 #ifdef __SSE2_MATH__
 #include <xmmintrin.h>
 #define TURN_ON_FTZ \
@@ -576,7 +438,8 @@ static void ebur128_filter_##type(ebur128_state* st, const type* src,          \
                       (float) (src[i * st->channels + c] / scaling_factor);    \
       }                                                                        \
     }                                                                          \
-    ebur128_check_true_peak(st, frames);                                       \
+    kernels->true_peak(st->d->interp, st->d->resampler_buffer_input, frames,  \
+                       st->d->prev_true_peak);                                 \
   }                                                                            \
   for (c = 0; c < st->channels; ++c) {                                         \
     int ci = st->d->channel_map[c] - 1;                                        \
@@ -605,9 +468,35 @@ static void ebur128_filter_##type(ebur128_state* st, const type* src,          \
 }
 EBUR128_FILTER(short, SHRT_MIN, SHRT_MAX)
 EBUR128_FILTER(int, INT_MIN, INT_MAX)
-EBUR128_FILTER(float, -1.0f, 1.0f)
 EBUR128_FILTER(double, -1.0, 1.0)
 
+/* Float input needs no scaling, so is passed straight to the (vectorized)
+ * kernels. */
+static void ebur128_filter_float(ebur128_state* st, const float* src,
+                                 size_t frames) {
+  double* audio_data = st->d->audio_data + st->d->audio_data_index;
+  size_t c;
+
+  TURN_ON_FTZ
+
+  if ((st->mode & EBUR128_MODE_SAMPLE_PEAK) == EBUR128_MODE_SAMPLE_PEAK) {
+    kernels->sample_peak(src, frames, st->channels, st->d->prev_sample_peak);
+  }
+  if ((st->mode & EBUR128_MODE_TRUE_PEAK) == EBUR128_MODE_TRUE_PEAK &&
+      st->d->interp) {
+    kernels->true_peak(st->d->interp, src, frames, st->d->prev_true_peak);
+  }
+  kernels->filter(src, frames, st->channels, st->d->channel_map,
+                  st->d->a, st->d->b, st->d->v, audio_data);
+  for (c = 0; c < st->channels; ++c) {
+    int ci = st->d->channel_map[c] - 1;
+    if (ci < 0) continue;
+    else if (ci == EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */
+    FLUSH_MANUALLY
+  }
+  TURN_OFF_FTZ
+}
+
 static double ebur128_energy_to_loudness(double energy) {
   return 10 * (log(energy) / log(10.0)) - 0.691;
 }
@@ -631,34 +520,31 @@ static size_t find_histogram_index(double energy) {
 
 static int ebur128_calc_gating_block(ebur128_state* st, size_t frames_per_block,
                                      double* optional_output) {
-  size_t i, c;
+  size_t c;
   double sum = 0.0;
   double channel_sum;
+  size_t frames_available = st->d->audio_data_index / st->channels;
+  for (c = 0; c < st->channels; ++c) {
+    st->d->channel_energy[c] = 0.0;
+  }
+  if (frames_available < frames_per_block) {
+    kernels->energy(st->d->audio_data, frames_available, st->channels,
+                    st->d->channel_energy);
+    kernels->energy(st->d->audio_data + (st->d->audio_data_frames -
+                                         (frames_per_block - frames_available)) *
+                                        st->channels,
+                    frames_per_block - frames_available, st->channels,
+                    st->d->channel_energy);
+  } else {
+    kernels->energy(st->d->audio_data +
+                      (frames_available - frames_per_block) * st->channels,
+                    frames_per_block, st->channels, st->d->channel_energy);
+  }
   for (c = 0; c < st->channels; ++c) {
     if (st->d->channel_map[c] == EBUR128_UNUSED) {
       continue;
     }
-    channel_sum = 0.0;
-    if (st->d->audio_data_index < frames_per_block * st->channels) {
-      for (i = 0; i < st->d->audio_data_index / st->channels; ++i) {
-        channel_sum += st->d->audio_data[i * st->channels + c] *
-                       st->d->audio_data[i * st->channels + c];
-      }
-      for (i = st->d->audio_data_frames -
-              (frames_per_block -
-               st->d->audio_data_index / st->channels);
-           i < st->d->audio_data_frames; ++i) {
-        channel_sum += st->d->audio_data[i * st->channels + c] *
-                       st->d->audio_data[i * st->channels + c];
-      }
-    } else {
-      for (i = st->d->audio_data_index / st->channels - frames_per_block;
-           i < st->d->audio_data_index / st->channels;
-           ++i) {
-        channel_sum += st->d->audio_data[i * st->channels + c] *
-                       st->d->audio_data[i * st->channels + c];
-      }
-    }
+    channel_sum = st->d->channel_energy[c];
     if (st->d->channel_map[c] == EBUR128_Mp110 ||
         st->d->channel_map[c] == EBUR128_Mm110 ||
         st->d->channel_map[c] == EBUR128_Mp060 ||
@@ -740,6 +626,7 @@ int ebur128_change_parameters(ebur128_state* st,
     free(st->d->prev_sample_peak); st->d->prev_sample_peak = NULL;
     free(st->d->true_peak);   st->d->true_peak = NULL;
     free(st->d->prev_true_peak); st->d->prev_true_peak = NULL;
+    free(st->d->channel_energy); st->d->channel_energy = NULL;
     st->channels = channels;
 
     errcode = ebur128_init_channel_map(st);
@@ -753,6 +640,8 @@ int ebur128_change_parameters(ebur128_state* st,
     CHECK_ERROR(!st->d->true_peak, EBUR128_ERROR_NOMEM, exit)
     st->d->prev_true_peak = (double*) malloc(channels * sizeof(double));
     CHECK_ERROR(!st->d->prev_true_peak, EBUR128_ERROR_NOMEM, exit)
+    st->d->channel_energy = (double*) malloc(channels * sizeof(double));
+    CHECK_ERROR(!st->d->channel_energy, EBUR128_ERROR_NOMEM, exit)
     for (i = 0; i < channels; ++i) {
       st->d->sample_peak[i] = 0.0;
       st->d->prev_sample_peak[i] = 0.0;
@@ -0,0 +1,623 @@
+/* See COPYING file for copyright and license details. */
+
+#include "ebur128_kernels.h"
+#include "ebur128.h"
+
+#include <math.h> /* You may have to define _USE_MATH_DEFINES if you use MSVC */
+#include <stdlib.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define EBUR128_HAVE_SSE2
+#define EBUR128_HAVE_AVX2
+#define EBUR128_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define EBUR128_HAVE_SSE2
+#define EBUR128_TARGET(isa)
+#endif
+
+#if defined(EBUR128_HAVE_SSE2) || defined(EBUR128_HAVE_AVX2)
+#include <immintrin.h>
+#endif
+
+#define ALMOST_ZERO 0.000001
+
+interpolator* ebur128_interp_create(unsigned int taps, unsigned int factor,
+                                    unsigned int channels) {
+  interpolator* interp = calloc(1, sizeof(interpolator));
+  unsigned int j = 0;
+
+  if (!interp) {
+    return NULL;
+  }
+  interp->taps = taps;
+  interp->factor = factor;
+  interp->channels = channels;
+  interp->delay = (interp->taps + interp->factor - 1) / interp->factor;
+
+  /* Initialize the filter memory
+   * One subfilter per interpolation factor. */
+  interp->filter = calloc(interp->factor, sizeof(*interp->filter));
+  for (j = 0; j < interp->factor; j++) {
+    interp->filter[j].index = calloc(interp->delay, sizeof(unsigned int));
+    interp->filter[j].coeff = calloc(interp->delay, sizeof(double));
+  }
+  interp->dense = calloc(interp->delay * interp->factor, sizeof(double));
+  /* One delay buffer per channel. */
+  interp->z = calloc(interp->channels, sizeof(float*));
+  for (j = 0; j < interp->channels; j++) {
+    interp->z[j] = calloc(interp->delay * 2, sizeof(float));
+  }
+
+  /* Calculate the filter coefficients */
+  for (j = 0; j < interp->taps; j++) {
+    /* Calculate sinc */
+    double m = (double)j - (double)(interp->taps - 1) / 2.0;
+    double c = 1.0;
+    if (fabs(m) > ALMOST_ZERO) {
+      c = sin(m * M_PI / interp->factor) / (m * M_PI / interp->factor);
+    }
+    /* Apply Hanning window */
+    c *= 0.5 * (1 - cos(2 * M_PI * j / (interp->taps - 1)));
+
+    if (fabs(c) > ALMOST_ZERO) { /* Ignore any zero coeffs. */
+      /* Put the coefficient into the correct subfilter */
+      unsigned int f = j % interp->factor;
+      unsigned int t = interp->filter[f].count++;
+      interp->filter[f].coeff[t] = c;
+      interp->filter[f].index[t] = j / interp->factor;
+      interp->dense[(j / interp->factor) * interp->factor + f] = c;
+    }
+  }
+  return interp;
+}
+
+void ebur128_interp_destroy(interpolator* interp) {
+  unsigned int j = 0;
+  if (!interp) {
+    return;
+  }
+  for (j = 0; j < interp->factor; j++) {
+    free(interp->filter[j].index);
+    free(interp->filter[j].coeff);
+  }
+  free(interp->filter);
+  free(interp->dense);
+  for (j = 0; j < interp->channels; j++) {
+    free(interp->z[j]);
+  }
+  free(interp->z);
+  free(interp);
+}
+
+/* Index into the filter state for channel c, or -1 if c is not used. */
+static int filter_index(const int* channel_map, unsigned int c) {
+  int ci = channel_map[c] - 1;
+  if (ci == EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */
+  return ci;
+}
+
+/*
+ * Scalar
+ */
+
+static void sample_peak_scalar(const float* src, size_t frames,
+                               unsigned int channels, double* peaks) {
+  size_t i;
+  unsigned int c;
+  for (c = 0; c < channels; ++c) {
+    double max = 0.0;
+    for (i = 0; i < frames; ++i) {
+      if (src[i * channels + c] > max) {
+        max =        src[i * channels + c];
+      } else if (-src[i * channels + c] > max) {
+        max = -1.0 * src[i * channels + c];
+      }
+    }
+    if (max > peaks[c]) peaks[c] = max;
+  }
+}
+
+static void true_peak_scalar(interpolator* interp, const float* src,
+                             size_t frames, double* peaks) {
+  size_t frame = 0;
+  unsigned int chan = 0;
+  unsigned int f = 0;
+  unsigned int t = 0;
+  for (frame = 0; frame < frames; frame++) {
+    for (chan = 0; chan < interp->channels; chan++) {
+      float* z = interp->z[chan];
+      /* Add sample to delay buffer */
+      z[interp->zi] = z[interp->zi + interp->delay] = *src++;
+      /* Apply coefficients */
+      for (f = 0; f < interp->factor; f++) {
+        double acc = 0.0;
+        float out;
+        for (t = 0; t < interp->filter[f].count; t++) {
+          acc += z[interp->zi + interp->delay - interp->filter[f].index[t]] *
+                 interp->filter[f].coeff[t];
+        }
+        out = (float)acc;
+        if (out > peaks[chan]) {
+          peaks[chan] = out;
+        } else if (-out > peaks[chan]) {
+          peaks[chan] = -out;
+        }
+      }
+    }
+    interp->zi++;
+    if (interp->zi == interp->delay) {
+      interp->zi = 0;
+    }
+  }
+}
+
+static void filter_channel(const float* src, size_t frames,
+                           unsigned int channels, unsigned int c,
+                           const double* a, const double* b, double* v,
+                           double* dst) {
+  size_t i;
+  for (i = 0; i < frames; ++i) {
+    v[0] = (double) src[i * channels + c]
+         - a[1] * v[1]
+         - a[2] * v[2]
+         - a[3] * v[3]
+         - a[4] * v[4];
+    dst[i * channels + c] =
+           b[0] * v[0]
+         + b[1] * v[1]
+         + b[2] * v[2]
+         + b[3] * v[3]
+         + b[4] * v[4];
+    v[4] = v[3];
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+  }
+}
+
+static void filter_scalar(const float* src, size_t frames,
+                          unsigned int channels, const int* channel_map,
+                          const double* a, const double* b, double (*v)[5],
+                          double* dst) {
+  unsigned int c;
+  for (c = 0; c < channels; ++c) {
+    int ci = filter_index(channel_map, c);
+    if (ci >= 0) {
+      filter_channel(src, frames, channels, c, a, b, v[ci], dst);
+    }
+  }
+}
+
+static void energy_channels(const double* data, size_t frames,
+                            unsigned int channels, unsigned int first,
+                            double* sums) {
+  size_t i;
+  unsigned int c;
+  for (c = first; c < channels; ++c) {
+    for (i = 0; i < frames; ++i) {
+      sums[c] += data[i * channels + c] * data[i * channels + c];
+    }
+  }
+}
+
+static void energy_scalar(const double* data, size_t frames,
+                          unsigned int channels, double* sums) {
+  energy_channels(data, frames, channels, 0, sums);
+}
+
+static const ebur128_kernels scalar_kernels = {
+  "scalar", sample_peak_scalar, true_peak_scalar, filter_scalar, energy_scalar
+};
+
+const ebur128_kernels* ebur128_kernels_scalar(void) {
+  return &scalar_kernels;
+}
+
+/*
+ * SSE2 - filter and energy run two channels per vector, peaks run
+ * frames * channels samples 4 at a time, true peak runs 2 phases per vector.
+ */
+
+#ifdef EBUR128_HAVE_SSE2
+EBUR128_TARGET("sse2")
+static void peak_lanes_sse2(__m128 max, unsigned int channels,
+                            double* peaks) {
+  float lanes[4];
+  unsigned int l;
+  _mm_storeu_ps(lanes, max);
+  for (l = 0; l < 4; ++l) {
+    if (lanes[l] > peaks[l % channels]) peaks[l % channels] = lanes[l];
+  }
+}
+
+EBUR128_TARGET("sse2")
+static void sample_peak_sse2(const float* src, size_t frames,
+                             unsigned int channels, double* peaks) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 max = _mm_setzero_ps();
+  size_t samples = frames * channels;
+  size_t i;
+
+  if (4 % channels) {
+    sample_peak_scalar(src, frames, channels, peaks);
+    return;
+  }
+  /* Each lane always holds the same channel. NaNs are ignored, as max
+   * returns its second operand if either is NaN. */
+  for (i = 0; i + 4 <= samples; i += 4) {
+    max = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(src + i), abs_mask), max);
+  }
+  peak_lanes_sse2(max, channels, peaks);
+  sample_peak_scalar(src + i, (samples - i) / channels, channels, peaks);
+}
+
+EBUR128_TARGET("sse2")
+static void true_peak_sse2(interpolator* interp, const float* src,
+                           size_t frames, double* peaks) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  unsigned int delay = interp->delay;
+  unsigned int channels = interp->channels;
+  unsigned int chan, k;
+  size_t frame;
+
+  if (interp->factor != 2 && interp->factor != 4) {
+    true_peak_scalar(interp, src, frames, peaks);
+    return;
+  }
+  /* Channels are independent, so run each over all frames. Subfilters
+   * without a coefficient for a delay index have 0.0 in the dense table,
+   * adding this does not alter the sum. */
+  for (chan = 0; chan < channels; ++chan) {
+    float* z = interp->z[chan];
+    unsigned int zi = interp->zi;
+    __m128 max = _mm_setzero_ps();
+    for (frame = 0; frame < frames; ++frame) {
+      const double* coeff = interp->dense;
+      const float* newest;
+      __m128d acc0 = _mm_setzero_pd();
+      __m128 out;
+      z[zi] = z[zi + delay] = src[frame * channels + chan];
+      newest = z + zi + delay;
+      if (4 == interp->factor) {
+        __m128d acc1 = _mm_setzero_pd();
+        for (k = 0; k < delay; ++k, coeff += 4) {
+          __m128d s = _mm_set1_pd((double) *(newest - k));
+          acc0 = _mm_add_pd(acc0, _mm_mul_pd(s, _mm_loadu_pd(coeff)));
+          acc1 = _mm_add_pd(acc1, _mm_mul_pd(s, _mm_loadu_pd(coeff + 2)));
+        }
+        out = _mm_movelh_ps(_mm_cvtpd_ps(acc0), _mm_cvtpd_ps(acc1));
+      } else {
+        for (k = 0; k < delay; ++k, coeff += 2) {
+          __m128d s = _mm_set1_pd((double) *(newest - k));
+          acc0 = _mm_add_pd(acc0, _mm_mul_pd(s, _mm_loadu_pd(coeff)));
+        }
+        out = _mm_cvtpd_ps(acc0);
+      }
+      max = _mm_max_ps(_mm_and_ps(out, abs_mask), max);
+      if (++zi == delay) zi = 0;
+    }
+    {
+      float lanes[4];
+      unsigned int l;
+      _mm_storeu_ps(lanes, max);
+      for (l = 0; l < 4; ++l) {
+        if (lanes[l] > peaks[chan]) peaks[chan] = lanes[l];
+      }
+    }
+  }
+  interp->zi = (unsigned int) ((interp->zi + frames) % delay);
+}
+
+EBUR128_TARGET("sse2")
+static void filter_pair_sse2(const float* src, size_t frames,
+                             unsigned int channels, unsigned int c,
+                             const double* a, const double* b,
+                             double* va, double* vb, double* dst) {
+  const __m128d a1 = _mm_set1_pd(a[1]), a2 = _mm_set1_pd(a[2]),
+                a3 = _mm_set1_pd(a[3]), a4 = _mm_set1_pd(a[4]);
+  const __m128d b0 = _mm_set1_pd(b[0]), b1 = _mm_set1_pd(b[1]),
+                b2 = _mm_set1_pd(b[2]), b3 = _mm_set1_pd(b[3]),
+                b4 = _mm_set1_pd(b[4]);
+  __m128d v0 = _mm_set_pd(vb[0], va[0]);
+  __m128d v1 = _mm_set_pd(vb[1], va[1]);
+  __m128d v2 = _mm_set_pd(vb[2], va[2]);
+  __m128d v3 = _mm_set_pd(vb[3], va[3]);
+  __m128d v4 = _mm_set_pd(vb[4], va[4]);
+  size_t i;
+
+  /* Same operation order as filter_channel() */
+  for (i = 0; i < frames; ++i) {
+    __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(
+                  _mm_loadl_epi64((const __m128i*) (src + i * channels + c))));
+    v0 = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(_mm_sub_pd(x,
+                                                     _mm_mul_pd(a1, v1)),
+                                          _mm_mul_pd(a2, v2)),
+                               _mm_mul_pd(a3, v3)),
+                    _mm_mul_pd(a4, v4));
+    _mm_storeu_pd(dst + i * channels + c,
+                  _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(b0, v0),
+                                                              _mm_mul_pd(b1, v1)),
+                                                   _mm_mul_pd(b2, v2)),
+                                        _mm_mul_pd(b3, v3)),
+                             _mm_mul_pd(b4, v4)));
+    v4 = v3;
+    v3 = v2;
+    v2 = v1;
+    v1 = v0;
+  }
+
+  _mm_storel_pd(&va[0], v0); _mm_storeh_pd(&vb[0], v0);
+  _mm_storel_pd(&va[1], v1); _mm_storeh_pd(&vb[1], v1);
+  _mm_storel_pd(&va[2], v2); _mm_storeh_pd(&vb[2], v2);
+  _mm_storel_pd(&va[3], v3); _mm_storeh_pd(&vb[3], v3);
+  _mm_storel_pd(&va[4], v4); _mm_storeh_pd(&vb[4], v4);
+}
+
+/* Filter channels from 'c' onwards, pairing up channels with their own
+ * state. Channels sharing a state are still filtered in channel order. */
+EBUR128_TARGET("sse2")
+static void filter_from_sse2(const float* src, size_t frames,
+                             unsigned int channels, unsigned int c,
+                             const int* channel_map, const double* a,
+                             const double* b, double (*v)[5], double* dst) {
+  while (c < channels) {
+    int ci = filter_index(channel_map, c);
+    if (c + 1 < channels) {
+      int cj = filter_index(channel_map, c + 1);
+      if (ci >= 0 && cj >= 0 && ci != cj) {
+        filter_pair_sse2(src, frames, channels, c, a, b, v[ci], v[cj], dst);
+        c += 2;
+        continue;
+      }
+    }
+    if (ci >= 0) {
+      filter_channel(src, frames, channels, c, a, b, v[ci], dst);
+    }
+    c++;
+  }
+}
+
+EBUR128_TARGET("sse2")
+static void filter_sse2(const float* src, size_t frames,
+                        unsigned int channels, const int* channel_map,
+                        const double* a, const double* b, double (*v)[5],
+                        double* dst) {
+  filter_from_sse2(src, frames, channels, 0, channel_map, a, b, v, dst);
+}
+
+EBUR128_TARGET("sse2")
+static void energy_from_sse2(const double* data, size_t frames,
+                             unsigned int channels, unsigned int c,
+                             double* sums) {
+  size_t i;
+  for (; c + 2 <= channels; c += 2) {
+    __m128d acc = _mm_loadu_pd(sums + c);
+    for (i = 0; i < frames; ++i) {
+      __m128d x = _mm_loadu_pd(data + i * channels + c);
+      acc = _mm_add_pd(acc, _mm_mul_pd(x, x));
+    }
+    _mm_storeu_pd(sums + c, acc);
+  }
+  energy_channels(data, frames, channels, c, sums);
+}
+
+EBUR128_TARGET("sse2")
+static void energy_sse2(const double* data, size_t frames,
+                        unsigned int channels, double* sums) {
+  energy_from_sse2(data, frames, channels, 0, sums);
+}
+
+static const ebur128_kernels sse2_kernels = {
+  "sse2", sample_peak_sse2, true_peak_sse2, filter_sse2, energy_sse2
+};
+#endif
+
+const ebur128_kernels* ebur128_kernels_sse2(void) {
+#ifdef EBUR128_HAVE_SSE2
+#if defined(__GNUC__) && !defined(__x86_64__)
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse2")) {
+    return NULL;
+  }
+#endif
+  return &sse2_kernels;
+#else
+  return NULL;
+#endif
+}
+
+/*
+ * AVX2 - filter and energy run four channels per vector (stereo uses SSE2),
+ * peaks run 8 samples at a time, true peak runs all 4 phases per vector.
+ */
+
+#ifdef EBUR128_HAVE_AVX2
+EBUR128_TARGET("avx2")
+static void sample_peak_avx2(const float* src, size_t frames,
+                             unsigned int channels, double* peaks) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 max = _mm256_setzero_ps();
+  size_t samples = frames * channels;
+  size_t i;
+
+  if (8 % channels) {
+    sample_peak_sse2(src, frames, channels, peaks);
+    return;
+  }
+  for (i = 0; i + 8 <= samples; i += 8) {
+    max = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(src + i), abs_mask), max);
+  }
+  if (8 == channels) {
+    float lanes[8];
+    unsigned int l;
+    _mm256_storeu_ps(lanes, max);
+    for (l = 0; l < 8; ++l) {
+      if (lanes[l] > peaks[l]) peaks[l] = lanes[l];
+    }
+  } else {
+    /* 4 is a multiple of channels here too, so lanes 4..7 map as 0..3 */
+    peak_lanes_sse2(_mm_max_ps(_mm256_castps256_ps128(max),
+                               _mm256_extractf128_ps(max, 1)),
+                    channels, peaks);
+  }
+  sample_peak_scalar(src + i, (samples - i) / channels, channels, peaks);
+}
+
+EBUR128_TARGET("avx2")
+static void true_peak_avx2(interpolator* interp, const float* src,
+                           size_t frames, double* peaks) {
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  unsigned int delay = interp->delay;
+  unsigned int channels = interp->channels;
+  unsigned int chan, k;
+  size_t frame;
+
+  if (interp->factor != 4) {
+    true_peak_sse2(interp, src, frames, peaks);
+    return;
+  }
+  for (chan = 0; chan < channels; ++chan) {
+    float* z = interp->z[chan];
+    unsigned int zi = interp->zi;
+    __m128 max = _mm_setzero_ps();
+    for (frame = 0; frame < frames; ++frame) {
+      const double* coeff = interp->dense;
+      const float* newest;
+      __m256d acc = _mm256_setzero_pd();
+      z[zi] = z[zi + delay] = src[frame * channels + chan];
+      newest = z + zi + delay;
+      for (k = 0; k < delay; ++k, coeff += 4) {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set1_pd((double) *(newest - k)),
+                                               _mm256_loadu_pd(coeff)));
+      }
+      max = _mm_max_ps(_mm_and_ps(_mm256_cvtpd_ps(acc), abs_mask), max);
+      if (++zi == delay) zi = 0;
+    }
+    {
+      float lanes[4];
+      unsigned int l;
+      _mm_storeu_ps(lanes, max);
+      for (l = 0; l < 4; ++l) {
+        if (lanes[l] > peaks[chan]) peaks[chan] = lanes[l];
+      }
+    }
+  }
+  interp->zi = (unsigned int) ((interp->zi + frames) % delay);
+}
+
+EBUR128_TARGET("avx2")
+static void filter_quad_avx2(const float* src, size_t frames,
+                             unsigned int channels, unsigned int c,
+                             const double* a, const double* b,
+                             double** state, double* dst) {
+  const __m256d a1 = _mm256_set1_pd(a[1]), a2 = _mm256_set1_pd(a[2]),
+                a3 = _mm256_set1_pd(a[3]), a4 = _mm256_set1_pd(a[4]);
+  const __m256d b0 = _mm256_set1_pd(b[0]), b1 = _mm256_set1_pd(b[1]),
+                b2 = _mm256_set1_pd(b[2]), b3 = _mm256_set1_pd(b[3]),
+                b4 = _mm256_set1_pd(b[4]);
+  __m256d v[5];
+  double lanes[4];
+  size_t i;
+  unsigned int j, l;
+
+  for (j = 0; j < 5; ++j) {
+    v[j] = _mm256_set_pd(state[3][j], state[2][j], state[1][j], state[0][j]);
+  }
+  /* Same operation order as filter_channel() */
+  for (i = 0; i < frames; ++i) {
+    __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(src + i * channels + c));
+    v[0] = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(x,
+                                                                   _mm256_mul_pd(a1, v[1])),
+                                                     _mm256_mul_pd(a2, v[2])),
+                                       _mm256_mul_pd(a3, v[3])),
+                         _mm256_mul_pd(a4, v[4]));
+    _mm256_storeu_pd(dst + i * channels + c,
+                     _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(b0, v[0]),
+                                                                             _mm256_mul_pd(b1, v[1])),
+                                                               _mm256_mul_pd(b2, v[2])),
+                                                 _mm256_mul_pd(b3, v[3])),
+                                   _mm256_mul_pd(b4, v[4])));
+    v[4] = v[3];
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+  }
+  for (j = 0; j < 5; ++j) {
+    _mm256_storeu_pd(lanes, v[j]);
+    for (l = 0; l < 4; ++l) {
+      state[l][j] = lanes[l];
+    }
+  }
+}
+
+EBUR128_TARGET("avx2")
+static void filter_avx2(const float* src, size_t frames,
+                        unsigned int channels, const int* channel_map,
+                        const double* a, const double* b, double (*v)[5],
+                        double* dst) {
+  unsigned int c = 0;
+  while (c + 4 <= channels) {
+    int ci[4];
+    unsigned int j, k;
+    int distinct = 1;
+    for (j = 0; j < 4; ++j) {
+      ci[j] = filter_index(channel_map, c + j);
+      distinct = distinct && ci[j] >= 0;
+      for (k = 0; k < j; ++k) {
+        distinct = distinct && ci[j] != ci[k];
+      }
+    }
+    if (!distinct) {
+      break;
+    }
+    {
+      double* state[4];
+      state[0] = v[ci[0]];
+      state[1] = v[ci[1]];
+      state[2] = v[ci[2]];
+      state[3] = v[ci[3]];
+      filter_quad_avx2(src, frames, channels, c, a, b, state, dst);
+    }
+    c += 4;
+  }
+  filter_from_sse2(src, frames, channels, c, channel_map, a, b, v, dst);
+}
+
+EBUR128_TARGET("avx2")
+static void energy_avx2(const double* data, size_t frames,
+                        unsigned int channels, double* sums) {
+  unsigned int c = 0;
+  size_t i;
+  for (; c + 4 <= channels; c += 4) {
+    __m256d acc = _mm256_loadu_pd(sums + c);
+    for (i = 0; i < frames; ++i) {
+      __m256d x = _mm256_loadu_pd(data + i * channels + c);
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(x, x));
+    }
+    _mm256_storeu_pd(sums + c, acc);
+  }
+  energy_from_sse2(data, frames, channels, c, sums);
+}
+
+static const ebur128_kernels avx2_kernels = {
+  "avx2", sample_peak_avx2, true_peak_avx2, filter_avx2, energy_avx2
+};
+#endif
+
+const ebur128_kernels* ebur128_kernels_avx2(void) {
+#ifdef EBUR128_HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && ebur128_kernels_sse2()) {
+    return &avx2_kernels;
+  }
+#endif
+  return NULL;
+}
+
+const ebur128_kernels* ebur128_kernels_select(void) {
+  const ebur128_kernels* kernels = ebur128_kernels_avx2();
+  if (!kernels) {
+    kernels = ebur128_kernels_sse2();
+  }
+  return kernels ? kernels : ebur128_kernels_scalar();
+}
@@ -0,0 +1,65 @@
+/* See COPYING file for copyright and license details. */
+
+#ifndef EBUR128_KERNELS_H_
+#define EBUR128_KERNELS_H_
+
+/* Internal inner loops of the float path, with scalar, SSE2 and AVX2
+ * implementations. All implementations accumulate in the same order as the
+ * scalar code, so results do not depend upon which set is used. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {              /* Data structure for polyphase FIR interpolator */
+  unsigned int factor;        /* Interpolation factor of the interpolator */
+  unsigned int taps;          /* Taps (prefer odd to increase zero coeffs) */
+  unsigned int channels;      /* Number of channels */
+  unsigned int delay;         /* Size of delay buffer */
+  struct {
+    unsigned int count;       /* Number of coefficients in this subfilter */
+    unsigned int* index;      /* Delay index of corresponding filter coeff */
+    double* coeff;            /* List of subfilter coefficients */
+  }* filter;                  /* List of subfilters (one for each factor) */
+  double* dense;              /* [delay][factor] coefficients, 0.0 if unused */
+  float** z;                  /* List of delay buffers (one for each channel),
+                                 each sample is stored twice so that the
+                                 last 'delay' samples are always contiguous */
+  unsigned int zi;            /* Current delay buffer index */
+} interpolator;
+
+interpolator* ebur128_interp_create(unsigned int taps, unsigned int factor,
+                                    unsigned int channels);
+void ebur128_interp_destroy(interpolator* interp);
+
+typedef struct {
+  const char* name;
+  /** peaks[c] = max(peaks[c], |src|) for each channel. */
+  void (*sample_peak)(const float* src, size_t frames, unsigned int channels,
+                      double* peaks);
+  /** As sample_peak, but of the signal upsampled by interp. */
+  void (*true_peak)(interpolator* interp, const float* src, size_t frames,
+                    double* peaks);
+  /** BS.1770 K-weighting filter, into interleaved dst. */
+  void (*filter)(const float* src, size_t frames, unsigned int channels,
+                 const int* channel_map, const double* a, const double* b,
+                 double (*v)[5], double* dst);
+  /** sums[c] += data^2 for each channel. */
+  void (*energy)(const double* data, size_t frames, unsigned int channels,
+                 double* sums);
+} ebur128_kernels;
+
+const ebur128_kernels* ebur128_kernels_scalar(void);
+/* These return NULL if the build, or the CPU, does not support them */
+const ebur128_kernels* ebur128_kernels_sse2(void);
+const ebur128_kernels* ebur128_kernels_avx2(void);
+/* Best set for the current CPU */
+const ebur128_kernels* ebur128_kernels_select(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* EBUR128_KERNELS_H_ */
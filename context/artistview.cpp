@@ -50,7 +50,7 @@ const QLatin1String ArtistView::constCacheDir("artists/");
 const QLatin1String ArtistView::constInfoExt(".html.gz");
 const QLatin1String ArtistView::constSimilarInfoExt(".txt");
 
-static QString cacheFileName(const QString &artist, const QString &lang, bool similar, bool createDir)
+QString ArtistView::cacheFileName(const QString &artist, const QString &lang, bool similar, bool createDir)
 {
     return Utils::cacheDir(ArtistView::constCacheDir, createDir)+
             Covers::encodeName(artist)+(similar ? "-similar" : ("."+lang))+(similar ? ArtistView::constSimilarInfoExt : ArtistView::constInfoExt);
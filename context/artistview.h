@@ -48,6 +48,8 @@ public:
     static const QLatin1String constInfoExt;
     static const QLatin1String constSimilarInfoExt;
 
+    static QString cacheFileName(const QString &artist, const QString &lang, bool similar, bool createDir);
+
     ArtistView(QWidget *parent);
     virtual ~ArtistView() { abort(); }
 
@@ -34,6 +34,7 @@ ContextEngine * ContextEngine::create(QObject *parent)
 ContextEngine::ContextEngine(QObject *p)
     : QObject(p)
     , job(0)
+    , priority(QNetworkRequest::NormalPriority)
 {
 }
 
@@ -66,6 +67,13 @@ void ContextEngine::cancel()
     }
 }
 
+QNetworkRequest ContextEngine::request(const QUrl &url) const
+{
+    QNetworkRequest req(url);
+    req.setPriority(priority);
+    return req;
+}
+
 NetworkJob * ContextEngine::getReply(QObject *obj)
 {
     NetworkJob *reply = qobject_cast<NetworkJob*>(obj);
@@ -26,6 +26,7 @@
 
 #include <QObject>
 #include <QStringList>
+#include <QNetworkRequest>
 
 class NetworkJob;
 
@@ -49,6 +50,8 @@ public:
     virtual QStringList getLangs() const =0;
     virtual QString getPrefix(const QString &key) const =0;
     QStringList fixQuery(const QStringList &query) const;
+    // Priority of subsequent network requests - background fetches use QNetworkRequest::LowPriority
+    virtual void setPriority(QNetworkRequest::Priority p) { priority=p; }
 
     void cancel();
 
@@ -60,9 +63,11 @@ Q_SIGNALS:
 
 protected:
     NetworkJob * getReply(QObject *obj);
+    QNetworkRequest request(const QUrl &url) const;
 
 protected:
     NetworkJob *job;
+    QNetworkRequest::Priority priority;
 };
 
 #endif
@@ -0,0 +1,398 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "contextprefetcher.h"
+#include "contextengine.h"
+#include "ultimatelyrics.h"
+#include "artistview.h"
+#include "albumview.h"
+#include "songview.h"
+#include "gui/covers.h"
+#include "models/playqueuemodel.h"
+#include "mpd-interface/mpdstatus.h"
+#include "support/configuration.h"
+#include "qtiocompressor/qtiocompressor.h"
+#include <QWidget>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+
+#include <QDebug>
+static bool debugEnabled=false;
+#define DBUG if (debugEnabled) qWarning() << metaObject()->className() << __FUNCTION__
+void ContextPrefetcher::enableDebug()
+{
+    debugEnabled=true;
+}
+
+// Number of upcoming songs, and the lookups and KiB allowed per period. These can be changed via hidden config items.
+static const int constMaxSongs=2;
+static const int constMaxRequests=30;
+static const int constMaxKb=4096;
+static const qint64 constBudgetPeriod=60*60*1000;
+// Wait a little before prefetching, so that the views can first fetch the info for the current song.
+static const int constStartDelay=5000;
+// If lyrics could not be fetched due to network errors, try again after this long.
+static const int constRetryDelay=5*60*1000;
+
+static QString coverKey(const Song &song)
+{
+    return song.isArtistImageRequest()
+            ? QLatin1String("artist:")+song.albumartist
+            : QLatin1String("album:")+song.albumArtist()+QLatin1Char('\n')+song.album;
+}
+
+ContextPrefetcher::ContextPrefetcher(QWidget *v)
+    : QObject(v)
+    , view(v)
+    , lyrics(0)
+    , nextSongId(-1)
+    , busy(false)
+    , lyricsId(0)
+    , requests(0)
+    , bytes(0)
+{
+    Configuration cfg(metaObject()->className());
+    maxSongs=cfg.get("songs", constMaxSongs, 0, 10);
+    maxRequests=cfg.get("maxRequests", constMaxRequests, 0, 1000);
+    maxBytes=cfg.get("maxKb", constMaxKb, 0, 1024*1024)*1024ll;
+
+    timer=new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setInterval(constStartDelay);
+    connect(timer, SIGNAL(timeout()), SLOT(start()));
+    engine=ContextEngine::create(this);
+    engine->setPriority(QNetworkRequest::LowPriority);
+    connect(engine, SIGNAL(searchResult(QString,QString)), SLOT(searchResponse(QString,QString)));
+
+    if (isEnabled()) {
+        connect(MPDStatus::self(), SIGNAL(updated()), SLOT(statusUpdated()));
+        connect(PlayQueueModel::self(), SIGNAL(modelReset()), SLOT(schedule()));
+        connect(PlayQueueModel::self(), SIGNAL(layoutChanged()), SLOT(schedule()));
+        connect(PlayQueueModel::self(), SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(schedule()));
+        connect(PlayQueueModel::self(), SIGNAL(rowsRemoved(QModelIndex,int,int)), SLOT(schedule()));
+        connect(Covers::self(), SIGNAL(cover(Song,QImage,QString)), SLOT(coverReceived(Song,QImage,QString)));
+        connect(Covers::self(), SIGNAL(artistImage(Song,QImage,QString)), SLOT(coverReceived(Song,QImage,QString)));
+    }
+    period.start();
+}
+
+ContextPrefetcher::~ContextPrefetcher()
+{
+    stop();
+    if (lyrics) {
+        lyrics->release();
+    }
+}
+
+void ContextPrefetcher::setCurrent(const Song &s)
+{
+    current=s;
+    schedule();
+}
+
+void ContextPrefetcher::schedule()
+{
+    if (isEnabled()) {
+        timer->start();
+    }
+}
+
+void ContextPrefetcher::statusUpdated()
+{
+    if (MPDStatus::self()->nextSongId()!=nextSongId) {
+        nextSongId=MPDStatus::self()->nextSongId();
+        schedule();
+    }
+}
+
+void ContextPrefetcher::start()
+{
+    if (!view->isVisible()) {
+        DBUG << "View not visible";
+        stop();
+        targets.clear();
+        return;
+    }
+
+    QList<Song> songs;
+    QStringList keys;
+    // nextSongId is not accurate if we are stopped, and only the next song is known if in random mode.
+    if (-1!=nextSongId && MPDState_Stopped!=MPDStatus::self()->state()) {
+        qint32 row=PlayQueueModel::self()->getRowById(nextSongId);
+        qint32 last=row<0 ? row : qMin(row+(MPDStatus::self()->random() ? 1 : maxSongs), PlayQueueModel::self()->rowCount());
+        for (qint32 r=row; r<last; ++r) {
+            Song s=PlayQueueModel::self()->getSongByRow(r);
+            if (s.isVariousArtists()) {
+                s.revertVariousArtists();
+            }
+            if (s.isStream() || Song::OnlineSvrTrack==s.type || s.artist.isEmpty() || s.title.isEmpty() ||
+                (s.artist==current.artist && s.title==current.title)) {
+                continue;
+            }
+            songs.append(s);
+            keys.append(s.file);
+        }
+    }
+
+    if (keys==targets) {
+        return;
+    }
+
+    stop();
+    targets=keys;
+    QSet<QString> added;
+    for (const Song &s: songs) {
+        addItems(s, added);
+    }
+    DBUG << targets << items.count();
+    next();
+}
+
+void ContextPrefetcher::stop()
+{
+    items.clear();
+    pendingCovers.clear();
+    if (busy) {
+        engine->cancel();
+        if (lyrics) {
+            lyrics->abort();
+        }
+        busy=false;
+    }
+}
+
+void ContextPrefetcher::addItems(const Song &song, QSet<QString> &keys)
+{
+    QList<Type> types=QList<Type>() << Lyrics << Artist << Album << Track << Cover << ArtistImage;
+    for (Type type: types) {
+        QString key;
+        switch (type) {
+        case Artist:
+        case ArtistImage:
+            key=song.basicArtist();
+            break;
+        case Album:
+        case Cover:
+            if (song.albumArtist().isEmpty() || song.album.isEmpty()) {
+                continue;
+            }
+            key=song.albumArtist()+QLatin1Char('\n')+song.album;
+            break;
+        default:
+            key=song.artist+QLatin1Char('\n')+song.title;
+            break;
+        }
+
+        // Songs on the same album, or by the same artist, share lookups
+        key=QString::number(type)+QLatin1Char(':')+key;
+        if (!keys.contains(key)) {
+            keys.insert(key);
+            Item item(type, song);
+            if (!isCached(item)) {
+                items.append(item);
+            }
+        }
+    }
+}
+
+bool ContextPrefetcher::isCached(const Item &item) const
+{
+    switch (item.type) {
+    case Artist:
+    case Album:
+    case Track:
+        for (const QString &lang: engine->getLangs()) {
+            QString prefix=engine->getPrefix(lang);
+            QString fileName=Artist==item.type
+                                ? ArtistView::cacheFileName(item.song.basicArtist(), prefix, false, false)
+                                : Album==item.type
+                                    ? AlbumView::cacheFileName(Covers::fixArtist(item.song.albumArtist()), item.song.album, prefix, false)
+                                    : SongView::infoCacheFileName(item.song, prefix, false);
+            if (QFile::exists(fileName)) {
+                return true;
+            }
+        }
+        return false;
+    case Lyrics:
+        return SongView::lyricsKnown(item.song);
+    default:
+        // Covers checks its own cache, in its own thread, before downloading anything.
+        return false;
+    }
+}
+
+bool ContextPrefetcher::haveBudget()
+{
+    if (period.elapsed()>constBudgetPeriod) {
+        period.restart();
+        requests=0;
+        bytes=0;
+    }
+    return requests<maxRequests && bytes<maxBytes;
+}
+
+void ContextPrefetcher::next()
+{
+    if (busy) {
+        return;
+    }
+
+    while (!items.isEmpty()) {
+        if (!haveBudget()) {
+            DBUG << "Budget used" << requests << bytes;
+            items.clear();
+            break;
+        }
+
+        active=items.takeFirst();
+        // The views may have fetched this since it was queued...
+        if (isCached(active)) {
+            continue;
+        }
+
+        DBUG << (int)active.type << active.song.artist << active.song.album << active.song.title;
+        requests++;
+        switch (active.type) {
+        case Artist:
+            busy=true;
+            engine->search(QStringList() << active.song.basicArtist(), ContextEngine::Artist);
+            return;
+        case Album:
+            busy=true;
+            engine->search(QStringList() << active.song.albumArtist() << active.song.album, ContextEngine::Album);
+            return;
+        case Track:
+            busy=true;
+            engine->search(QStringList() << active.song.artist << active.song.title, ContextEngine::Track);
+            return;
+        case Lyrics:
+            if (!lyrics) {
+                lyrics=new UltimateLyrics();
+                lyrics->setParent(this);
+                lyrics->setPriority(QNetworkRequest::LowPriority);
+                connect(lyrics, SIGNAL(lyricsReady(int,int,QString)), SLOT(lyricsReady(int,int,QString)));
+                connect(lyrics, SIGNAL(lyricsFailed(int)), SLOT(lyricsFailed(int)));
+            }
+            if (!lyrics->fetch(++lyricsId, active.song).isEmpty()) {
+                busy=true;
+                return;
+            }
+            break;
+        case Cover:
+            pendingCovers.insert(coverKey(active.song));
+            Covers::self()->requestImage(active.song);
+            break;
+        case ArtistImage: {
+            Song s;
+            s.setArtistImageRequest();
+            s.albumartist=active.song.basicArtist();
+            if (!active.song.isVariousArtists()) {
+                s.file=active.song.file;
+            }
+            pendingCovers.insert(coverKey(s));
+            Covers::self()->requestImage(s);
+            break;
+        }
+        }
+    }
+
+    // Nothing left to fetch, so release the lyrics providers until they are next needed.
+    if (lyrics) {
+        lyrics->release();
+        lyrics->deleteLater();
+        lyrics=0;
+    }
+}
+
+void ContextPrefetcher::searchResponse(const QString &html, const QString &lang)
+{
+    if (!busy || (Artist!=active.type && Album!=active.type && Track!=active.type)) {
+        return;
+    }
+
+    busy=false;
+    if (!html.isEmpty() && !lang.isEmpty()) {
+        switch (active.type) {
+        case Artist:
+            saveInfo(ArtistView::cacheFileName(active.song.basicArtist(), lang, false, true), html);
+            break;
+        case Album:
+            saveInfo(AlbumView::cacheFileName(Covers::fixArtist(active.song.albumArtist()), active.song.album, lang, true), html);
+            break;
+        default:
+            saveInfo(SongView::infoCacheFileName(active.song, lang, true), html);
+            break;
+        }
+    }
+    // Engine is still within its own network slot, so start the next lookup from the event loop.
+    QTimer::singleShot(0, this, SLOT(next()));
+}
+
+void ContextPrefetcher::lyricsReady(int id, int provider, const QString &text)
+{
+    Q_UNUSED(provider)
+    if (!busy || Lyrics!=active.type || id!=lyricsId) {
+        return;
+    }
+
+    busy=false;
+    bytes+=text.toUtf8().length();
+    // Empty lyrics are only reported if all providers responded without any, and so are stored as not found.
+    SongView::storeLyrics(active.song, text.trimmed());
+    QTimer::singleShot(0, this, SLOT(next()));
+}
+
+void ContextPrefetcher::lyricsFailed(int id)
+{
+    if (!busy || Lyrics!=active.type || id!=lyricsId) {
+        return;
+    }
+
+    DBUG << "Failed" << active.song.artist << active.song.title;
+    busy=false;
+    // Nothing is stored, so forget the current targets - the lyrics are then re-queued when next scheduled.
+    targets.clear();
+    QTimer::singleShot(constRetryDelay, this, SLOT(schedule()));
+    QTimer::singleShot(0, this, SLOT(next()));
+}
+
+void ContextPrefetcher::coverReceived(const Song &song, const QImage &img, const QString &file)
+{
+    if (!img.isNull() && !file.isEmpty() && pendingCovers.remove(coverKey(song))) {
+        bytes+=QFileInfo(file).size();
+    }
+}
+
+void ContextPrefetcher::saveInfo(const QString &fileName, const QString &html)
+{
+    QByteArray data=html.toUtf8();
+    bytes+=data.length();
+    QFile f(fileName);
+    QtIOCompressor compressor(&f);
+    compressor.setStreamFormat(QtIOCompressor::GzipFormat);
+    if (compressor.open(QIODevice::WriteOnly)) {
+        compressor.write(data);
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CONTEXT_PREFETCHER_H
+#define CONTEXT_PREFETCHER_H
+
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QElapsedTimer>
+#include "mpd-interface/song.h"
+
+class QWidget;
+class QTimer;
+class QImage;
+class ContextEngine;
+class UltimateLyrics;
+
+// Fetches the artist, album, and track information, lyrics, and covers of the next few songs in the play
+// queue into the same cache files used by the context views - so that these can be shown as soon as a
+// track changes. Requests are made at low network priority, and are limited to a number of lookups and
+// bytes per hour.
+class ContextPrefetcher : public QObject
+{
+    Q_OBJECT
+
+    enum Type {
+        Artist,
+        Album,
+        Track,
+        Lyrics,
+        Cover,
+        ArtistImage
+    };
+
+    struct Item {
+        Item(Type t=Artist, const Song &s=Song()) : type(t), song(s) { }
+        Type type;
+        Song song;
+    };
+
+public:
+    static void enableDebug();
+
+    // Song info is only prefetched whilst 'view' is visible.
+    ContextPrefetcher(QWidget *view);
+    virtual ~ContextPrefetcher();
+
+    // Song being displayed by the views - these fetch its info themselves.
+    void setCurrent(const Song &s);
+
+public Q_SLOTS:
+    void schedule();
+
+private Q_SLOTS:
+    void statusUpdated();
+    void start();
+    void next();
+    void searchResponse(const QString &html, const QString &lang);
+    void lyricsReady(int id, int provider, const QString &text);
+    void lyricsFailed(int id);
+    void coverReceived(const Song &song, const QImage &img, const QString &file);
+
+private:
+    bool isEnabled() const { return maxSongs>0 && maxRequests>0 && maxBytes>0; }
+    void stop();
+    void addItems(const Song &song, QSet<QString> &keys);
+    bool isCached(const Item &item) const;
+    bool haveBudget();
+    void saveInfo(const QString &fileName, const QString &html);
+
+private:
+    QWidget *view;
+    QTimer *timer;
+    ContextEngine *engine;
+    UltimateLyrics *lyrics;
+    Song current;
+    qint32 nextSongId;
+    QStringList targets;
+    QList<Item> items;
+    Item active;
+    bool busy;
+    int lyricsId;
+    QSet<QString> pendingCovers;
+    int maxSongs;
+    int maxRequests;
+    qint64 maxBytes;
+    int requests;
+    qint64 bytes;
+    QElapsedTimer period;
+};
+
+#endif
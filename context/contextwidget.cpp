@@ -26,6 +26,7 @@
 #include "albumview.h"
 #include "songview.h"
 #include "onlineview.h"
+#include "contextprefetcher.h"
 #include "mpd-interface/song.h"
 #include "support/utils.h"
 #include "gui/covers.h"
@@ -270,6 +271,7 @@ ContextWidget::ContextWidget(QWidget *parent)
     artist = new ArtistView(standardContext);
     album = new AlbumView(standardContext);
     song = new SongView(standardContext);
+    prefetcher = new ContextPrefetcher(this);
     minWidth=album->picSize().width()*2.5;
 
     artist->addEventFilter(this);
@@ -498,6 +500,7 @@ void ContextWidget::showEvent(QShowEvent *e)
     if (backdropType) {
         updateBackdrop();
     }
+    prefetcher->schedule();
     if (!shown) {
         // Some styles (e.g Adwaita-Qt) draw base colour for scrollbar background.
         // We need to fix this to use the window background. Therefore, the first
@@ -616,6 +619,7 @@ void ContextWidget::update(const Song &s)
     if (s.albumArtist()!=currentSong.albumArtist()) {
         cancel();
     }
+    prefetcher->setCurrent(sng);
 
     if (Song::OnlineSvrTrack==sng.type) {
         if (!onlineContext) {
@@ -42,6 +42,7 @@ class QToolButton;
 class QButtonGroup;
 class QWheelEvent;
 class OnlineView;
+class ContextPrefetcher;
 
 class ViewSelector : public QWidget
 {
@@ -154,6 +155,7 @@ private:
     ArtistView *artist;
     AlbumView *album;
     SongView *song;
+    ContextPrefetcher *prefetcher;
     QColor appLinkColor;
     double fadeValue;
     QPropertyAnimation animator;
@@ -87,7 +87,7 @@ void LastFmEngine::search(const QStringList &query, Mode mode)
 
     url.setQuery(urlQuery);
 
-    job=NetworkAccessManager::self()->get(url);
+    job=NetworkAccessManager::self()->get(request(url));
     job->setProperty(constModeProperty, (int)mode);
     
     QStringList queryString;
@@ -61,6 +61,13 @@ QString MetaEngine::translateLinks(QString text) const
     return lastfm->translateLinks(wiki->translateLinks(text));
 }
 
+void MetaEngine::setPriority(QNetworkRequest::Priority p)
+{
+    ContextEngine::setPriority(p);
+    wiki->setPriority(p);
+    lastfm->setPriority(p);
+}
+
 void MetaEngine::search(const QStringList &query, Mode mode)
 {
     DBUG <<  query << (int)mode;
@@ -54,6 +54,7 @@ public:
     QStringList getLangs() const;
     QString getPrefix(const QString &key) const;
     QString translateLinks(QString text) const;
+    void setPriority(QNetworkRequest::Priority p);
 
 public Q_SLOTS:
     void search(const QStringList &query, Mode mode);
@@ -47,8 +47,10 @@
 #include <QFile>
 #include <QDir>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QMenu>
 #include <QTextStream>
+#include <QTextDocument>
 #include <QTimer>
 #include <QScrollBar>
 #include <QDesktopServices>
@@ -56,10 +58,11 @@
 
 const QLatin1String SongView::constLyricsDir("lyrics/");
 const QLatin1String SongView::constExtension(".lyrics");
+const QLatin1String SongView::constNotFoundExtension(".lyrics-notfound");
 const QLatin1String SongView::constCacheDir("tracks/");
 const QLatin1String SongView::constInfoExt(".html.gz");
 
-static QString infoCacheFileName(const Song &song, const QString &lang, bool createDir)
+QString SongView::infoCacheFileName(const Song &song, const QString &lang, bool createDir)
 {
     QString artist=song.artist;
     QString title=song.title;
@@ -87,6 +90,51 @@ static QString lyricsCacheFileName(const Song &song, bool createDir=false)
     return dir+Covers::encodeName(title)+SongView::constExtension;
 }
 
+// If no provider has lyrics for a song, this is noted (along with the providers used) so that they are
+// not queried again every time the song is played. These notes expire, as lyrics may be added later.
+static const int constNotFoundExpiry=7*24*60*60;
+
+static QString lyricsNotFoundFileName(const Song &song, bool createDir=false)
+{
+    QString file=lyricsCacheFileName(song, createDir);
+    return file.isEmpty() ? file : Utils::changeExtension(file, SongView::constNotFoundExtension);
+}
+
+static QString lyricsProvidersKey()
+{
+    return Settings::self()->lyricProviders().join(QLatin1String(","));
+}
+
+static bool lyricsNotFound(const Song &song)
+{
+    QFile f(lyricsNotFoundFileName(song));
+    if (!f.exists()) {
+        return false;
+    }
+    if (QFileInfo(f).lastModified().secsTo(QDateTime::currentDateTime())<constNotFoundExpiry &&
+        f.open(QIODevice::ReadOnly) && QString::fromUtf8(f.readAll())==lyricsProvidersKey()) {
+        return true;
+    }
+    f.remove();
+    return false;
+}
+
+static void setLyricsNotFound(const Song &song)
+{
+    QFile f(lyricsNotFoundFileName(song, true));
+    if (f.open(QIODevice::WriteOnly)) {
+        f.write(lyricsProvidersKey().toUtf8());
+    }
+}
+
+static void removeLyricsNotFound(const Song &song)
+{
+    QString file=lyricsNotFoundFileName(song);
+    if (!file.isEmpty() && QFile::exists(file)) {
+        QFile::remove(file);
+    }
+}
+
 #if !defined Q_OS_WIN && !defined Q_OS_MAC
 static QString lyricsOtherFileName(const Song &song, bool createDir=false)
 {
@@ -125,6 +173,51 @@ static QString actualFile(const Song &song)
     return songFile;
 }
 
+bool SongView::lyricsKnown(const Song &song)
+{
+    if (!MPDConnection::self()->getDetails().dir.isEmpty() && !song.file.isEmpty() && !song.isNonMPD() &&
+        !MPDConnection::self()->getDetails().dir.startsWith(QLatin1String("http:/"))) {
+        QString mpdLyrics=mpdLyricsFilePath(actualFile(song));
+        if (QFile::exists(mpdLyrics) || QFile::exists(Utils::changeExtension(mpdLyrics, ".txt"))) {
+            return true;
+        }
+    }
+
+    QString file=lyricsCacheFileName(song);
+    if (file.isEmpty() || QFile::exists(file) || QFile::exists(Utils::changeExtension(file, ".txt"))) {
+        return true;
+    }
+    #if !defined Q_OS_WIN && !defined Q_OS_MAC
+    if (QFile::exists(lyricsOtherFileName(song))) {
+        return true;
+    }
+    #endif
+    return lyricsNotFound(song);
+}
+
+void SongView::storeLyrics(const Song &song, const QString &lyrics)
+{
+    if (lyrics.isEmpty()) {
+        setLyricsNotFound(song);
+        return;
+    }
+
+    // Strip any formatting, in the same manner as when lyrics are displayed and then saved.
+    QTextDocument doc;
+    doc.setHtml(fixNewLines(lyrics));
+    QString plain=doc.toPlainText().trimmed();
+    if (plain.isEmpty()) {
+        return;
+    }
+
+    QFile f(lyricsCacheFileName(song, true));
+    if (f.open(QIODevice::WriteOnly)) {
+        QTextStream(&f) << plain;
+        f.close();
+        removeLyricsNotFound(song);
+    }
+}
+
 SongView::SongView(QWidget *p)
     : View(p, QStringList() << tr("Lyrics") << tr("Information") << tr("Metadata"))
     , scrollTimer(0)
@@ -133,7 +226,7 @@ SongView::SongView(QWidget *p)
     , currentRequest(0)
     , mode(Mode_Display)
     , job(0)
-    , currentProv(0)
+    , fetchingLyrics(false)
     , lyricsNeedsUpdating(true)
     , infoNeedsUpdating(true)
     , metadataNeedsUpdating(true)
@@ -150,7 +243,8 @@ SongView::SongView(QWidget *p)
     connect(refreshAction, SIGNAL(triggered()), SLOT(update()));
     connect(editAction, SIGNAL(triggered()), SLOT(edit()));
     connect(delAction, SIGNAL(triggered()), SLOT(del()));
-    connect(UltimateLyrics::self(), SIGNAL(lyricsReady(int, QString)), SLOT(lyricsReady(int, QString)));
+    connect(UltimateLyrics::self(), SIGNAL(lyricsReady(int, int, QString)), SLOT(lyricsReady(int, int, QString)));
+    connect(UltimateLyrics::self(), SIGNAL(lyricsFailed(int)), SLOT(lyricsFailed(int)));
 
     engine=ContextEngine::create(this);
     refreshInfoAction = ActionCollection::get()->createAction("refreshtrack", tr("Refresh Track Information"), Icons::self()->refreshIcon);
@@ -205,6 +299,7 @@ void SongView::update()
         }
     }
 
+    removeLyricsNotFound(currentSong);
     update(currentSong, true);
 }
 
@@ -233,6 +328,7 @@ void SongView::search()
         if (!cacheName.isEmpty() && QFile::exists(cacheName)) {
             QFile::remove(cacheName);
         }
+        removeLyricsNotFound(dlg.song());
         update(dlg.song(), true);
     }
 }
@@ -449,6 +545,11 @@ void SongView::loadLyrics()
     }
     #endif
 
+    if (lyricsNotFound(currentSong)) {
+        noLyrics();
+        return;
+    }
+
     getLyrics();
 }
 
@@ -727,9 +828,9 @@ void SongView::abort()
         job=0;
     }
     currentProvider=-1;
-    if (currentProv) {
-        currentProv->abort();
-        currentProv=0;
+    if (fetchingLyrics) {
+        UltimateLyrics::self()->abort();
+        fetchingLyrics=false;
 
         text->setText(QString());
         // Set lyrics file anyway - so that editing is enabled!
@@ -815,16 +916,20 @@ void SongView::downloadFinished()
     getLyrics();
 }
 
-void SongView::lyricsReady(int id, QString lyrics)
+void SongView::lyricsReady(int id, int provider, QString lyrics)
 {
     if (id != currentRequest) {
         return;
     }
+    fetchingLyrics=false;
     lyrics=lyrics.trimmed();
 
     if (lyrics.isEmpty()) {
-        getLyrics();
+        // No provider had lyrics, so don't ask again for a while
+        setLyricsNotFound(currentSong);
+        noLyrics();
     } else {
+        currentProvider=provider;
         cancelJobAction->setEnabled(false);
         hideSpinner();
         QString before=text->toHtml();
@@ -847,6 +952,16 @@ void SongView::lyricsReady(int id, QString lyrics)
     }
 }
 
+void SongView::lyricsFailed(int id)
+{
+    if (id != currentRequest) {
+        return;
+    }
+    // Some providers could not be queried, so the lyrics may still exist - i.e. do not mark these as not found
+    fetchingLyrics=false;
+    noLyrics();
+}
+
 bool SongView::saveFile(const QString &fileName)
 {
     QFile f(fileName);
@@ -855,6 +970,7 @@ bool SongView::saveFile(const QString &fileName)
         QTextStream(&f) << text->toPlainText();
         f.close();
         lyricsFile=fileName;
+        removeLyricsNotFound(currentSong);
         return true;
     }
 
@@ -874,22 +990,27 @@ QString SongView::cacheFileName() const
 
 void SongView::getLyrics()
 {
-    currentProv=UltimateLyrics::self()->getNext(currentProvider);
-    if (currentProv) {
-        text->setText(tr("Fetching lyrics via %1").arg(currentProv->displayName()));
-        currentProv->fetchInfo(currentRequest, currentSong);
-        showSpinner();
+    QStringList providers=UltimateLyrics::self()->fetch(currentRequest, currentSong, currentProvider);
+    if (providers.isEmpty()) {
+        noLyrics();
     } else {
-        text->setText(QString());
-        currentProvider=-1;
-        // Set lyrics file anyway - so that editing is enabled!
-        lyricsFile=Settings::self()->storeLyricsInMpdDir() && !currentSong.isNonMPD()
-                ? mpdLyricsFilePath(currentSong)
-                : lyricsCacheFileName(currentSong);
-        setMode(Mode_Display);
+        fetchingLyrics=true;
+        text->setText(tr("Fetching lyrics via %1").arg(providers.join(QLatin1String(", "))));
+        showSpinner();
     }
 }
 
+void SongView::noLyrics()
+{
+    text->setText(QString());
+    currentProvider=-1;
+    // Set lyrics file anyway - so that editing is enabled!
+    lyricsFile=Settings::self()->storeLyricsInMpdDir() && !currentSong.isNonMPD()
+            ? mpdLyricsFilePath(currentSong)
+            : lyricsCacheFileName(currentSong);
+    setMode(Mode_Display);
+}
+
 void SongView::setMode(Mode m)
 {
     if (Mode_Display==m) {
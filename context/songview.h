@@ -53,9 +53,15 @@ class SongView : public View
 public:
     static const QLatin1String constLyricsDir;
     static const QLatin1String constExtension;
+    static const QLatin1String constNotFoundExtension;
     static const QLatin1String constCacheDir;
     static const QLatin1String constInfoExt;
 
+    static QString infoCacheFileName(const Song &song, const QString &lang, bool createDir);
+    // Whether lyrics for 'song' are stored locally, or are known not to be available from any provider.
+    static bool lyricsKnown(const Song &song);
+    static void storeLyrics(const Song &song, const QString &lyrics);
+
     SongView(QWidget *p);
     ~SongView();
 
@@ -67,7 +73,8 @@ Q_SIGNALS:
 
 public Q_SLOTS:
     void downloadFinished();
-    void lyricsReady(int, QString lyrics);
+    void lyricsReady(int id, int provider, QString lyrics);
+    void lyricsFailed(int id);
     void update();
     void search();
     void edit();
@@ -95,6 +102,7 @@ private:
     QString mpdFileName() const;
     QString cacheFileName() const;
     void getLyrics();
+    void noLyrics();
     void setMode(Mode m);
     bool saveFile(const QString &fileName);
 
@@ -124,7 +132,7 @@ private:
     QString lyricsFile;
     QString preEdit;
     NetworkJob *job;
-    UltimateLyricsProvider *currentProv;
+    bool fetchingLyrics;
 
     bool lyricsNeedsUpdating;
     bool infoNeedsUpdating;
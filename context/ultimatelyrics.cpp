@@ -25,6 +25,7 @@
 #include "ultimatelyricsprovider.h"
 #include "gui/settings.h"
 #include "support/globalstatic.h"
+#include "support/configuration.h"
 #include <QDir>
 #include <QFile>
 #include <QFileInfoList>
@@ -33,6 +34,9 @@
 
 GLOBAL_STATIC(UltimateLyrics, instance)
 
+// Number of providers to query at once, this can be changed via a hidden config item.
+static const int constConcurrentProviders=3;
+
 static bool compareLyricProviders(const UltimateLyricsProvider *a, const UltimateLyricsProvider *b)
 {
     return a->getRelevance() < b->getRelevance();
@@ -105,8 +109,22 @@ static UltimateLyricsProvider * parseProvider(QXmlStreamReader *reader)
     return scraper;
 }
 
+UltimateLyrics::UltimateLyrics()
+    : priority(QNetworkRequest::NormalPriority)
+    , maxConcurrent(constConcurrentProviders)
+    , active(false)
+    , starting(false)
+    , exhausted(true)
+    , fetchId(0)
+    , lastIndex(-1)
+{
+    Configuration cfg(metaObject()->className());
+    maxConcurrent=qMax(1, cfg.get("concurrentProviders", constConcurrentProviders));
+}
+
 void UltimateLyrics::release()
 {
+    abort();
     for (UltimateLyricsProvider *provider: providers) {
         delete provider;
     }
@@ -144,6 +162,144 @@ UltimateLyricsProvider * UltimateLyrics::getNext(int &index)
     return 0;
 }
 
+QStringList UltimateLyrics::fetch(int id, const Song &song, int index)
+{
+    abort();
+    load();
+    active=true;
+    exhausted=false;
+    fetchId=id;
+    fetchSong=song;
+    lastIndex=index;
+    startQueries();
+
+    QStringList names;
+    for (const Query &q: queries) {
+        names.append(providers.at(q.index)->displayName());
+    }
+    if (names.isEmpty()) {
+        active=false;
+    } else {
+        // Providers may have already responded (e.g. if they cannot handle this song), but the caller
+        // should not be informed until this call has returned.
+        QMetaObject::invokeMethod(this, "checkResults", Qt::QueuedConnection);
+    }
+    return names;
+}
+
+void UltimateLyrics::abort()
+{
+    for (const Query &q: queries) {
+        if (!q.done) {
+            providers.at(q.index)->abort();
+        }
+    }
+    queries.clear();
+    active=false;
+}
+
+void UltimateLyrics::providerReady(int id, const QString &data)
+{
+    providerDone(id, data, false);
+}
+
+void UltimateLyrics::providerFailed(int id)
+{
+    providerDone(id, QString(), true);
+}
+
+void UltimateLyrics::providerDone(int id, const QString &data, bool failed)
+{
+    UltimateLyricsProvider *provider=qobject_cast<UltimateLyricsProvider *>(sender());
+    if (!active || id!=fetchId || !provider) {
+        return;
+    }
+    int index=providers.indexOf(provider);
+    for (Query &q: queries) {
+        if (q.index==index && !q.done) {
+            q.done=true;
+            q.failed=failed;
+            q.lyrics=data.trimmed();
+            break;
+        }
+    }
+    if (!starting) {
+        checkResults();
+    }
+}
+
+void UltimateLyrics::checkResults()
+{
+    while (active) {
+        startQueries();
+        // Queries are in order of relevance, so only use a result once all more relevant providers have failed
+        for (const Query &q: queries) {
+            if (!q.done) {
+                return;
+            }
+            if (!q.lyrics.isEmpty()) {
+                finish(q.index, q.lyrics);
+                return;
+            }
+        }
+        if (exhausted) {
+            finish(-1, QString());
+        }
+    }
+}
+
+void UltimateLyrics::startQueries()
+{
+    int running=0;
+    for (const Query &q: queries) {
+        if (!q.done) {
+            running++;
+        }
+    }
+
+    // Providers may respond immediately, so don't check results until all have been started
+    starting=true;
+    while (running<maxConcurrent && !exhausted) {
+        UltimateLyricsProvider *provider=getNext(lastIndex);
+        if (provider) {
+            queries.append(Query(lastIndex));
+            running++;
+            provider->fetchInfo(fetchId, fetchSong);
+        } else {
+            exhausted=true;
+        }
+    }
+    starting=false;
+}
+
+void UltimateLyrics::finish(int provider, const QString &lyrics)
+{
+    int id=fetchId;
+    bool failed=false;
+    if (provider<0) {
+        for (const Query &q: queries) {
+            if (q.failed) {
+                failed=true;
+                break;
+            }
+        }
+    }
+    abort();
+    if (failed) {
+        emit lyricsFailed(id);
+    } else {
+        emit lyricsReady(id, provider, lyrics);
+    }
+}
+
+void UltimateLyrics::setPriority(QNetworkRequest::Priority p)
+{
+    priority=p;
+    for (UltimateLyricsProvider *provider: providers) {
+        provider->setPriority(p);
+    }
+}
+
 void UltimateLyrics::load()
 {
     if (!providers.isEmpty()) {
@@ -171,8 +327,10 @@ void UltimateLyrics::load()
                         if (!providerNames.contains(name)) {
                             UltimateLyricsProvider *provider = parseProvider(&reader);
                             if (provider) {
+                                provider->setPriority(priority);
                                 providers << provider;
-                                connect(provider, SIGNAL(lyricsReady(int,QString)), this, SIGNAL(lyricsReady(int,QString)));
+                                connect(provider, SIGNAL(lyricsReady(int,QString)), this, SLOT(providerReady(int,QString)));
+                                connect(provider, SIGNAL(lyricsFailed(int)), this, SLOT(providerFailed(int)));
                                 providerNames.insert(name);
                             }
                         }
@@ -25,6 +25,10 @@
 #define ULTIMATELYRICS_H
 
 #include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QNetworkRequest>
+#include "mpd-interface/song.h"
 
 class UltimateLyricsProvider;
 
@@ -34,22 +38,57 @@ class UltimateLyrics : public QObject
 
 public:
     static UltimateLyrics * self();
-    UltimateLyrics() { }
+    UltimateLyrics();
 
     UltimateLyricsProvider * getNext(int &index);
     const QList<UltimateLyricsProvider *> getProviders();
     void release();
     void setEnabled(const QStringList &enabled);
+    void setPriority(QNetworkRequest::Priority p);
+
+    // Fetch lyrics from the enabled providers after 'index'. Several providers are queried at once, and
+    // lyricsReady() is emitted with the lyrics of the most relevant that found some - or with an empty
+    // string, and a provider of -1, if all responded without any. If none had lyrics, but some could not be
+    // queried, then lyricsFailed() is emitted instead. Returns the names of the providers being queried.
+    QStringList fetch(int id, const Song &song, int index=-1);
+    void abort();
 
 Q_SIGNALS:
-    void lyricsReady(int id, const QString &data);
+    void lyricsReady(int id, int provider, const QString &data);
+    void lyricsFailed(int id);
+
+private Q_SLOTS:
+    void providerReady(int id, const QString &data);
+    void providerFailed(int id);
+    void checkResults();
 
 private:
     UltimateLyricsProvider * providerByName(const QString &name) const;
     void load();
+    void startQueries();
+    void finish(int provider, const QString &lyrics);
+    void providerDone(int id, const QString &data, bool failed);
 
 private:
+    struct Query
+    {
+        Query(int i=-1) : index(i), done(false), failed(false) { }
+        int index;
+        bool done;
+        bool failed;
+        QString lyrics;
+    };
+
     QList<UltimateLyricsProvider *> providers;
+    QNetworkRequest::Priority priority;
+    int maxConcurrent;
+    bool active;
+    bool starting;
+    bool exhausted;
+    int fetchId;
+    int lastIndex;
+    Song fetchSong;
+    QList<Query> queries;
 };
 
 #endif // ULTIMATELYRICS_H
@@ -190,6 +190,7 @@ static QString urlEncode(QString str)
 
 UltimateLyricsProvider::UltimateLyricsProvider()
     : enabled(true)
+    , priority(QNetworkRequest::NormalPriority)
     , relevance(0)
 {
 }
@@ -228,7 +229,9 @@ void UltimateLyricsProvider::fetchInfo(int id, const Song &metadata)
         query.addQueryItem(QLatin1String("fmt"), QLatin1String("xml"));
         url.setQuery(query);
 
-        NetworkJob *reply = NetworkAccessManager::self()->get(url);
+        QNetworkRequest req(url);
+        req.setPriority(priority);
+        NetworkJob *reply = NetworkAccessManager::self()->get(req);
         requests[reply] = id;
         connect(reply, SIGNAL(finished()), this, SLOT(wikiMediaSearchResponse()));
         return;
@@ -267,6 +270,7 @@ void UltimateLyricsProvider::fetchInfo(int id, const Song &metadata)
 
     QNetworkRequest req(url);
     req.setRawHeader("User-Agent", "Mozilla/5.0 (X11; Linux i686; rv:6.0) Gecko/20100101 Firefox/6.0");
+    req.setPriority(priority);
     NetworkJob *reply = NetworkAccessManager::self()->get(req);
     requests[reply] = id;
     connect(reply, SIGNAL(finished()), this, SLOT(lyricsFetched()));
@@ -295,7 +299,7 @@ void UltimateLyricsProvider::wikiMediaSearchResponse()
     reply->deleteLater();
 
     if (!reply->ok()) {
-        emit lyricsReady(id, QString());
+        replyFailed(id, reply);
         return;
     }
 
@@ -316,7 +320,9 @@ void UltimateLyricsProvider::wikiMediaSearchResponse()
         QString path=url.path();
         QByteArray u=url.scheme().toLatin1()+"://"+url.host().toLatin1()+"/api.php?action=query&prop=revisions&rvprop=content&format=xml&titles=";
         QByteArray titles=QUrl::toPercentEncoding(path.startsWith(QLatin1Char('/')) ? path.mid(1) : path).replace('+', "%2b");
-        NetworkJob *reply = NetworkAccessManager::self()->get(QUrl::fromEncoded(u+titles));
+        QNetworkRequest req(QUrl::fromEncoded(u+titles));
+        req.setPriority(priority);
+        NetworkJob *reply = NetworkAccessManager::self()->get(req);
         requests[reply] = id;
         connect(reply, SIGNAL(finished()), this, SLOT(wikiMediaLyricsFetched()));
     } else {
@@ -335,7 +341,7 @@ void UltimateLyricsProvider::wikiMediaLyricsFetched()
     reply->deleteLater();
 
     if (!reply->ok()) {
-        emit lyricsReady(id, QString());
+        replyFailed(id, reply);
         return;
     }
 
@@ -357,8 +363,7 @@ void UltimateLyricsProvider::lyricsFetched()
     Song song=songs.take(id);
 
     if (!reply->ok()) {
-        //emit Finished(id);
-        emit lyricsReady(id, QString());
+        replyFailed(id, reply);
         return;
     }
 
@@ -405,6 +410,18 @@ void UltimateLyricsProvider::lyricsFetched()
     emit lyricsReady(id, lyrics);
 }
 
+// A 'not found' response means the provider does not have these lyrics. Anything else (no network, timeouts,
+// server errors, etc.) means that we do not know - and so this should not be remembered as a miss.
+void UltimateLyricsProvider::replyFailed(int id, const NetworkJob *reply)
+{
+    if (QNetworkReply::ContentNotFoundError==reply->error() || QNetworkReply::ContentGoneError==reply->error()) {
+        emit lyricsReady(id, QString());
+    } else {
+        DBUG << name << "failed" << reply->errorString();
+        emit lyricsFailed(id);
+    }
+}
+
 void UltimateLyricsProvider::doUrlReplace(const QString &tag, const QString &value, QString &u) const
 {
     if (!u.contains(tag)) {
@@ -26,6 +26,7 @@
 
 #include "mpd-interface/song.h"
 #include <QObject>
+#include <QNetworkRequest>
 #include <QPair>
 #include <QStringList>
 #include <QHash>
@@ -60,10 +61,13 @@ public:
     void fetchInfo(int id, const Song &metadata);
     bool isEnabled() const { return enabled; }
     void setEnabled(bool e) { enabled = e; }
+    void setPriority(QNetworkRequest::Priority p) { priority = p; }
     void abort();
 
 Q_SIGNALS:
     void lyricsReady(int id, const QString &data);
+    // Emitted instead of lyricsReady() if the provider could not be queried (e.g. network errors)
+    void lyricsFailed(int id);
 
 private Q_SLOTS:
     void wikiMediaSearchResponse();
@@ -71,11 +75,13 @@ private Q_SLOTS:
     void lyricsFetched();
 
 private:
+    void replyFailed(int id, const NetworkJob *reply);
     QString doTagReplace(QString str, const Song &song, bool doAll=true);
     void doUrlReplace(const QString &tag, const QString &value, QString &u) const;
 
 private:
     bool enabled;
+    QNetworkRequest::Priority priority;
     QHash<NetworkJob *, int> requests;
     QMap<int, Song> songs;
     QString name;
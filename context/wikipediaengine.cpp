@@ -357,7 +357,7 @@ void WikipediaEngine::requestTitles(const QStringList &query, Mode mode, const Q
     q.addQueryItem(QLatin1String("format"), QLatin1String("xml"));
     url.setQuery(q);
 
-    job=NetworkAccessManager::self()->get(url);
+    job=NetworkAccessManager::self()->get(request(url));
     job->setProperty(constModeProperty, (int)mode);
     job->setProperty(constQueryProperty, query);
     DBUG <<  url.toString();
@@ -546,7 +546,7 @@ void WikipediaEngine::getPage(const QStringList &query, Mode mode, const QString
     url.setScheme(QLatin1String("https"));
     url.setHost(lang+".wikipedia.org");
     url.setPath("/wiki"+wikipediaSpecialExport(lang)+title);
-    job=NetworkAccessManager::self()->get(url);
+    job=NetworkAccessManager::self()->get(request(url));
     job->setProperty(constModeProperty, (int)mode);
     job->setProperty(constQueryProperty, query);
     DBUG <<  url.toString();
@@ -22,15 +22,22 @@
  */
 
 #include "librarydb.h"
+#include "mpd-interface/cuefile.h"
 #include <QCoreApplication>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QFile>
 #include <QRegExp>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QMutexLocker>
+#include <QTemporaryDir>
+#include <QTextStream>
 #include <QDebug>
 
-static const int constSchemaVersion=5;
+static const int constSchemaVersion=9;
 
 bool LibraryDb::dbgEnabled=false;
 #define DBUG if (dbgEnabled) qWarning() << metaObject()->className() << __FUNCTION__ << (void *)this
@@ -38,6 +45,49 @@ bool LibraryDb::dbgEnabled=false;
 const QLatin1String LibraryDb::constFileExt(".sql");
 const QLatin1String LibraryDb::constNullGenre("-");
 
+static const int constMaxReadThreads=2;
+
+// QSqlDatabase connections can only be used in the thread that created them. Therefore, each thread that
+// reads from a DB has its own read-only connection. These are closed when the thread exits.
+class ReadConnections
+{
+public:
+    ~ReadConnections()
+    {
+        for (const QString &name: names) {
+            remove(name);
+        }
+    }
+
+    void remove(const QString &name)
+    {
+        // Prepared queries must be released before their connection is closed
+        queries.remove(name);
+        {
+            QSqlDatabase db=QSqlDatabase::database(name, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(name);
+    }
+
+    QMap<QString, QString> names; // LibraryDb name -> connection name
+    QMap<QString, QHash<QString, QSqlQuery> > queries; // Connection name -> SQL -> prepared query
+};
+
+static QThreadStorage<ReadConnections *> readConnections;
+
+QThreadPool * LibraryDb::queryPool()
+{
+    static QThreadPool *pool=0;
+    if (!pool) {
+        pool=new QThreadPool(QCoreApplication::instance());
+        pool->setMaxThreadCount(constMaxReadThreads);
+        // Keep threads alive, so that their connections are re-used
+        pool->setExpiryTimeout(-1);
+    }
+    return pool;
+}
+
 LibraryDb::AlbumSort LibraryDb::toAlbumSort(const QString &str)
 {
     for (int i=0; i<AS_Count; ++i) {
@@ -173,6 +223,12 @@ static bool albumsSortYrArAl(const LibraryDb::Album &a, const LibraryDb::Album &
     return an.localeAwareCompare(bn)<0;
 }
 
+// Best search matches first. bm25() returns lower values for better matches.
+static bool albumsSortRank(const LibraryDb::Album &a, const LibraryDb::Album &b)
+{
+    return a.rank<b.rank;
+}
+
 static bool albumsSortModified(const LibraryDb::Album &a, const LibraryDb::Album &b)
 {
     if (a.lastModified==b.lastModified) {
@@ -385,18 +441,87 @@ static QString albumSort(const Song &s)
     return Song::sortString(s.album);
 }
 
+// Return the MPD folder containing this song - without trailing slash. Tracks from CUE files
+// are placed in the folder of the CUE file. Songs in the top-level folder return "", and not a
+// null string, as this would be stored (and bound in queries) as NULL - which never matches.
+static QString songDir(const QString &file)
+{
+    static const QLatin1String constCuePrefix("cue:///");
+    QString path=file;
+    if (CueFile::isCue(path)) {
+        path=path.mid(constCuePrefix.size());
+        int pos=path.lastIndexOf(QLatin1String("?pos="));
+        if (-1!=pos) {
+            path=path.left(pos);
+        }
+    }
+    int slash=path.lastIndexOf(Utils::constDirSep);
+    return -1==slash ? QString(QLatin1String("")) : path.left(slash);
+}
+
+static const int constMaxPreparedQueries=64;
+
+// Get a prepared query for the SQL from the calling thread's cache. The query is removed from the cache whilst
+// in use, so that nested uses of the same SQL do not interfere with each other.
+static QSqlQuery takePrepared(const QSqlDatabase &db, const QString &sql)
+{
+    if (readConnections.hasLocalData()) {
+        QMap<QString, QHash<QString, QSqlQuery> > &queries=readConnections.localData()->queries;
+        QMap<QString, QHash<QString, QSqlQuery> >::Iterator conn=queries.find(db.connectionName());
+        if (conn!=queries.end()) {
+            QHash<QString, QSqlQuery>::Iterator it=conn.value().find(sql);
+            if (it!=conn.value().end()) {
+                QSqlQuery query=it.value();
+                conn.value().erase(it);
+                return query;
+            }
+        }
+    }
+    QSqlQuery query(db);
+    query.prepare(sql);
+    return query;
+}
+
+static void releasePrepared(const QSqlDatabase &db, const QString &sql, QSqlQuery &query)
+{
+    if (sql.isEmpty() || query.lastError().isValid() || !readConnections.hasLocalData()) {
+        return;
+    }
+    ReadConnections *conns=readConnections.localData();
+    QString name=db.connectionName();
+    // Only cache queries for read connections, as these are the ones owned by this thread
+    if (!conns->names.values().contains(name)) {
+        return;
+    }
+    query.finish();
+    QHash<QString, QSqlQuery> &cache=conns->queries[name];
+    if (cache.size()>=constMaxPreparedQueries) {
+        // Queries with inline values (e.g. row ranges) produce many distinct statements, so just start again
+        cache.clear();
+    }
+    cache.insert(sql, query);
+}
+
+static const QString constFtsRank("ftsRank");
+
 // Code taken from Clementine's LibraryQuery
 class SqlQuery
 {
 public:
-    SqlQuery(const QString &colSpec, QSqlDatabase &database)
+    SqlQuery(const QString &colSpec, const QSqlDatabase &database)
             : db(database)
             , fts(false)
+            , ftsRanked(false)
             , columSpec(colSpec)
             , limit(0)
     {
     }
 
+    ~SqlQuery()
+    {
+        releasePrepared(db, sql, query);
+    }
+
     void addWhere(const QString &column, const QVariant &value, const QString &op="=")
     {
         // ignore 'literal' for IN
@@ -430,12 +555,13 @@ public:
         }
     }
 
-    void setFilter(const QString &filter, const QString yearFilter)
+    // If ranked is set, then the match's bm25() score is available as constFtsRank
+    void setFilter(const QString &filter, const QString yearFilter, bool ranked=false)
     {
         if (!filter.isEmpty()) {
-            whereClauses << "songs_fts match ?";
-            boundValues << "\'"+filter+"\'";
+            ftsFilter=filter;
             fts=true;
+            ftsRanked=ranked;
         }
         if (!yearFilter.isEmpty()) {
             whereClauses << yearFilter;
@@ -454,8 +580,14 @@ public:
 
     bool exec()
     {
-        QString sql=fts
-                ? QString("SELECT %1 FROM songs INNER JOIN songs_fts AS fts ON songs.ROWID = fts.ROWID").arg(columSpec)
+        if (!sql.isEmpty()) {
+            releasePrepared(db, sql, query);
+        }
+        // songs_fts shares column names with songs (artist, albumId, etc.), so match in a sub-query that only
+        // exposes the rowid (and rank) - otherwise unqualified columns in the spec, where, and order, are ambiguous.
+        sql=fts
+                ? QString("SELECT %1 FROM songs INNER JOIN (SELECT rowid AS ftsRowId%2 FROM songs_fts WHERE songs_fts MATCH ?) AS fts "
+                          "ON songs.rowid = fts.ftsRowId").arg(columSpec, ftsRanked ? QString(", bm25(songs_fts) AS "+constFtsRank) : QString())
                 : QString("SELECT %1 FROM songs").arg(columSpec);
 
         if (!whereClauses.isEmpty()) {
@@ -467,11 +599,13 @@ public:
         if (limit>0) {
             sql+=" LIMIT "+QString::number(limit);
         }
-        query = QSqlQuery(db);
-        query.prepare(sql);
-
-        for (const QVariant &value: boundValues) {
-            query.addBindValue(value);
+        query=takePrepared(db, sql);
+        int offset=0;
+        if (fts) {
+            query.bindValue(offset++, ftsFilter);
+        }
+        for (int i=0; i<boundValues.count(); ++i) {
+            query.bindValue(offset+i, boundValues.at(i));
         }
         return query.exec();
     }
@@ -483,9 +617,12 @@ public:
     const QSqlQuery & realQuery() const { return query; }
 
 private:
-    QSqlDatabase &db;
+    QSqlDatabase db;
+    QString sql;
     QSqlQuery query;
     bool fts;
+    bool ftsRanked;
+    QString ftsFilter;
     QString columSpec;
     QStringList whereClauses;
     QVariantList boundValues;
@@ -498,8 +635,13 @@ LibraryDb::LibraryDb(QObject *p, const QString &name)
     , dbName(name)
     , currentVersion(0)
     , newVersion(0)
+    , incremental(false)
+    , readGeneration(0)
+    , canRead(false)
+    , ftsVersion(0)
     , db(0)
     , insertSongQuery(0)
+    , insertBatchQuery(0)
 {
     DBUG;
 }
@@ -514,7 +656,7 @@ void LibraryDb::clear()
     if (db) {
         DBUG;
         erase();
-        currentVersion=0;
+        setCurrentVersion(0);
         init(dbFileName);
     }
 }
@@ -524,9 +666,106 @@ void LibraryDb::erase()
     reset();
     if (!dbFileName.isEmpty() && QFile::exists(dbFileName)) {
         QFile::remove(dbFileName);
+        QFile::remove(dbFileName+QLatin1String("-wal"));
+        QFile::remove(dbFileName+QLatin1String("-shm"));
     }
 }
 
+int LibraryDb::getCurrentVersion() const
+{
+    QMutexLocker locker(&mutex);
+    return currentVersion;
+}
+
+QString LibraryDb::getFilter() const
+{
+    QMutexLocker locker(&mutex);
+    return filter;
+}
+
+void LibraryDb::setCurrentVersion(time_t v)
+{
+    QMutexLocker locker(&mutex);
+    currentVersion=v;
+}
+
+// Convert the search words into an FTS match expression. Each word is a prefix match.
+LibraryDb::Filters LibraryDb::currentFilters() const
+{
+    QMutexLocker locker(&mutex);
+    Filters f;
+    f.genre=genreFilter;
+    f.year=yearFilter;
+    f.ranked=false;
+    if (!filter.isEmpty()) {
+        QStringList words=filter.split(' ', QString::SkipEmptyParts);
+        QStringList tokens;
+        if (5==ftsVersion) {
+            // FTS5 only allows alphanumerics in barewords, so quote each word
+            for (QString word: words) {
+                // Words with no letters or digits have no tokens - and an empty phrase would match nothing
+                if (word.contains(QRegExp("\\w"))) {
+                    tokens.append('"'+word.replace('"', QLatin1String("\"\""))+QLatin1String("\"*"));
+                }
+            }
+            f.text=tokens.join(' ');
+            f.ranked=!f.text.isEmpty();
+        } else {
+            static QList<QLatin1Char> replaceChars=QList<QLatin1Char>() << QLatin1Char('(') << QLatin1Char(')') << QLatin1Char('"')
+                                                                        << QLatin1Char(':') << QLatin1Char('-') << QLatin1Char('#');
+            for (QString word: words) {
+                for (const QLatin1Char ch: replaceChars) {
+                    word.replace(ch, '?');
+                }
+                tokens.append(word+QLatin1String("*"));
+            }
+            f.text="\'"+tokens.join(' ')+"\'";
+        }
+    }
+    return f;
+}
+
+// Get the read-only connection for the calling thread. Connections are created on demand, and re-created if
+// the DB has been reset since this thread last used it.
+QSqlDatabase LibraryDb::readDb() const
+{
+    QString fileName;
+    int generation;
+    {
+        QMutexLocker locker(&mutex);
+        if (!canRead) {
+            return QSqlDatabase();
+        }
+        fileName=dbFileName;
+        generation=readGeneration;
+    }
+
+    if (!readConnections.hasLocalData()) {
+        readConnections.setLocalData(new ReadConnections());
+    }
+    ReadConnections *conns=readConnections.localData();
+    QString connName=dbName+QLatin1String("-read-")+QString::number(generation)+QLatin1Char('-')+
+                     QString::number((quintptr)QThread::currentThreadId());
+    QMap<QString, QString>::Iterator it=conns->names.find(dbName);
+    if (it!=conns->names.end()) {
+        if (it.value()==connName) {
+            return QSqlDatabase::database(connName, false);
+        }
+        conns->remove(it.value());
+        conns->names.erase(it);
+    }
+
+    DBUG << connName;
+    QSqlDatabase rdb=QSqlDatabase::addDatabase("QSQLITE", connName);
+    rdb.setDatabaseName(fileName);
+    rdb.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!rdb.open()) {
+        qWarning() << "Failed to open read connection" << connName << rdb.lastError().text();
+    }
+    conns->names.insert(dbName, connName);
+    return rdb;
+}
+
 enum SongFields {
     SF_file,
     SF_artist ,
@@ -548,13 +787,98 @@ enum SongFields {
     SF_year,
     SF_origYear,
     SF_type,
-    SF_lastModified
+    SF_lastModified,
+    SF_dir,
+
+    SF_Count
+};
+
+static const QString constSongColumns("file, artist, artistId, albumArtist, artistSort, composer, album, albumId, albumSort, title, "
+                                      "genre1, genre2, genre3, genre4, track, disc, time, year, origYear, type, lastModified, dir");
+
+// Number of songs to insert with each multi-row insert statement. 45 rows of 22 columns is within SQLite's
+// default limit of 999 bound variables per statement.
+static const int constInsertBatchSize=45;
+
+static QString insertSql(int rows)
+{
+    QString values="(?";
+    for (int i=1; i<SF_Count; ++i) {
+        values+=",?";
+    }
+    values+=")";
+
+    QString sql="insert into songs("+constSongColumns+") values"+values;
+    for (int i=1; i<rows; ++i) {
+        sql+=","+values;
+    }
+    return sql;
+}
+
+// Indexes used by the browse queries. These are dropped before a full update, and re-created afterwards, as it
+// is quicker to build them in one go than to update them with each insert.
+static const char * constIndexes[] = {
+    "songs_dir on songs(dir)",
+    "songs_artistId on songs(artistId, albumId, artistSort)",
+    "songs_albumId on songs(albumId, artistId)",
+    "songs_genre1 on songs(genre1, artistId, albumId)",
+    "songs_genre2 on songs(genre2, artistId, albumId)",
+    "songs_genre3 on songs(genre3, artistId, albumId)",
+    "songs_genre4 on songs(genre4, artistId, albumId)",
+    0
 };
 
+static const QString constFtsColumns("artist, artistId, album, albumId, title");
+static const QString constFtsValues("%1.rowid, %1.artist, %1.artistId, %1.album, %1.albumId, %1.title");
+
+// Triggers to keep songs_fts in sync with songs, so that incremental updates only re-index changed rows. As with
+// the indexes, these are dropped for full updates - and the FTS table rebuilt afterwards.
+static QStringList ftsTriggers(bool fts5)
+{
+    QString insert="insert into songs_fts(rowid, "+constFtsColumns+") values("+QString(constFtsValues).arg("new")+"); ";
+    if (fts5) {
+        QString remove="insert into songs_fts(songs_fts, rowid, "+constFtsColumns+") values('delete', "+QString(constFtsValues).arg("old")+"); ";
+        return QStringList() << "songs_ai after insert on songs begin "+insert+"end"
+                             << "songs_ad after delete on songs begin "+remove+"end"
+                             << "songs_au after update on songs begin "+remove+insert+"end";
+    }
+
+    // FTS4 reads the old values from the content table, so its rows must be removed *before* songs are changed
+    QString remove="delete from songs_fts where docid=old.rowid; ";
+    return QStringList() << "songs_ai after insert on songs begin "+insert+"end"
+                         << "songs_bd before delete on songs begin "+remove+"end"
+                         << "songs_bu before update on songs begin "+remove+"end"
+                         << "songs_au after update on songs begin "+insert+"end";
+}
+
+static void createIndexes(QSqlDatabase &db, int ftsVersion)
+{
+    for (int i=0; constIndexes[i]; ++i) {
+        QSqlQuery(db).exec(QLatin1String("create index if not exists ")+QLatin1String(constIndexes[i]));
+    }
+    if (ftsVersion>0) {
+        for (const QString &trigger: ftsTriggers(5==ftsVersion)) {
+            QSqlQuery(db).exec(QLatin1String("create trigger if not exists ")+trigger);
+        }
+    }
+}
+
+static void dropIndexes(QSqlDatabase &db)
+{
+    for (int i=0; constIndexes[i]; ++i) {
+        QString index=QLatin1String(constIndexes[i]);
+        QSqlQuery(db).exec(QLatin1String("drop index if exists ")+index.left(index.indexOf(' ')));
+    }
+    for (const QString &trigger: QStringList() << "songs_ai" << "songs_ad" << "songs_bd" << "songs_bu" << "songs_au") {
+        QSqlQuery(db).exec(QLatin1String("drop trigger if exists ")+trigger);
+    }
+}
+
 bool LibraryDb::init(const QString &dbFile)
 {
     if (dbFile!=dbFileName) {
         reset();
+        QMutexLocker locker(&mutex);
         dbFileName=dbFile;
     }
     if (db) {
@@ -562,7 +886,7 @@ bool LibraryDb::init(const QString &dbFile)
     }
 
     DBUG << dbFile << dbName;
-    currentVersion=0;
+    setCurrentVersion(0);
     db=new QSqlDatabase(QSqlDatabase::addDatabase("QSQLITE", dbName.isEmpty() ? QLatin1String(QSqlDatabase::defaultConnection) : dbName));
     if (!db || !db->isValid()) {
         emit error(tr("Database error - please check Qt SQLite driver is installed"));
@@ -576,6 +900,8 @@ bool LibraryDb::init(const QString &dbFile)
         DBUG << "Failed to open";
         return false;
     }
+    // WAL allows the read-only connections to query the DB whilst it is being written to
+    QSqlQuery(*db).exec("pragma journal_mode=WAL");
 
     if (!createTable("versions(collection integer, schema integer)")) {
         DBUG << "Failed to create versions table";
@@ -584,12 +910,12 @@ bool LibraryDb::init(const QString &dbFile)
     QSqlQuery query("select collection, schema from versions", *db);
     int schemaVersion=0;
     if (query.next()) {
-        currentVersion=query.value(0).toUInt();
+        setCurrentVersion(query.value(0).toUInt());
         schemaVersion=query.value(1).toUInt();
     }
     if (schemaVersion>0 && schemaVersion!=constSchemaVersion) {
         DBUG << "Scheme version changed";
-        currentVersion=0;
+        setCurrentVersion(0);
         erase();
         return init(dbFile);
     }
@@ -622,68 +948,124 @@ bool LibraryDb::init(const QString &dbFile)
                     "origYear integer, "
                     "type integer, "
                     "lastModified integer, "
+                    "dir text, "
                     "primary key (file))")) {
+        // The FTS table uses songs as its content, and is kept in sync via triggers. Prefix indexes on 2 and 3
+        // characters allow short search strings (as typed) to be looked up without scanning all terms.
         QSqlQuery fts(*db);
-        if (!fts.exec("create virtual table if not exists songs_fts using fts4(fts_artist, fts_artistId, fts_album, fts_albumId, fts_title, tokenize=unicode61)")) {
-            DBUG << "Failed to create FTS table" << fts.lastError().text() << "trying again with simple tokenizer";
-            if (!fts.exec("create virtual table if not exists songs_fts using fts4(fts_artist, fts_artistId, fts_album, fts_albumId, fts_title, tokenize=simple)")) {
-                DBUG << "Failed to create FTS table" << fts.lastError().text();
+        if (!fts.exec("create virtual table if not exists songs_fts using fts5("+constFtsColumns+", content='songs', content_rowid='rowid', prefix='2 3')")) {
+            DBUG << "Failed to create FTS5 table" << fts.lastError().text() << "trying FTS4";
+            if (!fts.exec("create virtual table if not exists songs_fts using fts4("+constFtsColumns+", content=\"songs\", prefix=\"2,3\", tokenize=unicode61)")) {
+                DBUG << "Failed to create FTS table" << fts.lastError().text() << "trying again with simple tokenizer";
+                if (!fts.exec("create virtual table if not exists songs_fts using fts4("+constFtsColumns+", content=\"songs\", prefix=\"2,3\", tokenize=simple)")) {
+                    DBUG << "Failed to create FTS table" << fts.lastError().text();
+                }
             }
         }
+        QSqlQuery ftsType("select sql from sqlite_master where name='songs_fts'", *db);
+        int version=!ftsType.next() ? 0 : ftsType.value(0).toString().contains(QLatin1String("fts5"), Qt::CaseInsensitive) ? 5 : 4;
+        DBUG << "FTS version" << version;
+        mutex.lock();
+        ftsVersion=version;
+        mutex.unlock();
+        createIndexes(*db, ftsVersion);
     } else {
         DBUG << "Failed to create songs table";
         return false;
     }
+    mutex.lock();
+    canRead=true;
+    mutex.unlock();
     emit libraryUpdated();
     DBUG << "Created";
     return true;
 }
 
+void LibraryDb::bindSong(QSqlQuery *query, int offset, const Song &s)
+{
+    QString albumId=s.albumId();
+    query->bindValue(offset+SF_file, s.file);
+    query->bindValue(offset+SF_artist, s.artist);
+    query->bindValue(offset+SF_artistId, s.artistOrComposer());
+    query->bindValue(offset+SF_albumArtist, s.albumartist);
+    query->bindValue(offset+SF_artistSort, artistSort(s));
+    query->bindValue(offset+SF_composer, s.composer());
+    query->bindValue(offset+SF_album, s.album==albumId ? QString() : s.album);
+    query->bindValue(offset+SF_albumId, albumId);
+    query->bindValue(offset+SF_albumSort, albumSort(s));
+    query->bindValue(offset+SF_title, s.title);
+    for (int i=0; i<Song::constNumGenres; ++i) {
+        query->bindValue(offset+SF_genre1+i, s.genres[i].isEmpty() ? constNullGenre : s.genres[i]);
+    }
+    query->bindValue(offset+SF_track, s.track);
+    query->bindValue(offset+SF_disc, s.disc);
+    query->bindValue(offset+SF_time, s.time);
+    query->bindValue(offset+SF_year, s.year);
+    query->bindValue(offset+SF_origYear, s.origYear);
+    query->bindValue(offset+SF_type, s.type);
+    query->bindValue(offset+SF_lastModified, s.lastModified);
+    query->bindValue(offset+SF_dir, songDir(s.file));
+}
+
 void LibraryDb::insertSong(const Song &s)
 {
+    if (!db) {
+        return;
+    }
     if (!insertSongQuery) {
         insertSongQuery=new QSqlQuery(*db);
-        insertSongQuery->prepare("insert into songs(file, artist, artistId, albumArtist, artistSort, composer, album, albumId, albumSort, title, genre1, genre2, genre3, genre4, track, disc, time, year, origYear, type, lastModified) "
-                                 "values(:file, :artist, :artistId, :albumArtist, :artistSort, :composer, :album, :albumId, :albumSort, :title, :genre1, :genre2, :genre3, :genre4, :track, :disc, :time, :year, :origYear, :type, :lastModified)");
+        insertSongQuery->prepare(insertSql(1));
     }
-    QString albumId=s.albumId();
-    insertSongQuery->bindValue(":file", s.file);
-    insertSongQuery->bindValue(":artist", s.artist);
-    insertSongQuery->bindValue(":artistId", s.artistOrComposer());
-    insertSongQuery->bindValue(":albumArtist", s.albumartist);
-    insertSongQuery->bindValue(":artistSort", artistSort(s));
-    insertSongQuery->bindValue(":composer", s.composer());
-    insertSongQuery->bindValue(":album", s.album==albumId ? QString() : s.album);
-    insertSongQuery->bindValue(":albumId", albumId);
-    insertSongQuery->bindValue(":albumSort", albumSort(s));
-    insertSongQuery->bindValue(":title", s.title);
-    for (int i=0; i<Song::constNumGenres; ++i) {
-        insertSongQuery->bindValue(":genre"+QString::number(i+1), s.genres[i].isEmpty() ? constNullGenre : s.genres[i]);
-    }
-    insertSongQuery->bindValue(":track", s.track);
-    insertSongQuery->bindValue(":disc", s.disc);
-    insertSongQuery->bindValue(":time", s.time);
-    insertSongQuery->bindValue(":year", s.year);
-    insertSongQuery->bindValue(":origYear", s.origYear);
-    insertSongQuery->bindValue(":type", s.type);
-    insertSongQuery->bindValue(":lastModified", s.lastModified);
+    bindSong(insertSongQuery, 0, s);
     if (!insertSongQuery->exec()) {
         qWarning() << "insert failed" << insertSongQuery->lastError().text() << newVersion << s.file;
     }
 }
 
+void LibraryDb::insertSongList(const QList<Song> &songs)
+{
+    if (!db || songs.isEmpty()) {
+        return;
+    }
+
+    int pos=0;
+    if (songs.count()>=constInsertBatchSize) {
+        if (!insertBatchQuery) {
+            insertBatchQuery=new QSqlQuery(*db);
+            insertBatchQuery->prepare(insertSql(constInsertBatchSize));
+        }
+        for (; pos+constInsertBatchSize<=songs.count(); pos+=constInsertBatchSize) {
+            for (int i=0; i<constInsertBatchSize; ++i) {
+                bindSong(insertBatchQuery, i*SF_Count, songs.at(pos+i));
+            }
+            if (!insertBatchQuery->exec()) {
+                // One song (e.g. a duplicate) causes the whole statement to fail, so add these individually
+                DBUG << "batch insert failed" << insertBatchQuery->lastError().text();
+                for (int i=0; i<constInsertBatchSize; ++i) {
+                    insertSong(songs.at(pos+i));
+                }
+            }
+        }
+    }
+    for (; pos<songs.count(); ++pos) {
+        insertSong(songs.at(pos));
+    }
+}
+
 QList<LibraryDb::Genre> LibraryDb::getGenres()
 {
     DBUG;
     QMap<QString, QSet<QString> > map;
-    if (0!=currentVersion && db) {
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        Filters f=currentFilters();
         QString queryStr("distinct ");
         for (int i=0; i<Song::constNumGenres; ++i) {
             queryStr+="genre"+QString::number(i+1)+", ";
         }
         queryStr+="artistId";
-        SqlQuery query(queryStr, *db);
-        query.setFilter(filter, yearFilter);
+        SqlQuery query(queryStr, rdb);
+        query.setFilter(f.text, f.year);
 
         query.exec();
         DBUG << query.executedQuery();
@@ -713,18 +1095,37 @@ QList<LibraryDb::Artist> LibraryDb::getArtists(const QString &genre)
     DBUG << genre;
     QMap<QString, QString> sortMap;
     QMap<QString, int> albumMap;
-    if (0!=currentVersion && db) {
-        SqlQuery query("distinct artistId, albumId, artistSort", *db);
-        query.setFilter(filter, yearFilter);
+    QMap<QString, double> rankMap;
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        Filters f=currentFilters();
+        // When ranking, each song has its own score - so rows are not distinct
+        SqlQuery query(f.ranked ? "artistId, albumId, artistSort, "+constFtsRank : "distinct artistId, albumId, artistSort", rdb);
+        query.setFilter(f.text, f.year, f.ranked);
         if (!genre.isEmpty()) {
             query.addWhere("genre", genre);
-        } else if (!genreFilter.isEmpty()) {
-            query.addWhere("genre", genreFilter);
-        } 
+        } else if (!f.genre.isEmpty()) {
+            query.addWhere("genre", f.genre);
+        }
         query.exec();
         DBUG << query.executedQuery();
+        QSet<QString> artistAlbums;
         while (query.next()) {
             QString artist=query.value(0).toString();
+            if (f.ranked) {
+                double rank=query.value(3).toDouble();
+                QMap<QString, double>::Iterator rIt=rankMap.find(artist);
+                if (rIt==rankMap.end()) {
+                    rankMap.insert(artist, rank);
+                } else if (rank<rIt.value()) {
+                    rIt.value()=rank;
+                }
+                QString key=artist+QLatin1Char('\n')+query.value(1).toString();
+                if (artistAlbums.contains(key)) {
+                    continue;
+                }
+                artistAlbums.insert(key);
+            }
             albumMap[artist]++;
             sortMap[artist]=query.value(2).toString();
         }
@@ -738,15 +1139,25 @@ QList<LibraryDb::Artist> LibraryDb::getArtists(const QString &genre)
         artists.append(Artist(it.key(), sortMap[it.key()], it.value()));
     }
     qSort(artists);
+    if (!rankMap.isEmpty()) {
+        // Best matches first. bm25() returns lower values for better matches.
+        qStableSort(artists.begin(), artists.end(), [&rankMap](const Artist &a, const Artist &b) {
+            return rankMap.value(a.name)<rankMap.value(b.name);
+        });
+    }
     return artists;
 }
 
 QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QString &genre, AlbumSort sort)
 {
+    QElapsedTimer timer;
     timer.start();
     DBUG << artistId << genre;
     QList<Album> albums;
-    if (0!=currentVersion && db) {
+    bool ranked=false;
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        Filters f=currentFilters();
         bool wantModified=AS_Modified==sort;
         bool wantArtist=artistId.isEmpty();
         QString queryString="album, albumId, albumSort, artist, albumArtist, composer";
@@ -760,15 +1171,18 @@ QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QStr
         if (wantArtist) {
             queryString+=", artistId, artistSort";
         }
-        SqlQuery query(queryString, *db);
-        query.setFilter(filter, yearFilter);
+        if (f.ranked) {
+            queryString+=", "+constFtsRank;
+        }
+        SqlQuery query(queryString, rdb);
+        query.setFilter(f.text, f.year, f.ranked);
         if (!artistId.isEmpty()) {
             query.addWhere("artistId", artistId);
         }
         if (!genre.isEmpty()) {
             query.addWhere("genre", genre);
-        } else if (!genreFilter.isEmpty()) {
-            query.addWhere("genre", genreFilter);
+        } else if (!f.genre.isEmpty()) {
+            query.addWhere("genre", f.genre);
         }
         query.exec();
         int count=0;
@@ -804,6 +1218,7 @@ QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QStr
             int lastModified=wantModified ? query.value(col++).toInt() : 0;
             QString artist=wantArtist ? query.value(col++).toString() : QString();
             QString artistSort=wantArtist ? query.value(col++).toString() : QString();
+            double rank=f.ranked ? query.value(col++).toDouble() : 0.0;
             // If listing albums not filtered on artist, then if we have a unqique id for the album use that.
             // This will allow us to grouup albums with different composers when the composer tweak is set
             // Issue #1025
@@ -812,9 +1227,12 @@ QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QStr
             QMap<QString, Album>::iterator it=entries.find(key);
 
             if (it==entries.end()) {
-                entries.insert(key, Album(album.isEmpty() ? albumId : album, albumId, albumSort, artist, artistSort, year, 1, time, lastModified, haveUniqueId));
+                Album al(album.isEmpty() ? albumId : album, albumId, albumSort, artist, artistSort, year, 1, time, lastModified, haveUniqueId);
+                al.rank=rank;
+                entries.insert(key, al);
             } else {
                 Album &al=it.value();
+                al.rank=qMin(al.rank, rank);
                 if (wantModified) {
                     al.lastModified=qMax(al.lastModified, lastModified);
                 }
@@ -845,6 +1263,7 @@ QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QStr
         }
 
         albums=entries.values();
+        ranked=f.ranked;
         DBUG << count << albums.count();
     }
 
@@ -874,6 +1293,9 @@ QList<LibraryDb::Album> LibraryDb::getAlbums(const QString &artistId, const QStr
     default:
         break;
     }
+    if (ranked) {
+        qStableSort(albums.begin(), albums.end(), albumsSortRank);
+    }
     DBUG << "After sort" << timer.elapsed();
     return albums;
 }
@@ -882,10 +1304,12 @@ QList<Song> LibraryDb::getTracks(const QString &artistId, const QString &albumId
 {
     DBUG << artistId << albumId << genre << sort;
     QList<Song> songs;
-    if (0!=currentVersion && db) {
-        SqlQuery query("*", *db);
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        Filters f=currentFilters();
+        SqlQuery query("*", rdb);
         if (useFilter) {
-            query.setFilter(filter, yearFilter);
+            query.setFilter(f.text, f.year);
         }
         if (!artistId.isEmpty()) {
             query.addWhere("artistId", artistId);
@@ -895,8 +1319,8 @@ QList<Song> LibraryDb::getTracks(const QString &artistId, const QString &albumId
         }
         if (!genre.isEmpty()) {
             query.addWhere("genre", genre);
-        } else if (useFilter && !genreFilter.isEmpty()) {
-            query.addWhere("genre", genreFilter);
+        } else if (useFilter && !f.genre.isEmpty()) {
+            query.addWhere("genre", f.genre);
         }
         query.exec();
         DBUG << query.executedQuery();
@@ -928,8 +1352,9 @@ QList<Song> LibraryDb::getTracks(const QString &artistId, const QString &albumId
 QList<Song> LibraryDb::getTracks(int rowFrom, int count)
 {
     QList<Song> songList;
-    if (db) {
-        SqlQuery query("*", *db);
+    QSqlDatabase rdb=readDb();
+    if (rdb.isOpen()) {
+        SqlQuery query("*", rdb);
         query.addWhere("rowid", rowFrom, ">");
         query.addWhere("rowid", rowFrom+count, "<=");
         query.addWhere("type", 0);
@@ -944,10 +1369,11 @@ QList<Song> LibraryDb::getTracks(int rowFrom, int count)
 
 int LibraryDb::trackCount()
 {
-    if (!db) {
+    QSqlDatabase rdb=readDb();
+    if (!rdb.isOpen()) {
         return 0;
     }
-    SqlQuery query("(count())", *db);
+    SqlQuery query("(count())", rdb);
     query.addWhere("type", 0);
     query.exec();
     DBUG << query.executedQuery();
@@ -959,9 +1385,10 @@ int LibraryDb::trackCount()
 QList<Song> LibraryDb::songs(const QStringList &files, bool allowPlaylists) const
 {
     QList<Song> songList;
-    if (0!=currentVersion && db) {
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
         for (const QString &f: files) {
-            SqlQuery query("*", *db);
+            SqlQuery query("*", rdb);
             query.addWhere("file", f);
             query.exec();
             DBUG << query.executedQuery();
@@ -977,11 +1404,37 @@ QList<Song> LibraryDb::songs(const QStringList &files, bool allowPlaylists) cons
     return songList;
 }
 
+// Get all songs matching a where clause, e.g. as compiled from smart playlist rules
+QList<Song> LibraryDb::songs(const QString &where, const QVariantList &values) const
+{
+    QList<Song> songList;
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        QSqlQuery query(rdb);
+        query.prepare("select * from songs where "+where);
+        for (const QVariant &v: values) {
+            query.addBindValue(v);
+        }
+        if (!query.exec()) {
+            qWarning() << "Failed to query songs" << query.lastError().text();
+            return songList;
+        }
+        DBUG << query.executedQuery();
+        while (query.next()) {
+            songList.append(getSong(query));
+        }
+        DBUG << songList.count();
+    }
+
+    return songList;
+}
+
 QList<LibraryDb::Album> LibraryDb::getAlbumsWithArtist(const QString &artist)
 {
     QList<LibraryDb::Album> albums;
-    if (0!=currentVersion && db) {
-        SqlQuery query("distinct album, albumId, albumSort", *db);
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        SqlQuery query("distinct album, albumId, albumSort", rdb);
         query.addWhere("artist", artist);
         query.exec();
         DBUG << query.executedQuery();
@@ -1000,8 +1453,10 @@ QList<LibraryDb::Album> LibraryDb::getAlbumsWithArtist(const QString &artist)
 LibraryDb::Album LibraryDb::getRandomAlbum(const QString &genre, const QString &artist)
 {
     Album al;
-    if (0!=currentVersion && db) {
-        SqlQuery query("artistId, albumId", *db);
+    QSqlDatabase rdb=readDb();
+    if (0!=getCurrentVersion() && rdb.isOpen()) {
+        Filters f=currentFilters();
+        SqlQuery query("artistId, albumId", rdb);
         query.setOrder("random()");
         query.setLimit(1);
         if (!artist.isEmpty()) {
@@ -1009,11 +1464,11 @@ LibraryDb::Album LibraryDb::getRandomAlbum(const QString &genre, const QString &
         }
         if (!genre.isEmpty()) {
             query.addWhere("genre", genre);
-        } else if (!genreFilter.isEmpty()) {
-            query.addWhere("genre", genreFilter);
+        } else if (!f.genre.isEmpty()) {
+            query.addWhere("genre", f.genre);
         }
-        if (yearFilter>0) {
-            query.addWhere("year", yearFilter);
+        if (f.year>0) {
+            query.addWhere("year", f.year);
         }
         query.exec();
         DBUG << query.executedQuery();
@@ -1050,11 +1505,15 @@ LibraryDb::Album LibraryDb::getRandomAlbum(const QStringList &genres, const QStr
 
 QSet<QString> LibraryDb::get(const QString &type)
 {
-    if (detailsCache.contains(type)) {
-        return detailsCache[type];
+    {
+        QMutexLocker locker(&mutex);
+        if (detailsCache.contains(type)) {
+            return detailsCache[type];
+        }
     }
     QSet<QString> set;
-    if (!db) {
+    QSqlDatabase rdb=readDb();
+    if (!rdb.isOpen()) {
         return set;
     }
 
@@ -1073,7 +1532,7 @@ QSet<QString> LibraryDb::get(const QString &type)
     }
 
     for (const QString &col: columns) {
-        SqlQuery query("distinct "+col, *db);
+        SqlQuery query("distinct "+col, rdb);
         query.exec();
         DBUG << query.executedQuery();
         while (query.next()) {
@@ -1102,7 +1561,9 @@ QSet<QString> LibraryDb::get(const QString &type)
             }
         }
     }
+    mutex.lock();
     detailsCache[type]=set;
+    mutex.unlock();
     return set;
 }
 
@@ -1117,10 +1578,11 @@ void LibraryDb::getDetails(QSet<QString> &artists, QSet<QString> &albumArtists,
 
 bool LibraryDb::songExists(const Song &song)
 {
-    if (!db) {
+    QSqlDatabase rdb=readDb();
+    if (!rdb.isOpen()) {
         return false;
     }
-    SqlQuery query("file", *db);
+    SqlQuery query("file", rdb);
     query.addWhere("artistId", song.artistOrComposer());
     query.addWhere("albumId", song.albumId());
     query.addWhere("title", song.title);
@@ -1129,6 +1591,25 @@ bool LibraryDb::songExists(const Song &song)
     return query.next();
 }
 
+Song LibraryDb::firstSong(const QString &artistId, const QString &albumId) const
+{
+    QSqlDatabase rdb=readDb();
+    if (0==getCurrentVersion() || !rdb.isOpen()) {
+        return Song();
+    }
+    SqlQuery query("*", rdb);
+    if (!artistId.isEmpty()) {
+        query.addWhere("artistId", artistId);
+    }
+    if (!albumId.isEmpty()) {
+        query.addWhere("albumId", albumId);
+    }
+    query.setLimit(1);
+    query.exec();
+    DBUG << query.executedQuery();
+    return query.next() ? getSong(query.realQuery()) : Song();
+}
+
 static const quint16 constMinYear=1500;
 static const quint16 constMaxYear=2500; // 2500 (bit hopeful here :-) )
 
@@ -1138,8 +1619,6 @@ bool LibraryDb::setFilter(const QString &f, const QString &genre)
     QString year;
     if (!f.isEmpty()) {
         QStringList strings(newFilter.split(QRegExp("\\s+")));
-        static QList<QLatin1Char> replaceChars=QList<QLatin1Char>() << QLatin1Char('(') << QLatin1Char(')') << QLatin1Char('"')
-                                                                    << QLatin1Char(':') << QLatin1Char('-') << QLatin1Char('#');
         QStringList tokens;
         for (QString str: strings) {
             if (str.startsWith('#')) {
@@ -1159,16 +1638,15 @@ bool LibraryDb::setFilter(const QString &f, const QString &genre)
                     }
                 }
             }
-            for (const QLatin1Char ch: replaceChars) {
-                str.replace(ch, '?');
-            }
             if (str.length()>0) {
-                tokens.append(str+QLatin1String("*"));
+                tokens.append(str);
             }
         }
+        // Words are converted into an FTS expression when used - see currentFilters()
         newFilter=tokens.join(" ");
         DBUG << newFilter;
     }
+    QMutexLocker locker(&mutex);
     bool modified=newFilter!=filter || genre!=genreFilter || year!=yearFilter;
     filter=newFilter;
     genreFilter=genre;
@@ -1183,13 +1661,103 @@ void LibraryDb::updateStarted(time_t ver)
         return;
     }
     newVersion=ver;
+    incremental=false;
     timer.start();
     db->transaction();
+    // Drop the FTS triggers, and indexes, before clearing so that songs are not removed from these row by row
+    dropIndexes(*db);
     if (currentVersion>0) {
         clearSongs(false);
     }
 }
 
+void LibraryDb::incrementalUpdateStarted(time_t ver)
+{
+    DBUG << (void *)db << currentVersion << ver;
+    if (!db) {
+        return;
+    }
+    newVersion=ver;
+    incremental=true;
+    timer.start();
+    db->transaction();
+    mutex.lock();
+    detailsCache.clear();
+    mutex.unlock();
+}
+
+void LibraryDb::replaceDirSongs(const QString &dir, const QList<Song> &songs)
+{
+    DBUG << dir << songs.size();
+    if (!db || !incremental) {
+        return;
+    }
+
+    QSqlQuery query(*db);
+    query.prepare("delete from songs where dir=:dir");
+    query.bindValue(":dir", dir.isNull() ? QString(QLatin1String("")) : dir);
+    query.exec();
+
+    insertSongList(songs);
+}
+
+void LibraryDb::removeMissingSongs(const QSet<QString> &files, const QSet<QString> &dirs)
+{
+    DBUG << files.size() << dirs.size();
+    if (!db || !incremental) {
+        return;
+    }
+
+    QList<qint64> removed;
+    QSet<QString> known;
+    QSet<QString> cueDirs;
+    QSqlQuery query("select rowid, file, dir, type from songs", *db);
+    while (query.next()) {
+        QString file=query.value(1).toString();
+        QString dir=query.value(2).toString();
+        bool isCue=CueFile::isCue(file);
+        // CUE tracks, and playlists, are not listed as files by MPD - so for these just check their folder still exists.
+        bool exists=isCue || Song::Playlist==query.value(3).toInt()
+                        ? dir.isEmpty() || dirs.contains(dir)
+                        : files.contains(file);
+        if (!exists) {
+            removed.append(query.value(0).toLongLong());
+        } else if (isCue) {
+            cueDirs.insert(dir);
+        } else {
+            known.insert(file);
+        }
+    }
+
+    // Files moved, or renamed, into a folder keep their modification time - and so are not found by
+    // 'modified-since'. Any file MPD has that we do not, means its folder needs to be listed again. Folders
+    // with CUE tracks are skipped, as the source files of these are (usually) not stored as songs.
+    QSet<QString> unlisted;
+    for (const QString &file: files) {
+        if (!known.contains(file)) {
+            QString dir=songDir(file);
+            if (!cueDirs.contains(dir)) {
+                unlisted.insert(dir);
+            }
+        }
+    }
+
+    DBUG << "Removing" << removed.size();
+    if (!removed.isEmpty()) {
+        QSqlQuery del(*db);
+        del.prepare("delete from songs where rowid=:rowid");
+        for (qint64 rowid: removed) {
+            del.bindValue(":rowid", rowid);
+            del.exec();
+        }
+    }
+
+    if (!unlisted.isEmpty()) {
+        DBUG << "Unlisted folders" << unlisted.size();
+        emit listDirs(unlisted.toList());
+    }
+}
+
 void LibraryDb::insertSongs(QList<Song> *songs)
 {
     DBUG << (int)(songs ? songs->size() : -1);
@@ -1197,9 +1765,7 @@ void LibraryDb::insertSongs(QList<Song> *songs)
         return;
     }
 
-    for (const Song &s: *songs) {
-        insertSong(s);
-    }
+    insertSongList(*songs);
     delete songs;
 }
 
@@ -1208,20 +1774,28 @@ void LibraryDb::updateFinished()
     if (!db) {
         return;
     }
-    DBUG << timer.elapsed();
-    DBUG << "update fts" << timer.elapsed();
-    QSqlQuery(*db).exec("insert into songs_fts(fts_artist, fts_artistId, fts_album, fts_albumId, fts_title) "
-                        "select artist, artistId, album, albumId, title from songs");
+    DBUG << timer.elapsed() << incremental;
+    if (!incremental) {
+        DBUG << "update fts" << timer.elapsed();
+        QSqlQuery(*db).exec("insert into songs_fts(songs_fts) values('rebuild')");
+        DBUG << "create indexes" << timer.elapsed();
+        createIndexes(*db, ftsVersion);
+    }
+    incremental=false;
     QSqlQuery(*db).exec("update versions set collection ="+QString::number(newVersion));
     DBUG << "commit" << timer.elapsed();
     db->commit();
+    mutex.lock();
     currentVersion=newVersion;
+    detailsCache.clear();
+    mutex.unlock();
     DBUG << "complete" << timer.elapsed();
     emit libraryUpdated();
 }
 
 void LibraryDb::abortUpdate()
 {
+    incremental=false;
     if (db) {
         db->rollback();
     }
@@ -1284,14 +1858,21 @@ Song LibraryDb::getSong(const QSqlQuery &query)
 
 void LibraryDb::reset()
 {
+    mutex.lock();
+    canRead=false;
+    readGeneration++;
+    mutex.unlock();
+
     bool removeDb=0!=db;
     delete insertSongQuery;
+    delete insertBatchQuery;
     if (db) {
         db->close();
     }
     delete db;
 
     insertSongQuery=0;
+    insertBatchQuery=0;
     db=0;
     if (removeDb) {
         QSqlDatabase::removeDatabase(dbName);
@@ -1307,9 +1888,190 @@ void LibraryDb::clearSongs(bool startTransaction)
         db->transaction();
     }
     QSqlQuery(*db).exec("delete from songs");
-    QSqlQuery(*db).exec("delete from songs_fts");
+    QSqlQuery(*db).exec("insert into songs_fts(songs_fts) values('rebuild')");
+    mutex.lock();
     detailsCache.clear();
+    mutex.unlock();
     if (startTransaction) {
         db->commit();
     }
 }
+
+static const int constBenchmarkIterations=5;
+static const int constBenchmarkSongsPerAlbum=12;
+static const int constBenchmarkAlbumsPerArtist=8;
+static const int constBenchmarkGenres=24;
+
+bool LibraryDb::benchmark(int numSongs)
+{
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    if (numSongs<=0 || !dir.isValid()) {
+        out << "Invalid number of songs, or failed to create temporary folder" << endl;
+        return false;
+    }
+
+    LibraryDb db(0, "benchmark");
+    if (!db.init(dir.path()+"/benchmark"+constFileExt)) {
+        out << "Failed to create database" << endl;
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    db.updateStarted(1);
+    QList<Song> songs;
+    QStringList files;
+    for (int i=0; i<numSongs; ++i) {
+        int album=i/constBenchmarkSongsPerAlbum;
+        int artist=album/constBenchmarkAlbumsPerArtist;
+        Song s;
+        s.artist=s.albumartist=QString("Artist %1").arg(artist);
+        s.album=QString("Album %1").arg(album);
+        s.title=QString("Title %1").arg(i);
+        s.file=s.artist+'/'+s.album+'/'+s.title+".mp3";
+        s.addGenre(QString("Genre %1").arg(album%constBenchmarkGenres));
+        s.track=(i%constBenchmarkSongsPerAlbum)+1;
+        s.year=1950+(album%70);
+        s.time=120+(i%240);
+        s.lastModified=i;
+        if (0==i%qMax(1, numSongs/100)) {
+            files.append(s.file);
+        }
+        songs.append(s);
+        if (songs.count()>=1000) {
+            db.insertSongList(songs);
+            songs.clear();
+        }
+    }
+    db.insertSongList(songs);
+    db.updateFinished();
+    out << "Created " << numSongs << " songs in " << timer.elapsed() << "ms" << endl;
+
+    QString artist=QString("Artist %1").arg((numSongs/constBenchmarkSongsPerAlbum/constBenchmarkAlbumsPerArtist)/2);
+    QString album=QString("Album %1").arg((numSongs/constBenchmarkSongsPerAlbum)/2);
+    QString genre=QString("Genre %1").arg(constBenchmarkGenres/2);
+    Song existing=db.firstSong(artist, album);
+    for (int shape=0; ; ++shape) {
+        QString name;
+        qint64 total=0;
+        int count=0;
+        for (int i=0; i<constBenchmarkIterations; ++i) {
+            timer.restart();
+            switch (shape) {
+            case 0: name="getGenres"; count=db.getGenres().count(); break;
+            case 1: name="getArtists"; count=db.getArtists().count(); break;
+            case 2: name="getArtists(genre)"; count=db.getArtists(genre).count(); break;
+            case 3: name="getAlbums"; count=db.getAlbums().count(); break;
+            case 4: name="getAlbums(artist)"; count=db.getAlbums(artist).count(); break;
+            case 5: name="getAlbums(artist, genre)"; count=db.getAlbums(artist, genre).count(); break;
+            case 6: name="getTracks(artist, album)"; count=db.getTracks(artist, album).count(); break;
+            case 7: name="firstSong(artist, album)"; count=db.firstSong(artist, album).isEmpty() ? 0 : 1; break;
+            case 8: name="firstSong(artist)"; count=db.firstSong(artist, QString()).isEmpty() ? 0 : 1; break;
+            case 9: name="trackCount"; count=db.trackCount(); break;
+            case 10: name="songExists"; count=db.songExists(existing) ? 1 : 0; break;
+            case 11: name="songs(files)"; count=db.songs(files).count(); break;
+            case 12:
+                name="getArtists(search)";
+                db.setFilter("title 1");
+                count=db.getArtists().count();
+                db.setFilter(QString());
+                break;
+            default:
+                return true;
+            }
+            total+=timer.nsecsElapsed();
+        }
+        out << qSetFieldWidth(28) << left << name << qSetFieldWidth(0)
+            << QString::number(total/(constBenchmarkIterations*1000000.0), 'f', 2) << "ms (" << count << " results)" << endl;
+    }
+}
+
+// Count the tracks reachable via the (filtered) artist -> album -> track tree, as the library view would
+static int filteredTrackCount(LibraryDb &db, const QString &genre=QString())
+{
+    int count=0;
+    for (const LibraryDb::Artist &artist: db.getArtists(genre)) {
+        for (const LibraryDb::Album &album: db.getAlbums(artist.name, genre)) {
+            count+=db.getTracks(artist.name, album.id, genre).count();
+        }
+    }
+    return count;
+}
+
+bool LibraryDb::selfTest()
+{
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "Failed to create temporary folder" << endl;
+        return false;
+    }
+
+    LibraryDb db(0, "selftest");
+    if (!db.init(dir.path()+"/selftest"+constFileExt)) {
+        out << "Failed to create database" << endl;
+        return false;
+    }
+
+    static const struct {
+        const char *artist;
+        const char *album;
+        const char *title;
+        const char *genre;
+        int year;
+    } constSongs[] = {
+        { "Miles Davis", "Kind of Blue", "So What", "Jazz", 1959 },
+        { "Miles Davis", "Kind of Blue", "Blue in Green", "Jazz", 1959 },
+        { "Miles Davis", "Bitches Brew", "Spanish Key", "Jazz", 1970 },
+        { "Joni Mitchell", "Blue", "Blue", "Folk", 1971 },
+        { "Joni Mitchell", "Blue", "River", "Folk", 1971 },
+        { "Joni Mitchell", "Blue", "California", "Folk", 1971 }
+    };
+
+    db.updateStarted(1);
+    QList<Song> songs;
+    int track=1;
+    for (const auto &entry: constSongs) {
+        Song s;
+        s.artist=s.albumartist=QLatin1String(entry.artist);
+        s.album=QLatin1String(entry.album);
+        s.title=QLatin1String(entry.title);
+        s.file=s.artist+'/'+s.album+'/'+s.title+".mp3";
+        s.addGenre(QLatin1String(entry.genre));
+        s.year=entry.year;
+        s.track=track++;
+        s.time=180;
+        songs.append(s);
+    }
+    db.insertSongList(songs);
+    db.updateFinished();
+
+    static const struct {
+        const char *filter;
+        const char *genre;
+        int genres;
+        int artists;
+        int tracks;
+    } constChecks[] = {
+        { "",             "",     2, 2, 6 },
+        { "blue",         "",     2, 2, 5 },
+        { "blue",         "Jazz", 2, 1, 2 },
+        { "river",        "",     1, 1, 1 },
+        { "spanish #1970", "",    1, 1, 1 },
+        { "davis #1971",  "",     0, 0, 0 }
+    };
+
+    bool ok=true;
+    for (const auto &check: constChecks) {
+        db.setFilter(QLatin1String(check.filter), QLatin1String(check.genre));
+        int genres=db.getGenres().count();
+        int artists=db.getArtists().count();
+        int tracks=filteredTrackCount(db);
+        bool passed=genres==check.genres && artists==check.artists && tracks==check.tracks;
+        out << (passed ? "PASS " : "FAIL ") << "filter:\"" << check.filter << "\" genre:\"" << check.genre << "\" - genres:" << genres
+            << " artists:" << artists << " tracks:" << tracks << endl;
+        ok=ok && passed;
+    }
+    return ok;
+}
@@ -27,12 +27,15 @@
 #include <QObject>
 #include <QList>
 #include <QMap>
+#include <QVariant>
 #include <QElapsedTimer>
+#include <QMutex>
+#include <QSqlDatabase>
 #include "mpd-interface/song.h"
 #include <time.h>
 
-class QSqlDatabase;
 class QSqlQuery;
+class QThreadPool;
 
 class LibraryDb : public QObject
 {
@@ -57,6 +60,12 @@ public:
         AS_Count
     };
 
+    // Pool used to run queries away from the GUI thread
+    static QThreadPool * queryPool();
+    // Time each of the query types against a synthetic DB of the given number of songs, and print the results
+    static bool benchmark(int numSongs);
+    // Check that filtered (searched) queries return the expected results from a small temporary DB
+    static bool selfTest();
     static AlbumSort toAlbumSort(const QString &str);
     static QString albumSortStr(AlbumSort m);
 
@@ -98,7 +107,7 @@ public:
         Album(const QString &n=QString(), const QString &i=QString(), const QString &s=QString(),
               const QString &a=QString(), const QString &as=QString(),
               int y=0, int tc=0, int d=0, int lm=0, bool onlyUseId=false)
-            : name(n), id(i), sort(s), artist(a), artistSort(as), year(y), trackCount(tc), duration(d), lastModified(lm), identifyById(onlyUseId) { }
+            : name(n), id(i), sort(s), artist(a), artistSort(as), year(y), trackCount(tc), duration(d), lastModified(lm), identifyById(onlyUseId), rank(0.0) { }
         QString name;
         QString id;
         QString sort;
@@ -109,12 +118,12 @@ public:
         int duration;
         int lastModified;
         bool identifyById; // Should we jsut use albumId to locate tracks - Issue #1025
+        double rank; // bm25() of best matching track, when searching
     };
 
     LibraryDb(QObject *p, const QString &name);
     ~LibraryDb();
 
-    void clear();
     void erase();
     virtual bool init(const QString &dbFile);
     void insertSong(const Song &s);
@@ -125,6 +134,7 @@ public:
     QList<Song> getTracks(int rowFrom, int count);
     int trackCount();
     QList<Song> songs(const QStringList &files, bool allowPlaylists=false) const;
+    QList<Song> songs(const QString &where, const QVariantList &values) const;
     QList<Album> getAlbumsWithArtist(const QString &artist);
     Album getRandomAlbum(const QString &genre, const QString &artist);
     Album getRandomAlbum(const QStringList &genres, const QStringList &artists);
@@ -132,22 +142,44 @@ public:
     void getDetails(QSet<QString> &artists, QSet<QString> &albumArtists, QSet<QString> &composers, QSet<QString> &albums, QSet<QString> &genres);
     bool songExists(const Song &song);
     bool setFilter(const QString &f, const QString &genre=QString());
-    const QString & getFilter() const { return filter; }
-    int getCurrentVersion() const { return currentVersion; }
+    QString getFilter() const;
+    int getCurrentVersion() const;
 
 Q_SIGNALS:
     void libraryUpdated();
     void error(const QString &str);
+    // Emitted, during an incremental update, with the folders that need to be listed again
+    void listDirs(const QStringList &dirs);
 
 public Q_SLOTS:
+    void clear();
     void updateStarted(time_t ver);
+    void incrementalUpdateStarted(time_t ver);
     void insertSongs(QList<Song> *songs);
+    void replaceDirSongs(const QString &dir, const QList<Song> &songs);
+    void removeMissingSongs(const QSet<QString> &files, const QSet<QString> &dirs);
     virtual void updateFinished();
     void abortUpdate();
 
 protected:
+    struct Filters
+    {
+        QString text; // FTS match expression
+        QString genre;
+        QString year;
+        bool ranked; // Can order by bm25() of the match
+    };
+
     bool createTable(const QString &q);
     static Song getSong(const QSqlQuery &query);
+    Song firstSong(const QString &artistId, const QString &albumId) const;
+    void insertSongList(const QList<Song> &songs);
+    void setCurrentVersion(time_t v);
+    Filters currentFilters() const;
+    QSqlDatabase readDb() const;
+
+private:
+    static void bindSong(QSqlQuery *query, int offset, const Song &s);
 
 protected:
     virtual void reset();
@@ -160,8 +192,16 @@ protected:
     QString dbFileName;
     time_t currentVersion;
     time_t newVersion;
+    bool incremental;
+    int readGeneration;
+    bool canRead;
+    int ftsVersion;
+    // Protects currentVersion, dbFileName, readGeneration, canRead, ftsVersion, the filters, and detailsCache - as these are
+    // accessed by both the writer thread and the threads performing queries.
+    mutable QMutex mutex;
     QSqlDatabase *db;
     QSqlQuery *insertSongQuery;
+    QSqlQuery *insertBatchQuery;
     QElapsedTimer timer;
     QString filter;
     QString genreFilter;
@@ -60,6 +60,8 @@ void MpdLibraryDb::removeUnusedDbs()
     for (const QFileInfo &file: files) {
         if (!existing.contains(file.fileName())) {
             QFile::remove(file.absoluteFilePath());
+            QFile::remove(file.absoluteFilePath()+QLatin1String("-wal"));
+            QFile::remove(file.absoluteFilePath()+QLatin1String("-shm"));
         }
     }
 }
@@ -67,15 +69,17 @@ void MpdLibraryDb::removeUnusedDbs()
 MpdLibraryDb::MpdLibraryDb(QObject *p)
     : LibraryDb(p, "MPD")
     , loading(false)
-    , coverQuery(0)
-    , albumIdOnlyCoverQuery(0)
-    , artistImageQuery(0)
 {
     connect(MPDConnection::self(), SIGNAL(updatingLibrary(time_t)), this, SLOT(updateStarted(time_t)));
+    connect(MPDConnection::self(), SIGNAL(updatingLibraryIncrementally(time_t)), this, SLOT(incrementalUpdateStarted(time_t)));
     connect(MPDConnection::self(), SIGNAL(librarySongs(QList<Song>*)), this, SLOT(insertSongs(QList<Song>*)));
+    connect(MPDConnection::self(), SIGNAL(libraryDirSongs(QString,QList<Song>)), this, SLOT(replaceDirSongs(QString,QList<Song>)));
+    connect(MPDConnection::self(), SIGNAL(libraryFiles(QSet<QString>,QSet<QString>)), this, SLOT(removeMissingSongs(QSet<QString>,QSet<QString>)));
     connect(MPDConnection::self(), SIGNAL(updatedLibrary()), this, SLOT(updateFinished()));
     connect(MPDConnection::self(), SIGNAL(statsUpdated(MPDStatsValues)), this, SLOT(statsUpdated(MPDStatsValues)));
     connect(this, SIGNAL(loadLibrary()), MPDConnection::self(), SLOT(loadLibrary()));
+    connect(this, SIGNAL(updateLibrary(time_t)), MPDConnection::self(), SLOT(updateLibrary(time_t)));
+    connect(this, SIGNAL(listDirs(QStringList)), MPDConnection::self(), SLOT(updateLibraryDirs(QStringList)));
     connect(MPDConnection::self(), SIGNAL(connectionChanged(MPDConnectionDetails)), this, SLOT(connectionChanged(MPDConnectionDetails)));
     DBUG;
 }
@@ -87,38 +91,7 @@ MpdLibraryDb::~MpdLibraryDb()
 Song MpdLibraryDb::getCoverSong(const QString &artistId, const QString &albumId)
 {
     DBUG << artistId << albumId;
-    if (0!=currentVersion && db) {
-        QSqlQuery *query=0;
-        if (albumId.isEmpty()) {
-            if (!artistImageQuery) {
-                artistImageQuery=new QSqlQuery(*db);
-                artistImageQuery->prepare("select * from songs where artistId=:artistId limit 1;");
-            }
-            query=artistImageQuery;
-            query->bindValue(":artistId", artistId);
-        } else if (artistId.isEmpty()) {
-            if (!albumIdOnlyCoverQuery) {
-                albumIdOnlyCoverQuery=new QSqlQuery(*db);
-                albumIdOnlyCoverQuery->prepare("select * from songs where albumId=:albumId limit 1;");
-            }
-            query=albumIdOnlyCoverQuery;
-            query->bindValue(":albumId", albumId);
-        } else {
-            if (!coverQuery) {
-                coverQuery=new QSqlQuery(*db);
-                coverQuery->prepare("select * from songs where artistId=:artistId and albumId=:albumId limit 1;");
-            }
-            query=coverQuery;
-            query->bindValue(":albumId", albumId);
-            query->bindValue(":artistId", artistId);
-        }
-        query->exec();
-        DBUG << "coverquery" << query->executedQuery() << query->size();
-        while (query->next()) {
-            return getSong(*query);
-        }
-    }
-    return Song();
+    return firstSong(artistId, albumId);
 }
 
 void MpdLibraryDb::connectionChanged(const MPDConnectionDetails &details)
@@ -132,17 +105,6 @@ void MpdLibraryDb::connectionChanged(const MPDConnectionDetails &details)
     }
 }
 
-void MpdLibraryDb::reset()
-{
-    delete coverQuery;
-    delete artistImageQuery;
-    delete albumIdOnlyCoverQuery;
-    coverQuery=0;
-    artistImageQuery=0;
-    albumIdOnlyCoverQuery=0;
-    LibraryDb::reset();
-}
-
 void MpdLibraryDb::updateFinished()
 {
     loading=false;
@@ -154,6 +116,11 @@ void MpdLibraryDb::statsUpdated(const MPDStatsValues &stats)
     if (!loading && stats.dbUpdate>currentVersion) {
         DBUG << stats.dbUpdate << currentVersion;
         loading=true;
-        emit loadLibrary();
+        // If we already have a copy of the library, then only fetch what has changed...
+        if (currentVersion>0) {
+            emit updateLibrary(currentVersion);
+        } else {
+            emit loadLibrary();
+        }
     }
 }
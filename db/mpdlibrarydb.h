@@ -34,8 +34,6 @@
 
 struct MPDStatsValues;
 struct MPDConnectionDetails;
-class QSqlDatabase;
-class QSqlQuery;
 class QSettings;
 
 class MpdLibraryDb : public LibraryDb
@@ -52,20 +50,17 @@ public:
 
 Q_SIGNALS:
     void loadLibrary();
+    void updateLibrary(time_t since);
 
 public Q_SLOTS:
     void connectionChanged(const MPDConnectionDetails &details);
     void statsUpdated(const MPDStatsValues &stats);
 
 private:
-    void reset();
     void updateFinished();
 
 private:
     bool loading;
-    QSqlQuery *coverQuery;
-    QSqlQuery *albumIdOnlyCoverQuery;
-    QSqlQuery *artistImageQuery;
 };
 
 #endif
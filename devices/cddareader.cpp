@@ -0,0 +1,233 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "cddareader.h"
+#include "cdparanoia.h"
+#include "support/thread.h"
+#include "http/httpserver.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <string.h>
+#define DBUG if (HttpServer::debugEnabled()) qWarning() << metaObject()->className() << __FUNCTION__
+
+// Sectors held in ring buffer - 75 sectors per second, so 1 minute of audio (~10Mb)
+static const int constRingSectors=75*60;
+// How far to read ahead of the consumer - 10 seconds
+static const int constReadAhead=75*10;
+// Number of sectors to read before checking for seeks, and notifying consumer.
+static const int constSectorsPerBatch=25;
+
+CddaReader::CddaReader(const QString &dev)
+    : cdparanoia(0)
+    , nextConsumerId(0)
+    , readPos(0)
+    , needSeek(true)
+    , scheduled(false)
+    , stopped(false)
+    , failedSector(-1)
+    , users(0)
+{
+    CdParanoia *cdp=new CdParanoia(dev, false, false, true);
+    if (*cdp) {
+        cdparanoia=cdp;
+        ring.resize(constRingSectors*CD_FRAMESIZE_RAW);
+        ringSectors.fill(-1, constRingSectors);
+    } else {
+        delete cdp;
+    }
+    DBUG << dev << isOk();
+    lastUsed.start();
+    thread=new Thread(metaObject()->className());
+    moveToThread(thread);
+    thread->start();
+}
+
+CddaReader::~CddaReader()
+{
+    delete cdparanoia;
+}
+
+bool CddaReader::trackSectors(int track, int &first, int &last)
+{
+    if (!cdparanoia) {
+        return false;
+    }
+    // These only access the TOC read when the drive was opened, and so are safe to call whilst reading.
+    first=cdparanoia->firstSectorOfTrack(track);
+    last=cdparanoia->lastSectorOfTrack(track);
+    return first>=0 && last>=first;
+}
+
+CddaReader::Status CddaReader::sector(int id, int s, int lim, char *buffer)
+{
+    QMutexLocker locker(&mutex);
+    if (stopped || s==failedSector) {
+        return Failed;
+    }
+
+    consumers.insert(id, Consumer(s, lim));
+    int slot=s%constRingSectors;
+    if (ringSectors.at(slot)==s) {
+        memcpy(buffer, ring.constData()+(slot*CD_FRAMESIZE_RAW), CD_FRAMESIZE_RAW);
+        if (nextSector()>=0) {
+            schedule();
+        }
+        return Read;
+    }
+
+    // Sector not read yet. The reader thread decides where to read next, so that when there are several
+    // consumers the drive is not made to seek between them for every sector.
+    schedule();
+    return Pending;
+}
+
+int CddaReader::addUser()
+{
+    users++;
+    // New stream, so allow sectors that previously failed to be retried.
+    QMutexLocker locker(&mutex);
+    failedSector=-1;
+    consumers.insert(nextConsumerId, Consumer());
+    return nextConsumerId++;
+}
+
+void CddaReader::removeUser(int id)
+{
+    users--;
+    lastUsed.restart();
+    QMutexLocker locker(&mutex);
+    consumers.remove(id);
+}
+
+void CddaReader::stop()
+{
+    DBUG;
+    mutex.lock();
+    stopped=true;
+    mutex.unlock();
+    // Reader will be deleted once its thread has finished.
+    deleteLater();
+    thread->stop();
+}
+
+void CddaReader::schedule()
+{
+    if (!scheduled) {
+        scheduled=true;
+        QMetaObject::invokeMethod(this, "readAhead", Qt::QueuedConnection);
+    }
+}
+
+// First sector within the consumer's read-ahead window that is not in the ring buffer, or -1 if there are none.
+// Called with the mutex locked.
+int CddaReader::firstMissing(const Consumer &c) const
+{
+    int last=qMin(c.limit, c.target+constReadAhead-1);
+    for (int s=c.target; s<=last; ++s) {
+        if (ringSectors.at(s%constRingSectors)!=s) {
+            return s==failedSector ? -1 : s;
+        }
+    }
+    return -1;
+}
+
+// Determine the next sector to read, or -1 if all consumers have enough buffered. Called with the mutex locked.
+int CddaReader::nextSector() const
+{
+    // Carry on from the current position whilst any consumer still wants it, so that the drive reads sequentially.
+    if (readPos!=failedSector && ringSectors.at(readPos%constRingSectors)!=readPos) {
+        for (const Consumer &c: consumers) {
+            if (readPos>=c.target && readPos<=qMin(c.limit, c.target+constReadAhead-1)) {
+                return readPos;
+            }
+        }
+    }
+
+    // Otherwise move to a consumer that has run out of data, or failing that one that has less than half of its
+    // read-ahead buffered. Those with more can wait, so that switching between consumers only happens every
+    // few seconds of audio. Ties are served in sector order.
+    int next=-1;
+    bool nextStarved=false;
+    for (const Consumer &c: consumers) {
+        int s=firstMissing(c);
+        if (s<0) {
+            continue;
+        }
+        bool starved=s==c.target;
+        if (!starved && s-c.target>=constReadAhead/2) {
+            continue;
+        }
+        if (next<0 || (starved && !nextStarved) || (starved==nextStarved && s<next)) {
+            next=s;
+            nextStarved=starved;
+        }
+    }
+    return next;
+}
+
+void CddaReader::readAhead()
+{
+    for (int i=0; i<constSectorsPerBatch; ++i) {
+        mutex.lock();
+        int s=stopped ? -1 : nextSector();
+        if (s<0) {
+            scheduled=false;
+            mutex.unlock();
+            emit dataAvailable();
+            return;
+        }
+        if (s!=readPos) {
+            DBUG << "Seek from" << readPos << "to" << s;
+            readPos=s;
+            needSeek=true;
+        }
+        bool seek=needSeek;
+        needSeek=false;
+        mutex.unlock();
+
+        if (seek) {
+            cdparanoia->seek(s, SEEK_SET);
+        }
+        qint16 *data=cdparanoia->read();
+
+        QMutexLocker locker(&mutex);
+        if (!data) {
+            DBUG << "Failed to read sector" << s;
+            failedSector=s;
+            scheduled=false;
+            needSeek=true;
+            locker.unlock();
+            emit dataAvailable();
+            return;
+        }
+        failedSector=-1;
+        int slot=s%constRingSectors;
+        memcpy(ring.data()+(slot*CD_FRAMESIZE_RAW), data, CD_FRAMESIZE_RAW);
+        ringSectors[slot]=s;
+        readPos++;
+    }
+
+    emit dataAvailable();
+    // Process any other events (e.g. stop) before reading more.
+    QMetaObject::invokeMethod(this, "readAhead", Qt::QueuedConnection);
+}
@@ -0,0 +1,102 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CDDA_READER_H
+#define CDDA_READER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QMap>
+#include <QMutex>
+#include <QElapsedTimer>
+
+class CdParanoia;
+class Thread;
+
+// Reads audio sectors from an AudioCD on its own thread. Sectors are read ahead of the position currently
+// being streamed, into a ring buffer, so that paranoia retries do not starve the consumer. Sectors remain in
+// the ring buffer whilst the reader exists, so seeking back, or restarting a track, does not re-read the disc.
+// There is one reader per drive, and so if several tracks are streamed at once (e.g. MPD pre-buffering the next
+// track) each consumer's read-ahead is filled in turn - rather than seeking between them on every request.
+class CddaReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Status {
+        Read,
+        Pending,
+        Failed
+    };
+
+    CddaReader(const QString &dev);
+    virtual ~CddaReader();
+
+    bool isOk() const { return 0!=cdparanoia; }
+    bool trackSectors(int track, int &first, int &last);
+    // Copy sector 's' into 'buffer' for consumer 'id'. If the sector has not yet been read, Pending is returned and
+    // dataAvailable() will be emitted once it has. 'limit' is the last sector the reader should read ahead to.
+    Status sector(int id, int s, int limit, char *buffer);
+    void stop();
+
+    // Usage tracking, only called from the thread that created the reader. addUser() returns the consumer id.
+    int addUser();
+    void removeUser(int id);
+    bool isIdle(qint64 ms) const { return 0==users && lastUsed.elapsed()>ms; }
+
+Q_SIGNALS:
+    void dataAvailable();
+
+private Q_SLOTS:
+    void readAhead();
+
+private:
+    struct Consumer {
+        Consumer(int t=0, int l=-1) : target(t), limit(l) { }
+        int target;
+        int limit;
+    };
+
+    void schedule();
+    int firstMissing(const Consumer &c) const;
+    int nextSector() const;
+
+private:
+    Thread *thread;
+    CdParanoia *cdparanoia;
+    QMutex mutex;
+    QByteArray ring;
+    QVector<int> ringSectors;
+    QMap<int, Consumer> consumers;
+    int nextConsumerId;
+    int readPos;
+    bool needSeek;
+    bool scheduled;
+    bool stopped;
+    int failedSector;
+    int users;
+    QElapsedTimer lastUsed;
+};
+
+#endif
@@ -0,0 +1,608 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "devicecache.h"
+#include "models/musiclibraryitemroot.h"
+#include "models/musiclibraryitemartist.h"
+#include "models/musiclibraryitemalbum.h"
+#include "models/musiclibraryitemsong.h"
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QMap>
+#include <QVector>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <string.h>
+
+// File layout, all values are little-endian:
+//   Header   - magic, version, and the position of the current index.
+//   Strings  - chunks of UTF-8 strings. Songs refer to these by index, index 0 is always "".
+//   Sections - one per folder, listing the songs within that folder.
+//   Index    - position of each string chunk and section.
+// Saving appends any new strings, changed sections, and a new index - and then updates the header
+// to point to this. Only once more than half of the file is unused is it completely re-written.
+static const quint32 constMagic=0x43444243; // "CBDC"
+static const quint32 constVersion=1;
+static const quint32 constHeaderSize=24;
+static const int constProgressInterval=250;
+
+// Bits of the flags byte, lower 3 bits hold Song::blank
+static const quint8 constGuessed=0x08;
+
+namespace
+{
+struct Chunk
+{
+    Chunk(quint64 o=0, quint32 l=0, quint32 c=0) : offset(o), length(l), count(c) { }
+    quint64 offset;
+    quint32 length;
+    quint32 count;
+};
+
+struct Section
+{
+    Section(quint32 f=0, quint64 o=0, quint32 l=0) : folder(f), offset(o), length(l) { }
+    quint32 folder;
+    quint64 offset;
+    quint32 length;
+};
+
+struct Index
+{
+    Index() : tracks(0) { }
+    QList<Chunk> chunks;
+    QList<Section> sections;
+    quint64 tracks;
+};
+
+class Reader
+{
+public:
+    Reader(const uchar *d, quint64 len) : pos(d), end(d+len), ok(true) { }
+
+    template<typename T> T get() {
+        if (!ok || (quint64)(end-pos)<sizeof(T)) {
+            ok=false;
+            return 0;
+        }
+        T v=qFromLittleEndian<T>(pos);
+        pos+=sizeof(T);
+        return v;
+    }
+    quint8 byte() {
+        if (!ok || pos>=end) {
+            ok=false;
+            return 0;
+        }
+        return *pos++;
+    }
+    QString string() {
+        quint32 len=get<quint32>();
+        if (!ok || (quint64)(end-pos)<len) {
+            ok=false;
+            return QString();
+        }
+        QString s=QString::fromUtf8((const char *)pos, len);
+        pos+=len;
+        return s;
+    }
+
+    const uchar *pos;
+    const uchar *end;
+    bool ok;
+};
+
+template<typename T> void put(QByteArray &ba, T v)
+{
+    uchar buf[sizeof(T)];
+    qToLittleEndian<T>(v, buf);
+    ba.append((const char *)buf, sizeof(T));
+}
+
+class StringTable
+{
+public:
+    StringTable() : count(0) { }
+
+    quint32 intern(const QString &s) {
+        QHash<QString, quint32>::ConstIterator it=indexes.constFind(s);
+        if (it!=indexes.constEnd()) {
+            referenced.insert(it.value());
+            return it.value();
+        }
+        indexes.insert(s, count);
+        added.append(s);
+        return count++;
+    }
+    void addExisting(const QString &s) {
+        if (!indexes.contains(s)) {
+            indexes.insert(s, count);
+        }
+        count++;
+    }
+    QHash<QString, quint32> indexes;
+    QSet<quint32> referenced; // Existing strings that are still used
+    QStringList added; // Strings not yet in the file
+    quint32 count;
+};
+
+// Mapped file, or its contents if mapping fails (e.g. on some network filesystems)
+class Data
+{
+public:
+    Data(QFile &f) : file(f), mapped(0), ptr(0), size(0) {
+        size=file.size();
+        mapped=size>0 ? file.map(0, size) : 0;
+        if (mapped) {
+            ptr=mapped;
+        } else {
+            contents=file.readAll();
+            ptr=(const uchar *)contents.constData();
+            size=contents.size();
+        }
+    }
+    ~Data() {
+        if (mapped) {
+            file.unmap(mapped);
+        }
+    }
+
+    QFile &file;
+    uchar *mapped;
+    QByteArray contents;
+    const uchar *ptr;
+    quint64 size;
+};
+}
+
+// Only real tags are stored, and not the fields that are used internally
+static const quint16 constStoredExtras[]={ Song::Composer, Song::Performer, Song::Comment, Song::MusicBrainzAlbumId, Song::Name,
+                                           Song::AlbumSort, Song::ArtistSort, Song::AlbumArtistSort };
+static const int constNumStoredExtras=sizeof(constStoredExtras)/sizeof(quint16);
+
+static bool readIndex(const Data &data, Index &index)
+{
+    Reader header(data.ptr, data.size);
+    if (constMagic!=header.get<quint32>() || constVersion!=header.get<quint32>()) {
+        return false;
+    }
+    quint64 offset=header.get<quint64>();
+    quint32 length=header.get<quint32>();
+    if (!header.ok || offset<constHeaderSize || offset+length>data.size) {
+        return false;
+    }
+
+    Reader reader(data.ptr+offset, length);
+    index.tracks=reader.get<quint64>();
+    quint32 numChunks=reader.get<quint32>();
+    for (quint32 i=0; i<numChunks && reader.ok; ++i) {
+        Chunk c;
+        c.offset=reader.get<quint64>();
+        c.length=reader.get<quint32>();
+        c.count=reader.get<quint32>();
+        index.chunks.append(c);
+    }
+    quint32 numSections=reader.get<quint32>();
+    for (quint32 i=0; i<numSections && reader.ok; ++i) {
+        Section s;
+        s.folder=reader.get<quint32>();
+        s.offset=reader.get<quint64>();
+        s.length=reader.get<quint32>();
+        index.sections.append(s);
+    }
+    if (!reader.ok) {
+        return false;
+    }
+    for (const Chunk &c: index.chunks) {
+        if (c.offset+c.length>data.size) {
+            return false;
+        }
+    }
+    for (const Section &s: index.sections) {
+        if (s.offset+s.length>data.size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool readStrings(const Data &data, const Index &index, QVector<QString> &strings)
+{
+    for (const Chunk &c: index.chunks) {
+        Reader reader(data.ptr+c.offset, c.length);
+        for (quint32 i=0; i<c.count; ++i) {
+            strings.append(reader.string());
+        }
+        if (!reader.ok) {
+            return false;
+        }
+    }
+    return !strings.isEmpty();
+}
+
+static void writeSong(QByteArray &ba, StringTable &strings, const Song &s, const QString &name)
+{
+    put<quint32>(ba, strings.intern(name));
+    put<quint32>(ba, strings.intern(s.title));
+    put<quint32>(ba, strings.intern(s.artist));
+    put<quint32>(ba, strings.intern(s.albumartist));
+    put<quint32>(ba, strings.intern(s.album));
+    for (int i=0; i<Song::constNumGenres; ++i) {
+        put<quint32>(ba, strings.intern(s.genres[i]));
+    }
+    put<quint16>(ba, s.time);
+    put<quint16>(ba, s.track);
+    put<quint16>(ba, s.year);
+    put<quint16>(ba, s.origYear);
+    put<quint32>(ba, (quint32)s.size);
+    put<quint32>(ba, s.lastModified);
+    ba.append((char)s.disc);
+    ba.append((char)s.type);
+    ba.append((char)((s.blank&0x07)|(s.guessed ? constGuessed : 0)));
+    quint8 extras=0;
+    for (int i=0; i<constNumStoredExtras; ++i) {
+        if (s.hasExtraField(constStoredExtras[i])) {
+            extras++;
+        }
+    }
+    ba.append((char)extras);
+    for (int i=0; i<constNumStoredExtras; ++i) {
+        if (s.hasExtraField(constStoredExtras[i])) {
+            put<quint16>(ba, constStoredExtras[i]);
+            put<quint32>(ba, strings.intern(s.extraField(constStoredExtras[i])));
+        }
+    }
+}
+
+static QString stringAt(const QVector<QString> &strings, quint32 idx, Reader &reader)
+{
+    if (idx>=(quint32)strings.count()) {
+        reader.ok=false;
+        return QString();
+    }
+    return strings.at(idx);
+}
+
+static bool readSection(const Data &data, const Section &section, const QVector<QString> &strings, MusicLibraryItemRoot *lib)
+{
+    Reader reader(data.ptr+section.offset, section.length);
+    QString folder=stringAt(strings, reader.get<quint32>(), reader);
+    if (!folder.isEmpty()) {
+        folder+=QLatin1Char('/');
+    }
+    quint32 numSongs=reader.get<quint32>();
+    for (quint32 i=0; i<numSongs && reader.ok; ++i) {
+        Song song;
+        song.file=folder+stringAt(strings, reader.get<quint32>(), reader);
+        song.title=stringAt(strings, reader.get<quint32>(), reader);
+        song.artist=stringAt(strings, reader.get<quint32>(), reader);
+        song.albumartist=stringAt(strings, reader.get<quint32>(), reader);
+        song.album=stringAt(strings, reader.get<quint32>(), reader);
+        for (int g=0; g<Song::constNumGenres; ++g) {
+            song.genres[g]=stringAt(strings, reader.get<quint32>(), reader);
+        }
+        song.time=reader.get<quint16>();
+        song.track=reader.get<quint16>();
+        song.year=reader.get<quint16>();
+        song.origYear=reader.get<quint16>();
+        song.size=(qint32)reader.get<quint32>();
+        song.lastModified=reader.get<quint32>();
+        song.disc=reader.byte();
+        song.type=(Song::Type)reader.byte();
+        quint8 flags=reader.byte();
+        song.blank=flags&0x07;
+        song.guessed=flags&constGuessed;
+        quint8 extras=reader.byte();
+        for (quint8 e=0; e<extras && reader.ok; ++e) {
+            quint16 key=reader.get<quint16>();
+            song.setExtraField(key, stringAt(strings, reader.get<quint32>(), reader));
+        }
+        if (!reader.ok) {
+            return false;
+        }
+        song.populateSorts();
+        MusicLibraryItemAlbum *albumItem=lib->artist(song)->album(song);
+        albumItem->append(new MusicLibraryItemSong(song, albumItem));
+    }
+    return reader.ok;
+}
+
+bool DeviceCache::load(const QString &fileName, MusicLibraryItemRoot *lib, MusicLibraryProgressMonitor *prog)
+{
+    if (lib->flat()) {
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    Data data(file);
+    Index index;
+    QVector<QString> strings;
+    if (!readIndex(data, index) || !readStrings(data, index, strings)) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    int percent=0;
+    if (prog) {
+        prog->readProgress(0.0);
+        timer.start();
+    }
+    for (int i=0; i<index.sections.count(); ++i) {
+        if (prog && prog->wasStopped()) {
+            return false;
+        }
+        if (!readSection(data, index.sections.at(i), strings, lib)) {
+            lib->clearItems();
+            return false;
+        }
+        if (prog) {
+            int pc=((i*100.0)/index.sections.count())+0.5;
+            if (pc!=percent && timer.elapsed()>=constProgressInterval) {
+                prog->readProgress(pc);
+                timer.restart();
+                percent=pc;
+            }
+        }
+    }
+    return true;
+}
+
+enum Update
+{
+    Update_Done,
+    Update_Rewrite,
+    Update_Stopped
+};
+
+static QByteArray indexData(const Index &index)
+{
+    QByteArray idx;
+    put<quint64>(idx, index.tracks);
+    put<quint32>(idx, index.chunks.count());
+    for (const Chunk &c: index.chunks) {
+        put<quint64>(idx, c.offset);
+        put<quint32>(idx, c.length);
+        put<quint32>(idx, c.count);
+    }
+    put<quint32>(idx, index.sections.count());
+    for (const Section &s: index.sections) {
+        put<quint32>(idx, s.folder);
+        put<quint64>(idx, s.offset);
+        put<quint32>(idx, s.length);
+    }
+    return idx;
+}
+
+static QByteArray stringData(const QStringList &strings)
+{
+    QByteArray chunk;
+    for (const QString &s: strings) {
+        QByteArray utf8=s.toUtf8();
+        put<quint32>(chunk, utf8.length());
+        chunk+=utf8;
+    }
+    return chunk;
+}
+
+static QByteArray sectionData(StringTable &strings, const QString &folder, const QList<const Song *> &songs)
+{
+    QByteArray section;
+    put<quint32>(section, strings.intern(folder));
+    put<quint32>(section, songs.count());
+    int nameStart=folder.isEmpty() ? 0 : folder.length()+1;
+    for (const Song *s: songs) {
+        writeSong(section, strings, *s, s->file.mid(nameStart));
+    }
+    return section;
+}
+
+static bool writeAll(const QString &fileName, const QMap<QString, QList<const Song *> > &folders, quint64 tracks)
+{
+    StringTable strings;
+    strings.intern(QString());
+    Index index;
+    index.tracks=tracks;
+    QByteArray sections;
+    QMap<QString, QList<const Song *> >::ConstIterator it=folders.constBegin();
+    QMap<QString, QList<const Song *> >::ConstIterator end=folders.constEnd();
+    for (; it!=end; ++it) {
+        QByteArray section=sectionData(strings, it.key(), it.value());
+        index.sections.append(Section(strings.intern(it.key()), sections.length(), section.length()));
+        sections+=section;
+    }
+
+    QByteArray chunk=stringData(strings.added);
+    index.chunks.append(Chunk(constHeaderSize, chunk.length(), strings.added.count()));
+    quint64 sectionsStart=constHeaderSize+chunk.length();
+    for (Section &s: index.sections) {
+        s.offset+=sectionsStart;
+    }
+    QByteArray idx=indexData(index);
+
+    QByteArray header;
+    put<quint32>(header, constMagic);
+    put<quint32>(header, constVersion);
+    put<quint64>(header, sectionsStart+sections.length());
+    put<quint32>(header, idx.length());
+    put<quint32>(header, 0);
+
+    QString tmpName=fileName+QLatin1String(".tmp");
+    QFile f(tmpName);
+    if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        return false;
+    }
+    bool ok=f.write(header)==header.length() && f.write(chunk)==chunk.length() &&
+            f.write(sections)==sections.length() && f.write(idx)==idx.length();
+    f.close();
+    if (!ok) {
+        QFile::remove(tmpName);
+        return false;
+    }
+    QFile::remove(fileName);
+    return QFile::rename(tmpName, fileName);
+}
+
+// Append sections of changed folders, keeping those of unchanged folders.
+static Update append(QFile &file, const QMap<QString, QList<const Song *> > &folders, quint64 tracks, MusicLibraryProgressMonitor *prog)
+{
+    Data data(file);
+    Index existing;
+    QVector<QString> existingStrings;
+    if (!readIndex(data, existing) || !readStrings(data, existing, existingStrings)) {
+        return Update_Rewrite;
+    }
+
+    StringTable strings;
+    for (const QString &s: existingStrings) {
+        strings.addExisting(s);
+    }
+
+    QHash<QString, Section> existingSections;
+    for (const Section &s: existing.sections) {
+        if (s.folder>=(quint32)existingStrings.count()) {
+            return Update_Rewrite;
+        }
+        existingSections.insert(existingStrings.at(s.folder), s);
+    }
+
+    Index index;
+    index.tracks=tracks;
+    index.chunks=existing.chunks;
+    QByteArray appended;
+    quint64 appendPos=data.size;
+    quint64 used=constHeaderSize;
+    QMap<QString, QList<const Song *> >::ConstIterator it=folders.constBegin();
+    QMap<QString, QList<const Song *> >::ConstIterator end=folders.constEnd();
+    for (; it!=end; ++it) {
+        QByteArray section=sectionData(strings, it.key(), it.value());
+        QHash<QString, Section>::ConstIterator e=existingSections.constFind(it.key());
+        if (e!=existingSections.constEnd() && e.value().length==(quint32)section.length() &&
+            0==memcmp(data.ptr+e.value().offset, section.constData(), section.length())) {
+            index.sections.append(e.value());
+        } else {
+            // Position is relative to the end of the file, and is adjusted once the size of any new strings is known
+            index.sections.append(Section(strings.intern(it.key()), appendPos+appended.length(), section.length()));
+            appended+=section;
+        }
+        used+=section.length();
+        if (prog && prog->wasStopped()) {
+            return Update_Stopped;
+        }
+    }
+
+    if (appended.isEmpty() && strings.added.isEmpty() && existing.sections.count()==index.sections.count() && existing.tracks==tracks) {
+        return Update_Done;
+    }
+
+    QByteArray chunk=stringData(strings.added);
+    if (!chunk.isEmpty()) {
+        index.chunks.append(Chunk(appendPos, chunk.length(), strings.added.count()));
+        for (Section &s: index.sections) {
+            if (s.offset>=appendPos) {
+                s.offset+=chunk.length();
+            }
+        }
+    }
+    // Strings of removed songs remain in their chunks, so only count those that are still referenced - otherwise
+    // the file would never be considered wasteful enough to re-write.
+    for (quint32 i: strings.referenced) {
+        if (i<(quint32)existingStrings.count()) {
+            used+=sizeof(quint32)+existingStrings.at(i).toUtf8().length();
+        }
+    }
+    used+=chunk.length();
+    QByteArray idx=indexData(index);
+    used+=idx.length();
+
+    quint64 indexPos=appendPos+chunk.length()+appended.length();
+    if (indexPos+idx.length()-used>used) {
+        return Update_Rewrite;
+    }
+
+    // The header is only updated once everything else has been written, so that an interrupted save
+    // leaves the previous index in place.
+    QByteArray header;
+    put<quint64>(header, indexPos);
+    put<quint32>(header, idx.length());
+    if (!file.seek(appendPos) || file.write(chunk)!=chunk.length() || file.write(appended)!=appended.length() ||
+        file.write(idx)!=idx.length() || !file.flush() || !file.seek(8) || file.write(header)!=header.length()) {
+        return Update_Rewrite;
+    }
+    return Update_Done;
+}
+
+bool DeviceCache::save(const QString &fileName, const MusicLibraryItemRoot *lib, MusicLibraryProgressMonitor *prog)
+{
+    if (lib->flat()) {
+        return false;
+    }
+
+    // If we have NO items, then remove cache file...
+    if (0==lib->childCount()) {
+        if (QFile::exists(fileName)) {
+            QFile::remove(fileName);
+        }
+        return true;
+    }
+
+    if (prog) {
+        prog->writeProgress(0.0);
+    }
+
+    // Songs are sorted within each folder, so that unchanged folders give the same section
+    QMap<QString, QList<const Song *> > folders;
+    quint64 tracks=0;
+    for (const MusicLibraryItem *a: lib->childItems()) {
+        for (const MusicLibraryItem *al: static_cast<const MusicLibraryItemArtist *>(a)->childItems()) {
+            for (const MusicLibraryItem *t: static_cast<const MusicLibraryItemAlbum *>(al)->childItems()) {
+                const Song &song=static_cast<const MusicLibraryItemSong *>(t)->song();
+                int slash=song.file.lastIndexOf(QLatin1Char('/'));
+                folders[slash>0 ? song.file.left(slash) : QString()].append(&song);
+                tracks++;
+            }
+            if (prog && prog->wasStopped()) {
+                return false;
+            }
+        }
+    }
+    QMap<QString, QList<const Song *> >::Iterator it=folders.begin();
+    QMap<QString, QList<const Song *> >::Iterator end=folders.end();
+    for (; it!=end; ++it) {
+        std::sort(it.value().begin(), it.value().end(), [](const Song *a, const Song *b) { return a->file<b->file; });
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    Update update=append(file, folders, tracks, prog);
+    file.close();
+    return Update_Rewrite==update ? writeAll(fileName, folders, tracks) : Update_Stopped!=update;
+}
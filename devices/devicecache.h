@@ -0,0 +1,42 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DEVICE_CACHE_H
+#define DEVICE_CACHE_H
+
+#include <QString>
+
+class MusicLibraryItemRoot;
+class MusicLibraryProgressMonitor;
+
+// Binary cache of a device's library. Strings (artists, albums, genres, etc.) are stored once, and
+// songs are stored in one section per folder. Loading maps the file, and saving only writes the
+// sections of folders that have changed.
+class DeviceCache
+{
+public:
+    static bool load(const QString &fileName, MusicLibraryItemRoot *lib, MusicLibraryProgressMonitor *prog=0);
+    static bool save(const QString &fileName, const MusicLibraryItemRoot *lib, MusicLibraryProgressMonitor *prog=0);
+};
+
+#endif
@@ -38,13 +38,21 @@
 #include "actiondialog.h"
 #include "gui/covers.h"
 #include "support/thread.h"
+#include "tags/taghelperpool.h"
+#include "devicecache.h"
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QTextStream>
 #include <QTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 
 const QLatin1String FsDevice::constCantataCacheFile("/.cache");
+static const QLatin1String constCacheExtension(".bin");
+static const QLatin1String constXmlCacheExtension(".xml.gz"); // Older caches, only read so that they can be converted
 const QLatin1String FsDevice::constCantataSettingsFile("/.cantata");
 const QLatin1String FsDevice::constMusicFilenameSchemeKey("music_filenamescheme");
 const QLatin1String FsDevice::constVfatSafeKey("vfat_safe");
@@ -59,11 +67,30 @@ const QLatin1String FsDevice::constUseCacheKey("use_cache"); // Cantata extensio
 const QLatin1String FsDevice::constDefCoverFileName("cover.jpg");
 const QLatin1String FsDevice::constAutoScanKey("auto_scan"); // Cantata extension!
 
+// Tags are read by TagHelperPool's helper processes, so parsing is not limited to the one core used by
+// a single helper. Files are passed to these in batches, as they are found.
+static const int constMaxTagReaders=4;
+static const int constTagBatchSize=16;
+static const int constCountInterval=1500;
+static const int constWaitInterval=250;
+
+class TagReadRunner : public QRunnable
+{
+public:
+    TagReadRunner(MusicScanner *s, MusicScanner::Batch *b) : scanner(s), batch(b) { }
+    void run() { scanner->readTags(batch); }
+private:
+    MusicScanner *scanner;
+    MusicScanner::Batch *batch;
+};
+
 MusicScanner::MusicScanner()
     : QObject(0)
     , stopRequested(false)
     , count(0)
 {
+    pool=new QThreadPool(this);
+    pool->setMaxThreadCount(qBound(1, QThread::idealThreadCount(), constMaxTagReaders));
     thread=new Thread(metaObject()->className());
     moveToThread(thread);
     thread->start();
@@ -74,12 +101,31 @@ MusicScanner::~MusicScanner()
     stop();
 }
 
+static QString xmlCacheFile(const QString &cacheFile)
+{
+    return cacheFile.left(cacheFile.length()-constCacheExtension.size())+constXmlCacheExtension;
+}
+
 void MusicScanner::scan(const QString &folder, const QString &cacheFile, bool readCache, const QSet<FileOnlySong> &existingSongs)
 {
     if (!cacheFile.isEmpty() && readCache) {
         MusicLibraryItemRoot *lib=new MusicLibraryItemRoot;
         readProgress(0.0);
-        if (lib->fromXML(cacheFile, folder)) {
+        bool loaded=DeviceCache::load(cacheFile, lib, this);
+        if (!loaded && !stopRequested) {
+            QString xmlCache=xmlCacheFile(cacheFile);
+            if (QFile::exists(xmlCache)) {
+                lib->clearItems();
+                loaded=lib->fromXML(xmlCache, folder);
+                if (loaded && !stopRequested) {
+                    writeProgress(0.0);
+                    if (DeviceCache::save(cacheFile, lib, this)) {
+                        QFile::remove(xmlCache);
+                    }
+                }
+            }
+        }
+        if (loaded) {
             if (!stopRequested) {
                 emit libraryUpdated(lib);
             } else {
@@ -95,16 +141,44 @@ void MusicScanner::scan(const QString &folder, const QString &cacheFile, bool re
         return;
     }
     count=0;
-    MusicLibraryItemRoot *library = new MusicLibraryItemRoot;
+    tagsRead.store(0);
     QString topLevel=Utils::fixPath(QDir(folder).absolutePath());
     QSet<FileOnlySong> existing=existingSongs;
+    QList<File> files;
     timer.start();
-    scanFolder(library, topLevel, topLevel, existing, 0);
+    scanFolders(topLevel, existing, files);
+    waitForBatches(files);
+    updateCount(true);
+
+    if (stopRequested) {
+        return;
+    }
 
+    MusicLibraryItemRoot *library = new MusicLibraryItemRoot;
+    MusicLibraryItemArtist *artistItem = 0;
+    MusicLibraryItemAlbum *albumItem = 0;
+    for (File &file: files) {
+        Song &song=file.song;
+        song.file=file.path;
+        if (song.isEmpty()) {
+            continue;
+        }
+        song.fillEmptyFields();
+        song.populateSorts();
+        song.size=file.size;
+        song.lastModified=file.modified;
+        if (!artistItem || song.artistOrComposer()!=artistItem->data()) {
+            artistItem = library->artist(song);
+        }
+        if (!albumItem || albumItem->parentItem()!=artistItem || song.albumName()!=albumItem->data()) {
+            albumItem = artistItem->album(song);
+        }
+        albumItem->append(new MusicLibraryItemSong(song, albumItem));
+    }
     if (!stopRequested) {
         if (!cacheFile.isEmpty()) {
             writeProgress(0.0);
-            library->toXML(cacheFile, this);
+            DeviceCache::save(cacheFile, library, this);
         }
         emit libraryUpdated(library);
     } else {
@@ -115,72 +189,128 @@ void MusicScanner::scan(const QString &folder, const QString &cacheFile, bool re
 void MusicScanner::saveCache(const QString &cache, MusicLibraryItemRoot *lib)
 {
     writeProgress(0.0);
-    lib->toXML(cache, this);
+    DeviceCache::save(cache, lib, this);
     emit cacheSaved();
 }
 
 void MusicScanner::stop()
 {
     stopRequested=true;
-    thread->stop();
-    thread=0;
+    if (thread) {
+        thread->stop();
+        thread=0;
+    }
 }
 
-void MusicScanner::scanFolder(MusicLibraryItemRoot *library, const QString &topLevel, const QString &f,
-                              QSet<FileOnlySong> &existing, int level)
+void MusicScanner::scanFolders(const QString &topLevel, QSet<FileOnlySong> &existing, QList<File> &files)
 {
-    if (stopRequested) {
-        return;
-    }
-    if (level<4) {
-        QDir d(f);
-        QFileInfoList entries=d.entryInfoList(QDir::Files|QDir::NoSymLinks|QDir::Dirs|QDir::NoDotAndDotDot);
-        MusicLibraryItemArtist *artistItem = 0;
-        MusicLibraryItemAlbum *albumItem = 0;
+    // Folders are walked iteratively, so there is no limit upon depth. Symlinks are not followed, and each
+    // folder is only read once, so loops (e.g. via bind mounts) are not an issue.
+    QStringList folders;
+    QSet<QString> visited;
+    Batch *batch=0;
+    folders.append(topLevel);
+    while (!folders.isEmpty() && !stopRequested) {
+        QString folder=folders.takeLast();
+        QString canonical=QFileInfo(folder).canonicalFilePath();
+        if (visited.contains(canonical)) {
+            continue;
+        }
+        visited.insert(canonical);
+
+        QFileInfoList entries=QDir(folder).entryInfoList(QDir::Files|QDir::NoSymLinks|QDir::Dirs|QDir::NoDotAndDotDot);
+        QStringList subFolders;
         for (const QFileInfo &info: entries) {
             if (stopRequested) {
-                return;
+                break;
             }
             if (info.isDir()) {
-                scanFolder(library, topLevel, info.absoluteFilePath(), existing, level+1);
+                subFolders.append(info.absoluteFilePath());
             } else if(info.isReadable()) {
-                Song song;
                 QString fname=info.absoluteFilePath().mid(topLevel.length());
 
                 if (fname.endsWith(".jpg", Qt::CaseInsensitive) || fname.endsWith(".png", Qt::CaseInsensitive) ||
                     fname.endsWith(".lyrics", Qt::CaseInsensitive) || fname.endsWith(".pamp", Qt::CaseInsensitive)) {
                     continue;
                 }
+                File file(fname, info.size(), info.lastModified().toTime_t());
+                Song song;
                 song.file=fname;
                 QSet<FileOnlySong>::iterator it=existing.find(song);
-                if (existing.end()==it) {
-                    song=Tags::read(info.absoluteFilePath());
-                    song.file=fname;
-                } else {
-                    song=*it;
+                if (existing.end()!=it) {
+                    // Only re-read tags if the file has changed since these were last read
+                    if ((*it).size==(qint32)file.size && (*it).lastModified==file.modified) {
+                        file.song=*it;
+                        file.read=true;
+                        count++;
+                    }
                     existing.erase(it);
                 }
-                if (song.isEmpty()) {
-                    continue;
-                }
-                count++;
-                if (timer.elapsed()>=1500 || 0==(count%5)) {
-                    timer.restart();
-                    emit songCount(count);
-                }
-
-                song.fillEmptyFields();
-                song.populateSorts();
-                song.size=info.size();
-                if (!artistItem || song.artistOrComposer()!=artistItem->data()) {
-                    artistItem = library->artist(song);
-                }
-                if (!albumItem || albumItem->parentItem()!=artistItem || song.albumName()!=albumItem->data()) {
-                    albumItem = artistItem->album(song);
+                if (!file.read) {
+                    if (!batch) {
+                        batch=new Batch;
+                    }
+                    batch->indexes.append(files.count());
+                    batch->paths.append(info.absoluteFilePath());
+                    if (batch->paths.count()>=constTagBatchSize) {
+                        startBatch(batch);
+                        batch=0;
+                    }
                 }
-                albumItem->append(new MusicLibraryItemSong(song, albumItem));
+                files.append(file);
+                updateCount();
             }
         }
+        // Stack, so process sub-folders in their listed order
+        for (int i=subFolders.count()-1; i>=0; --i) {
+            folders.append(subFolders.at(i));
+        }
+    }
+
+    if (batch) {
+        startBatch(batch);
+    }
+}
+
+void MusicScanner::startBatch(Batch *batch)
+{
+    pool->start(new TagReadRunner(this, batch));
+}
+
+void MusicScanner::waitForBatches(QList<File> &files)
+{
+    while (!pool->waitForDone(constWaitInterval)) {
+        updateCount(true);
+    }
+
+    mutex.lock();
+    QList<Batch *> batches=finishedBatches;
+    finishedBatches.clear();
+    mutex.unlock();
+    for (Batch *batch: batches) {
+        for (int i=0; i<batch->songs.count(); ++i) {
+            files[batch->indexes.at(i)].song=batch->songs.at(i);
+            files[batch->indexes.at(i)].read=true;
+        }
+        delete batch;
+    }
+}
+
+void MusicScanner::readTags(Batch *batch)
+{
+    if (!stopRequested) {
+        batch->songs=TagHelperPool::self()->read(batch->paths);
+        tagsRead.fetchAndAddOrdered(batch->songs.count());
+    }
+    QMutexLocker locker(&mutex);
+    finishedBatches.append(batch);
+}
+
+void MusicScanner::updateCount(bool force)
+{
+    if (force || timer.elapsed()>=constCountInterval) {
+        timer.restart();
+        emit songCount(count+tagsRead.load());
     }
 }
 
@@ -722,7 +852,12 @@ QString FsDevice::cacheFileName() const
     if (audioFolder.isEmpty()) {
         setAudioFolder();
     }
-    return audioFolder+constCantataCacheFile+".xml.gz";
+    return audioFolder+constCantataCacheFile+constCacheExtension;
+}
+
+QString FsDevice::xmlCacheFileName() const
+{
+    return xmlCacheFile(cacheFileName());
 }
 
 void FsDevice::saveCache()
@@ -744,9 +879,10 @@ void FsDevice::savedCache()
 
 void FsDevice::removeCache()
 {
-    QString cacheFile(cacheFileName());
-    if (QFile::exists(cacheFile)) {
-        QFile::remove(cacheFile);
+    for (const QString &cacheFile: QStringList() << cacheFileName() << xmlCacheFileName()) {
+        if (QFile::exists(cacheFile)) {
+            QFile::remove(cacheFile);
+        }
     }
 }
 
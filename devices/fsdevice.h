@@ -32,8 +32,11 @@
 #include "http/httpserver.h"
 #include <QStringList>
 #include <QElapsedTimer>
+#include <QMutex>
+#include <QAtomicInt>
 
 class Thread;
+class QThreadPool;
 
 struct FileOnlySong : public Song
 {
@@ -72,13 +75,40 @@ Q_SIGNALS:
     void savingCache(int pc);
 
 private:
-    void scanFolder(MusicLibraryItemRoot *library, const QString &topLevel, const QString &f, QSet<FileOnlySong> &existing, int level);
+    struct File
+    {
+        File(const QString &p=QString(), qint64 sz=0, uint m=0) : path(p), size(sz), modified(m), read(false) { }
+        QString path; // Relative to top-level folder
+        qint64 size;
+        uint modified;
+        bool read; // Tags read, or taken from existing song
+        Song song;
+    };
+
+    // Files whose tags are to be read by one of the pool's workers
+    struct Batch
+    {
+        QList<int> indexes;
+        QStringList paths;
+        QList<Song> songs;
+    };
+
+    void scanFolders(const QString &topLevel, QSet<FileOnlySong> &existing, QList<File> &files);
+    void startBatch(Batch *batch);
+    void waitForBatches(QList<File> &files);
+    void readTags(Batch *batch);
+    void updateCount(bool force=false);
 
 private:
     Thread *thread;
     bool stopRequested;
     int count;
+    QAtomicInt tagsRead;
     QElapsedTimer timer;
+    QThreadPool *pool;
+    QMutex mutex;
+    QList<Batch *> finishedBatches;
+    friend class TagReadRunner;
 };
 
 class FsDevice : public Device
@@ -125,6 +155,7 @@ public:
     void cleanDirs(const QSet<QString> &dirs);
     Covers::Image requestCover(const Song &s);
     QString cacheFileName() const;
+    QString xmlCacheFileName() const;
     virtual void setAudioFolder() const { }
     void saveCache();
     void removeCache();
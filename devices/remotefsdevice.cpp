@@ -488,7 +488,7 @@ bool RemoteFsDevice::isConnected() const
         return false;
     }
 
-    if (opts.useCache && !audioFolder.isEmpty() && QFile::exists(cacheFileName())) {
+    if (opts.useCache && !audioFolder.isEmpty() && (QFile::exists(cacheFileName()) || QFile::exists(xmlCacheFileName()))) {
         currentMountStatus=true;
         return true;
     }
@@ -38,6 +38,9 @@
 #include "online/podcastsearchdialog.h"
 #include "support/squeezedtextlabel.h"
 #include "scrobbling/scrobbler.h"
+#ifdef ENABLE_REPLAYGAIN_SUPPORT
+#include "replaygain/albumscanner.h"
+#endif
 #include <QLabel>
 #include <QPushButton>
 #include <QStyle>
@@ -259,10 +262,10 @@ CacheSettings::CacheSettings(QWidget *parent)
 
     new CacheItem(tr("Covers"), Utils::cacheDir(Covers::constCoverDir, false), QStringList() << "*.jpg" << "*.png", tree,
                   CacheItem::Type_Covers);
-    new CacheItem(tr("Scaled Covers"), Utils::cacheDir(Covers::constScaledCoverDir, false), QStringList() << "*.jpg" << "*.png", tree,
+    new CacheItem(tr("Scaled Covers"), Utils::cacheDir(Covers::constScaledCoverDir, false), QStringList() << "*.atlas" << "*.index" << "*.jpg" << "*.png", tree,
                   CacheItem::Type_ScaledCovers);
     new CacheItem(tr("Backdrops"), Utils::cacheDir(ContextWidget::constCacheDir, false), QStringList() << "*.jpg" << "*.png", tree);
-    new CacheItem(tr("Lyrics"), Utils::cacheDir(SongView::constLyricsDir, false), QStringList() << "*"+SongView::constExtension, tree);
+    new CacheItem(tr("Lyrics"), Utils::cacheDir(SongView::constLyricsDir, false), QStringList() << "*"+SongView::constExtension << "*"+SongView::constNotFoundExtension, tree);
     new CacheItem(tr("Artist Information"), Utils::cacheDir(ArtistView::constCacheDir, false), QStringList() << "*"+ArtistView::constInfoExt
                   << "*"+ArtistView::constSimilarInfoExt << "*.json.gz" << "*.jpg" << "*.png", tree);
     new CacheItem(tr("Album Information"), Utils::cacheDir(AlbumView::constCacheDir, false), QStringList() << "*"+AlbumView::constInfoExt << "*.jpg" << "*.png", tree);
@@ -271,6 +274,9 @@ CacheSettings::CacheSettings(QWidget *parent)
     new CacheItem(tr("Podcast Directories"), Utils::cacheDir(PodcastSearchDialog::constCacheDir, false), QStringList() << "*"+PodcastSearchDialog::constExt, tree);
     new CacheItem(tr("Wikipedia Languages"), Utils::cacheDir(WikipediaSettings::constSubDir, false), QStringList() << "*.xml.gz", tree);
     new CacheItem(tr("Scrobble Tracks"), Utils::cacheDir(Scrobbler::constCacheDir, false), QStringList() << "*.xml.gz", tree);
+    #ifdef ENABLE_REPLAYGAIN_SUPPORT
+    new CacheItem(tr("ReplayGain Results"), Utils::cacheDir(AlbumScanner::constCacheDir, false), QStringList() << "*.cache", tree);
+    #endif
 
     for (int i=0; i<tree->topLevelItemCount(); ++i) {
         connect(static_cast<CacheItem *>(tree->topLevelItem(i)), SIGNAL(updated()), this, SLOT(updateSpace()));
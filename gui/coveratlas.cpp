@@ -0,0 +1,354 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "coveratlas.h"
+#include "covers.h"
+#include "support/utils.h"
+#include "support/globalstatic.h"
+#include <QFile>
+#include <QDir>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QDebug>
+
+GLOBAL_STATIC(CoverAtlas, instance)
+
+#define DBUG if (Covers::debugEnabled()) qWarning() << "CoverAtlas" << __FUNCTION__
+
+static const QLatin1String constDataExtension(".atlas");
+static const QLatin1String constIndexExtension(".index");
+static const quint32 constIndexMagic=0x43564154;
+static const quint32 constIndexVersion=1;
+// Only compact a data file when more than half of it is unused, and doing so would save at least this much.
+static const quint64 constMinCompactSize=1024*1024;
+
+static QByteArray indexHeader()
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << constIndexMagic << constIndexVersion;
+    return header;
+}
+
+// A record with a length of 0 marks the removal of a key
+static QByteArray indexRecord(const QString &key, quint64 offset, quint32 length)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << key << offset << length;
+    return record;
+}
+
+CoverAtlas::CoverAtlas()
+{
+}
+
+CoverAtlas::~CoverAtlas()
+{
+    for (Store *s: stores) {
+        if (s) {
+            close(s);
+            delete s;
+        }
+    }
+}
+
+QByteArray CoverAtlas::find(const QString &key, int size)
+{
+    QMutexLocker locker(&mutex);
+    Store *s=store(size);
+    if (!s) {
+        return QByteArray();
+    }
+
+    QHash<QString, Entry>::ConstIterator it=s->entries.constFind(key);
+    if (it==s->entries.constEnd()) {
+        return QByteArray();
+    }
+
+    qint64 end=it.value().offset+it.value().length;
+    if (end>s->mapped) {
+        // Covers have been added since the file was mapped, so re-map to include these.
+        if (s->map) {
+            s->data->unmap(s->map);
+            s->map=0;
+            s->mapped=0;
+        }
+        qint64 fileSize=s->data->size();
+        s->map=s->data->map(0, fileSize);
+        if (s->map) {
+            s->mapped=fileSize;
+        }
+    }
+    if (s->map && end<=s->mapped) {
+        return QByteArray((const char *)s->map+it.value().offset, it.value().length);
+    }
+    // Failed to map file, so fallback to reading it
+    return s->data->seek(it.value().offset) ? s->data->read(it.value().length) : QByteArray();
+}
+
+bool CoverAtlas::insert(const QString &key, int size, const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    Store *s=store(size);
+    if (!s) {
+        return false;
+    }
+
+    Entry entry(s->data->size(), data.length());
+    if (!s->data->seek(entry.offset) || s->data->write(data)!=data.length() || !s->data->flush()) {
+        DBUG << "Failed to write" << key << size;
+        s->data->resize(entry.offset);
+        return false;
+    }
+    if (!append(s, key, entry)) {
+        DBUG << "Failed to update index" << key << size;
+        return false;
+    }
+    QHash<QString, Entry>::Iterator it=s->entries.find(key);
+    if (it!=s->entries.end()) {
+        s->wasted+=it.value().length;
+        it.value()=entry;
+    } else {
+        s->entries.insert(key, entry);
+    }
+    return true;
+}
+
+void CoverAtlas::remove(const QString &key, int size)
+{
+    QMutexLocker locker(&mutex);
+    Store *s=store(size);
+    if (!s) {
+        return;
+    }
+
+    QHash<QString, Entry>::Iterator it=s->entries.find(key);
+    if (it!=s->entries.end()) {
+        DBUG << key << size;
+        s->wasted+=it.value().length;
+        s->entries.erase(it);
+        append(s, key, Entry());
+    }
+}
+
+QList<int> CoverAtlas::sizes()
+{
+    QMutexLocker locker(&mutex);
+    QList<int> sizes;
+    for (QHash<int, Store *>::ConstIterator it=stores.constBegin(), end=stores.constEnd(); it!=end; ++it) {
+        if (it.value()) {
+            sizes.append(it.key());
+        }
+    }
+
+    QString dir=Utils::cacheDir(Covers::constScaledCoverDir, false);
+    if (!dir.isEmpty()) {
+        QStringList indexes=QDir(dir).entryList(QStringList() << QString(QLatin1Char('*'))+constIndexExtension, QDir::Files);
+        for (const QString &index: indexes) {
+            bool ok=false;
+            int size=index.left(index.length()-constIndexExtension.size()).toInt(&ok);
+            if (ok && !sizes.contains(size)) {
+                sizes.append(size);
+            }
+        }
+    }
+    return sizes;
+}
+
+void CoverAtlas::clear()
+{
+    QMutexLocker locker(&mutex);
+    for (Store *s: stores) {
+        if (s) {
+            close(s);
+            delete s;
+        }
+    }
+    stores.clear();
+
+    QString dir=Utils::cacheDir(Covers::constScaledCoverDir, false);
+    if (!dir.isEmpty()) {
+        QDir d(dir);
+        QStringList files=d.entryList(QStringList() << QString(QLatin1Char('*'))+constDataExtension << QString(QLatin1Char('*'))+constIndexExtension, QDir::Files);
+        for (const QString &file: files) {
+            QFile::remove(dir+file);
+        }
+    }
+}
+
+CoverAtlas::Store * CoverAtlas::store(int size)
+{
+    QHash<int, Store *>::ConstIterator it=stores.constFind(size);
+    if (it!=stores.constEnd()) {
+        return it.value();
+    }
+
+    Store *s=new Store();
+    if (!open(s, size)) {
+        close(s);
+        delete s;
+        s=0;
+    }
+    // Failures are also stored, so that we do not keep trying to open files that cannot be opened.
+    stores.insert(size, s);
+    return s;
+}
+
+bool CoverAtlas::open(Store *s, int size)
+{
+    QString dir=Utils::cacheDir(Covers::constScaledCoverDir, true);
+    if (dir.isEmpty()) {
+        return false;
+    }
+
+    s->data=new QFile(dir+QString::number(size)+constDataExtension);
+    s->index=new QFile(dir+QString::number(size)+constIndexExtension);
+    if (!s->data->open(QIODevice::ReadWrite) || !s->index->open(QIODevice::ReadWrite)) {
+        DBUG << "Failed to open" << s->data->fileName() << s->index->fileName();
+        return false;
+    }
+
+    QByteArray index=s->index->readAll();
+    QDataStream stream(index);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic=0;
+    quint32 version=0;
+    stream >> magic >> version;
+    if (QDataStream::Ok!=stream.status() || constIndexMagic!=magic || constIndexVersion!=version) {
+        // New, or incompatible, atlas - so start afresh.
+        QByteArray header=indexHeader();
+        return s->data->resize(0) && s->index->resize(0) && s->index->seek(0) &&
+               s->index->write(header)==header.length() && s->index->flush();
+    }
+
+    qint64 dataSize=s->data->size();
+    qint64 valid=stream.device()->pos();
+    while (!stream.atEnd()) {
+        QString key;
+        quint64 offset=0;
+        quint32 length=0;
+        stream >> key >> offset >> length;
+        if (QDataStream::Ok!=stream.status()) {
+            break;
+        }
+        valid=stream.device()->pos();
+        if (0==length) {
+            s->entries.remove(key);
+        } else if ((qint64)(offset+length)<=dataSize) {
+            s->entries.insert(key, Entry(offset, length));
+        }
+    }
+    if (valid<index.length()) {
+        // Last record was only partially written, remove this so that new records can be appended.
+        DBUG << "Truncating index" << s->index->fileName() << index.length() << valid;
+        s->index->resize(valid);
+    }
+
+    quint64 used=0;
+    for (const Entry &e: s->entries) {
+        used+=e.length;
+    }
+    s->wasted=dataSize-used;
+    DBUG << size << s->entries.count() << dataSize << s->wasted;
+    if (s->wasted>constMinCompactSize && s->wasted>used) {
+        compact(s, size);
+    }
+    return s->data->isOpen() && s->index->isOpen();
+}
+
+void CoverAtlas::compact(Store *s, int size)
+{
+    DBUG << size << s->entries.count() << s->wasted;
+    QString dataName=s->data->fileName();
+    QString indexName=s->index->fileName();
+    QFile data(dataName+QLatin1String(".new"));
+    QFile index(indexName+QLatin1String(".new"));
+    if (!data.open(QIODevice::WriteOnly) || !index.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QHash<QString, Entry> entries;
+    bool ok=index.write(indexHeader())>0;
+    for (QHash<QString, Entry>::ConstIterator it=s->entries.constBegin(), end=s->entries.constEnd(); ok && it!=end; ++it) {
+        if (!s->data->seek(it.value().offset)) {
+            continue;
+        }
+        QByteArray bytes=s->data->read(it.value().length);
+        if (bytes.length()!=(int)it.value().length) {
+            continue;
+        }
+        Entry entry(data.pos(), bytes.length());
+        QByteArray record=indexRecord(it.key(), entry.offset, entry.length);
+        ok=data.write(bytes)==bytes.length() && index.write(record)==record.length();
+        entries.insert(it.key(), entry);
+    }
+    ok=ok && data.flush() && index.flush();
+    data.close();
+    index.close();
+    if (!ok) {
+        DBUG << "Failed to compact" << dataName;
+        QFile::remove(data.fileName());
+        QFile::remove(index.fileName());
+        return;
+    }
+
+    s->data->close();
+    s->index->close();
+    QFile::remove(dataName);
+    QFile::remove(indexName);
+    if (QFile::rename(data.fileName(), dataName) && QFile::rename(index.fileName(), indexName)) {
+        s->entries=entries;
+    } else {
+        s->entries.clear();
+    }
+    s->wasted=0;
+    s->data->open(QIODevice::ReadWrite);
+    s->index->open(QIODevice::ReadWrite);
+}
+
+void CoverAtlas::close(Store *s)
+{
+    if (s->map) {
+        s->data->unmap(s->map);
+        s->map=0;
+        s->mapped=0;
+    }
+    delete s->data;
+    delete s->index;
+    s->data=0;
+    s->index=0;
+    s->entries.clear();
+}
+
+bool CoverAtlas::append(Store *s, const QString &key, const Entry &entry)
+{
+    QByteArray record=indexRecord(key, entry.offset, entry.length);
+    return s->index->seek(s->index->size()) && s->index->write(record)==record.length() && s->index->flush();
+}
@@ -0,0 +1,82 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef COVER_ATLAS_H
+#define COVER_ATLAS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+class QFile;
+
+// Packed store of scaled covers. There is one data file per cover size, holding the encoded images back-to-back,
+// and an index file mapping each cover's cache key to its position. The data file is memory-mapped, so reading
+// a cover does not require a stat/open per image.
+class CoverAtlas
+{
+public:
+    static CoverAtlas * self();
+
+    CoverAtlas();
+    ~CoverAtlas();
+
+    QByteArray find(const QString &key, int size);
+    bool insert(const QString &key, int size, const QByteArray &data);
+    void remove(const QString &key, int size);
+    QList<int> sizes();
+    void clear();
+
+private:
+    struct Entry
+    {
+        Entry(quint64 o=0, quint32 l=0) : offset(o), length(l) { }
+        quint64 offset;
+        quint32 length;
+    };
+
+    struct Store
+    {
+        Store() : data(0), index(0), map(0), mapped(0), wasted(0) { }
+        QFile *data;
+        QFile *index;
+        uchar *map;
+        qint64 mapped;
+        quint64 wasted;
+        QHash<QString, Entry> entries;
+    };
+
+    Store * store(int size);
+    bool open(Store *s, int size);
+    void compact(Store *s, int size);
+    void close(Store *s);
+    bool append(Store *s, const QString &key, const Entry &entry);
+
+private:
+    QMutex mutex;
+    QHash<int, Store *> stores;
+};
+
+#endif
@@ -22,6 +22,7 @@
  */
 
 #include "covers.h"
+#include "coveratlas.h"
 #include "mpd-interface/song.h"
 #include "support/utils.h"
 #include "mpd-interface/mpdconnection.h"
@@ -39,12 +40,14 @@
 #include "tags/tags.h"
 #endif
 #include "support/globalstatic.h"
+#include "support/configuration.h"
 #include "widgets/icons.h"
 #include <QFile>
 #include <QDir>
 #include <QUrl>
 #include <QUrlQuery>
 #include <QTextStream>
+#include <QBuffer>
 #include <qglobal.h>
 #include <QIcon>
 #include <QImage>
@@ -53,7 +56,10 @@
 #include <QFont>
 #include <QXmlStreamReader>
 #include <QTimer>
+#include <QThreadPool>
+#include <QRunnable>
 #include <QApplication>
+#include <climits>
 
 GLOBAL_STATIC(Covers, instance)
 
@@ -247,6 +253,50 @@ static inline QString cacheKey(const Song &song, int size)
     return songKey(song)+QString::number(size);
 }
 
+// Ids for in-memory cache entries that do not depend upon the album, artist, etc.
+enum ReservedIds {
+    Id_VariousArtists = 1,
+    Id_SingleTracks,
+    Id_Stream,
+    Id_DefaultArtist,
+    Id_DefaultPodcast,
+    Id_DefaultAlbum,
+
+    Id_FirstDynamic = 16
+};
+
+static inline quint64 cacheIdForSize(quint32 id, int size)
+{
+    return (((quint64)id)<<32)|(quint32)size;
+}
+
+static inline int cacheIdSize(quint64 id)
+{
+    return (int)(id&0xFFFFFFFF);
+}
+
+static quint32 allocateId(QHash<QString, quint32> &ids, const QString &key, quint32 &next)
+{
+    QHash<QString, quint32>::ConstIterator it=ids.constFind(key);
+    if (it!=ids.constEnd()) {
+        return it.value();
+    }
+    ids.insert(key, next);
+    return next++;
+}
+
+// Default size, in MB, of the in-memory cover cache.
+static const int constDefaultCacheSize=10;
+// Approximate size of a QPixmap, and its cache node, excluding its pixel data.
+static const int constPixmapOverhead=128;
+// Number of lookups between logging of cache statistics.
+static const int constCacheStatsInterval=2000;
+
+static inline int pixmapCost(const QPixmap *pix)
+{
+    return (pix->width()*pix->height()*(pix->depth()/8))+constPixmapOverhead;
+}
+
 static QString getScaledCoverName(const Song &song, int size, bool createDir)
 {
     if (song.isArtistImageRequest()) {
@@ -276,6 +326,11 @@ static void clearScaledCache(const Song &song)
     }
 
     DBUG_CLASS("Covers") << song.file << song.artist << song.albumartist << song.album;
+    for (int size: CoverAtlas::self()->sizes()) {
+        CoverAtlas::self()->remove(cacheKey(song, size), size);
+    }
+
+    // Remove any scaled covers saved by a previous version, as these would otherwise be imported into the atlas...
     QStringList sizeDirNames=d.entryList(QStringList() << "*", QDir::Dirs|QDir::NoDotAndDotDot);
 
     if (song.isArtistImageRequest() || song.isComposerImageRequest()) {
@@ -306,13 +361,33 @@ static void clearScaledCache(const Song &song)
 
 static QImage loadScaledCover(const Song &song, int size)
 {
+    QString key=cacheKey(song, size);
+    QByteArray data=CoverAtlas::self()->find(key, size);
+    if (!data.isEmpty()) {
+        QImage img=QImage::fromData(data, constScaledFormat);
+        if (!img.isNull() && (img.width()==size || img.height()==size)) {
+            DBUG_CLASS("Covers") << song.albumArtist() << song.albumId() << size << "scaled cover found in atlas";
+            return img;
+        }
+        CoverAtlas::self()->remove(key, size);
+    }
+
+    // Scaled covers used to be saved one file per cover, if one of these exists then move it into the atlas.
     QString fileName=getScaledCoverName(song, size, false);
     if (!fileName.isEmpty()) {
         if (QFile::exists(fileName)) {
-            QImage img(fileName, constScaledFormat);
-            if (!img.isNull() && (img.width()==size || img.height()==size)) {
-                DBUG_CLASS("Covers") << song.albumArtist() << song.albumId() << size << "scaled cover found" << fileName;
-                return img;
+            QFile f(fileName);
+            if (f.open(QIODevice::ReadOnly)) {
+                data=f.readAll();
+                f.close();
+                QImage img=QImage::fromData(data, constScaledFormat);
+                if (!img.isNull() && (img.width()==size || img.height()==size)) {
+                    DBUG_CLASS("Covers") << song.albumArtist() << song.albumId() << size << "scaled cover found" << fileName;
+                    if (CoverAtlas::self()->insert(key, size, data)) {
+                        QFile::remove(fileName);
+                    }
+                    return img;
+                }
             }
         } else { // Remove any previous PNG/JPEG scaled cover...
             fileName=Utils::changeExtension(fileName, constScaledPrevExtension);
@@ -953,129 +1028,194 @@ NetworkAccessManager * CoverDownloader::network()
     return manager;
 }
 
-CoverLocator::CoverLocator()
-    : timer(0)
+// To improve responsiveness of views, covers are processed in small batches - so that the queue can be
+// re-prioritised as views are scrolled.
+static const int constMaxCoverUpdatePerIteration=4;
+static const int constMaxCoverThreads=2;
+// Time to wait, after a view has been scrolled, before cancelling requests for covers that are no longer visible.
+static const int constCancelDelay=250;
+static const int constStopWait=2000;
+
+class CoverQueueRunner : public QRunnable
 {
-    thread=new Thread(metaObject()->className());
-    moveToThread(thread);
-    thread->start();
-}
+public:
+    CoverQueueRunner(CoverQueue *q) : queue(q) { }
+    void run() { queue->run(); }
+private:
+    CoverQueue *queue;
+};
 
-void CoverLocator::stop()
+CoverQueue::CoverQueue(const QString &n, int maxThreads)
+    : name(n)
+    , seq(0)
+    , running(0)
+    , stopped(false)
 {
-    thread->stop();
+    pool=new QThreadPool(this);
+    pool->setMaxThreadCount(maxThreads);
 }
 
-void CoverLocator::startTimer(int interval)
+CoverQueue::~CoverQueue()
 {
-    if (!timer) {
-        timer=thread->createTimer(this);
-        timer->setSingleShot(true);
-        connect(timer, SIGNAL(timeout()), this, SLOT(locate()), Qt::QueuedConnection);
-    }
-    timer->start(interval);
+    stop();
 }
 
-void CoverLocator::locate(const Song &s)
+void CoverQueue::stop()
 {
-    queue.append(s);
-    startTimer(0);
+    mutex.lock();
+    stopped=true;
+    pending.clear();
+    order.clear();
+    mutex.unlock();
+    pool->waitForDone(constStopWait);
 }
 
-// To improve responsiveness of views, we only process a max of X images per even loop iteration.
-// If more images are asked for, we place these into a list, and get them on the next iteration
-// of the loop. This way things appear smoother.
-static const int constMaxCoverUpdatePerIteration=10;
-
-void CoverLocator::locate()
+void CoverQueue::add(const Song &song, quint64 key, quint32 epoch)
 {
-    QList<Song> toDo;
-    for (int i=0; i<constMaxCoverUpdatePerIteration && !queue.isEmpty(); ++i) {
-        toDo.append(queue.takeFirst());
-    }
-    if (toDo.isEmpty()) {
+    QMutexLocker locker(&mutex);
+    if (stopped || active.contains(key)) {
         return;
     }
-    QList<LocatedCover> covers;
-    for (const Song &s: toDo) {
-        DBUG << s.file << s.artist << s.albumartist << s.album;
-        Covers::Image img=Covers::locateImage(s);
-        covers.append(LocatedCover(s, img.img, img.fileName));
-    }
-    if (!covers.isEmpty()) {
-        DBUG << "located" << covers.count();
-        emit located(covers);
+
+    // Later epochs are processed first, and within an epoch requests are processed in the order they were made.
+    quint64 pos=(((quint64)epoch)<<32)|(0xFFFFFFFF-(++seq));
+    QHash<quint64, Request>::Iterator it=pending.find(key);
+    if (it!=pending.end()) {
+        if (it.value().epoch<epoch) {
+            order.remove(it.value().pos);
+            it.value().epoch=epoch;
+            it.value().pos=pos;
+            order.insert(pos, key);
+        }
+        return;
     }
 
-    if (!queue.isEmpty()) {
-        startTimer(0);
+    pending.insert(key, Request(song, epoch, pos));
+    order.insert(pos, key);
+    if (running<pool->maxThreadCount()) {
+        running++;
+        pool->start(new CoverQueueRunner(this));
     }
 }
 
-CoverLoader::CoverLoader()
-    : timer(0)
+void CoverQueue::touch(quint64 key, quint32 epoch)
 {
-    thread=new Thread(metaObject()->className());
-    moveToThread(thread);
-    thread->start();
+    QMutexLocker locker(&mutex);
+    QHash<quint64, Request>::Iterator it=pending.find(key);
+    if (it!=pending.end() && it.value().epoch<epoch) {
+        order.remove(it.value().pos);
+        it.value().epoch=epoch;
+        it.value().pos=(((quint64)epoch)<<32)|(0xFFFFFFFF-(++seq));
+        order.insert(it.value().pos, key);
+    }
 }
 
-void CoverLoader::stop()
+QList<quint64> CoverQueue::cancel(quint32 olderThan)
 {
-    thread->stop();
+    QList<quint64> cancelled;
+    QMutexLocker locker(&mutex);
+    QHash<quint64, Request>::Iterator it=pending.begin();
+    while (it!=pending.end()) {
+        if (it.value().epoch<olderThan) {
+            order.remove(it.value().pos);
+            cancelled.append(it.key());
+            it=pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return cancelled;
 }
 
-void CoverLoader::startTimer(int interval)
+void CoverQueue::run()
 {
-    if (!timer) {
-        timer=thread->createTimer(this);
-        timer->setSingleShot(true);
-        connect(timer, SIGNAL(timeout()), this, SLOT(load()), Qt::QueuedConnection);
+    QThread::currentThread()->setObjectName(name);
+    QList<quint64> keys;
+    for (;;) {
+        QList<Song> toDo;
+        mutex.lock();
+        for (quint64 k: keys) {
+            active.remove(k);
+        }
+        keys.clear();
+        while (toDo.count()<constMaxCoverUpdatePerIteration && !order.isEmpty() && !stopped) {
+            QMap<quint64, quint64>::Iterator last=order.end()-1;
+            quint64 key=last.value();
+            order.erase(last);
+            toDo.append(pending.take(key).song);
+            active.insert(key);
+            keys.append(key);
+        }
+        if (toDo.isEmpty()) {
+            running--;
+            mutex.unlock();
+            return;
+        }
+        mutex.unlock();
+        process(toDo);
     }
-    timer->start(interval);
 }
 
-void CoverLoader::load(const Song &song)
+CoverLocator::CoverLocator()
+    : CoverQueue(metaObject()->className(), constMaxCoverThreads)
 {
-    queue.append(LoadedCover(song));
-    startTimer(0);
 }
 
-void CoverLoader::load()
+void CoverLocator::process(const QList<Song> &songs)
 {
-    QList<LoadedCover> toDo;
-    for (int i=0; i<constMaxCoverUpdatePerIteration && !queue.isEmpty(); ++i) {
-        toDo.append(queue.takeFirst());
+    QList<LocatedCover> covers;
+    for (const Song &s: songs) {
+        DBUG << s.file << s.artist << s.albumartist << s.album;
+        Covers::Image img=Covers::locateImage(s);
+        covers.append(LocatedCover(s, img.img, img.fileName));
     }
-    if (toDo.isEmpty()) {
-        return;
+    if (!covers.isEmpty()) {
+        DBUG << "located" << covers.count();
+        emit located(covers);
     }
+}
+
+CoverLoader::CoverLoader()
+    : CoverQueue(metaObject()->className(), constMaxCoverThreads)
+{
+}
+
+void CoverLoader::process(const QList<Song> &songs)
+{
     QList<LoadedCover> covers;
-    for (const LoadedCover &s: toDo) {
-        DBUG << s.song.artist << s.song.albumId() << s.song.size;
-        int size=s.song.size;
+    for (const Song &s: songs) {
+        DBUG << s.artist << s.albumId() << s.size;
+        int size=s.size;
         if (size<constRetinaScaleMaxSize) {
             size*=devicePixelRatio;
         }
-        covers.append(LoadedCover(s.song, loadScaledCover(s.song, size)));
+        covers.append(LoadedCover(s, loadScaledCover(s, size)));
     }
     if (!covers.isEmpty()) {
         DBUG << "loaded" << covers.count();
         emit loaded(covers);
     }
-
-    if (!queue.isEmpty()) {
-        startTimer(0);
-    }
 }
 
 Covers::Covers()
     : downloader(0)
     , locator(0)
     , loader(0)
+    , epoch(0)
+    , cancelTimer(0)
+    , nextId(Id_FirstDynamic)
+    , cacheHits(0)
+    , cacheMisses(0)
+    , cacheEvictions(0)
 {
     devicePixelRatio=qApp->devicePixelRatio();
-    cache.setMaxCost(10*1024*1024);
+    // Budget is specified in MB for 1x displays. HiDPI covers have devicePixelRatio^2 as many pixels, so scale to match.
+    Configuration cfg(metaObject()->className());
+    double budget=qMax(1, cfg.get("cacheSize", constDefaultCacheSize))*1024.0*1024.0*devicePixelRatio*devicePixelRatio;
+    cache.setMaxCost((int)qMin(budget, (double)INT_MAX));
+    DBUG << "Cache size" << cache.maxCost();
+    // Atlas is used from loader threads, so ensure it is created here.
+    CoverAtlas::self();
 }
 
 void Covers::readConfig()
@@ -1086,6 +1226,7 @@ void Covers::readConfig()
 
 void Covers::stop()
 {
+    logCacheStats();
     if (downloader) {
         disconnect(downloader, SIGNAL(artistImage(Song,QImage,QString)), this, SLOT(artistImageDownloaded(Song,QImage,QString)));
         disconnect(downloader, SIGNAL(composerImage(Song,QImage,QString)), this, SLOT(composerImageDownloaded(Song,QImage,QString)));
@@ -1103,6 +1244,9 @@ void Covers::stop()
         loader->stop();
         loader=0;
     }
+    if (cancelTimer) {
+        cancelTimer->stop();
+    }
     #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
     cleanCdda();
     #endif
@@ -1117,9 +1261,65 @@ void Covers::clearNameCache()
     mutex.unlock();
 }
 
+quint64 Covers::cacheId(const Song &song, int size)
+{
+    if (song.isArtistImageRequest() && song.isVariousArtists()) {
+        return cacheIdForSize(Id_VariousArtists, size);
+    } else if (Song::SingleTracks==song.type) {
+        return cacheIdForSize(Id_SingleTracks, size);
+    } else if (song.isStandardStream()) {
+        return cacheIdForSize(Id_Stream, size);
+    } else if (isOnlineServiceImage(song)) {
+        return cacheIdForSize(allocateId(serviceIds, song.onlineService(), nextId), size);
+    } else if (song.isArtistImageRequest()) {
+        return cacheIdForSize(allocateId(artistIds, song.albumArtist(), nextId), size);
+    } else if (song.isComposerImageRequest()) {
+        return cacheIdForSize(allocateId(composerIds, song.composer(), nextId), size);
+    }
+    return cacheIdForSize(allocateId(albumIds[song.albumArtist()], song.albumId(), nextId), size);
+}
+
+QPixmap * Covers::cacheObject(quint64 id)
+{
+    QPixmap *pix=cache.object(id);
+    if (pix) {
+        cacheHits++;
+    } else {
+        cacheMisses++;
+    }
+    if (0==(cacheHits+cacheMisses)%constCacheStatsInterval) {
+        logCacheStats();
+    }
+    return pix;
+}
+
+void Covers::cacheInsert(quint64 id, QPixmap *pix)
+{
+    // QCache does not report evictions, so calculate these from the change in the number of entries.
+    int before=cache.count();
+    bool replace=cache.contains(id);
+    cache.insert(id, pix, pixmapCost(pix));
+    cacheEvictions+=before+(replace ? 0 : 1)-cache.count();
+    cacheSizes.insert(cacheIdSize(id));
+}
+
+void Covers::cacheRemove(quint64 id)
+{
+    cache.remove(id);
+}
+
+void Covers::logCacheStats()
+{
+    quint64 lookups=cacheHits+cacheMisses;
+    DBUG << "hits:" << cacheHits << "misses:" << cacheMisses << "evictions:" << cacheEvictions
+         << "hit-rate:" << (lookups ? (cacheHits*100.0)/lookups : 0.0)
+         << "entries:" << cache.count() << "cost:" << cache.totalCost() << "max-cost:" << cache.maxCost();
+}
+
 void Covers::clearScaleCache()
 {
     cache.clear();
+    CoverAtlas::self()->clear();
 }
 
 QPixmap * Covers::getScaledCover(const Song &song, int size)
@@ -1128,21 +1328,17 @@ QPixmap * Covers::getScaledCover(const Song &song, int size)
         return 0;
     }
 //    DBUG_CLASS("Covers") << song.albumArtist() << song.album << song.mbAlbumId << size;
-    QString key=cacheKey(song, size);
-    QPixmap *pix(cache.object(key));
+    quint64 key=cacheId(song, size);
+    QPixmap *pix(cacheObject(key));
     if (!pix) {
         QImage img=loadScaledCover(song, size);
         if (!img.isNull()) {
             pix=new QPixmap(QPixmap::fromImage(img));
-        }
-        if (pix) {
-            cache.insert(key, pix, pix->width()*pix->height()*(pix->depth()/8));
         } else {
             // Create a dummy image so that we dont keep on stating files that do not exist!
             pix=new QPixmap(1, 1);
-            cache.insert(key, pix, 1);
         }
-        cacheSizes.insert(size);
+        cacheInsert(key, pix);
     }
     return pix && pix->width()>1 ? pix : 0;
 }
@@ -1154,29 +1350,26 @@ QPixmap * Covers::saveScaledCover(const QImage &img, const Song &song, int size)
     }
 
     if (!isOnlineServiceImage(song)) {
-        QString fileName=getScaledCoverName(song, size, true);
-        bool status=img.save(fileName, constScaledFormat);
-        DBUG_CLASS("Covers") << song.albumArtist() << song.album << song.mbAlbumId() << size << fileName << status;
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        bool status=img.save(&buffer, constScaledFormat) && CoverAtlas::self()->insert(cacheKey(song, size), size, data);
+        DBUG_CLASS("Covers") << song.albumArtist() << song.album << song.mbAlbumId() << size << status;
     }
     QPixmap *pix=new QPixmap(QPixmap::fromImage(img));
-    cache.insert(cacheKey(song, size), pix, pix->width()*pix->height()*(pix->depth()/8));
-    cacheSizes.insert(size);
+    cacheInsert(cacheId(song, size), pix);
     return pix;
 }
 
 QPixmap * Covers::defaultPix(const Song &song, int size, int origSize)
 {
     bool podcast=!song.isArtistImageRequest() && !song.isComposerImageRequest() && song.isFromOnlineService() && OnlineService::isPodcasts(song.onlineService());
-    QString key=song.isArtistImageRequest()
-                ? QLatin1String("artist-")
-                    : song.isComposerImageRequest()
-                        ? QLatin1String("composer-")
-                        : podcast
-                            ? QLatin1String("podcast-")
-                            : QLatin1String("album-");
-
-    key+=QString::number(size);
-    QPixmap *pix=cache.object(key);
+    quint64 key=cacheIdForSize(song.isArtistImageRequest() || song.isComposerImageRequest()
+                                ? Id_DefaultArtist
+                                : podcast
+                                    ? Id_DefaultPodcast
+                                    : Id_DefaultAlbum, size);
+    QPixmap *pix=cacheObject(key);
     if (!pix) {
         const Icon &icn=song.isArtistImageRequest() || song.isComposerImageRequest()
                 ? Icons::self()->artistIcon
@@ -1188,8 +1381,7 @@ QPixmap * Covers::defaultPix(const Song &song, int size, int origSize)
             pix->setDevicePixelRatio(devicePixelRatio);
             DBUG << "Set pixel ratio of dummy pixmap" << devicePixelRatio;
         }
-        cache.insert(key, pix, 1);
-        cacheSizes.insert(size);
+        cacheInsert(key, pix);
     }
     return pix;
 }
@@ -1197,7 +1389,7 @@ QPixmap * Covers::defaultPix(const Song &song, int size, int origSize)
 QPixmap * Covers::get(const Song &song, int size, bool urgent)
 {
     VERBOSE_DBUG_CLASS("Covers") << song.albumArtist() << song.album << song.mbAlbumId() << song.composer() << song.isArtistImageRequest() << song.isComposerImageRequest() << size << urgent;
-    QString key;
+    quint64 key=0;
     QPixmap *pix=0;
     if (0==size) {
         size=22;
@@ -1208,8 +1400,8 @@ QPixmap * Covers::get(const Song &song, int size, bool urgent)
         size*=devicePixelRatio;
     }
     if (!song.isUnknownAlbum() || song.isStandardStream()) {
-        key=cacheKey(song, size);
-        pix=cache.object(key);
+        key=cacheId(song, size);
+        pix=cacheObject(key);
 
         if (!pix) {
             if (song.isArtistImageRequest() && song.isVariousArtists()) {
@@ -1230,8 +1422,7 @@ QPixmap * Covers::get(const Song &song, int size, bool urgent)
                     pix->setDevicePixelRatio(devicePixelRatio);
                     VERBOSE_DBUG << "Set pixel ratio of cover" << devicePixelRatio;
                 }
-                cache.insert(key, pix, 1);
-                cacheSizes.insert(size);
+                cacheInsert(key, pix);
             }
         }
         if (!pix) {
@@ -1255,13 +1446,12 @@ QPixmap * Covers::get(const Song &song, int size, bool urgent)
                         pix->setDevicePixelRatio(devicePixelRatio);
                         VERBOSE_DBUG << "Set pixel ratio of loaded scaled cover" << devicePixelRatio;
                     }
-                    cache.insert(key, pix, pix->width()*pix->height()*(pix->depth()/8));
-                    cacheSizes.insert(size);
+                    cacheInsert(key, pix);
                     return pix;
                 }
             }
             VERBOSE_DBUG << "Cached cover not found";
-            tryToLoad(setSizeRequest(song, origSize));
+            tryToLoad(setSizeRequest(song, origSize), key);
 
             // Create a dummy image so that we dont keep on locating/loading/downloading files that do not exist!
             pix=new QPixmap(1, 1);
@@ -1269,14 +1459,17 @@ QPixmap * Covers::get(const Song &song, int size, bool urgent)
                 pix->setDevicePixelRatio(devicePixelRatio);
                 VERBOSE_DBUG << "Set pixel ratio of dummy cover" << devicePixelRatio;
             }
-            cache.insert(key, pix, 1);
-            cacheSizes.insert(size);
+            cacheInsert(key, pix);
         }
 
         if (pix && pix->width()>1) {
             VERBOSE_DBUG << "Found cached pixmap" << pix->width();
             return pix;
         }
+        if (loader) {
+            // Cover is being shown, so if it is still queued then move it to the front
+            loader->touch(key, epoch);
+        }
     }
     VERBOSE_DBUG << "Use default pixmap";
     return defaultPix(song, size, origSize);
@@ -1313,12 +1506,12 @@ bool Covers::updateCache(const Song &song, const QImage &img, bool dummyEntriesO
     bool updated=false;
 
     for (int s: cacheSizes) {
-        QString key=cacheKey(song, s);
+        quint64 key=cacheId(song, s);
         QPixmap *pix(cache.object(key));
 
         if (pix && (!dummyEntriesOnly || pix->width()<2)) {
             double pixRatio=pix->devicePixelRatio();
-            cache.remove(key);
+            cacheRemove(key);
             if (!img.isNull()) {
                 DBUG_CLASS("Covers");
                 QPixmap *p=saveScaledCover(scale(song, img, s), song, s);
@@ -1347,9 +1540,8 @@ void Covers::tryToLocate(const Song &song)
         qRegisterMetaType<QList<LocatedCover> >("QList<LocatedCover>");
         locator=new CoverLocator();
         connect(locator, SIGNAL(located(QList<LocatedCover>)), this, SLOT(located(QList<LocatedCover>)), Qt::QueuedConnection);
-        connect(this, SIGNAL(locate(Song)), locator, SLOT(locate(Song)), Qt::QueuedConnection);
     }
-    emit locate(song);
+    locator->add(song, cacheId(song, 0), epoch);
 }
 
 void Covers::tryToDownload(const Song &song)
@@ -1368,16 +1560,44 @@ void Covers::tryToDownload(const Song &song)
     emit download(song);
 }
 
-void Covers::tryToLoad(const Song &song)
+void Covers::tryToLoad(const Song &song, quint64 key)
 {
     if (!loader) {
         qRegisterMetaType<LoadedCover>("LoadedCover");
         qRegisterMetaType<QList<LoadedCover> >("QList<LoadedCover>");
         loader=new CoverLoader();
         connect(loader, SIGNAL(loaded(QList<LoadedCover>)), this, SLOT(loaded(QList<LoadedCover>)), Qt::QueuedConnection);
-        connect(this, SIGNAL(load(Song)), loader, SLOT(load(Song)), Qt::QueuedConnection);
     }
-    emit load(song);
+    loader->add(song, key, epoch);
+}
+
+void Covers::viewScrolled()
+{
+    epoch++;
+    if (!cancelTimer) {
+        cancelTimer=new QTimer(this);
+        cancelTimer->setSingleShot(true);
+        connect(cancelTimer, SIGNAL(timeout()), this, SLOT(cancelHiddenLoads()));
+    }
+    cancelTimer->start(constCancelDelay);
+}
+
+void Covers::cancelHiddenLoads()
+{
+    if (!loader) {
+        return;
+    }
+    // Any cover that is still visible will have been re-requested (and so 'touched') when its view was
+    // repainted after scrolling. Those that were not are no longer visible, so cancel these - and remove
+    // their place-holder from the cache, so that they are requested again if scrolled back into view.
+    QList<quint64> cancelled=loader->cancel(epoch);
+    for (quint64 key: cancelled) {
+        QPixmap *pix=cache.object(key);
+        if (pix && pix->width()<2) {
+            cacheRemove(key);
+        }
+    }
+    DBUG << "Cancelled" << cancelled.count();
 }
 
 Covers::Image Covers::findImage(const Song &song, bool emitResult)
@@ -1771,8 +1991,7 @@ void Covers::loaded(const QList<LoadedCover> &covers)
                 pix->setDevicePixelRatio(devicePixelRatio);
                 DBUG << "Set pixel ratio of loaded pixmap" << devicePixelRatio;
             }
-            cache.insert(cacheKey(cvr.song, size), pix, pix->width()*pix->height()*(pix->depth()/8));
-            cacheSizes.insert(size);
+            cacheInsert(cacheId(cvr.song, size), pix);
             emit loaded(cvr.song, cvr.song.size);
         } else { // Failed to load a scaled cover, try locating non-scaled cover...
             tryToLocate(cvr.song);
@@ -40,6 +40,7 @@ class Thread;
 class NetworkJob;
 class QMutex;
 class QTimer;
+class QThreadPool;
 class NetworkAccessManager;
 
 class CoverDownloader : public QObject
@@ -109,29 +110,61 @@ struct LocatedCover
     QString fileName;
 };
 
-class CoverLocator : public QObject
+// Queue of cover requests, processed by a small pool of threads. Requests are prioritised by the 'epoch' in
+// which they were last asked for (see Covers::viewScrolled()) - so covers currently visible are processed first.
+// Requests for the same key are coalesced.
+class CoverQueue : public QObject
 {
     Q_OBJECT
 public:
-    CoverLocator();
-    ~CoverLocator() { }
+    CoverQueue(const QString &name, int maxThreads);
+    virtual ~CoverQueue();
 
     void stop();
+    void add(const Song &song, quint64 key, quint32 epoch);
+    void touch(quint64 key, quint32 epoch);
+    QList<quint64> cancel(quint32 olderThan);
 
-Q_SIGNALS:
-    void located(const QList<LocatedCover> &covers);
+protected:
+    virtual void process(const QList<Song> &songs)=0;
 
-public Q_SLOTS:
-    void locate(const Song &s);
-    void locate();
+private:
+    void run();
 
 private:
-    void startTimer(int interval);
+    struct Request
+    {
+        Request(const Song &s=Song(), quint32 e=0, quint64 p=0)
+            : song(s), epoch(e), pos(p) { }
+        Song song;
+        quint32 epoch;
+        quint64 pos;
+    };
+
+    QString name;
+    QThreadPool *pool;
+    QMutex mutex;
+    QHash<quint64, Request> pending;
+    QMap<quint64, quint64> order; // Position -> key, highest position is processed first
+    QSet<quint64> active;
+    quint32 seq;
+    int running;
+    bool stopped;
+    friend class CoverQueueRunner;
+};
+
+class CoverLocator : public CoverQueue
+{
+    Q_OBJECT
+public:
+    CoverLocator();
+    ~CoverLocator() { }
+
+Q_SIGNALS:
+    void located(const QList<LocatedCover> &covers);
 
 private:
-    Thread *thread;
-    QTimer *timer;
-    QList<Song> queue;
+    void process(const QList<Song> &songs);
 };
 
 struct LoadedCover
@@ -142,29 +175,18 @@ struct LoadedCover
     QImage img;
 };
 
-class CoverLoader : public QObject
+class CoverLoader : public CoverQueue
 {
     Q_OBJECT
 public:
     CoverLoader();
     ~CoverLoader() { }
 
-    void stop();
-
 Q_SIGNALS:
     void loaded(const QList<LoadedCover> &covers);
 
-public Q_SLOTS:
-    void load(const Song &song);
-    void load();
-
-private:
-    void startTimer(int interval);
-
 private:
-    Thread *thread;
-    QTimer *timer;
-    QList<LoadedCover> queue;
+    void process(const QList<Song> &songs);
 };
 
 class Covers : public QObject
@@ -238,10 +260,13 @@ public:
 
     static Image locateImage(const Song &song);
 
+public Q_SLOTS:
+    // Called when a view showing covers is scrolled. Covers requested after this are given priority, and those
+    // that are no longer being shown are cancelled.
+    void viewScrolled();
+
 Q_SIGNALS:
     void download(const Song &s);
-    void locate(const Song &s);
-    void load(const Song &song);
     void loaded(const Song &song, int s);
     void cover(const Song &song, const QImage &img, const QString &file);
     void coverUpdated(const Song &song, const QImage &img, const QString &file);
@@ -254,28 +279,46 @@ private Q_SLOTS:
     void coverDownloaded(const Song &song, const QImage &img, const QString &file);
     void artistImageDownloaded(const Song &song, const QImage &img, const QString &file);
     void composerImageDownloaded(const Song &song, const QImage &img, const QString &file);
+    void cancelHiddenLoads();
 
 private:
     QPixmap * defaultPix(const Song &song, int size, int origSize);
     void tryToLocate(const Song &song);
     void tryToDownload(const Song &song);
-    void tryToLoad(const Song &song);
+    void tryToLoad(const Song &song, quint64 key);
     Image findImage(const Song &song, bool emitResult);
     bool updateCache(const Song &song, const QImage &img, bool dummyEntriesOnly);
     void gotAlbumCover(const Song &song, const QImage &img, const QString &fileName, bool emitResult=true);
     void gotArtistImage(const Song &song, const QImage &img, const QString &fileName, bool emitResult=true);
     void gotComposerImage(const Song &song, const QImage &img, const QString &fileName, bool emitResult=true);
     QString getFilename(const Song &s);
+    quint64 cacheId(const Song &song, int size);
+    QPixmap * cacheObject(quint64 id);
+    void cacheInsert(quint64 id, QPixmap *pix);
+    void cacheRemove(quint64 id);
+    void logCacheStats();
 
 private:
     QSet<QString> currentImageRequests;
     QList<Song> queue;
     QSet<int> cacheSizes;
-    QCache<QString, QPixmap> cache;
+    QCache<quint64, QPixmap> cache;
+    // Cache keys are an integer id for the album/artist/composer, combined with the size. Ids are allocated
+    // on first use, keyed on album artist then album id - so no string needs to be built per lookup.
+    QHash<QString, QHash<QString, quint32> > albumIds;
+    QHash<QString, quint32> artistIds;
+    QHash<QString, quint32> composerIds;
+    QHash<QString, quint32> serviceIds;
+    quint32 nextId;
+    quint64 cacheHits;
+    quint64 cacheMisses;
+    quint64 cacheEvictions;
     QMap<QString, QString> filenames;
     CoverDownloader *downloader;
     CoverLocator *locator;
     CoverLoader *loader;
+    quint32 epoch;
+    QTimer *cancelTimer;
     QMutex mutex;
 };
 
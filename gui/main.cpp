@@ -45,6 +45,7 @@
 #include "context/lastfmengine.h"
 #include "context/metaengine.h"
 #include "playlists/dynamicplaylists.h"
+#include "playlists/rulesquery.h"
 #ifdef ENABLE_DEVICES_SUPPORT
 #include "models/devicesmodel.h"
 #endif
@@ -55,6 +56,7 @@
 #include "context/ultimatelyricsprovider.h"
 #include "tags/taghelperiface.h"
 #include "context/contextwidget.h"
+#include "context/contextprefetcher.h"
 #include "scrobbling/scrobbler.h"
 #include "gui/mediakeys.h"
 #ifdef ENABLE_HTTP_STREAM_PLAYBACK
@@ -153,8 +155,12 @@ static void installDebugMessageHandler(const QString &cmdLine)
             MetaEngine::enableDebug();
         } else if (QLatin1String("context-widget")==area) {
             ContextWidget::enableDebug();
+        } else if (QLatin1String("context-prefetch")==area) {
+            ContextPrefetcher::enableDebug();
         } else if (QLatin1String("dynamic")==area) {
             DynamicPlaylists::enableDebug();
+        } else if (QLatin1String("smart")==area) {
+            RulesQuery::enableDebug();
         } else if (QLatin1String("stream-fetcher")==area) {
             StreamFetcher::enableDebug();
         } else if (QLatin1String("http-server")==area) {
@@ -222,9 +228,26 @@ int main(int argc, char *argv[])
     QCommandLineOption debugOption(QStringList() << "d" << "debug", "Set debug areas", "debug", "");
     QCommandLineOption noNetworkOption(QStringList() << "n" << "no-network", "Disable network access", "", "false");
     cmdLineParser.addOption(debugOption);
+    QCommandLineOption dbBenchmarkOption("db-benchmark", "Time library database queries against a synthetic database, and exit", "songs");
     cmdLineParser.addOption(noNetworkOption);
+    cmdLineParser.addOption(dbBenchmarkOption);
+    QCommandLineOption dbSelfTestOption("db-selftest", "Check library database searches against a temporary database, and exit");
+    cmdLineParser.addOption(dbSelfTestOption);
     cmdLineParser.process(app);
 
+    if (cmdLineParser.isSet(dbBenchmarkOption)) {
+        if (cmdLineParser.isSet(debugOption)) {
+            installDebugMessageHandler(cmdLineParser.value(debugOption));
+        }
+        return LibraryDb::benchmark(cmdLineParser.value(dbBenchmarkOption).toInt()) ? 0 : 1;
+    }
+    if (cmdLineParser.isSet(dbSelfTestOption)) {
+        if (cmdLineParser.isSet(debugOption)) {
+            installDebugMessageHandler(cmdLineParser.value(debugOption));
+        }
+        return LibraryDb::selfTest() ? 0 : 1;
+    }
+
     if (!app.start()) {
         return 0;
     }
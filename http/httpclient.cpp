@@ -0,0 +1,242 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "httpclient.h"
+#include "httpserver.h"
+#include <QTcpSocket>
+#include <QRegExp>
+#include <QDebug>
+#define DBUG if (HttpServer::debugEnabled()) qWarning() << "HttpClient" << __FUNCTION__
+
+static const int constMaxRequestSize = 32768;
+// Size of each write to the socket, and how much may be queued in its write buffer before waiting for it to drain.
+static const qint64 constChunkSize = 64*1024;
+static const qint64 constMaxPending = 256*1024;
+// Files are mapped in windows of this size, rather than as a whole, so that large files do not use up address space.
+static const qint64 constMapSize = 4*1024*1024;
+
+static int getSep(const QByteArray &a, int pos)
+{
+    for (int i=pos+1; i<a.length(); ++i) {
+        if ('\n'==a[i] || '\r'==a[i] || ' '==a[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static QList<QByteArray> split(const QByteArray &a)
+{
+    QList<QByteArray> rv;
+    int lastPos=-1;
+    for (;;) {
+        int pos=getSep(a, lastPos);
+
+        if (pos==(lastPos+1)) {
+            lastPos++;
+        } else if (pos>-1) {
+            lastPos++;
+            rv.append(a.mid(lastPos, pos-lastPos));
+            lastPos=pos;
+        } else {
+            lastPos++;
+            rv.append(a.mid(lastPos));
+            break;
+        }
+    }
+    return rv;
+}
+
+static const char * statusText(int code)
+{
+    switch (code) {
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 416: return "Requested Range Not Satisfiable";
+    default:  return "Error";
+    }
+}
+
+HttpClient::FileSource::FileSource(const QString &fileName)
+    : file(fileName)
+    , pos(0)
+    , end(0)
+    , map(0)
+    , mapStart(0)
+    , mapEnd(0)
+{
+}
+
+HttpClient::FileSource::~FileSource()
+{
+    if (map) {
+        file.unmap(map);
+    }
+}
+
+bool HttpClient::FileSource::open()
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    end=file.size();
+    return true;
+}
+
+void HttpClient::FileSource::setRange(qint64 from, qint64 to)
+{
+    pos=from;
+    end=to+1;
+}
+
+qint64 HttpClient::FileSource::next(const char *&data, qint64 maxLen)
+{
+    if (pos>=end) {
+        return 0;
+    }
+
+    if (!map || pos<mapStart || pos>=mapEnd) {
+        if (map) {
+            file.unmap(map);
+        }
+        mapStart=pos;
+        mapEnd=qMin(end, pos+constMapSize);
+        map=file.map(mapStart, mapEnd-mapStart);
+    }
+
+    qint64 len=0;
+    if (map) {
+        len=qMin(maxLen, mapEnd-pos);
+        data=(const char *)map+(pos-mapStart);
+    } else {
+        // Could not map file, so fallback to reading.
+        if (!file.seek(pos)) {
+            return Error;
+        }
+        buffer=file.read(qMin(maxLen, end-pos));
+        len=buffer.length();
+        data=buffer.constData();
+        if (len<=0) {
+            return Error;
+        }
+    }
+    pos+=len;
+    return len;
+}
+
+HttpClient::HttpClient(QTcpSocket *s, QObject *p)
+    : QObject(p)
+    , sock(s)
+    , requested(false)
+    , source(0)
+{
+    sock->setParent(this);
+    connect(sock, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(sock, SIGNAL(bytesWritten(qint64)), this, SLOT(writeData()));
+    connect(sock, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+}
+
+HttpClient::~HttpClient()
+{
+    delete source;
+}
+
+void HttpClient::sendError(int code)
+{
+    DBUG << code;
+    sock->write("HTTP/1.0 "+QByteArray::number(code)+" "+statusText(code)+"\r\n"
+                "Content-Type: text/html; charset=\"utf-8\"\r\n"
+                "\r\n");
+    sock->disconnectFromHost();
+}
+
+void HttpClient::send(const QByteArray &header, Source *src)
+{
+    delete source;
+    source=src;
+    sock->write(header);
+    writeData();
+}
+
+void HttpClient::readRequest()
+{
+    if (requested) {
+        // Ignore anything sent after the request
+        sock->readAll();
+        return;
+    }
+
+    buffer+=sock->readAll();
+    int end=buffer.indexOf("\r\n\r\n");
+    if (-1==end) {
+        end=buffer.indexOf("\n\n");
+    }
+    if (-1==end) {
+        if (buffer.length()>=constMaxRequestSize) {
+            DBUG << "Request too large";
+            requested=true;
+            sendError(400);
+        }
+        return;
+    }
+
+    requested=true;
+    int lineEnd=buffer.indexOf('\n');
+    tokens=split(buffer.left(lineEnd));
+    params=QString(buffer.mid(lineEnd+1, end-lineEnd)).split(QRegExp("[\r\n][\r\n]*"), QString::SkipEmptyParts);
+    buffer.clear();
+    DBUG << "params" << params << "tokens" << tokens;
+    emit request();
+}
+
+void HttpClient::writeData()
+{
+    if (!source) {
+        return;
+    }
+
+    while (sock->bytesToWrite()<constMaxPending) {
+        const char *data=0;
+        qint64 len=source->next(data, constChunkSize);
+        if (Source::NotReady==len) {
+            return;
+        }
+        if (len<=0) {
+            if (len<0) {
+                DBUG << "Failed to read data";
+            }
+            delete source;
+            source=0;
+            // Socket will be closed once all pending data has been written
+            sock->disconnectFromHost();
+            return;
+        }
+        if (sock->write(data, len)!=len) {
+            DBUG << "Failed to write data";
+            delete source;
+            source=0;
+            sock->abort();
+            return;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _HTTP_CLIENT_H_
+#define _HTTP_CLIENT_H_
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QStringList>
+#include <QFile>
+
+class QTcpSocket;
+
+// A single connection to the HTTP server. The request is read as it arrives, and the response is written
+// as the socket's write buffer drains - so a slow client does not hold up any other client.
+class HttpClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Supplies the body of a response.
+    class Source
+    {
+    public:
+        enum {
+            Error = -1,
+            NotReady = -2
+        };
+
+        virtual ~Source() { }
+        // Point 'data' at the next block of data (at most maxLen bytes), and return its length. The data
+        // only needs to remain valid until the next call. Return 0 at the end of the data, Error on failure,
+        // or NotReady if the data is not available yet - in which case writeData() must be called once it is.
+        virtual qint64 next(const char *&data, qint64 maxLen)=0;
+    };
+
+    // Reads a (64-bit) range of a file, via memory-mapped windows where possible.
+    class FileSource : public Source
+    {
+    public:
+        FileSource(const QString &fileName);
+        virtual ~FileSource();
+
+        bool open();
+        qint64 size() const { return file.size(); }
+        void setRange(qint64 from, qint64 to);
+        qint64 next(const char *&data, qint64 maxLen);
+
+    private:
+        QFile file;
+        qint64 pos;
+        qint64 end;
+        uchar *map;
+        qint64 mapStart;
+        qint64 mapEnd;
+        QByteArray buffer;
+    };
+
+    HttpClient(QTcpSocket *s, QObject *p);
+    virtual ~HttpClient();
+
+    QTcpSocket * socket() const { return sock; }
+    const QList<QByteArray> & requestLine() const { return tokens; }
+    const QStringList & headers() const { return params; }
+
+    void sendError(int code);
+    void send(const QByteArray &header, Source *src);
+
+public Q_SLOTS:
+    void writeData();
+
+Q_SIGNALS:
+    void request();
+
+private Q_SLOTS:
+    void readRequest();
+
+private:
+    QTcpSocket *sock;
+    QByteArray buffer;
+    QList<QByteArray> tokens;
+    QStringList params;
+    bool requested;
+    Source *source;
+};
+
+#endif
@@ -24,19 +24,22 @@
 #include "config.h"
 #include "httpsocket.h"
 #include "httpserver.h"
+#include "httpclient.h"
 #include "gui/settings.h"
 #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
 #include "devices/cdparanoia.h"
+#include "devices/cddareader.h"
 #include "devices/extractjob.h"
 #endif
 #include <QTcpSocket>
 #include <QStringList>
-#include <QTextStream>
+#include <QBuffer>
 #include <QFile>
 #include <QUrl>
 #include <QNetworkProxy>
 #include <QUrlQuery>
 #include <QFileInfo>
+#include <QTimer>
 #include <QDebug>
 #define DBUG if (HttpServer::debugEnabled()) qWarning() << "HttpSocket" << __FUNCTION__
 
@@ -94,64 +97,28 @@ static QString detectMimeType(const QString &file)
     return QString();
 }
 
-static void writeMimeType(const QString &mimeType, QTcpSocket *socket, qint32 from, qint32 size, bool allowSeek)
+static QByteArray responseHeader(const QString &mimeType, qint64 from, qint64 to, qint64 size, bool allowSeek)
 {
-    if (!mimeType.isEmpty()) {
-        QTextStream os(socket);
-        os.setAutoDetectUnicode(true);
-        if (allowSeek) {
-            if (0==from) {
-                os << "HTTP/1.0 200 OK"
-                   << "\r\nAccept-Ranges: bytes"
-                   << "\r\nContent-Length: " << QString::number(size)
-                   << "\r\nContent-Type: " << mimeType << "\r\n\r\n";
-            } else {
-                os << "HTTP/1.0 200 OK"
-                   << "\r\nAccept-Ranges: bytes"
-                   << "\r\nContent-Range: bytes " << QString::number(from) << "-" << QString::number(size-1) << "/" << QString::number(size)
-                   << "\r\nContent-Length: " << QString::number(size-from)
-                   << "\r\nContent-Type: " << mimeType << "\r\n\r\n";
-            }
-            DBUG << mimeType << QString::number(size) << "Can seek";
+    QByteArray header;
+    if (allowSeek) {
+        if (0==from && to==size-1) {
+            header="HTTP/1.0 200 OK"
+                   "\r\nAccept-Ranges: bytes"
+                   "\r\nContent-Length: "+QByteArray::number(size);
         } else {
-            os << "HTTP/1.0 200 OK"
-               << "\r\nContent-Length: " << QString::number(size)
-               << "\r\nContent-Type: " << mimeType << "\r\n\r\n";
-            DBUG << mimeType << QString::number(size);
+            header="HTTP/1.0 206 Partial Content"
+                   "\r\nAccept-Ranges: bytes"
+                   "\r\nContent-Range: bytes "+QByteArray::number(from)+"-"+QByteArray::number(to)+"/"+QByteArray::number(size)+
+                   "\r\nContent-Length: "+QByteArray::number((to-from)+1);
         }
-    }
-}
-
-static int getSep(const QByteArray &a, int pos)
-{
-    for (int i=pos+1; i<a.length(); ++i) {
-        if ('\n'==a[i] || '\r'==a[i] || ' '==a[i]) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-static QList<QByteArray> split(const QByteArray &a)
-{
-    QList<QByteArray> rv;
-    int lastPos=-1;
-    for (;;) {
-        int pos=getSep(a, lastPos);
-
-        if (pos==(lastPos+1)) {
-            lastPos++;
-        } else if (pos>-1) {
-            lastPos++;
-            rv.append(a.mid(lastPos, pos-lastPos));
-            lastPos=pos;
-        } else {
-            lastPos++;
-            rv.append(a.mid(lastPos));
-            break;
-        }
-    }
-    return rv;
+        DBUG << mimeType << size << from << to << "Can seek";
+    } else {
+        header="HTTP/1.0 200 OK"
+               "\r\nContent-Length: "+QByteArray::number(size);
+        DBUG << mimeType << size;
+    }
+    return header+"\r\nContent-Type: "+(mimeType.isEmpty() ? QByteArray("application/octet-stream") : mimeType.toLatin1())+
+           "\r\nConnection: close\r\n\r\n";
 }
 
 static bool isFromMpd(const QStringList &params)
@@ -164,18 +131,25 @@ static bool isFromMpd(const QStringList &params)
     return false;
 }
 
-static void getRange(const QStringList &params, qint32 &from, qint32 &to)
+// Parse "Range: bytes=from-[to]", 'to' is left as -1 if not specified. For suffix ranges ("bytes=-N", i.e. the
+// last N bytes) 'from' is set to -1, and 'to' to N - checkRange() then converts this to the actual range.
+static void getRange(const QStringList &params, qint64 &from, qint64 &to)
 {
     for (const QString &str: params) {
-        if (str.startsWith("Range:")) {
+        if (str.startsWith("Range:", Qt::CaseInsensitive)) {
             int start=str.indexOf("bytes=");
             if (start>0) {
-                QStringList range=str.mid(start+6).split("-", QString::SkipEmptyParts);
-                if (1==range.length()) {
-                    from=range.at(0).toLong();
-                } else if (2==range.length()) {
-                    from=range.at(0).toLong();
-                    to=range.at(1).toLong();
+                QStringList range=str.mid(start+6).split("-");
+                if (range.length()>=2 && range.at(0).trimmed().isEmpty()) {
+                    from=-1;
+                    to=range.at(1).trimmed().toLongLong();
+                    break;
+                }
+                if (range.length()>=1) {
+                    from=range.at(0).trimmed().toLongLong();
+                }
+                if (range.length()>=2 && !range.at(1).trimmed().isEmpty()) {
+                    to=range.at(1).trimmed().toLongLong();
                 }
             }
             break;
@@ -183,10 +157,103 @@ static void getRange(const QStringList &params, qint32 &from, qint32 &to)
     }
 }
 
+// Check requested range against size of data, and set 'to' to the last byte if not specified.
+static bool checkRange(qint64 &from, qint64 &to, qint64 size)
+{
+    if (from<0) {
+        // Suffix range - last 'to' bytes, or the whole file if it is smaller than this (RFC 7233, 2.1)
+        if (to<=0 || 0==size) {
+            return false;
+        }
+        from=qMax((qint64)0, size-to);
+        to=size-1;
+        return true;
+    }
+    if (to<0 || to>=size) {
+        to=size-1;
+    }
+    return from>=0 && (0==size || from<size) && from<=to+1;
+}
+
+#if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+// AudioCD tracks are streamed as a WAV header followed by the track's sectors. Sectors are obtained from a
+// CddaReader, which reads ahead on its own thread.
+class CddaSource : public HttpClient::Source
+{
+public:
+    CddaSource(CddaReader *r, int first, int last, qint64 from, qint64 to)
+        : reader(r)
+        , id(-1)
+        , firstSector(first)
+        , lastSector(last)
+        , bufferedSector(-1)
+        , pos(from)
+        , end(to+1)
+    {
+        QBuffer buf(&header);
+        buf.open(QIODevice::WriteOnly);
+        ExtractJob::writeWavHeader(buf, ((lastSector-firstSector)+1)*CD_FRAMESIZE_RAW);
+        id=reader->addUser();
+    }
+
+    virtual ~CddaSource()
+    {
+        reader->removeUser(id);
+    }
+
+    qint64 next(const char *&data, qint64 maxLen)
+    {
+        if (pos>=end) {
+            return 0;
+        }
+
+        qint64 len=0;
+        if (pos<header.length()) {
+            len=qMin(qMin(maxLen, (qint64)header.length()-pos), end-pos);
+            data=header.constData()+pos;
+        } else {
+            // Map byte position to sector, and offset within that sector.
+            qint64 pcm=pos-header.length();
+            int sector=firstSector+(int)(pcm/CD_FRAMESIZE_RAW);
+            int offset=(int)(pcm%CD_FRAMESIZE_RAW);
+            if (sector!=bufferedSector) {
+                switch (reader->sector(id, sector, lastSector, buffer)) {
+                case CddaReader::Pending: return NotReady;
+                case CddaReader::Failed:  return Error;
+                case CddaReader::Read:    bufferedSector=sector; break;
+                }
+            }
+            len=qMin(qMin(maxLen, (qint64)(CD_FRAMESIZE_RAW-offset)), end-pos);
+            data=buffer+offset;
+        }
+        pos+=len;
+        return len;
+    }
+
+private:
+    CddaReader *reader;
+    int id;
+    int firstSector;
+    int lastSector;
+    int bufferedSector;
+    qint64 pos;
+    qint64 end;
+    QByteArray header;
+    char buffer[CD_FRAMESIZE_RAW];
+};
+
+// Readers are kept for a while after their last stream finishes, so that sectors already read can be re-used
+// if the stream is restarted. They are not kept for too long, as the disc may be changed.
+static const int constCddaReaderIdleTime=30000;
+#endif
+
 HttpSocket::HttpSocket(const QString &iface, quint16 port)
     : QTcpServer(0)
     , cfgInterface(iface)
     , terminated(false)
+    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+    , cddaTimer(0)
+    #endif
 {
     if (!openPort(port)) {
         openPort(0);
@@ -201,6 +268,17 @@ HttpSocket::HttpSocket(const QString &iface, quint16 port)
     connect(this, SIGNAL(newConnection()), SLOT(handleNewConnection()));
 }
 
+HttpSocket::~HttpSocket()
+{
+    // Delete clients before readers, as CD streams use these.
+    qDeleteAll(findChildren<HttpClient *>());
+    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+    for (CddaReader *reader: cddaReaders) {
+        reader->stop();
+    }
+    #endif
+}
+
 bool HttpSocket::openPort(quint16 p)
 {
     setProxy(QNetworkProxy::NoProxy);
@@ -242,196 +320,150 @@ void HttpSocket::handleNewConnection()
                           peer==QLatin1String("127.0.0.1") || peer==(constIpV6Prefix+QLatin1String("127.0.0.1"));
 
         DBUG << "peer:" << peer << "mpd:" << mpdAddr << "iface:" << ifaceAddress << "ok:" << hostOk;
+        HttpClient *client=new HttpClient(socket, this);
         if (!hostOk) {
-            sendErrorResponse(socket, 400);
-            socket->close();
             DBUG << "Not from valid host";
-            return;
+            client->sendError(400);
+            continue;
         }
 
-        connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
-        connect(socket, SIGNAL(disconnected()), this, SLOT(discardClient()));
+        connect(client, SIGNAL(request()), this, SLOT(handleRequest()));
     }
 }
 
-void HttpSocket::readClient()
+void HttpSocket::handleRequest()
 {
-    if (terminated) {
+    HttpClient *client=qobject_cast<HttpClient *>(sender());
+    if (!client || terminated) {
         return;
     }
 
-    QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
-    if (!socket) {
+    const QList<QByteArray> &tokens=client->requestLine();
+    if (tokens.length()<2 || "GET"!=tokens[0]) {
+        DBUG << "Bad Request";
+        client->sendError(400);
         return;
     }
 
-    if (socket->bytesAvailable() >= constMaxBuffer) {
-        // Request too large, reject
-        sendErrorResponse(socket, 400);
-        socket->close();
-        DBUG << "Request too large";
+    const QStringList &params=client->headers();
+    if (!isFromMpd(params)) {
+        DBUG << "Not from MPD";
+        client->sendError(400);
         return;
     }
 
-    if (socket->canReadLine()) {
-        QList<QByteArray> tokens = split(socket->readLine()); // QRegExp("[ \r\n][ \r\n]*"));
-        if (tokens.length()>=2 && "GET"==tokens[0]) {
-            QStringList params = QString(socket->readAll()).split(QRegExp("[\r\n][\r\n]*"));
+    QUrl url(QUrl::fromEncoded(tokens[1]));
+    QUrlQuery q(url);
+    qint64 readBytesFrom=0;
+    qint64 readBytesTo=-1;
+    getRange(params, readBytesFrom, readBytesTo);
 
-            DBUG << "params" << params << "tokens" << tokens;
-            if (!isFromMpd(params)) {
-                sendErrorResponse(socket, 400);
-                socket->close();
-                DBUG << "Not from MPD";
-                return;
-            }
+    DBUG << "readBytesFrom" << readBytesFrom << "readBytesTo" << readBytesTo;
+    if (!q.hasQueryItem("cantata")) {
+        client->sendError(404);
+        return;
+    }
 
-            QUrl url(QUrl::fromEncoded(tokens[1]));
-            QUrlQuery q(url);
-            bool ok=false;
-            qint32 readBytesFrom=0;
-            qint32 readBytesTo=0;
-            getRange(params, readBytesFrom, readBytesTo);
-
-            DBUG << "readBytesFrom" << readBytesFrom << "readBytesTo" << readBytesTo;
-            if (q.hasQueryItem("cantata")) {
-                Song song=HttpServer::self()->decodeUrl(url);
-
-                if (!isCantataStream(song.file)) {
-                    sendErrorResponse(socket, 400);
-                    socket->close();
-                    DBUG << "Not cantata stream file";
-                    return;
-                }
+    Song song=HttpServer::self()->decodeUrl(url);
+    if (!isCantataStream(song.file)) {
+        DBUG << "Not cantata stream file";
+        client->sendError(400);
+        return;
+    }
 
-                if (song.isCdda()) {
-                    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
-                    QStringList parts=song.file.split("/", QString::SkipEmptyParts);
-                    if (parts.length()>=3) {
-                        QString dev=QLatin1Char('/')+parts.at(1)+QLatin1Char('/')+parts.at(2);
-                        CdParanoia cdparanoia(dev, false, false, true);
-
-                        if (cdparanoia) {
-                            int firstSector = cdparanoia.firstSectorOfTrack(song.id);
-                            int lastSector = cdparanoia.lastSectorOfTrack(song.id);
-                            qint32 totalSize = ((lastSector-firstSector)+1)*CD_FRAMESIZE_RAW;
-                            int count = 0;
-                            bool writeHeader=0==readBytesFrom; // Only write header if we are not seeking...
-//                            int bytesToDiscard = 0; // Number of bytes to discard in first read sector due to range request in HTTP header
-//                            if (readBytesFrom>=ExtractJob::constWavHeaderSize) {
-//                                readBytesFrom-=ExtractJob::constWavHeaderSize;
-//                            }
-
-//                            if (readBytesFrom>0) {
-//                                int sectorsToSeek=readBytesFrom/CD_FRAMESIZE_RAW;
-//                                firstSector+=sectorsToSeek;
-//                                bytesToDiscard=readBytesFrom-(sectorsToSeek*CD_FRAMESIZE_RAW);
-//                            }
-                            cdparanoia.seek(firstSector, SEEK_SET);
-                            ok=true;
-                            writeMimeType(QLatin1String("audio/x-wav"), socket, readBytesFrom, totalSize+ExtractJob::constWavHeaderSize, false);
-                            if (writeHeader) {
-                                ExtractJob::writeWavHeader(*socket, totalSize);
-                            }
-                            bool stop=false;
-                            while (!terminated && (firstSector+count) <= lastSector && !stop) {
-                                qint16 *buf = cdparanoia.read();
-                                if (!buf) {
-                                    break;
-                                }
-                                char *buffer=(char *)buf;
-                                qint32 writePos=0;
-                                qint32 toWrite=CD_FRAMESIZE_RAW;
-
-//                                if (bytesToDiscard>0) {
-//                                    int toSkip=qMin(toWrite, bytesToDiscard);
-//                                    writePos=toSkip;
-//                                    toWrite-=toSkip;
-//                                    bytesToDiscard-=toSkip;
-//                                }
-
-                                if (toWrite>0 && !write(socket, &buffer[writePos], toWrite, stop)) {
-                                    break;
-                                }
-                                count++;
-                            }
-                        }
-                    }
-                    #endif
-                } else if (!song.file.isEmpty()) {
-                    #ifdef Q_OS_WIN
-                    if (tokens[1].startsWith("//") && !song.file.startsWith(QLatin1String("//")) && !QFile::exists(song.file)) {
-                        QString share=QLatin1String("//")+url.host()+song.file;
-                        if (QFile::exists(share)) {
-                            song.file=share;
-                            DBUG << "fixed share-path" << song.file;
-                        }
-                    }
-                    #endif
-
-                    QFile f(song.file);
-
-                    if (f.open(QIODevice::ReadOnly)) {
-                        qint32 totalBytes = f.size();
-
-                        writeMimeType(detectMimeType(song.file), socket, readBytesFrom, totalBytes, true);
-                        ok=true;
-                        qint32 readPos = 0;
-                        qint32 bytesRead = 0;
-
-                        if (0!=readBytesFrom) {
-                            if (!f.seek(readBytesFrom)) {
-                                ok=false;
-                            }
-                            bytesRead+=readBytesFrom;
-                        }
-
-                        if (0!=readBytesTo && readBytesTo>readBytesFrom && readBytesTo!=totalBytes) {
-                            totalBytes-=(totalBytes-readBytesTo);
-                        }
-
-                        if (ok) {
-                            static const int constChunkSize=32768;
-                            char buffer[constChunkSize];
-                            bool stop=false;
-                            do {
-                                bytesRead = f.read(buffer, constChunkSize);
-                                readPos+=bytesRead;
-                                if (!write(socket, buffer, bytesRead, stop) || f.atEnd()) {
-                                    break;
-                                }
-                            } while (readPos<totalBytes && !stop && !terminated);
-                        }
-                    } else {
-                        DBUG << "Failed to open" << song.file;
-                    }
+    if (song.isCdda()) {
+        #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+        QStringList parts=song.file.split("/", QString::SkipEmptyParts);
+        if (parts.length()>=3) {
+            QString dev=QLatin1Char('/')+parts.at(1)+QLatin1Char('/')+parts.at(2);
+            CddaReader *reader=cddaReader(dev);
+            int firstSector=0;
+            int lastSector=0;
+            if (reader && reader->trackSectors(song.id, firstSector, lastSector)) {
+                qint64 totalBytes=(((qint64)(lastSector-firstSector))+1)*CD_FRAMESIZE_RAW+ExtractJob::constWavHeaderSize;
+                if (!checkRange(readBytesFrom, readBytesTo, totalBytes)) {
+                    DBUG << "Invalid range" << readBytesFrom << readBytesTo << totalBytes;
+                    client->sendError(416);
+                    return;
                 }
+                connect(reader, SIGNAL(dataAvailable()), client, SLOT(writeData()));
+                client->send(responseHeader(QLatin1String("audio/x-wav"), readBytesFrom, readBytesTo, totalBytes, true),
+                             new CddaSource(reader, firstSector, lastSector, readBytesFrom, readBytesTo));
+                return;
             }
-
-            if (!ok) {
-                sendErrorResponse(socket, 404);
+        }
+        #endif
+    } else if (!song.file.isEmpty()) {
+        #ifdef Q_OS_WIN
+        if (tokens[1].startsWith("//") && !song.file.startsWith(QLatin1String("//")) && !QFile::exists(song.file)) {
+            QString share=QLatin1String("//")+url.host()+song.file;
+            if (QFile::exists(share)) {
+                song.file=share;
+                DBUG << "fixed share-path" << song.file;
             }
-
-            socket->close();
-
-            if (QTcpSocket::UnconnectedState==socket->state()) {
-                socket->deleteLater();
+        }
+        #endif
+
+        HttpClient::FileSource *src=new HttpClient::FileSource(song.file);
+        if (src->open()) {
+            qint64 totalBytes=src->size();
+            if (!checkRange(readBytesFrom, readBytesTo, totalBytes)) {
+                DBUG << "Invalid range" << readBytesFrom << readBytesTo << totalBytes;
+                delete src;
+                client->sendError(416);
+                return;
             }
-        } else {
-            // Bad Request
-            sendErrorResponse(socket, 400);
-            socket->close();
-            DBUG << "Bad Request";
+            src->setRange(readBytesFrom, readBytesTo);
+            client->send(responseHeader(detectMimeType(song.file), readBytesFrom, readBytesTo, totalBytes, true), src);
             return;
         }
+        DBUG << "Failed to open" << song.file;
+        delete src;
     }
+
+    client->sendError(404);
 }
 
-void HttpSocket::discardClient()
+#if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+CddaReader * HttpSocket::cddaReader(const QString &dev)
 {
-    static_cast<QTcpSocket *>(sender())->deleteLater();
+    CddaReader *reader=cddaReaders.value(dev);
+    if (!reader) {
+        reader=new CddaReader(dev);
+        if (!reader->isOk()) {
+            reader->stop();
+            return 0;
+        }
+        cddaReaders.insert(dev, reader);
+        if (!cddaTimer) {
+            cddaTimer=new QTimer(this);
+            connect(cddaTimer, SIGNAL(timeout()), this, SLOT(removeIdleCddaReaders()));
+        }
+        if (!cddaTimer->isActive()) {
+            cddaTimer->start(constCddaReaderIdleTime/2);
+        }
+    }
+    return reader;
 }
 
+void HttpSocket::removeIdleCddaReaders()
+{
+    QMap<QString, CddaReader *>::Iterator it=cddaReaders.begin();
+    while (it!=cddaReaders.end()) {
+        if (it.value()->isIdle(constCddaReaderIdleTime)) {
+            DBUG << "Remove reader for" << it.key();
+            it.value()->stop();
+            it=cddaReaders.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (cddaReaders.isEmpty()) {
+        cddaTimer->stop();
+    }
+}
+#endif
+
 void HttpSocket::mpdAddress(const QString &a)
 {
     mpdAddr=a;
@@ -443,15 +475,6 @@ bool HttpSocket::isCantataStream(const QString &file) const
     return newlyAddedFiles.contains(file) || streamIds.values().contains(file);
 }
 
-void HttpSocket::sendErrorResponse(QTcpSocket *socket, int code)
-{
-    QTextStream os(socket);
-    os.setAutoDetectUnicode(true);
-    os << "HTTP/1.0 " << code << " OK\r\n"
-          "Content-Type: text/html; charset=\"utf-8\"\r\n"
-          "\r\n";
-}
-
 void HttpSocket::cantataStreams(const QStringList &files)
 {
     DBUG << files;
@@ -489,29 +512,3 @@ void HttpSocket::removedIds(const QSet<qint32> &ids)
         streamIds.remove(id);
     }
 }
-
-bool HttpSocket::write(QTcpSocket *socket, char *buffer, qint32 bytesRead, bool &stop)
-{
-    if (bytesRead<0 || terminated) {
-        return false;
-    }
-
-    qint32 writePos=0;
-    do {
-        qint32 bytesWritten = socket->write(&buffer[writePos], bytesRead - writePos);
-        if (terminated || -1==bytesWritten) {
-            stop=true;
-            break;
-        }
-        socket->flush();
-        writePos+=bytesWritten;
-    } while (writePos<bytesRead);
-
-    if (QAbstractSocket::ConnectedState==socket->state()) {
-        socket->waitForBytesWritten();
-    }
-    if (QAbstractSocket::ConnectedState!=socket->state()) {
-        return false;
-    }
-    return true;
-}
@@ -28,10 +28,13 @@
 #include <QMap>
 #include <QList>
 #include <QSet>
+#include "config.h"
 
 struct Song;
 class QHostAddress;
 class QTcpSocket;
+class QTimer;
+class CddaReader;
 
 class HttpSocket : public QTcpServer
 {
@@ -39,7 +42,7 @@ class HttpSocket : public QTcpServer
 
 public:
     HttpSocket(const QString &iface, quint16 port);
-    virtual ~HttpSocket() { }
+    virtual ~HttpSocket();
 
     QString configuredInterface() { return cfgInterface; }
     quint16 boundPort();
@@ -51,19 +54,22 @@ public Q_SLOTS:
 private:
     bool openPort(quint16 p);
     bool isCantataStream(const QString &file) const;
-    void sendErrorResponse(QTcpSocket *socket, int code);
 
 private Q_SLOTS:
     void handleNewConnection();
-    void readClient();
-    void discardClient();
+    void handleRequest();
     void cantataStreams(const QStringList &files);
     void cantataStreams(const QList<Song> &songs, bool isUpdate);
     void removedIds(const QSet<qint32> &ids);
+    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+    void removeIdleCddaReaders();
+    #endif
 
 private:
-    bool write(QTcpSocket *socket, char *buffer, qint32 bytesRead, bool &stop);
     void setUrlAddress();
+    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+    CddaReader * cddaReader(const QString &dev);
+    #endif
 
 private:
     QSet<QString> newlyAddedFiles; // Holds cantata strema filenames as added to MPD via "add"
@@ -71,6 +77,10 @@ private:
     QString cfgInterface;
     QString mpdAddr;
     bool terminated;
+    #if defined CDDB_FOUND || defined MUSICBRAINZ5_FOUND
+    QMap<QString, CddaReader *> cddaReaders;
+    QTimer *cddaTimer;
+    #endif
 };
 
 #endif
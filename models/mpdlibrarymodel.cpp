@@ -28,6 +28,7 @@
 #include "gui/settings.h"
 #include "gui/covers.h"
 #include "roles.h"
+#include "support/thread.h"
 #include <QTimer>
 #include <QDebug>
 
@@ -38,12 +39,17 @@ MpdLibraryModel::MpdLibraryModel()
     : SqlLibraryModel(new MpdLibraryDb(0), 0)
     , showArtistImages(false)
 {
+    // Library updates are written to the DB in its own thread. Queries use separate (per thread) read-only
+    // connections, so do not block on these.
+    Thread *thread=new Thread("MpdLibraryDb");
+    db->moveToThread(thread);
+    thread->start();
     connect(Covers::self(), SIGNAL(cover(Song,QImage,QString)), this, SLOT(cover(Song,QImage,QString)));
     connect(Covers::self(), SIGNAL(coverUpdated(Song,QImage,QString)), this, SLOT(coverUpdated(Song,QImage,QString)));
     connect(Covers::self(), SIGNAL(artistImage(Song,QImage,QString)), this, SLOT(artistImage(Song,QImage,QString)));
     connect(Covers::self(), SIGNAL(composerImage(Song,QImage,QString)), this, SLOT(artistImage(Song,QImage,QString)));
     if (MPDConnection::self()->isConnected()) {
-        static_cast<MpdLibraryDb *>(db)->connectionChanged(MPDConnection::self()->getDetails());
+        QMetaObject::invokeMethod(db, "connectionChanged", Qt::QueuedConnection, Q_ARG(MPDConnectionDetails, MPDConnection::self()->getDetails()));
     }
 }
 
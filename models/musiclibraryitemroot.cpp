@@ -220,6 +220,8 @@ static const QString constMbAlbumIdAttribute=QLatin1String("mbalbumid");
 static const QString constFileAttribute=QLatin1String("file");
 static const QString constPlaylistAttribute=QLatin1String("playlist");
 static const QString constGuessedAttribute=QLatin1String("guessed");
+static const QString constSizeAttribute=QLatin1String("size");
+static const QString constModifiedAttribute=QLatin1String("modified");
 static const QString constVersionAttribute=QLatin1String("version");
 static const QString constnumTracksAttribute=QLatin1String("num");
 static const QString constTrueValue=QLatin1String("true");
@@ -319,6 +321,13 @@ void MusicLibraryItemRoot::toXML(QXmlStreamWriter &writer, MusicLibraryProgressM
                 if (song.guessed) {
                     writer.writeAttribute(constGuessedAttribute, constTrueValue);
                 }
+                // Used by device scans, to only re-read tags of changed files
+                if (song.size>0) {
+                    writer.writeAttribute(constSizeAttribute, QString::number(song.size));
+                }
+                if (song.lastModified) {
+                    writer.writeAttribute(constModifiedAttribute, QString::number(song.lastModified));
+                }
                 if (prog && !prog->wasStopped() && total>0) {
                     count++;
                     int pc=((count*100.0)/(total*1.0))+0.5;
@@ -452,11 +461,17 @@ bool MusicLibraryItemRoot::fromXML(QXmlStreamReader &reader, const QString &base
                     song.type=Song::Playlist;
                 }
                 if (attributes.hasAttribute(constYearAttribute)) {
-                    song.disc=attributes.value(constYearAttribute).toString().toUInt();
+                    song.year=attributes.value(constYearAttribute).toString().toUInt();
                 }
                 if (attributes.hasAttribute(constGuessedAttribute) && constTrueValue==attributes.value(constGuessedAttribute).toString()) {
                     song.guessed=true;
                 }
+                if (attributes.hasAttribute(constSizeAttribute)) {
+                    song.size=attributes.value(constSizeAttribute).toString().toInt();
+                }
+                if (attributes.hasAttribute(constModifiedAttribute)) {
+                    song.lastModified=attributes.value(constModifiedAttribute).toString().toUInt();
+                }
 
                 song.populateSorts();
                 MusicLibraryItemAlbum *albumItem=artist(song)->album(song);
@@ -59,6 +59,7 @@
 #include <QTimer>
 #include <QApplication>
 #include <QMenu>
+#include <algorithm>
 
 GLOBAL_STATIC(PlayQueueModel, instance)
 
@@ -785,6 +786,15 @@ qint32 PlayQueueModel::getSongId(const QString &file) const
 
 qint32 PlayQueueModel::getRowById(qint32 id) const
 {
+    QHash<qint32, qint32>::ConstIterator it=idRows.find(id);
+    if (it==idRows.constEnd()) {
+        return -1;
+    }
+    if (it.value()<songs.size() && songs.at(it.value()).id==id) {
+        return it.value();
+    }
+
+    // Index is only stale whilst update() is changing rows, so fallback to a scan...
     for (int i = 0; i < songs.size(); i++) {
         if (songs.at(i).id == id) {
             return i;
@@ -801,12 +811,7 @@ Song PlayQueueModel::getSongByRow(const qint32 row) const
 
 Song PlayQueueModel::getSongById(qint32 id) const
 {
-    for (const Song &s: songs) {
-        if (s.id==id) {
-            return s;
-        }
-    }
-    return Song();
+    return getSongByRow(getRowById(id));
 }
 
 void PlayQueueModel::updateCurrentSong(quint32 id)
@@ -841,7 +846,7 @@ void PlayQueueModel::clear()
 {
     beginResetModel();
     songs.clear();
-    ids.clear();
+    idRows.clear();
     currentSongId=-1;
     currentSongRowNum=0;
     stopAfterTrackId=-1;
@@ -890,15 +895,55 @@ void PlayQueueModel::update(const QList<Song> &songList, bool isComplete)
     }
 
     // If we have too many changes UI can hang, so it is sometimes better just to do a complete reset!
-    if (isComplete && (songs.count()>MPDConnection::constMaxPqChanges
-                       || !MPDConnection::self()->isPlayQueueIdValid())) {
+    if (isComplete && !MPDConnection::self()->isPlayQueueIdValid()) {
         songs.clear();
     }
 
+    // Rows of songs that are no longer in the play queue
+    QList<qint32> removedRows;
+    if (!songs.isEmpty() && !songList.isEmpty()) {
+        for (QHash<qint32, qint32>::ConstIterator it=idRows.constBegin(); it!=idRows.constEnd(); ++it) {
+            if (!newIds.contains(it.key())) {
+                removedRows.append(it.value());
+            }
+        }
+        std::sort(removedRows.begin(), removedRows.end());
+
+        // Estimate how many remove/insert/move operations the update will require. Each block of removed
+        // songs, each new block of songs, and each existing song that is now before its predecessor, will
+        // (most likely) need its own operation.
+        int ops=0;
+        for (int i=0; i<removedRows.count(); ++i) {
+            if (0==i || removedRows.at(i-1)!=removedRows.at(i)-1) {
+                ops++;
+            }
+        }
+        int prevRow=-1;
+        bool prevNew=false;
+        for (const Song &s: songList) {
+            int row=idRows.value(s.id, -1);
+            if (-1==row) {
+                if (!prevNew) {
+                    ops++;
+                }
+                prevNew=true;
+            } else {
+                if (row<prevRow) {
+                    ops++;
+                }
+                prevRow=row;
+                prevNew=false;
+            }
+        }
+        if (ops>MPDConnection::constMaxPqChanges) {
+            songs.clear();
+        }
+    }
+
     if (songs.isEmpty() || songList.isEmpty()) {
         beginResetModel();
         songs=songList;
-        ids=newIds;
+        updateIdRows();
         endResetModel();
         if (songList.isEmpty()) {
             stopAfterTrackId=-1;
@@ -906,42 +951,65 @@ void PlayQueueModel::update(const QList<Song> &songList, bool isComplete)
     } else {
         time = 0;
 
-        QSet<qint32> removed=ids-newIds;
-        for (qint32 id: removed) {
-            qint32 row=getRowById(id);
-            if (row!=-1) {
-                beginRemoveRows(QModelIndex(), row, row);
-                songs.removeAt(row);
-                endRemoveRows();
+        // Remove songs that are no longer in the play queue - as contiguous blocks, starting from the end. Rows
+        // are re-indexed once all blocks have been removed, rather than after each block.
+        for (int row: removedRows) {
+            idRows.remove(songs.at(row).id);
+        }
+        for (int last=removedRows.count()-1; last>=0; ) {
+            int first=last;
+            while (first>0 && removedRows.at(first-1)==removedRows.at(first)-1) {
+                --first;
             }
+            beginRemoveRows(QModelIndex(), removedRows.at(first), removedRows.at(last));
+            songs.erase(songs.begin()+removedRows.at(first), songs.begin()+removedRows.at(last)+1);
+            endRemoveRows();
+            last=first-1;
+        }
+        if (!removedRows.isEmpty()) {
+            updateIdRows(removedRows.first());
         }
+
+        // Songs before row 'i' now match songList. Where they differ, either insert the block of new songs
+        // or move up the block of existing songs that are in the same order in songList.
         for (qint32 i=0; i<songList.count(); ++i) {
-            Song s=songList.at(i);
-            bool newSong=i>=songs.count();
-            Song currentSongAtPos=newSong ? Song() : songs.at(i);
-            bool isEmpty=s.isEmpty();
-
-            if (newSong || s.id!=currentSongAtPos.id) {
-                qint32 existingPos=newSong ? -1 : getRowById(s.id);
-                if (-1==existingPos) {
-                    beginInsertRows(QModelIndex(), i, i);
-                    songs.insert(i, s);
+            if (i>=songs.count() || songList.at(i).id!=songs.at(i).id) {
+                int existingRow=idRows.value(songList.at(i).id, -1);
+                if (-1==existingRow) {
+                    int count=1;
+                    while (i+count<songList.count() && !idRows.contains(songList.at(i+count).id)) {
+                        ++count;
+                    }
+                    int prevCount=songs.count();
+                    beginInsertRows(QModelIndex(), i, i+count-1);
+                    songs+=songList.mid(i, count);
+                    std::rotate(songs.begin()+i, songs.begin()+prevCount, songs.end());
+                    updateIdRows(i);
                     endInsertRows();
                 } else {
-                    beginMoveRows(QModelIndex(), existingPos, existingPos, QModelIndex(), i>existingPos ? i+1 : i);
-                    Song old=songs.takeAt(existingPos);
-//                     old.pos=s.pos;
-                    s.rating=old.rating;
-                    songs.insert(i, isEmpty ? old : s);
+                    // Rows before 'i' are already in place, so existingRow must be after 'i'
+                    int count=1;
+                    while (i+count<songList.count() && existingRow+count<songs.count() &&
+                           songs.at(existingRow+count).id==songList.at(i+count).id) {
+                        ++count;
+                    }
+                    beginMoveRows(QModelIndex(), existingRow, existingRow+count-1, QModelIndex(), i);
+                    std::rotate(songs.begin()+i, songs.begin()+existingRow, songs.begin()+existingRow+count);
+                    updateIdRows(i, existingRow+count-1);
                     endMoveRows();
                 }
-            } else if (isEmpty) {
+            }
+
+            Song s=songList.at(i);
+            const Song &currentSongAtPos=songs.at(i);
+            if (s.isEmpty()) {
                 s=currentSongAtPos;
             } else {
                 s.key=currentSongAtPos.key;
                 s.rating=currentSongAtPos.rating;
+                bool changed=s.title!=currentSongAtPos.title || s.artist!=currentSongAtPos.artist || s.name()!=currentSongAtPos.name();
                 songs.replace(i, s);
-                if (s.title!=currentSongAtPos.title || s.artist!=currentSongAtPos.artist || s.name()!=currentSongAtPos.name()) {
+                if (changed) {
                     emit dataChanged(index(i, 0), index(i, columnCount(QModelIndex())-1));
                 }
             }
@@ -953,16 +1021,15 @@ void PlayQueueModel::update(const QList<Song> &songList, bool isComplete)
         }
 
         if (songs.count()>songList.count()) {
-            int toBeRemoved=songs.count()-songList.count();
             beginRemoveRows(QModelIndex(), songList.count(), songs.count()-1);
-            for (int i=0; i<toBeRemoved; ++i) {
-                songs.takeLast();
+            for (int i=songList.count(); i<songs.count(); ++i) {
+                idRows.remove(songs.at(i).id);
             }
+            songs.erase(songs.begin()+songList.count(), songs.end());
             endRemoveRows();
         }
 
-        ids=newIds;
-        if (-1!=stopAfterTrackId && !ids.contains(stopAfterTrackId)) {
+        if (-1!=stopAfterTrackId && !idRows.contains(stopAfterTrackId)) {
             stopAfterTrackId=-1;
         }
         emit statsUpdated(songs.size(), time);
@@ -973,6 +1040,21 @@ void PlayQueueModel::update(const QList<Song> &songList, bool isComplete)
     sortAction->setEnabled(songs.count()>1);
 }
 
+// Re-index rows from..to (inclusive, -1 for end of list). Called whenever rows are shifted.
+void PlayQueueModel::updateIdRows(int from, int to)
+{
+    if (0==from && -1==to) {
+        idRows.clear();
+        idRows.reserve(songs.count());
+    }
+    if (-1==to || to>=songs.count()) {
+        to=songs.count()-1;
+    }
+    for (int i=from; i<=to; ++i) {
+        idRows.insert(songs.at(i).id, i);
+    }
+}
+
 void PlayQueueModel::setStopAfterTrack(qint32 track)
 {
     bool clear=track==stopAfterTrackId || (track==currentSongId && stopAfterCurrent);
@@ -1308,14 +1390,23 @@ void PlayQueueModel::ratingResult(const QString &file, quint8 r)
 
 void PlayQueueModel::stickerDbChanged()
 {
-    // Sticker DB changed, need to re-request ratings...
-    QSet<QString> requests;
+    // Sticker DB changed, so reset ratings. These will then be re-requested (from MPDConnection's rating
+    // cache) as rows are shown, rather than requesting the rating of every song now.
+    bool changed=false;
     for (const Song &song: songs) {
-        if (Song::Standard==song.type && song.rating<=Song::Rating_Max && !requests.contains(song.file)) {
-            emit getRating(song.file);
-            requests.insert(song.file);
+        if (Song::Standard==song.type && song.rating<=Song::Rating_Max) {
+            song.rating=Song::Rating_Null;
+            changed=true;
         }
     }
+    if (changed) {
+        emit dataChanged(index(0, 0), index(songs.count()-1, columnCount(QModelIndex())-1));
+    }
+    qint32 row=currentSongRow();
+    if (row>=0 && row<songs.count() && Song::Rating_Null==songs.at(row).rating) {
+        songs.at(row).rating=Song::Rating_Requested;
+        emit getRating(songs.at(row).file);
+    }
 }
 
 void PlayQueueModel::undo()
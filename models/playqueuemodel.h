@@ -34,6 +34,7 @@
 #include <QAbstractItemModel>
 #include <QList>
 #include <QSet>
+#include <QHash>
 #include <QStack>
 #include <QMap>
 
@@ -134,6 +135,7 @@ public:
 
 private:
     void saveHistory(const QList<Song> &prevList);
+    void updateIdRows(int from=0, int to=-1);
     void controlActions();
     void addSortAction(const QString &name, const QString &key);
 
@@ -180,7 +182,7 @@ Q_SIGNALS:
 
 private:
     QList<Song> songs;
-    QSet<qint32> ids;
+    QHash<qint32, qint32> idRows; // Song ID -> row in songs
     qint32 currentSongId;
     mutable qint32 currentSongRowNum;
     quint32 time;
@@ -28,6 +28,8 @@
 #include "support/configuration.h"
 #include "roles.h"
 #include <QMimeData>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 static QString parentData(const SqlLibraryModel::Item *i)
 {
@@ -74,6 +76,7 @@ SqlLibraryModel::SqlLibraryModel(LibraryDb *d, QObject *p, Type top)
     , db(d)
     , librarySort(LibraryDb::AS_YrAlAr)
     , albumSort(LibraryDb::AS_AlArYr)
+    , generation(0)
 {
     connect(db, SIGNAL(libraryUpdated()), SLOT(libraryUpdated()));
     connect(db, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
@@ -82,6 +85,8 @@ SqlLibraryModel::SqlLibraryModel(LibraryDb *d, QObject *p, Type top)
 void SqlLibraryModel::clear()
 {
     beginResetModel();
+    generation++;
+    fetching.clear();
     delete root;
     root=0;
     endResetModel();
@@ -89,7 +94,8 @@ void SqlLibraryModel::clear()
 
 void SqlLibraryModel::clearDb()
 {
-    db->clear();
+    // DB may be living in another thread, so call via the event loop
+    QMetaObject::invokeMethod(db, "clear", Qt::QueuedConnection);
 }
 
 void SqlLibraryModel::settings(Type top, LibraryDb::AlbumSort lib, LibraryDb::AlbumSort al)
@@ -152,6 +158,8 @@ void SqlLibraryModel::save(Configuration &config)
 void SqlLibraryModel::libraryUpdated()
 {
     beginResetModel();
+    generation++;
+    fetching.clear();
     delete root;
     root=new CollectionItem(T_Root, QString());
     switch (tl) {
@@ -256,6 +264,32 @@ bool SqlLibraryModel::hasChildren(const QModelIndex &index) const
 }
 
 bool SqlLibraryModel::canFetchMore(const QModelIndex &index) const
+{
+    return needFetch(index) && !fetching.contains(toItem(index));
+}
+
+void SqlLibraryModel::fetchMore(const QModelIndex &index)
+{
+    fetch(index, true);
+}
+
+// Details of a fetch of an item's children - this is passed to, and filled in by, a thread from the query pool
+struct SqlLibraryModel::Fetch
+{
+    Fetch() : item(0), generation(0), type(T_Root), sort(LibraryDb::AS_YrAlAr) { }
+    CollectionItem *item;
+    int generation;
+    Type type;
+    QString artistId;
+    QString albumId;
+    QString genre;
+    LibraryDb::AlbumSort sort;
+    QList<LibraryDb::Artist> artists;
+    QList<LibraryDb::Album> albums;
+    QList<Song> songs;
+};
+
+bool SqlLibraryModel::needFetch(const QModelIndex &index) const
 {
     if (index.isValid()) {
         Item *item = toItem(index);
@@ -265,54 +299,124 @@ bool SqlLibraryModel::canFetchMore(const QModelIndex &index) const
     }
 }
 
-void SqlLibraryModel::fetchMore(const QModelIndex &index)
+void SqlLibraryModel::fetch(const QModelIndex &index, bool async)
 {
-    if (!index.isValid()) {
+    if (!needFetch(index)) {
         return;
     }
 
     CollectionItem *item = static_cast<CollectionItem *>(toItem(index));
+    Fetch f;
+    f.item=item;
+    f.generation=generation;
+    f.type=item->getType();
     switch (item->getType()) {
-    case T_Root:
+    case T_Genre:
+        f.genre=item->getId();
         break;
-    case T_Genre: {
-        QList<LibraryDb::Artist> artists=db->getArtists(item->getId());
-        if (!artists.isEmpty())  {
-            beginInsertRows(index, 0, artists.count()-1);
-            for (const LibraryDb::Artist &artist: artists) {
+    case T_Artist:
+        f.artistId=item->getId();
+        f.genre=T_Genre==tl ? item->getParent()->getId() : QString();
+        f.sort=librarySort;
+        break;
+    case T_Album:
+        f.albumId=item->getId();
+        if (T_Album==tl) {
+            f.artistId=static_cast<AlbumItem *>(item)->getArtistId();
+            f.sort=albumSort;
+        } else {
+            f.artistId=item->getParent()->getId();
+            f.genre=T_Genre==tl ? item->getParent()->getParent()->getId() : QString();
+            f.sort=librarySort;
+        }
+        break;
+    default:
+        return;
+    }
+
+    if (async) {
+        if (!fetching.contains(item)) {
+            fetching.insert(item);
+            QFutureWatcher<Fetch> *watcher=new QFutureWatcher<Fetch>(this);
+            connect(watcher, SIGNAL(finished()), this, SLOT(fetched()));
+            watcher->setFuture(QtConcurrent::run(LibraryDb::queryPool(), &SqlLibraryModel::doFetch, db, f));
+        }
+    } else {
+        addFetched(doFetch(db, f));
+    }
+}
+
+SqlLibraryModel::Fetch SqlLibraryModel::doFetch(LibraryDb *db, Fetch f)
+{
+    switch (f.type) {
+    case T_Genre:
+        f.artists=db->getArtists(f.genre);
+        break;
+    case T_Artist:
+        f.albums=db->getAlbums(f.artistId, f.genre, f.sort);
+        break;
+    case T_Album:
+        f.songs=db->getTracks(f.artistId, f.albumId, f.genre, f.sort);
+        break;
+    default:
+        break;
+    }
+    return f;
+}
+
+void SqlLibraryModel::fetched()
+{
+    QFutureWatcher<Fetch> *watcher=static_cast<QFutureWatcher<Fetch> *>(sender());
+    if (!watcher) {
+        return;
+    }
+    addFetched(watcher->result());
+    watcher->deleteLater();
+}
+
+void SqlLibraryModel::addFetched(const Fetch &f)
+{
+    // Ignore results for items that have since been deleted (model was reset), or which were populated
+    // synchronously whilst this fetch was running.
+    if (f.generation!=generation) {
+        return;
+    }
+    fetching.remove(f.item);
+    if (0!=f.item->getChildCount()) {
+        return;
+    }
+
+    CollectionItem *item=f.item;
+    QModelIndex index=createIndex(item->getRow(), 0, item);
+    switch (f.type) {
+    case T_Genre:
+        if (!f.artists.isEmpty())  {
+            beginInsertRows(index, 0, f.artists.count()-1);
+            for (const LibraryDb::Artist &artist: f.artists) {
                 item->add(new CollectionItem(T_Artist, artist.name, artist.name, tr("%n Album(s)", "", artist.albumCount), item));
             }
             endInsertRows();
         }
         break;
-    }
-    case T_Artist: {
-        QList<LibraryDb::Album> albums=db->getAlbums(item->getId(), T_Genre==tl ? item->getParent()->getId() : QString(), librarySort);
-        if (!albums.isEmpty())  {
-            beginInsertRows(index, 0, albums.count()-1);
-            for (const LibraryDb::Album &album: albums) {
+    case T_Artist:
+        if (!f.albums.isEmpty())  {
+            beginInsertRows(index, 0, f.albums.count()-1);
+            for (const LibraryDb::Album &album: f.albums) {
                 item->add(new CollectionItem(T_Album, album.id, Song::displayAlbum(album.name, album.year),
                                              tr("%n Tracks (%1)", "", album.trackCount).arg(Utils::formatTime(album.duration, true)), item));
             }
             endInsertRows();
         }
         break;
-    }
-    case T_Album: {
-        QList<Song> songs=T_Album==tl
-                            ? db->getTracks(static_cast<AlbumItem *>(item)->getArtistId(), item->getId(), QString(), albumSort)
-                            : db->getTracks(item->getParent()->getId(), item->getId(),
-                                            T_Genre==tl ? item->getParent()->getParent()->getId() : QString(), librarySort);
-
-        if (!songs.isEmpty())  {
-            beginInsertRows(index, 0, songs.count()-1);
-            for (const Song &song: songs) {
+    case T_Album:
+        if (!f.songs.isEmpty())  {
+            beginInsertRows(index, 0, f.songs.count()-1);
+            for (const Song &song: f.songs) {
                 item->add(new TrackItem(song, item));
             }
             endInsertRows();
         }
         break;
-    }
     default:
         break;
     }
@@ -435,9 +539,7 @@ QModelIndex SqlLibraryModel::findSongIndex(const Song &song)
     if (root) {
         QModelIndex albumIndex=findAlbumIndex(song.artistOrComposer(), song.albumId());
         if (albumIndex.isValid()) {
-            if (canFetchMore(albumIndex)) {
-                fetchMore(albumIndex);
-            }
+            fetch(albumIndex, false);
             CollectionItem *al=static_cast<CollectionItem *>(albumIndex.internalPointer());
             for (Item *t: al->getChildren()) {
                 if (static_cast<TrackItem *>(t)->getSong().title==song.title) {
@@ -471,9 +573,7 @@ QModelIndex SqlLibraryModel::findAlbumIndex(const QString &artist, const QString
         } else {
             QModelIndex artistIndex=findArtistIndex(artist);
             if (artistIndex.isValid()) {
-                if (canFetchMore(artistIndex)) {
-                    fetchMore(artistIndex);
-                }
+                fetch(artistIndex, false);
                 CollectionItem *ar=static_cast<CollectionItem *>(artistIndex.internalPointer());
                 for (Item *al: ar->getChildren()) {
                     if (al->getId()==album) {
@@ -492,9 +592,7 @@ QModelIndex SqlLibraryModel::findArtistIndex(const QString &artist)
         if (T_Genre==tl) {
             for (Item *g: root->getChildren()) {
                 QModelIndex gIndex=index(g->getRow(), 0, QModelIndex());
-                if (canFetchMore(gIndex)) {
-                    fetchMore(gIndex);
-                }
+                fetch(gIndex, false);
                 for (Item *a: static_cast<CollectionItem *>(g)->getChildren()) {
                     if (a->getId()==artist) {
                         return index(a->getRow(), 0, gIndex);
@@ -555,9 +653,7 @@ int SqlLibraryModel::trackCount() const
 void SqlLibraryModel::populate(const QModelIndexList &list) const
 {
     for (const QModelIndex &idx: list) {
-        if (canFetchMore(idx)) {
-            const_cast<SqlLibraryModel *>(this)->fetchMore(idx);
-        }
+        const_cast<SqlLibraryModel *>(this)->fetch(idx, false);
         if (T_Track!=static_cast<Item *>(idx.internalPointer())->getType()) {
             populate(children(idx));
         }
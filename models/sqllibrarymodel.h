@@ -29,6 +29,7 @@
 #include "support/utils.h"
 #include "db/librarydb.h"
 #include <QMap>
+#include <QSet>
 
 class Configuration;
 
@@ -160,6 +161,7 @@ public:
     QList<Song> getAlbumTracks(const QString &artistId, const QString &albumId) const;
     QList<Song> getAlbumTracks(const Song &song) const { return getAlbumTracks(song.artistOrComposer(), song.albumId()); }
     QList<Song> songs(const QStringList &files, bool allowPlaylists=false) const;
+    QList<Song> songs(const QString &where, const QVariantList &values) const { return db->songs(where, values); }
     QList<LibraryDb::Album> getArtistAlbums(const QString &artist) const;
     void getDetails(QSet<QString> &artists, QSet<QString> &albumArtists, QSet<QString> &composers, QSet<QString> &albums, QSet<QString> &genres);
     bool songExists(const Song &song);
@@ -175,7 +177,15 @@ public Q_SLOTS:
 protected Q_SLOTS:
     void libraryUpdated();
 
+private Q_SLOTS:
+    void fetched();
+
 private:
+    struct Fetch;
+    bool needFetch(const QModelIndex &index) const;
+    void fetch(const QModelIndex &index, bool async);
+    static Fetch doFetch(LibraryDb *db, Fetch f);
+    void addFetched(const Fetch &f);
     void populate(const QModelIndexList &list) const;
     QModelIndexList children(const QModelIndex &parent) const;
     QList<Song> songs(const QModelIndex &idx, bool allowPlaylists) const;
@@ -188,6 +198,8 @@ protected:
     LibraryDb *db;
     LibraryDb::AlbumSort librarySort;
     LibraryDb::AlbumSort albumSort;
+    int generation;
+    QSet<Item *> fetching;
 };
 
 #endif
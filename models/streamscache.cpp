@@ -0,0 +1,226 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "streamscache.h"
+#include <QFile>
+#include <QDataStream>
+
+// File layout:
+//   Header - magic, version, and the positions of the top-level list and of the names.
+//   Lists  - one per category, each compressed separately. Categories store the position of their list
+//            of children (which is written before the category's own list), and the number of children.
+//   Names  - the names of the items within each list (other than the top-level one), compressed
+//            together, so that sub-categories may be filtered before their children are read.
+// The header is written last, so an incomplete file is never read.
+static const quint32 constMagic=0x43535443; // "CSTC"
+static const quint32 constVersion=3;
+static const qint64 constHeaderSize=24;
+
+static const quint8 constCategory=0x01;
+static const quint8 constIsAll=0x02;
+
+static qint64 writeList(QFile &file, const QList<StreamsModel::Item *> &items, StreamsModel::CachedNames &names)
+{
+    QByteArray data;
+    QDataStream str(&data, QIODevice::WriteOnly);
+    str.setVersion(QDataStream::Qt_5_0);
+    QList<const StreamsModel::Item *> toWrite;
+    for (const StreamsModel::Item *i: items) {
+        if (!i->isCategory() || !static_cast<const StreamsModel::CategoryItem *>(i)->isBookmarks) {
+            toWrite.append(i);
+        }
+    }
+
+    QList<QPair<QString, qint64> > listNames;
+    str << (quint32)toWrite.count();
+    for (const StreamsModel::Item *i: toWrite) {
+        if (i->isCategory()) {
+            const StreamsModel::CategoryItem *cat=static_cast<const StreamsModel::CategoryItem *>(i);
+            qint64 pos=cat->children.isEmpty() ? 0 : writeList(file, cat->children, names);
+            if (pos<0) {
+                return -1;
+            }
+            str << (quint8)(constCategory|(cat->isAll ? constIsAll : 0)) << cat->name << cat->url << pos << (quint32)cat->children.count();
+            listNames.append(QPair<QString, qint64>(cat->name, pos));
+        } else {
+            str << (quint8)0 << i->name << i->url;
+            listNames.append(QPair<QString, qint64>(i->name, 0));
+        }
+    }
+
+    qint64 pos=file.pos();
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << qCompress(data);
+    names.insert(pos, listNames);
+    return QDataStream::Ok==out.status() ? pos : -1;
+}
+
+static bool readHeader(QFile &file, qint64 &pos, qint64 &namesPos)
+{
+    QDataStream str(&file);
+    str.setVersion(QDataStream::Qt_5_0);
+    quint32 magic=0;
+    quint32 version=0;
+    str >> magic >> version >> pos >> namesPos;
+    return QDataStream::Ok==str.status() && constMagic==magic && constVersion==version;
+}
+
+static QByteArray readCompressed(QFile &file, qint64 pos)
+{
+    if (pos<constHeaderSize || pos>=file.size() || !file.seek(pos)) {
+        return QByteArray();
+    }
+
+    QByteArray compressed;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    in >> compressed;
+    return QDataStream::Ok==in.status() ? qUncompress(compressed) : QByteArray();
+}
+
+static QList<StreamsModel::Item *> readList(QFile &file, qint64 pos, StreamsModel::CategoryItem *parent)
+{
+    QList<StreamsModel::Item *> items;
+    QByteArray data=readCompressed(file, pos);
+    if (data.isEmpty()) {
+        return items;
+    }
+
+    QDataStream str(data);
+    str.setVersion(QDataStream::Qt_5_0);
+    quint32 count=0;
+    str >> count;
+    for (quint32 i=0; i<count && QDataStream::Ok==str.status(); ++i) {
+        quint8 flags=0;
+        QString name;
+        QString url;
+        str >> flags >> name >> url;
+        if (flags&constCategory) {
+            qint64 childPos=0;
+            quint32 childCount=0;
+            str >> childPos >> childCount;
+            StreamsModel::CategoryItem *cat=new StreamsModel::CategoryItem(url, name, parent);
+            cat->isAll=flags&constIsAll;
+            if (childPos>0 && childCount>0) {
+                // Children are read when expanded
+                cat->cacheOffset=childPos;
+                cat->cacheCount=childCount;
+            } else {
+                cat->state=StreamsModel::CategoryItem::Fetched;
+            }
+            items.append(cat);
+        } else {
+            items.append(new StreamsModel::Item(url, name, parent));
+        }
+    }
+
+    if (QDataStream::Ok!=str.status()) {
+        qDeleteAll(items);
+        items.clear();
+    }
+    return items;
+}
+
+QList<StreamsModel::Item *> StreamsCache::load(const QString &fileName, StreamsModel::CategoryItem *parent, qint64 offset)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QList<StreamsModel::Item *>();
+    }
+
+    qint64 pos=0;
+    qint64 namesPos=0;
+    if (!readHeader(file, pos, namesPos)) {
+        return QList<StreamsModel::Item *>();
+    }
+    return readList(file, offset>0 ? offset : pos, parent);
+}
+
+StreamsModel::CachedNames StreamsCache::loadNames(const QString &fileName)
+{
+    StreamsModel::CachedNames names;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return names;
+    }
+
+    qint64 pos=0;
+    qint64 namesPos=0;
+    if (!readHeader(file, pos, namesPos)) {
+        return names;
+    }
+    QByteArray data=readCompressed(file, namesPos);
+    if (data.isEmpty()) {
+        return names;
+    }
+
+    QDataStream str(data);
+    str.setVersion(QDataStream::Qt_5_0);
+    str >> names;
+    if (QDataStream::Ok!=str.status()) {
+        names.clear();
+    }
+    return names;
+}
+
+bool StreamsCache::save(const QString &fileName, const QList<StreamsModel::Item *> &items)
+{
+    if (items.isEmpty()) {
+        // No items, so remove cache...
+        return !QFile::exists(fileName) || QFile::remove(fileName);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream str(&file);
+    str.setVersion(QDataStream::Qt_5_0);
+    // Write header without the positions, so that the file is invalid until complete
+    str << constMagic << constVersion << (qint64)0 << (qint64)0;
+    StreamsModel::CachedNames names;
+    qint64 pos=QDataStream::Ok==str.status() ? writeList(file, items, names) : -1;
+    qint64 namesPos=-1;
+    if (pos>0) {
+        // The top-level list is always read, so its names are not required
+        names.remove(pos);
+        QByteArray data;
+        QDataStream nameStr(&data, QIODevice::WriteOnly);
+        nameStr.setVersion(QDataStream::Qt_5_0);
+        nameStr << names;
+        namesPos=file.pos();
+        str << qCompress(data);
+    }
+    if (namesPos>0 && QDataStream::Ok==str.status() && file.seek(2*sizeof(quint32))) {
+        str << pos << namesPos;
+        if (QDataStream::Ok==str.status() && file.flush()) {
+            return true;
+        }
+    }
+    file.close();
+    QFile::remove(fileName);
+    return false;
+}
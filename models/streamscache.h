@@ -0,0 +1,44 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef STREAMS_CACHE_H
+#define STREAMS_CACHE_H
+
+#include "streamsmodel.h"
+#include <QString>
+#include <QList>
+
+// Binary cache of a category's streams. The children of each sub-category are stored, and compressed,
+// separately - so that these only need to be read when the sub-category is expanded.
+class StreamsCache
+{
+public:
+    // Load the items stored at 'offset', or the top-level items if this is 0.
+    static QList<StreamsModel::Item *> load(const QString &fileName, StreamsModel::CategoryItem *parent, qint64 offset=0);
+    // Load the names of the items within all lists, other than the top-level one, so that these can be filtered.
+    static StreamsModel::CachedNames loadNames(const QString &fileName);
+    static bool save(const QString &fileName, const QList<StreamsModel::Item *> &items);
+};
+
+#endif
@@ -22,6 +22,8 @@
  */
 
 #include "streamsmodel.h"
+#include "streamsparser.h"
+#include "streamscache.h"
 #include "mpd-interface/mpdconnection.h"
 #include "mpd-interface/mpdparseutils.h"
 #include "widgets/icons.h"
@@ -53,6 +55,7 @@
 #include <QUrl>
 #include <QUrlQuery>
 #include <QJsonDocument>
+#include <QScopedPointer>
 #if defined Q_OS_WIN
 #include <QCoreApplication>
 #endif
@@ -63,7 +66,7 @@
 GLOBAL_STATIC(StreamsModel, instance)
 
 const QString StreamsModel::constSubDir=QLatin1String("streams");
-const QString StreamsModel::constCacheExt=QLatin1String(".xml.gz");
+const QString StreamsModel::constCacheExt=QLatin1String(".cache");
 
 const QString StreamsModel::constShoutCastApiKey=QLatin1String("fa1669MuiRPorUBw");
 const QString StreamsModel::constShoutCastHost=QLatin1String("api.shoutcast.com");
@@ -78,6 +81,9 @@ const QString StreamsModel::constPngIcon=QLatin1String("icon.png");
 const QString StreamsModel::constSvgIcon=QLatin1String("icon.svg");
 
 static const char * constOrigUrlProperty = "orig-url";
+static const QLatin1String constXmlCacheExt(".xml.gz"); // Older caches, removed when found
+static const QLatin1String constBookmarksExt(".xml.gz");
+static const int constInsertChunk=500;
 
 static QString constRadioTimeHost=QLatin1String("opml.radiotime.com");
 static QString constRadioTimeUrl=QLatin1String("http://")+constRadioTimeHost+QLatin1String("/Browse.ashx");
@@ -119,9 +125,17 @@ static QString categoryCacheName(const QString &name, bool createDir=false)
     return Utils::cacheDir(StreamsModel::constSubDir, createDir)+name+StreamsModel::constCacheExt;
 }
 
+static void removeXmlCache(const QString &name)
+{
+    QString cache=Utils::cacheDir(StreamsModel::constSubDir, false)+name+constXmlCacheExt;
+    if (QFile::exists(cache)) {
+        QFile::remove(cache);
+    }
+}
+
 static QString categoryBookmarksName(const QString &name, bool createDir=false)
 {
-    return Utils::dataDir(constBookmarksDir, createDir)+name+StreamsModel::constCacheExt;
+    return Utils::dataDir(constBookmarksDir, createDir)+name+constBookmarksExt;
 }
 
 QString StreamsModel::Item::modifiedName() const
@@ -253,28 +267,45 @@ void StreamsModel::CategoryItem::removeCache()
         if (QFile::exists(cache)) {
             QFile::remove(cache);
         }
+        removeXmlCache(cacheName);
     }
-}
-
-void StreamsModel::CategoryItem::saveCache() const
-{
-    if (!cacheName.isEmpty()) {
-        saveXml(categoryCacheName(cacheName, true));
-    }
+    cachedNameList.clear();
+    cachedNamesRead=false;
 }
 
 QList<StreamsModel::Item *> StreamsModel::CategoryItem::loadCache()
 {
-    if (!cacheName.isEmpty()) {
+    if (cacheOffset>0) {
+        // Sub-category of a cached category, so read just its children
+        const CategoryItem *top=getTopLevelCategory();
+        if (top && !top->cacheName.isEmpty()) {
+            return StreamsCache::load(categoryCacheName(top->cacheName), this, cacheOffset);
+        }
+    } else if (!cacheName.isEmpty()) {
+        removeXmlCache(cacheName);
         QString cache=categoryCacheName(cacheName);
-        if (!cache.isEmpty() && QFile::exists(cache)) {
-            return loadXml(cache);
+        if (QFile::exists(cache)) {
+            return StreamsCache::load(cache, this);
         }
     }
 
     return QList<Item *>();
 }
 
+const StreamsModel::CachedNames & StreamsModel::CategoryItem::cachedNames() const
+{
+    if (!cachedNamesRead) {
+        cachedNamesRead=true;
+        if (!cacheName.isEmpty()) {
+            QString cache=categoryCacheName(cacheName);
+            if (QFile::exists(cache)) {
+                cachedNameList=StreamsCache::loadNames(cache);
+            }
+        }
+    }
+    return cachedNameList;
+}
+
 QList<StreamsModel::Item *> StreamsModel::XmlCategoryItem::loadCache()
 {
     QList<Item *> newItems;
@@ -502,6 +533,7 @@ void StreamsModel::DiCategoryItem::addHeaders(QNetworkRequest &req)
 StreamsModel::StreamsModel(QObject *parent)
     : ActionModel(parent)
     , root(new CategoryItem(QString(), "root"))
+    , parser(0)
 {
     icn.addFile(":radio.svg");
     tuneIn=new CategoryItem(constRadioTimeUrl+QLatin1String("?locale=")+QLocale::system().name(), tr("TuneIn"), root, getIcon("tunein"), QString(), "tunein");
@@ -521,6 +553,10 @@ StreamsModel::StreamsModel(QObject *parent)
     addToFavouritesAction = new Action(favouritesIcon(), tr("Add Stream To Favorites"), this);
     configureDiAction = new Action(Icons::self()->configureIcon, tr("Configure Digitally Imported"), this);
     reloadAction = new Action(Icons::self()->reloadIcon, tr("Reload"), this);
+    insertTimer=new QTimer(this);
+    insertTimer->setSingleShot(true);
+    insertTimer->setInterval(0);
+    connect(insertTimer, SIGNAL(timeout()), SLOT(insertPending()));
 
     QSet<QString> hidden=Settings::self()->hiddenStreamCategories().toSet();
     for (Item *c: root->children) {
@@ -645,7 +681,7 @@ QVariant StreamsModel::data(const QModelIndex &index, int role) const
             const CategoryItem *cat=static_cast<const CategoryItem *>(item);
             switch (cat->state) {
             case CategoryItem::Initial:
-                return tr("Not Loaded");
+                return cat->cacheOffset>0 ? tr("%n Entry(s)", "", cat->cacheCount) : tr("Not Loaded");
             case CategoryItem::Fetching:
                 return tr("Loading...");
             default:
@@ -706,7 +742,8 @@ bool StreamsModel::canFetchMore(const QModelIndex &index) const
 {
     if (index.isValid()) {
         Item *item = toItem(index);
-        return item->isCategory() && CategoryItem::Initial==static_cast<CategoryItem *>(item)->state && !item->url.isEmpty() &&
+        return item->isCategory() && CategoryItem::Initial==static_cast<CategoryItem *>(item)->state &&
+               (!item->url.isEmpty() || static_cast<CategoryItem *>(item)->cacheOffset>0) &&
                !static_cast<CategoryItem *>(item)->isFavourites();
     } else {
         return false;
@@ -720,6 +757,17 @@ void StreamsModel::fetchMore(const QModelIndex &index)
     }
 
     Item *item = toItem(index);
+    if (item->isCategory() && static_cast<CategoryItem *>(item)->cacheOffset>0) {
+        // Child of a cached category, whose own children are only read when first expanded
+        CategoryItem *cat=static_cast<CategoryItem *>(item);
+        bool loaded=loadCache(cat);
+        cat->cacheOffset=0;
+        if (loaded || cat->url.isEmpty()) {
+            cat->state=CategoryItem::Fetched;
+            emit dataChanged(index, index);
+            return;
+        }
+    }
     if (item->isCategory() && !item->url.isEmpty()) {
         CategoryItem *cat=static_cast<CategoryItem *>(item);
         if (!cat->isFavourites() && !loadCache(cat)) {
@@ -732,7 +780,7 @@ void StreamsModel::fetchMore(const QModelIndex &index)
             cat->addHeaders(req);
             NetworkJob *job=NetworkAccessManager::self()->get(req);
             job->setProperty(constOrigUrlProperty, cat->url);
-            if (jobs.isEmpty()) {
+            if (!isLoading()) {
                 emit loading();
             }
             jobs.insert(job, cat);
@@ -756,6 +804,7 @@ void StreamsModel::reload(const QModelIndex &index)
         return;
     }
     CategoryItem *cat=static_cast<CategoryItem *>(item);
+    abortFetches(cat);
     if (!cat->children.isEmpty()) {
         cat->removeCache();
         beginRemoveRows(index, 0, cat->children.count()-1);
@@ -1041,93 +1090,196 @@ void StreamsModel::jobFinished()
         }
         jobs.remove(job);
 
-        // ShoutCast and Dirble have two jobs when listing a category - child categories and station list.
-        // So, only set as fetched if both are finished.
-        bool haveOtherJob=false;
-        for (CategoryItem *c: jobs.values()) {
-            if (c==cat) {
-                haveOtherJob=true;
-                break;
+        if (job->ok() && cat!=favourites && QLatin1String("http")==job->url().scheme()) {
+            QString url=job->origUrl().toString();
+            int type=-1;
+            if (constRadioTimeHost==job->origUrl().host()) {
+                type=ParseJob::RadioTime;
+            } else if (constIceCastUrl==url) {
+                type=ParseJob::IceCast;
+            } else if (cat->isSoma()) {
+                type=ParseJob::SomaFm;
+            } else if (constDiChannelListHost==job->origUrl().host()) {
+                type=ParseJob::DigitallyImported;
+            } else if (constShoutCastHost==job->origUrl().host()) {
+                type=ParseJob::ShoutCast;
+            } else if (constDirbleHost==job->origUrl().host()) {
+                type=ParseJob::Dirble;
+            } else if (cat->isListenLive()) {
+                type=ParseJob::ListenLive;
             }
-        }
 
-        if (!haveOtherJob) {
-            cat->state=CategoryItem::Fetched;
-        }
-
-        QModelIndex index=createIndex(cat->parent->children.indexOf(cat), 0, (void *)cat);
-        if (job->ok()) {
-            QList<Item *> newItems;
-            if (cat!=favourites && QLatin1String("http")==job->url().scheme()) {
-                QString url=job->origUrl().toString();
-                if (constRadioTimeHost==job->origUrl().host()) {
-                    newItems=parseRadioTimeResponse(job->actualJob(), cat);
-                } else if (constIceCastUrl==url) {
-                    newItems=parseIceCastResponse(job->actualJob(), cat);
-                } else if (cat->isSoma()) {
-                    newItems=parseSomaFmResponse(job->actualJob(), cat);
-                } else if (constDiChannelListHost==job->origUrl().host()) {
-                    newItems=parseDigitallyImportedResponse(job->actualJob(), cat);
-                } else if (constShoutCastHost==job->origUrl().host()) {
-                    newItems=parseShoutCastResponse(job->actualJob(), cat);
-                } else if (constDirbleHost==job->origUrl().host()) {
-                    newItems=parseDirbleResponse(job->actualJob(), cat, job->property(constOrigUrlProperty).toString());
-                } else if (cat->isListenLive()) {
-                    newItems=parseListenLiveResponse(job->actualJob(), cat);
+            if (-1!=type) {
+                if (!parser) {
+                    parser=new StreamsParser();
+                    connect(parser, SIGNAL(parsed(StreamsModel::ParseJob*)), this, SLOT(parsed(StreamsModel::ParseJob*)), Qt::QueuedConnection);
+                }
+                ParseJob *parseJob=new ParseJob((ParseJob::Type)type, cat->url, job->readAll(), job->property(constOrigUrlProperty).toString());
+                // Cache is saved by the parser, but only if these items are to be the category's only children.
+                if (!cat->cacheName.isEmpty() && cat->children.isEmpty() && !isFetching(cat)) {
+                    parseJob->cacheFile=categoryCacheName(cat->cacheName, true);
                 }
+                parsing.insert(parseJob, cat);
+                parser->parse(parseJob);
+                return;
             }
+        }
 
-            if (cat->parent==root && cat->supportsBookmarks) {
-                QList<Item *> bookmarks=cat->loadBookmarks();
-                if (bookmarks.count()) {
-                    CategoryItem *bookmarksCat=cat->getBookmarksCategory();
-
-                    if (bookmarksCat) {
-                        QList<Item *> newBookmarks;
-                        for (Item *bm: bookmarks) {
-                            for (Item *ex: bookmarksCat->children) {
-                                if (ex->url==bm->url) {
-                                    delete bm;
-                                    bm=0;
-                                    break;
-                                }
-                            }
-                            if (bm) {
-                                newBookmarks.append(bm);
-                                bm->parent=bookmarksCat;
-                            }
-                        }
-                        if (newBookmarks.count()) {
-                            QModelIndex index=createIndex(bookmarksCat->parent->children.indexOf(bookmarksCat), 0, (void *)bookmarksCat);
-                            beginInsertRows(index, bookmarksCat->children.count(), (bookmarksCat->children.count()+newBookmarks.count())-1);
-                            bookmarksCat->children+=newBookmarks;
-                            endInsertRows();
-                        }
-                    } else {
-                        bookmarksCat=cat->createBookmarksCategory();
-                        for (Item *i: bookmarks) {
-                            i->parent=bookmarksCat;
+        addItems(cat, QList<Item *>(), job->ok());
+    }
+}
+
+void StreamsModel::parsed(StreamsModel::ParseJob *job)
+{
+    QScopedPointer<ParseJob> cleanup(job);
+    CategoryItem *cat=parsing.take(job);
+    if (!cat) {
+        // Category was reloaded, or removed, whilst parsing
+        qDeleteAll(job->items);
+        return;
+    }
+    for (Item *item: job->items) {
+        item->parent=cat;
+    }
+    addItems(cat, job->items, true);
+}
+
+void StreamsModel::addItems(CategoryItem *cat, QList<Item *> newItems, bool withBookmarks)
+{
+    if (withBookmarks && cat->parent==root && cat->supportsBookmarks) {
+        QList<Item *> bookmarks=cat->loadBookmarks();
+        if (bookmarks.count()) {
+            CategoryItem *bookmarksCat=cat->getBookmarksCategory();
+
+            if (bookmarksCat) {
+                QList<Item *> newBookmarks;
+                for (Item *bm: bookmarks) {
+                    for (Item *ex: bookmarksCat->children) {
+                        if (ex->url==bm->url) {
+                            delete bm;
+                            bm=0;
+                            break;
                         }
-                        bookmarksCat->children=bookmarks;
-                        newItems.append(bookmarksCat);
+                    }
+                    if (bm) {
+                        newBookmarks.append(bm);
+                        bm->parent=bookmarksCat;
                     }
                 }
-            }
-            
-            if (!newItems.isEmpty()) {
-                beginInsertRows(index, cat->children.count(), (cat->children.count()+newItems.count())-1);
-                cat->children+=newItems;
-                endInsertRows();
-                if (cat!=favourites) {
-                    cat->saveCache();
+                if (newBookmarks.count()) {
+                    QModelIndex index=createIndex(bookmarksCat->parent->children.indexOf(bookmarksCat), 0, (void *)bookmarksCat);
+                    beginInsertRows(index, bookmarksCat->children.count(), (bookmarksCat->children.count()+newBookmarks.count())-1);
+                    bookmarksCat->children+=newBookmarks;
+                    endInsertRows();
+                }
+            } else {
+                bookmarksCat=cat->createBookmarksCategory();
+                for (Item *i: bookmarks) {
+                    i->parent=bookmarksCat;
                 }
+                bookmarksCat->children=bookmarks;
+                newItems.append(bookmarksCat);
             }
         }
-        emit dataChanged(index, index);
-        if (jobs.isEmpty()) {
-            emit loaded();
+    }
+
+    if (newItems.isEmpty()) {
+        fetchFinished(cat);
+    } else {
+        pendingItems[cat]+=newItems;
+        insertPending();
+    }
+}
+
+void StreamsModel::insertPending()
+{
+    if (pendingItems.isEmpty()) {
+        return;
+    }
+
+    // Add at most constInsertChunk items per event loop iteration, so that large directories do not block the GUI
+    QMap<CategoryItem *, QList<Item *> >::Iterator it=pendingItems.begin();
+    CategoryItem *cat=it.key();
+    QList<Item *> chunk=it.value().mid(0, constInsertChunk);
+    it.value()=it.value().mid(chunk.count());
+
+    QModelIndex index=createIndex(cat->parent->children.indexOf(cat), 0, (void *)cat);
+    beginInsertRows(index, cat->children.count(), (cat->children.count()+chunk.count())-1);
+    cat->children+=chunk;
+    endInsertRows();
+
+    if (it.value().isEmpty()) {
+        pendingItems.erase(it);
+        fetchFinished(cat);
+    }
+    if (!pendingItems.isEmpty()) {
+        insertTimer->start();
+    }
+}
+
+void StreamsModel::fetchFinished(CategoryItem *cat)
+{
+    // ShoutCast and Dirble have two jobs when listing a category - child categories and station list.
+    // So, only set as fetched once both have been parsed and added.
+    if (!isFetching(cat)) {
+        cat->state=CategoryItem::Fetched;
+    }
+
+    QModelIndex index=createIndex(cat->parent->children.indexOf(cat), 0, (void *)cat);
+    emit dataChanged(index, index);
+    if (!isLoading()) {
+        emit loaded();
+    }
+}
+
+static bool isWithin(const StreamsModel::Item *item, const StreamsModel::CategoryItem *cat)
+{
+    for (; item; item=item->parent) {
+        if (item==cat) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StreamsModel::abortFetches(CategoryItem *cat)
+{
+    bool wasLoading=isLoading();
+
+    QMap<NetworkJob *, CategoryItem *>::Iterator job=jobs.begin();
+    while (job!=jobs.end()) {
+        if (isWithin(job.value(), cat)) {
+            disconnect(job.key(), SIGNAL(finished()), this, SLOT(jobFinished()));
+            job.key()->cancelAndDelete();
+            job=jobs.erase(job);
+        } else {
+            ++job;
+        }
+    }
+
+    // Parse results for these are ignored when they arrive
+    QMap<ParseJob *, CategoryItem *>::Iterator parse=parsing.begin();
+    while (parse!=parsing.end()) {
+        if (isWithin(parse.value(), cat)) {
+            parse=parsing.erase(parse);
+        } else {
+            ++parse;
         }
     }
+
+    QMap<CategoryItem *, QList<Item *> >::Iterator pending=pendingItems.begin();
+    while (pending!=pendingItems.end()) {
+        if (isWithin(pending.key(), cat)) {
+            qDeleteAll(pending.value());
+            pending=pendingItems.erase(pending);
+        } else {
+            ++pending;
+        }
+    }
+
+    if (wasLoading && !isLoading()) {
+        emit loaded();
+    }
 }
 
 void StreamsModel::savedFavouriteStream(const QString &url, const QString &name)
@@ -1383,11 +1535,11 @@ QList<StreamsModel::Item *> StreamsModel::parseSomaFmResponse(QIODevice *dev, Ca
     return newItems;
 }
 
-QList<StreamsModel::Item *> StreamsModel::parseDigitallyImportedResponse(QIODevice *dev, CategoryItem *cat)
+QList<StreamsModel::Item *> StreamsModel::parseDigitallyImportedResponse(QIODevice *dev, CategoryItem *cat, const QString &catUrl)
 {
     QList<Item *> newItems;
     QVariantMap data=QJsonDocument::fromJson(dev->readAll()).toVariant().toMap();
-    QString listenHost=QLatin1String("listen.")+QUrl(cat->url).host().remove("www.");
+    QString listenHost=QLatin1String("listen.")+QUrl(catUrl).host().remove("www.");
 
     if (data.contains("channel_filters")) {
         QVariantList filters = data["channel_filters"].toList();
@@ -1827,6 +1979,7 @@ void StreamsModel::removeInstalledProvider(const QString &key)
         if (key==static_cast<CategoryItem *>(i)->configName) {
             int row=root->children.indexOf(i);
             if (row>=0) {
+                abortFetches(static_cast<CategoryItem *>(i));
                 static_cast<CategoryItem *>(i)->removeCache();
                 beginRemoveRows(QModelIndex(), row, row);
                 delete root->children.takeAt(row);
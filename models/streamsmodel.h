@@ -32,12 +32,17 @@
 #include "mpd-interface/playlist.h"
 #include "support/icon.h"
 #include <QList>
+#include <QStringList>
 #include <QMap>
 #include <QSet>
+#include <QHash>
+#include <QPair>
 #include <QDateTime>
 
 class NetworkJob;
+class StreamsParser;
 class QNetworkRequest;
+class QTimer;
 class QXmlStreamReader;
 class QIODevice;
 
@@ -59,6 +64,10 @@ public:
         CategoryItem *getTopLevelCategory() const;
     };
     
+    // Items of each list within a category's cache, keyed by the list's position - as the item's name, and the
+    // position of its own list of children (0 if none)
+    typedef QHash<qint64, QList<QPair<QString, qint64> > > CachedNames;
+
     struct CategoryItem : public Item
     {
         enum State
@@ -72,7 +81,7 @@ public:
                      const QString &cn=QString(), const QString &bn=QString(), bool modName=false)
             : Item(u, n, p), state(Initial), isAll(false), isBookmarks(false), supportsBookmarks(false),
               canBookmark(false), addCatToModifiedName(modName), icon(i), cacheName(cn),
-              bookmarksName(bn), configName(cn.isEmpty() ? bn : cn) { }
+              bookmarksName(bn), configName(cn.isEmpty() ? bn : cn), cacheOffset(0), cacheCount(0), cachedNamesRead(false) { }
 
         virtual ~CategoryItem() { qDeleteAll(children); }
         virtual bool isCategory() const { return true; }
@@ -89,8 +98,8 @@ public:
         QList<Item *> loadBookmarks();
         CategoryItem * getBookmarksCategory();
         CategoryItem * createBookmarksCategory();
-        void saveCache() const;
         virtual QList<Item *> loadCache();
+        const CachedNames & cachedNames() const;
         bool saveXml(const QString &fileName, bool format=false) const;
         bool saveXml(QIODevice *dev, bool format=false) const;
         QList<Item *> loadXml(const QString &fileName);
@@ -109,6 +118,12 @@ public:
         QString cacheName;
         QString bookmarksName;
         QString configName;
+        // Position, and number, of children within the top-level category's cache - if not yet loaded
+        qint64 cacheOffset;
+        quint32 cacheCount;
+        // Names of the items within this (top-level) category's cache, only read when first filtered
+        mutable CachedNames cachedNameList;
+        mutable bool cachedNamesRead;
     };
 
     struct FavouritesCategoryItem : public CategoryItem
@@ -180,6 +195,32 @@ public:
         bool isBuiltIn() const { return false; }
     };
 
+    // Network response, parsed by StreamsParser. The category may be removed whilst this is being parsed, so the
+    // parser is only given what it needs from it - and items are created without a parent, this being set once
+    // they are added to the model.
+    struct ParseJob
+    {
+        enum Type
+        {
+            RadioTime,
+            IceCast,
+            SomaFm,
+            DigitallyImported,
+            ShoutCast,
+            Dirble,
+            ListenLive
+        };
+
+        ParseJob(Type t, const QString &cu, const QByteArray &d, const QString &u)
+            : type(t), catUrl(cu), data(d), origUrl(u) { }
+        Type type;
+        QString catUrl;
+        QByteArray data;
+        QString origUrl;
+        QString cacheFile; // If set, parsed items are also saved here
+        QList<Item *> items;
+    };
+
     struct Category
     {
         Category(const QString &n, const QIcon &i, const QString &k, bool b, bool h, bool c)
@@ -287,19 +328,21 @@ public:
     static QList<Item *> parseRadioTimeResponse(QIODevice *dev, CategoryItem *cat, bool parseSubText=false);
     static QList<Item *> parseIceCastResponse(QIODevice *dev, CategoryItem *cat);
     static QList<Item *> parseSomaFmResponse(QIODevice *dev, CategoryItem *cat);
-    static QList<Item *> parseDigitallyImportedResponse(QIODevice *dev, CategoryItem *cat);
+    static QList<Item *> parseDigitallyImportedResponse(QIODevice *dev, CategoryItem *cat, const QString &catUrl);
     static QList<Item *> parseListenLiveResponse(QIODevice *dev, CategoryItem *cat);
     static QList<Item *> parseShoutCastSearchResponse(QIODevice *dev, CategoryItem *cat);
-    QList<Item *> parseShoutCastResponse(QIODevice *dev, CategoryItem *cat);
+    static QList<Item *> parseShoutCastResponse(QIODevice *dev, CategoryItem *cat);
     static QList<Item *> parseShoutCastLinks(QXmlStreamReader &doc, CategoryItem *cat);
     static QList<Item *> parseShoutCastStations(QXmlStreamReader &doc, CategoryItem *cat);
-    QList<Item *> parseDirbleResponse(QIODevice *dev, CategoryItem *cat, const QString &origUrl);
+    static QList<Item *> parseDirbleResponse(QIODevice *dev, CategoryItem *cat, const QString &origUrl);
     static QList<Item *> parseDirbleStations(QIODevice *dev, CategoryItem *cat);
     static Item * parseRadioTimeEntry(QXmlStreamReader &doc, CategoryItem *parent, bool parseSubText=false);
     static Item * parseSomaFmEntry(QXmlStreamReader &doc, CategoryItem *parent);
 
 private Q_SLOTS:
     void jobFinished();
+    void parsed(StreamsModel::ParseJob *job);
+    void insertPending();
 
     // Responses from MPD...
     void savedFavouriteStream(const QString &url, const QString &name);
@@ -310,12 +353,21 @@ private Q_SLOTS:
 
 private:
     bool loadCache(CategoryItem *cat);
+    bool isLoading() const { return !jobs.isEmpty() || !parsing.isEmpty() || !pendingItems.isEmpty(); }
+    bool isFetching(CategoryItem *cat) const { return jobs.key(cat) || parsing.key(cat) || pendingItems.contains(cat); }
+    void addItems(CategoryItem *cat, QList<Item *> newItems, bool withBookmarks);
+    void fetchFinished(CategoryItem *cat);
+    void abortFetches(CategoryItem *cat);
     Item * toItem(const QModelIndex &index) const { return index.isValid() ? static_cast<Item*>(index.internalPointer()) : root; }
     void importOldFavourites();
     void loadInstalledProviders();
 
 private:
     QMap<NetworkJob *, CategoryItem *> jobs;
+    QMap<ParseJob *, CategoryItem *> parsing;
+    QMap<CategoryItem *, QList<Item *> > pendingItems; // Parsed items, added to the model in chunks
+    QTimer *insertTimer;
+    StreamsParser *parser;
     CategoryItem *root;
     FavouritesCategoryItem *favourites;
     CategoryItem *tuneIn;
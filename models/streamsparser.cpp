@@ -0,0 +1,81 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "streamsparser.h"
+#include "streamscache.h"
+#include "support/thread.h"
+#include <QBuffer>
+
+StreamsParser::StreamsParser()
+{
+    // Thread is stopped, along with all others, by ThreadCleaner when Cantata exits.
+    thread=new Thread(metaObject()->className());
+    moveToThread(thread);
+    thread->start();
+    qRegisterMetaType<StreamsModel::ParseJob *>("StreamsModel::ParseJob*");
+    connect(this, SIGNAL(startParsing(StreamsModel::ParseJob*)), this, SLOT(doParsing(StreamsModel::ParseJob*)), Qt::QueuedConnection);
+}
+
+void StreamsParser::parse(StreamsModel::ParseJob *job)
+{
+    emit startParsing(job);
+}
+
+void StreamsParser::doParsing(StreamsModel::ParseJob *job)
+{
+    QBuffer buffer(&job->data);
+    if (buffer.open(QIODevice::ReadOnly)) {
+        switch (job->type) {
+        case StreamsModel::ParseJob::RadioTime:
+            job->items=StreamsModel::parseRadioTimeResponse(&buffer, 0);
+            break;
+        case StreamsModel::ParseJob::IceCast:
+            job->items=StreamsModel::parseIceCastResponse(&buffer, 0);
+            break;
+        case StreamsModel::ParseJob::SomaFm:
+            job->items=StreamsModel::parseSomaFmResponse(&buffer, 0);
+            break;
+        case StreamsModel::ParseJob::DigitallyImported:
+            job->items=StreamsModel::parseDigitallyImportedResponse(&buffer, 0, job->catUrl);
+            break;
+        case StreamsModel::ParseJob::ShoutCast:
+            job->items=StreamsModel::parseShoutCastResponse(&buffer, 0);
+            break;
+        case StreamsModel::ParseJob::Dirble:
+            job->items=StreamsModel::parseDirbleResponse(&buffer, 0, job->origUrl);
+            break;
+        case StreamsModel::ParseJob::ListenLive:
+            job->items=StreamsModel::parseListenLiveResponse(&buffer, 0);
+            break;
+        }
+    }
+    buffer.close();
+    job->data=QByteArray();
+
+    // Items are not yet part of the model, so can safely be saved here.
+    if (!job->cacheFile.isEmpty() && !job->items.isEmpty()) {
+        StreamsCache::save(job->cacheFile, job->items);
+    }
+    emit parsed(job);
+}
@@ -0,0 +1,54 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef STREAMS_PARSER_H
+#define STREAMS_PARSER_H
+
+#include "streamsmodel.h"
+#include <QObject>
+
+class Thread;
+
+// Parses stream directory listings in a background thread, so that large directories (e.g. IceCast)
+// do not block the GUI.
+class StreamsParser : public QObject
+{
+    Q_OBJECT
+public:
+    StreamsParser();
+    // Takes ownership of 'job', which is returned - with its data replaced by the parsed items - via parsed()
+    void parse(StreamsModel::ParseJob *job);
+
+Q_SIGNALS:
+    void startParsing(StreamsModel::ParseJob *job);
+    void parsed(StreamsModel::ParseJob *job);
+
+private Q_SLOTS:
+    void doParsing(StreamsModel::ParseJob *job);
+
+private:
+    Thread *thread;
+};
+
+#endif
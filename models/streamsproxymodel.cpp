@@ -48,11 +48,35 @@ bool StreamsProxyModel::filterAcceptsItem(const void *i, QStringList strings) co
                 return true;
             }
         }
+        // Sub-categories read from a cache only create their children when expanded, so check their names
+        if (cat->cacheOffset>0) {
+            const StreamsModel::CategoryItem *top=cat->getTopLevelCategory();
+            if (top && filterAcceptsCached(top->cachedNames(), cat->cacheOffset, strings)) {
+                return true;
+            }
+        }
     }
 
     return false;
 }
 
+bool StreamsProxyModel::filterAcceptsCached(const StreamsModel::CachedNames &names, qint64 pos, const QStringList &strings) const
+{
+    StreamsModel::CachedNames::ConstIterator list=names.constFind(pos);
+    if (list==names.constEnd()) {
+        return false;
+    }
+
+    for (const QPair<QString, qint64> &item: list.value()) {
+        QStringList itemStrings=strings;
+        itemStrings << item.first;
+        if (matchesFilter(itemStrings) || (item.second>0 && filterAcceptsCached(names, item.second, itemStrings))) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool StreamsProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
     if (!filterEnabled) {
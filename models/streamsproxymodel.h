@@ -25,6 +25,7 @@
 #define STREAMSPROXYMODEL_H
 
 #include "proxymodel.h"
+#include "streamsmodel.h"
 
 class StreamsProxyModel : public ProxyModel
 {
@@ -34,6 +35,9 @@ public:
     bool filterAcceptsItem(const void *i, QStringList strings) const;
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
     bool lessThan(const QModelIndex &left, const QModelIndex &right) const;
+
+private:
+    bool filterAcceptsCached(const StreamsModel::CachedNames &names, qint64 pos, const QStringList &strings) const;
 };
 
 #endif
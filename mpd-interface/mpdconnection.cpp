@@ -38,6 +38,8 @@
 #include <QDir>
 #include <QHostInfo>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QPropertyAnimation>
 #include <QCoreApplication>
 #include <QUdpSocket>
@@ -68,6 +70,7 @@ static const int constConnTimer=5000;
 static const QByteArray constOkValue("OK");
 static const QByteArray constOkMpdValue("OK MPD");
 static const QByteArray constOkNlValue("OK\n");
+static const QByteArray constListOkNlValue("list_OK\n");
 static const QByteArray constAckValue("ACK");
 static const QByteArray constIdleChangedKey("changed: ");
 static const QByteArray constIdleDbValue("database");
@@ -84,6 +87,12 @@ static const QByteArray constIdleMessageValue("message");
 static const QByteArray constDynamicIn("cantata-dynamic-in");
 static const QByteArray constDynamicOut("cantata-dynamic-out");
 static const QByteArray constRatingSticker("rating");
+static const QByteArray constFileKey("file: ");
+static const QByteArray constDirectoryKey("directory: ");
+static const QByteArray constPlaylistKey("playlist: ");
+static const int constMaxDirsPerListCommand=100;
+static const int constLibrarySongsBatch=200;
+static const int constDefaultBytesPerSong=256;
 
 static inline int socketTimeout(int dataSize)
 {
@@ -118,6 +127,45 @@ QByteArray MPDConnection::encodeName(const QString &name)
     return '\"'+name.toUtf8().replace("\\", "\\\\").replace("\"", "\\\"")+'\"';
 }
 
+// Check if we have read a complete response. Replies to 'command_list_ok_begin' contain
+// "list_OK" after each command, and if a command fails MPD will reply with ACK *after*
+// the responses to any previous commands.
+static bool isCompleteResponse(const QByteArray &data)
+{
+    if (data.startsWith(constOkValue) || data.startsWith(constAckValue)) {
+        return true;
+    }
+    if (!data.endsWith('\n')) {
+        return false;
+    }
+    if (data.endsWith(constOkNlValue)) {
+        return !data.endsWith(constListOkNlValue);
+    }
+    int lineStart=data.lastIndexOf('\n', data.length()-2)+1;
+    return data.mid(lineStart).startsWith(constAckValue);
+}
+
+// Split reply to a 'command_list_ok_begin' list into a reply per command.
+static QList<QByteArray> splitListResponse(const QByteArray &data)
+{
+    QList<QByteArray> replies;
+    int start=0;
+    for (;;) {
+        int end=data.mid(start, constListOkNlValue.length())==constListOkNlValue
+                ? start
+                : data.indexOf("\n"+constListOkNlValue, start);
+        if (-1==end) {
+            break;
+        }
+        if (end>start) {
+            end++; // Keep newline...
+        }
+        replies.append(data.mid(start, end-start));
+        start=end+constListOkNlValue.length();
+    }
+    return replies;
+}
+
 static QByteArray readFromSocket(MpdSocket &socket, int timeout=constSocketCommsTimeout)
 {
     QByteArray data;
@@ -138,7 +186,7 @@ static QByteArray readFromSocket(MpdSocket &socket, int timeout=constSocketComms
 
         data.append(socket.readAll());
 
-        if (data.endsWith(constOkNlValue) || data.startsWith(constOkValue) || data.startsWith(constAckValue)) {
+        if (isCompleteResponse(data)) {
             break;
         }
     }
@@ -230,10 +278,14 @@ MPDConnection::MPDConnection()
     , thread(0)
     , ver(0)
     , canUseStickers(false)
+    , canUseRegexFilter(false)
+    , ratingCacheValid(false)
+    , ratingStickerSet(false)
     , sock(this)
     , idleSocket(this)
     , lastStatusPlayQueueVersion(0)
     , lastUpdatePlayQueueVersion(0)
+    , playQueueBytesPerSong(constDefaultBytesPerSong)
     , state(State_Blank)
     , isListingMusic(false)
     , reconnectTimer(0)
@@ -246,6 +298,7 @@ MPDConnection::MPDConnection()
     , volumeFade(0)
     , fadeDuration(0)
     , restoreVolume(-1)
+    , useListAllInfo(true)
 {
     qRegisterMetaType<time_t>("time_t");
     qRegisterMetaType<Song>("Song");
@@ -269,7 +322,10 @@ MPDConnection::MPDConnection()
     #if (defined Q_OS_LINUX && defined QT_QTDBUS_FOUND) || (defined Q_OS_MAC && defined IOKIT_FOUND)
     connect(PowerManagement::self(), SIGNAL(resuming()), this, SLOT(reconnect()));
     #endif
-    MPDParseUtils::setSingleTracksFolders(Configuration().get("singleTracksFolders", QStringList()).toSet());
+    Configuration cfg;
+    MPDParseUtils::setSingleTracksFolders(cfg.get("singleTracksFolders", QStringList()).toSet());
+    // Allow listallinfo to be disabled, so that library listing can be compared with pipelined lsinfo calls
+    useListAllInfo=cfg.get("listAllInfo", true);
 }
 
 MPDConnection::~MPDConnection()
@@ -508,6 +564,7 @@ void MPDConnection::reconnect()
         getUrlHandlers();
         getTagTypes();
         getStickerSupport();
+        getRegexFilterSupport();
         playListInfo();
         outputs();
         reconnectStart=0;
@@ -601,6 +658,7 @@ void MPDConnection::setDetails(const MPDConnectionDetails &d)
             getUrlHandlers();
             getTagTypes();
             getStickerSupport();
+            getRegexFilterSupport();
             playListInfo();
             outputs();
             determineIfaceIp();
@@ -1032,7 +1090,8 @@ void MPDConnection::currentSong()
 /*
  * Call "plchangesposid" to recieve a list of positions+ids that have been changed since the last update.
  * If we have ids in this list that we don't know about, then these are new songs - so we call
- * "playlistinfo <pos>" to get the song information.
+ * "playlistinfo <start>:<end>" (for each contiguous range of new songs, in one command list) to get the
+ * song information. If this would transfer about as much as a complete "playlistinfo" then we just use that.
  *
  * Any songs that are know about, will actually be sent with empty data - as the playqueue model will
  * already hold these songs.
@@ -1054,16 +1113,51 @@ void MPDConnection::playListChanges()
         emitStatusUpdated(sv);
         QList<MPDParseUtils::IdPos> changes=MPDParseUtils::parseChanges(response.data);
         if (!changes.isEmpty()) {
-            if (changes.count()>constMaxPqChanges) {
+            QSet<qint32> prevIds=playQueueIds.toSet();
+            QList<quint32> newPositions;
+            for (const MPDParseUtils::IdPos &idp: changes) {
+                if (!prevIds.contains(idp.id) || streamIds.contains(idp.id)) {
+                    newPositions.append(idp.pos);
+                }
+            }
+
+            // Compare (estimated) size of fetching the new songs against refetching the whole playqueue...
+            qint64 changesSize=response.data.size()+((qint64)newPositions.count()*playQueueBytesPerSong);
+            qint64 fullSize=(qint64)sv.playlistLength*playQueueBytesPerSong;
+            if (changesSize>=fullSize) {
+                DBUG << "Changes payload" << changesSize << "full payload" << fullSize << "- using playlistinfo";
                 playListInfo();
                 return;
             }
+
+            QHash<qint32, Song> newSongs;
+            if (!newPositions.isEmpty()) {
+                QByteArray send="command_list_begin\n";
+                for (int i=0; i<newPositions.count(); ) {
+                    int end=i+1;
+                    while (end<newPositions.count() && newPositions.at(end)==newPositions.at(end-1)+1) {
+                        ++end;
+                    }
+                    send+="playlistinfo "+quote(newPositions.at(i))+':'+quote(newPositions.at(end-1)+1)+'\n';
+                    i=end;
+                }
+                send+="command_list_end";
+                response=sendCommand(send);
+                if (!response.ok) {
+                    playListInfo();
+                    return;
+                }
+                for (const Song &s: MPDParseUtils::parseSongs(response.data, MPDParseUtils::Loc_PlayQueue)) {
+                    newSongs.insert(s.id, s);
+                }
+                DBUG << "Fetched" << newSongs.count() << "new songs, in" << response.data.size() << "bytes";
+            }
+
             bool first=true;
             quint32 firstPos=0;
             QList<Song> songs;
             QList<Song> newCantataStreams;
             QList<qint32> ids;
-            QSet<qint32> prevIds=playQueueIds.toSet();
             QSet<qint32> strmIds;
 
             for (const MPDParseUtils::IdPos &idp: changes) {
@@ -1094,14 +1188,12 @@ void MPDConnection::playListChanges()
                     songs.append(s);
                 } else {
                     // New song!
-                    data = "playlistinfo ";
-                    data += quote(idp.pos);
-                    response=sendCommand(data);
-                    if (!response.ok) {
+                    QHash<qint32, Song>::ConstIterator it=newSongs.find(idp.id);
+                    if (it==newSongs.constEnd()) { // Playqueue changed whilst fetching?
                         playListInfo();
                         return;
                     }
-                    Song s=MPDParseUtils::parseSong(response.data, MPDParseUtils::Loc_PlayQueue);
+                    Song s=it.value();
                     s.id=idp.id;
 //                     s.pos=idp.pos;
                     songs.append(s);
@@ -1159,6 +1251,9 @@ void MPDConnection::playListInfo()
     if (response.ok) {
         lastUpdatePlayQueueVersion=lastStatusPlayQueueVersion;
         songs=MPDParseUtils::parseSongs(response.data, MPDParseUtils::Loc_PlayQueue);
+        if (!songs.isEmpty()) {
+            playQueueBytesPerSong=qMax(1, response.data.size()/songs.count());
+        }
         playQueueIds.clear();
         streamIds.clear();
 
@@ -1558,6 +1653,13 @@ void MPDConnection::parseIdleReturn(const QByteArray &data)
             } else if (constIdleOutputValue==value) {
                 outputs();
             } else if (constIdleStickerValue==value) {
+                // Idle events are merged, so this only skips re-reading the cache if setRating was the sole change
+                // since the last event.
+                if (ratingStickerSet) {
+                    ratingStickerSet=false;
+                } else {
+                    ratingCacheValid=false;
+                }
                 emit stickerDbChanged();
             } else if (constIdleSubscriptionValue==value) {
                 //if (dynamicId.isEmpty()) {
@@ -1618,8 +1720,136 @@ void MPDConnection::loadLibrary()
     DBUG << "loadLibrary";
     isListingMusic=true;
     emit updatingLibrary(dbUpdate);
-    QList<Song> songs;
-    recursivelyListDir("/", songs);
+
+    QElapsedTimer timer;
+    int roundTrips=0;
+    bool viaListAllInfo=listAllInfoSupported();
+    timer.start();
+
+    if (isMpd()) {
+        // UPnP database backend does not list separate metadata items, so if "list genre" returns
+        // empty response assume this is a UPnP backend and dont attempt to get rest of data...
+        // Although we dont use "list XXX", lsinfo will return duplciate items (due to the way most
+        // UPnP servers returing directories of classifications - Genre/Album/Tracks, Artist/Album/Tracks,
+        // etc...
+        Response response=sendCommand("list genre", false, false);
+        roundTrips++;
+        if (!response.ok || response.data.split('\n').length()<3) { // 2 lines - OK and blank
+            // ..just to be 100% sure, check no artists either...
+            response=sendCommand("list artist", false, false);
+            roundTrips++;
+            if (!response.ok || response.data.split('\n').length()<3) { // 2 lines - OK and blank
+                DBUG << "Library listing skipped - UPnP backend?";
+                emit updatedLibrary();
+                isListingMusic=false;
+                return;
+            }
+        }
+    }
+
+    bool ok=viaListAllInfo
+            ? listAllInfo(roundTrips)
+            : listDirs(QStringList() << QLatin1String("/"), false, roundTrips);
+    DBUG << "Library listing" << (viaListAllInfo ? "(listallinfo)" : "(lsinfo)") << "status:" << ok
+         << "round trips:" << roundTrips << "time (ms):" << timer.elapsed();
+    emit updatedLibrary();
+    isListingMusic=false;
+}
+
+/*
+ * Only update those folders that contain songs modified since the last update, and then
+ * use the list of all files to remove deleted songs. If this is not possible (non-MPD server,
+ * or MPD is too old to support 'modified-since') then fallback to a complete reload.
+ */
+void MPDConnection::updateLibrary(time_t since)
+{
+    DBUG << "updateLibrary" << since;
+    if (0==since || !isMpd() || !modifiedFindSupported()) {
+        loadLibrary();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Response response=sendCommand("listall", false, false);
+    if (!response.ok) {
+        loadLibrary();
+        return;
+    }
+
+    QSet<QString> allFiles;
+    QSet<QString> allDirs;
+    QList<QByteArray> lines=response.data.split('\n');
+    for (const QByteArray &line: lines) {
+        if (line.startsWith(constFileKey)) {
+            allFiles.insert(QString::fromUtf8(line.mid(constFileKey.length())));
+        } else if (line.startsWith(constDirectoryKey)) {
+            allDirs.insert(QString::fromUtf8(line.mid(constDirectoryKey.length())));
+        }
+    }
+    lines.clear();
+    response.data.clear();
+
+    response=sendCommand("find "+constModifiedSince.toLatin1()+' '+quote(since), false, false);
+    if (!response.ok) {
+        loadLibrary();
+        return;
+    }
+
+    QSet<QString> changedDirs;
+    lines=response.data.split('\n');
+    for (const QByteArray &line: lines) {
+        if (line.startsWith(constFileKey)) {
+            QString file=QString::fromUtf8(line.mid(constFileKey.length()));
+            int slash=file.lastIndexOf(Utils::constDirSep);
+            changedDirs.insert(-1==slash ? QString(QLatin1String("")) : file.left(slash));
+        }
+    }
+    lines.clear();
+    response.data.clear();
+
+    DBUG << "files:" << allFiles.size() << "dirs:" << allDirs.size() << "changed dirs:" << changedDirs.size();
+    int roundTrips=2;
+    isListingMusic=true;
+    emit updatingLibraryIncrementally(dbUpdate);
+    QStringList dirsToList;
+    for (const QString &dir: changedDirs) {
+        if (dir.isEmpty() || allDirs.contains(dir)) {
+            dirsToList.append(dir);
+        } else {
+            emit libraryDirSongs(dir, QList<Song>());
+        }
+    }
+    if (!listDirs(dirsToList, true, roundTrips)) {
+        // Something has gone wrong, so reload everything...
+        isListingMusic=false;
+        loadLibrary();
+        return;
+    }
+    DBUG << "Library update - round trips:" << roundTrips << "time (ms):" << timer.elapsed();
+    emit libraryFiles(allFiles, allDirs);
+    emit updatedLibrary();
+    isListingMusic=false;
+}
+
+/*
+ * List folders again, after an incremental update, as LibraryDb has found that these contain files it does
+ * not have - e.g. files moved into the folder, which keep their old modification time.
+ */
+void MPDConnection::updateLibraryDirs(const QStringList &dirs)
+{
+    DBUG << "updateLibraryDirs" << dirs.size();
+    QElapsedTimer timer;
+    timer.start();
+    int roundTrips=0;
+    isListingMusic=true;
+    emit updatingLibraryIncrementally(dbUpdate);
+    if (!listDirs(dirs, true, roundTrips)) {
+        isListingMusic=false;
+        loadLibrary();
+        return;
+    }
+    DBUG << "Library folders update - round trips:" << roundTrips << "time (ms):" << timer.elapsed();
     emit updatedLibrary();
     isListingMusic=false;
 }
@@ -1831,6 +2061,7 @@ void MPDConnection::search(const QString &field, const QString &value, int id)
         Response response=sendCommand(cmd);
         if (response.ok) {
             songs=MPDParseUtils::parseSongs(response.data, MPDParseUtils::Loc_Search);
+            getRatings(songs);
             qSort(songs);
         }
     }
@@ -1856,30 +2087,38 @@ void MPDConnection::search(const QByteArray &query, const QString &id)
     } else if (query.startsWith("RATING:")) {
         QList<QByteArray> parts = query.split(':');
         if (3==parts.length()) {
-            Response response=sendCommand("sticker find song \"\" rating", false, false);
-            if (response.ok) {
-                int min = parts.at(1).toInt();
-                int max = parts.at(2).toInt();
-                QList<MPDParseUtils::Sticker> stickers=MPDParseUtils::parseStickers(response.data, constRatingSticker);
-                if (!stickers.isEmpty()) {
-                    for (const MPDParseUtils::Sticker &sticker: stickers) {
-                        if (!sticker.file.isEmpty() && !sticker.value.isEmpty()) {
-                            int val = sticker.value.toInt();
-                            if (val>=min && val<=max) {
-                                Response resp = sendCommand("find file " + encodeName(QString::fromUtf8(sticker.file)) , false, false);
-                                if (resp.ok) {
-                                    songs.append(MPDParseUtils::parseSong(response.data, MPDParseUtils::Loc_Search));
-                                }
-                            }
-                        }
-                    }
+            if (!ratingCacheValid) {
+                loadRatingCache();
+            }
+            int min = parts.at(1).toInt();
+            int max = parts.at(2).toInt();
+            QStringList files;
+            QHash<QString, quint8>::ConstIterator it=ratingCache.constBegin();
+            QHash<QString, quint8>::ConstIterator end=ratingCache.constEnd();
+            for (; it!=end; ++it) {
+                if (it.value()>=min && it.value()<=max) {
+                    files.append(it.key());
+                }
+            }
+            // Fetch song details in batches, rather than a 'find file' round-trip per song...
+            for (int i=0; i<files.count(); i+=constMaxFilesPerAddCommand) {
+                QByteArray cmd="command_list_begin\n";
+                for (const QString &file: files.mid(i, constMaxFilesPerAddCommand)) {
+                    cmd+="find file "+encodeName(file)+'\n';
+                }
+                cmd+="command_list_end";
+                Response resp=sendCommand(cmd, false, false);
+                if (resp.ok) {
+                    songs+=MPDParseUtils::parseSongs(resp.data, MPDParseUtils::Loc_Search);
                 }
             }
+            getRatings(songs);
         }
     } else {
         Response response=sendCommand(query);
         if (response.ok) {
             songs=MPDParseUtils::parseSongs(response.data, MPDParseUtils::Loc_Search);
+            getRatings(songs);
         }
     }
     emit searchResponse(id, songs);
@@ -2044,53 +2283,174 @@ void MPDConnection::toggleStopAfterCurrent(bool afterCurrent)
     }
 }
 
-bool MPDConnection::recursivelyListDir(const QString &dir, QList<Song> &songs)
+// 'alreadyListed' holds folders whose songs have already been emitted, so for these only sub-folders are
+// listed. This is used when listallinfo fails part way through.
+bool MPDConnection::listDirs(const QStringList &dirs, bool incremental, int &roundTrips, const QSet<QString> &alreadyListed)
 {
-    bool topLevel="/"==dir || ""==dir;
+    QStringList pending=dirs;
+    QList<Song> songs;
+    int maxBatch=constMaxDirsPerListCommand;
 
-    if (topLevel && isMpd()) {
-        // UPnP database backend does not list separate metadata items, so if "list genre" returns
-        // empty response assume this is a UPnP backend and dont attempt to get rest of data...
-        // Although we dont use "list XXX", lsinfo will return duplciate items (due to the way most
-        // UPnP servers returing directories of classifications - Genre/Album/Tracks, Artist/Album/Tracks,
-        // etc...
-        Response response=sendCommand("list genre", false, false);
-        if (!response.ok || response.data.split('\n').length()<3) { // 2 lines - OK and blank
-            // ..just to be 100% sure, check no artists either...
-            response=sendCommand("list artist", false, false);
-            if (!response.ok || response.data.split('\n').length()<3) { // 2 lines - OK and blank
-                return false;
+    while (!pending.isEmpty()) {
+        QStringList batch=pending.mid(0, maxBatch);
+        pending=pending.mid(batch.count());
+
+        QByteArray send="command_list_ok_begin\n";
+        for (const QString &dir: batch) {
+            bool topLevel="/"==dir || dir.isEmpty();
+            send+=(topLevel ? serverInfo.getTopLevelLsinfo() : ("lsinfo "+encodeName(dir)))+'\n';
+        }
+        send+="command_list_end";
+
+        Response response=sendCommand(send, false, false);
+        roundTrips++;
+        QList<QByteArray> replies;
+        if (response.ok) {
+            replies=splitListResponse(response.data);
+        }
+        if (replies.count()!=batch.count()) {
+            // Reply was probably too large for MPD's output buffer - so try again with smaller batches...
+            if (batch.count()>1) {
+                DBUG << "Failed to list" << batch.count() << "folders, reducing batch size";
+                maxBatch=qMax(1, batch.count()/2);
+                pending=batch+pending;
+                continue;
+            }
+            return false;
+        }
+        response.data.clear();
+
+        for (int i=0; i<batch.count(); ++i) {
+            const QString &dir=batch.at(i);
+            bool topLevel="/"==dir || dir.isEmpty();
+            QStringList subDirs;
+            if (incremental) {
+                QList<Song> dirSongs;
+                MPDParseUtils::parseDirItems(replies.at(i), details.dir, ver, dirSongs, topLevel ? QString(QLatin1String("/")) : dir, subDirs, MPDParseUtils::Loc_Library);
+                emit libraryDirSongs(topLevel ? QString(QLatin1String("")) : dir, dirSongs);
+            } else if (alreadyListed.contains(dir)) {
+                QList<Song> dirSongs;
+                MPDParseUtils::parseDirItems(replies.at(i), details.dir, ver, dirSongs, dir, subDirs, MPDParseUtils::Loc_Library);
+                pending+=subDirs;
+            } else {
+                MPDParseUtils::parseDirItems(replies.at(i), details.dir, ver, songs, dir, subDirs, MPDParseUtils::Loc_Library);
+                pending+=subDirs;
             }
         }
+        if (!incremental) {
+            emitLibrarySongs(songs, false);
+        }
     }
+    if (!incremental) {
+        emitLibrarySongs(songs, true);
+    }
+    return true;
+}
 
-    Response response=sendCommand(topLevel
-                                    ? serverInfo.getTopLevelLsinfo()
-                                    : ("lsinfo "+encodeName(dir)));
-    if (response.ok) {
-        QStringList subDirs;
-        MPDParseUtils::parseDirItems(response.data, details.dir, ver, songs, dir, subDirs, MPDParseUtils::Loc_Library);
-        if (songs.count()>=200){
-            QCoreApplication::processEvents();
-            QList<Song> *copy=new QList<Song>();
-            *copy << songs;
-            emit librarySongs(copy);
-            songs.clear();
-        }
-        for (const QString &sub: subDirs) {
-            if (!recursivelyListDir(sub, songs)) {
+bool MPDConnection::listAllInfo(int &roundTrips)
+{
+    // Get top-level items via lsinfo, and then call listallinfo for each top-level folder. This way we
+    // are less likely to exceed MPD's max_output_buffer_size. If listallinfo does fail for a folder, then
+    // revert to using (pipelined) lsinfo calls for that folder.
+    Response response=sendCommand(serverInfo.getTopLevelLsinfo(), false, false);
+    roundTrips++;
+    if (!response.ok) {
+        return false;
+    }
+
+    QList<Song> songs;
+    QStringList topLevelDirs;
+    MPDParseUtils::parseDirItems(response.data, details.dir, ver, songs, QLatin1String("/"), topLevelDirs, MPDParseUtils::Loc_Library);
+    emitLibrarySongs(songs, false);
+
+    for (const QString &topLevelDir: topLevelDirs) {
+        MPDParseUtils::LibraryParser parser(details.dir, ver);
+        response=sendStreamedCommand("listallinfo "+encodeName(topLevelDir), parser);
+        roundTrips++;
+        if (!response.ok) {
+            DBUG << "listallinfo failed for" << topLevelDir << "using lsinfo";
+            // Emit the songs of all folders that were completely read, and skip these when using lsinfo - otherwise
+            // they would be added twice.
+            songs+=parser.songs();
+            emitLibrarySongs(songs, true);
+            if (!listDirs(QStringList() << topLevelDir, false, roundTrips, parser.parsedDirs())) {
                 return false;
             }
+            continue;
         }
+        parser.finish();
+        songs+=parser.songs();
+        emitLibrarySongs(songs, false);
+    }
+    emitLibrarySongs(songs, true);
+    return true;
+}
 
-        if (topLevel && !songs.isEmpty()) {
-            QList<Song> *copy=new QList<Song>();
-            *copy << songs;
-            emit librarySongs(copy);
-        }
-        return true;
+/*
+ * Send a command, and parse its response as it is read. Songs are emitted (to the library DB) in batches
+ * whilst the socket is still being read - so we never hold the complete response in memory. Unlike sendCommand(),
+ * this does not attempt to reconnect, or emit errors, on failure.
+ */
+MPDConnection::Response MPDConnection::sendStreamedCommand(const QByteArray &command, MPDParseUtils::LibraryParser &parser)
+{
+    DBUG << (void *)(&sock) << "sendStreamedCommand:" << log(command);
+    if (!isConnected() || QAbstractSocket::ConnectedState!=sock.state()) {
+        return Response(false);
+    }
+
+    connTimer->stop();
+    Response response(false);
+    if (-1==sock.write(command+'\n')) {
+        DBUG << "Failed to write";
+        sock.close();
     } else {
-        return false;
+        sock.waitForBytesWritten(socketTimeout(command.length()));
+        QByteArray buffer;
+        int attempt=0;
+        while (QAbstractSocket::ConnectedState==sock.state()) {
+            if (0==sock.bytesAvailable() && !sock.waitForReadyRead(constSocketCommsTimeout)) {
+                DBUG << (void *)(&sock) << "Wait for read failed - " << sock.errorString();
+                if (++attempt>=constMaxReadAttempts) {
+                    DBUG << "ERROR: Timedout waiting for response";
+                    sock.close();
+                    break;
+                }
+                continue;
+            }
+            buffer.append(sock.readAll());
+            if (isCompleteResponse(buffer)) {
+                bool ok=buffer.endsWith(constOkNlValue);
+                if (ok) {
+                    parser.parse(buffer.constData(), buffer.length());
+                }
+                response=Response(ok, ok ? QByteArray() : buffer);
+                break;
+            }
+            // Only pass complete lines to parser...
+            int lastNewLine=buffer.lastIndexOf('\n');
+            if (lastNewLine>=0) {
+                parser.parse(buffer.constData(), lastNewLine+1);
+                buffer.remove(0, lastNewLine+1);
+                emitLibrarySongs(parser.songs(), false);
+            }
+        }
+    }
+
+    DBUG << (void *)(&sock) << "sendStreamedCommand - status:" << response.ok;
+    if (QAbstractSocket::ConnectedState==sock.state()) {
+        connTimer->start(constConnTimer);
+    }
+    return response;
+}
+
+void MPDConnection::emitLibrarySongs(QList<Song> &songs, bool force)
+{
+    if (!songs.isEmpty() && (force || songs.count()>=constLibrarySongsBatch)) {
+        QCoreApplication::processEvents();
+        QList<Song> *copy=new QList<Song>();
+        *copy << songs;
+        emit librarySongs(copy);
+        songs.clear();
     }
 }
 
@@ -2242,7 +2602,15 @@ void MPDConnection::setRating(const QString &file, quint8 val)
         clearError();
     }
 
+    ratingStickerSet=ok && ratingCacheValid;
     if (ok) {
+        if (ratingCacheValid) {
+            if (0==val) {
+                ratingCache.remove(file);
+            } else {
+                ratingCache.insert(file, val);
+            }
+        }
         emit rating(file, val);
     } else {
         getRating(file);
@@ -2288,7 +2656,18 @@ void MPDConnection::setRating(const QStringList &files, quint8 val)
         if (!ok) {
             break;
         }
+        if (ratingCacheValid) {
+            for (const QString &f: list) {
+                if (0==val) {
+                    ratingCache.remove(f);
+                } else {
+                    ratingCache.insert(f, val);
+                }
+            }
+        }
     }
+    // A failed command list may have been partially applied, so the cache then needs to be re-read
+    ratingStickerSet=ok && ratingCacheValid;
 
     if (!ok && 0==val) {
         clearError();
@@ -2298,7 +2677,12 @@ void MPDConnection::setRating(const QStringList &files, quint8 val)
 void MPDConnection::getRating(const QString &file)
 {
     quint8 r=0;
-    if (canUseStickers) {
+    if (canUseStickers && !ratingCacheValid) {
+        loadRatingCache();
+    }
+    if (ratingCacheValid) {
+        r=ratingCache.value(file, 0);
+    } else if (canUseStickers) {
         Response resp=sendCommand("sticker get song "+encodeName(file)+' '+constRatingSticker, false);
         if (resp.ok) {
             QByteArray val=MPDParseUtils::parseSticker(resp.data, constRatingSticker);
@@ -2320,6 +2704,80 @@ void MPDConnection::getStickerSupport()
     Response response=sendCommand("commands");
     canUseStickers=response.ok &&
         MPDParseUtils::parseList(response.data, QByteArray("command: ")).toSet().contains("sticker");
+    ratingCacheValid=false;
+    ratingStickerSet=false;
+    ratingCache.clear();
+}
+
+/*
+ * The '=~' filter operator is only available if MPD was built with PCRE - otherwise the filter fails
+ * to parse. Probe this against the play queue, as that is cheap regardless of the library size.
+ */
+void MPDConnection::getRegexFilterSupport()
+{
+    canUseRegexFilter=false;
+    if (isMpd() && ver>=CANTATA_MAKE_VERSION(0, 21, 0)) {
+        canUseRegexFilter=sendCommand("playlistfind \"(file =~ '^$')\"", false, false).ok;
+        if (!canUseRegexFilter) {
+            clearError();
+        }
+    }
+    DBUG << canUseRegexFilter;
+}
+
+/*
+ * Read all rating stickers with a single 'sticker find' call, so that ratings can be looked up locally
+ * rather than via a 'sticker get' round-trip per file. Cache is invalidated when MPD's sticker DB changes.
+ */
+void MPDConnection::loadRatingCache()
+{
+    ratingCache.clear();
+    ratingCacheValid=false;
+    if (!canUseStickers) {
+        return;
+    }
+
+    Response response=sendCommand("sticker find song \"\" "+constRatingSticker, false, false);
+    if (response.ok) {
+        QList<MPDParseUtils::Sticker> stickers=MPDParseUtils::parseStickers(response.data, constRatingSticker);
+        for (const MPDParseUtils::Sticker &sticker: stickers) {
+            if (!sticker.file.isEmpty() && !sticker.value.isEmpty()) {
+                quint8 r=sticker.value.toUInt();
+                if (r>0 && r<=Song::Rating_Max) {
+                    ratingCache.insert(QString::fromUtf8(sticker.file), r);
+                }
+            }
+        }
+        ratingCacheValid=true;
+    } else if (response.data.startsWith(constAckValue)) {
+        // MPD returns an error if there are no rating stickers
+        ratingCacheValid=true;
+    }
+    DBUG << "Rating cache valid:" << ratingCacheValid << "entries:" << ratingCache.count();
+}
+
+// Set ratings of songs found locally (e.g. via LibraryDb), and return these as a search response
+void MPDConnection::addRatings(const QList<Song> &songs, const QString &id)
+{
+    QList<Song> rated=songs;
+    getRatings(rated);
+    emit searchResponse(id, rated);
+}
+
+void MPDConnection::getRatings(QList<Song> &songs)
+{
+    if (canUseStickers && !ratingCacheValid) {
+        loadRatingCache();
+        if (!ratingCacheValid) {
+            return;
+        }
+    }
+    // If stickers are not supported, then ratingCache is empty - and so all songs are unrated.
+    for (Song &s: songs) {
+        if (Song::Standard==s.type) {
+            s.rating=ratingCache.value(s.file, 0);
+        }
+    }
 }
 
 bool MPDConnection::fadingVolume()
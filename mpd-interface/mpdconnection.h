@@ -33,12 +33,14 @@
 #include <QNetworkProxy>
 #include <QStringList>
 #include <QSet>
+#include <QHash>
 #include "mpdstats.h"
 #include "mpdstatus.h"
 #include "song.h"
 #include "output.h"
 #include "playlist.h"
 #include "stream.h"
+#include "mpdparseutils.h"
 #include "config.h"
 #include <time.h>
 
@@ -274,6 +276,7 @@ public:
     bool replaygainSupported() const { return ver>=CANTATA_MAKE_VERSION(0, 16, 0); }
     bool localFilePlaybackSupported() const;
     bool stickersSupported() const { return canUseStickers; }
+    bool regexFilterSupported() const { return canUseRegexFilter; }
 
     long version() const { return ver; }
     static bool isPlaylist(const QString &file);
@@ -342,6 +345,8 @@ public Q_SLOTS:
 
     // Database
     void loadLibrary();
+    void updateLibrary(time_t since);
+    void updateLibraryDirs(const QStringList &dirs);
     void listFolder(const QString &folder);
 
     // Admin
@@ -378,6 +383,7 @@ public Q_SLOTS:
     void setRating(const QString &file, quint8 val);
     void setRating(const QStringList &files, quint8 val);
     void getRating(const QString &file);
+    void addRatings(const QList<Song> &songs, const QString &id);
 
     void seek();
 
@@ -404,6 +410,9 @@ Q_SIGNALS:
     void added(const QStringList &files);
     void replayGain(const QString &);
     void updatingLibrary(time_t dbUpdate);
+    void updatingLibraryIncrementally(time_t dbUpdate);
+    void libraryDirSongs(const QString &dir, const QList<Song> &songs);
+    void libraryFiles(const QSet<QString> &files, const QSet<QString> &dirs);
     void updatedLibrary();
     void updatingFileList();
     void updatedFileList();
@@ -456,11 +465,15 @@ private:
     void disconnectFromMPD();
     ConnectionReturn connectToMPD(MpdSocket &socket, bool enableIdle=false);
     Response sendCommand(const QByteArray &command, bool emitErrors=true, bool retry=true);
+    Response sendStreamedCommand(const QByteArray &command, MPDParseUtils::LibraryParser &parser);
     void initialize();
     void parseIdleReturn(const QByteArray &data);
     bool doMoveInPlaylist(const QString &name, const QList<quint32> &items, quint32 pos, quint32 size);
     void toggleStopAfterCurrent(bool afterCurrent);
-    bool recursivelyListDir(const QString &dir, QList<Song> &songs);
+    bool listAllInfoSupported() const { return useListAllInfo && isMpd(); }
+    bool listDirs(const QStringList &dirs, bool incremental, int &roundTrips, const QSet<QString> &alreadyListed=QSet<QString>());
+    bool listAllInfo(int &roundTrips);
+    void emitLibrarySongs(QList<Song> &songs, bool force);
     QStringList getPlaylistFiles(const QString &name);
     QStringList getAllFiles(const QString &dir);
     bool checkRemoteDynamicSupport();
@@ -472,8 +485,10 @@ private:
     void stopVolumeFade();
     void emitStatusUpdated(MPDStatusValues &v);
     void clearError();
+    void loadRatingCache();
     void getRatings(QList<Song> &songs);
     void getStickerSupport();
+    void getRegexFilterSupport();
     void playFirstTrack(bool emitErrors);
     void determineIfaceIp();
 
@@ -484,6 +499,10 @@ private:
     QSet<QString> handlers;
     QSet<QString> tagTypes;
     bool canUseStickers;
+    bool canUseRegexFilter;
+    bool ratingCacheValid;
+    QHash<QString, quint8> ratingCache; // file -> rating, from 'sticker find'
+    bool ratingStickerSet; // Sticker DB changed by setRating, whose changes are already in ratingCache
     MPDConnectionDetails details;
     time_t dbUpdate;
     // Use 2 sockets, 1 for commands and 1 to receive MPD idle events.
@@ -498,6 +517,7 @@ private:
     QSet<qint32> streamIds;
     quint32 lastStatusPlayQueueVersion;
     quint32 lastUpdatePlayQueueVersion;
+    int playQueueBytesPerSong; // Average size of a song in 'playlistinfo' response
 
     enum State
     {
@@ -521,6 +541,7 @@ private:
     QPropertyAnimation *volumeFade;
     int fadeDuration;
     int restoreVolume;
+    bool useListAllInfo;
 };
 
 #endif
@@ -29,6 +29,9 @@
 #include <QStringList>
 #include <QUrl>
 #include <QFile>
+#include <QVector>
+#include <QPair>
+#include <string.h>
 #include "online/onlineservice.h"
 #include "online/podcastservice.h"
 #include "mpdparseutils.h"
@@ -295,75 +298,205 @@ static QSet<QString> constStdProtocols=QSet<QString>() << constHttpProtocol
                                                        << QLatin1String("rtmpt://")
                                                        << QLatin1String("rtmps://");
 
-Song MPDParseUtils::parseSong(const QList<QByteArray> &lines, Location location)
+// Simple line tokenizer - returns pointers into the original data, so no copies are made.
+class LineIterator
 {
-    Song song;
-    for (const QByteArray &line: lines) {
-        if (line.startsWith(constFileKey)) {
-            song.file = QString::fromUtf8(line.mid(constFileKey.length()));
-        } else if (line.startsWith(constTimeKey) ){
-            song.time = line.mid(constTimeKey.length()).toUInt();
-        } else if (line.startsWith(constAlbumKey)) {
-            song.album = QString::fromUtf8(line.mid(constAlbumKey.length()));
-        } else if (line.startsWith(constArtistKey)) {
-            song.artist = QString::fromUtf8(line.mid(constArtistKey.length()));
-        } else if (line.startsWith(constAlbumArtistKey)) {
-            song.albumartist = QString::fromUtf8(line.mid(constAlbumArtistKey.length()));
-        } else if (line.startsWith(constComposerKey)) {
-            song.setComposer(QString::fromUtf8(line.mid(constComposerKey.length())));
-        } else if (line.startsWith(constTitleKey)) {
-            song.title =QString::fromUtf8(line.mid(constTitleKey.length()));
-        } else if (line.startsWith(constTrackKey)) {
-            int v=line.mid(constTrackKey.length()).split('/').at(0).toInt();
-            song.track = v<0 ? 0 : v;
-        } else if (Loc_Library!=location && Loc_Search!=location && line.startsWith(constIdKey)) {
-            song.id = line.mid(constIdKey.length()).toUInt();
-        } else if (line.startsWith(constDiscKey)) {
-            int v = line.mid(constDiscKey.length()).split('/').at(0).toInt();
-            song.disc = v<0 ? 0 : v;
-        } else if (line.startsWith(constDateKey)) {
-            QByteArray value=line.mid(constDateKey.length());
-            int v=value.length()>4 ? value.left(4).toUInt() : value.toUInt();
-            song.year=v<0 ? 0 : v;
-        } else if (line.startsWith(constOriginalDateKey)) {
-            QByteArray value=line.mid(constOriginalDateKey.length());
-            int v=value.length()>4 ? value.left(4).toUInt() : value.toUInt();
-            song.origYear=v<0 ? 0 : v;
-        } else if (line.startsWith(constGenreKey)) {
-            song.addGenre(QString::fromUtf8(line.mid(constGenreKey.length())));
-        } else if (line.startsWith(constNameKey)) {
-            song.setName(QString::fromUtf8(line.mid(constNameKey.length())));
-        } else if (line.startsWith(constPlaylistKey)) {
-            song.file = QString::fromUtf8(line.mid(constPlaylistKey.length()));
+public:
+    LineIterator(const char *d, int l)
+        : line(0)
+        , len(0)
+        , pos(d)
+        , end(d+l) {
+    }
+
+    bool next() {
+        if (pos>=end) {
+            return false;
+        }
+        line=pos;
+        const char *nl=static_cast<const char *>(memchr(pos, '\n', end-pos));
+        len=(nl ? nl : end)-pos;
+        pos=nl ? nl+1 : end;
+        return true;
+    }
+
+    bool startsWith(const QByteArray &key) const {
+        return len>=key.length() && 0==memcmp(line, key.constData(), key.length());
+    }
+
+    bool operator==(const QByteArray &val) const {
+        return len==val.length() && 0==memcmp(line, val.constData(), len);
+    }
+
+    const char *line;
+    int len;
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+static inline bool keyIs(const char *key, const char *name, int len)
+{
+    return 0==memcmp(key, name, len);
+}
+
+static inline QString toString(const char *value, int len)
+{
+    return QString::fromUtf8(value, len);
+}
+
+static inline int toInt(const char *value, int len)
+{
+    return QByteArray::fromRawData(value, len).toInt();
+}
+
+// Parse numbers such as track/disc, which may be in the form "1/12"
+static inline int toNumber(const char *value, int len)
+{
+    const char *slash=static_cast<const char *>(memchr(value, '/', len));
+    int v=toInt(value, slash ? slash-value : len);
+    return v<0 ? 0 : v;
+}
+
+// MPD only ever sends dates as "YYYY-MM-DDTHH:MM:SSZ", so parse this directly - and only
+// fallback to QDateTime's (slower) parsing if the format does not match.
+static uint toTime(const char *value, int len)
+{
+    if (20==len && '-'==value[4] && '-'==value[7] && 'T'==value[10] && ':'==value[13] && ':'==value[16] && 'Z'==value[19]) {
+        QDate date(toInt(value, 4), toInt(value+5, 2), toInt(value+8, 2));
+        QTime time(toInt(value+11, 2), toInt(value+14, 2), toInt(value+17, 2));
+        if (date.isValid() && time.isValid()) {
+            return QDateTime(date, time, Qt::UTC).toTime_t();
+        }
+    }
+    return QDateTime::fromString(toString(value, len), Qt::ISODate).toTime_t();
+}
+
+static inline int toYear(const char *value, int len)
+{
+    int v=toInt(value, len>4 ? 4 : len);
+    return v<0 ? 0 : v;
+}
+
+static inline void appendPerformer(Song &song, const char *value, int len)
+{
+    if (song.hasPerformer()) {
+        song.setPerformer(song.performer()+QLatin1String(", ")+toString(value, len));
+    } else {
+        song.setPerformer(toString(value, len));
+    }
+}
+
+// Dispatch on key length, and then compare key - this avoids the long chain of startsWith() calls.
+static void parseSongLine(Song &song, const char *line, int len, MPDParseUtils::Location location)
+{
+    const char *sep=static_cast<const char *>(memchr(line, ':', len));
+    if (!sep || sep+1>=line+len || ' '!=sep[1]) {
+        return;
+    }
+    int keyLen=sep-line;
+    const char *value=sep+2;
+    int valueLen=len-(keyLen+2);
+
+    switch (keyLen) {
+    case 2:
+        if (keyIs(line, "Id", 2) && MPDParseUtils::Loc_Library!=location && MPDParseUtils::Loc_Search!=location) {
+            song.id=toInt(value, valueLen);
+        }
+        break;
+    case 4:
+        if (keyIs(line, "file", 4)) {
+            song.file=toString(value, valueLen);
+        } else if (keyIs(line, "Time", 4)) {
+            song.time=QByteArray::fromRawData(value, valueLen).toUInt();
+        } else if (keyIs(line, "Disc", 4)) {
+            song.disc=toNumber(value, valueLen);
+        } else if (keyIs(line, "Date", 4)) {
+            song.year=toYear(value, valueLen);
+        } else if (keyIs(line, "Name", 4)) {
+            song.setName(toString(value, valueLen));
+        } else if (keyIs(line, "Prio", 4) && MPDParseUtils::Loc_PlayQueue==location) {
+            song.priority=QByteArray::fromRawData(value, valueLen).toUInt();
+        }
+        break;
+    case 5:
+        if (keyIs(line, "Album", 5)) {
+            song.album=toString(value, valueLen);
+        } else if (keyIs(line, "Title", 5)) {
+            song.title=toString(value, valueLen);
+        } else if (keyIs(line, "Track", 5)) {
+            song.track=toNumber(value, valueLen);
+        } else if (keyIs(line, "Genre", 5)) {
+            song.addGenre(toString(value, valueLen));
+        }
+        break;
+    case 6:
+        if (keyIs(line, "Artist", 6)) {
+            song.artist=toString(value, valueLen);
+        }
+        break;
+    case 7:
+        if (keyIs(line, "Comment", 7) && MPDParseUtils::Loc_PlayQueue==location) {
+            song.setComment(toString(value, valueLen));
+        }
+        break;
+    case 8:
+        if (keyIs(line, "Composer", 8)) {
+            song.setComposer(toString(value, valueLen));
+        } else if (keyIs(line, "playlist", 8)) {
+            song.file=toString(value, valueLen);
             song.title=Utils::getFile(song.file);
             song.type=Song::Playlist;
-        }  else if (line.startsWith(constAlbumId)) {
-            song.setMbAlbumId(line.mid(constAlbumId.length()));
-        } else if ((Loc_Search==location || Loc_Library==location) && line.startsWith(constLastModifiedKey)) {
-            song.lastModified=QDateTime::fromString(QString::fromUtf8(line.mid(constLastModifiedKey.length())), Qt::ISODate).toTime_t();
-        } else if ((Loc_Search==location || Loc_Playlists==location || Loc_PlayQueue==location) && line.startsWith(constPerformerKey)) {
-            if (song.hasPerformer()) {
-                song.setPerformer(song.performer()+QLatin1String(", ")+QString::fromUtf8(line.mid(constPerformerKey.length())));
-            } else {
-                song.setPerformer(QString::fromUtf8(line.mid(constPerformerKey.length())));
-            }
-        } else if (Loc_PlayQueue==location) {
-            if (line.startsWith(constPriorityKey)) {
-                song.priority = line.mid(constPriorityKey.length()).toUInt();
-            } else if (line.startsWith(constCommentKey)) {
-                song.setComment(QString::fromUtf8(line.mid(constCommentKey.length())));
-            }
-        } else if (Loc_Library==location) {
-            if (line.startsWith(constAlbumSortKey)) {
-                song.setAlbumSort(QString::fromUtf8(line.mid(constAlbumSortKey.length())));
-            } else if (line.startsWith(constArtistSortKey)) {
-                song.setArtistSort(QString::fromUtf8(line.mid(constArtistSortKey.length())));
-            } else if (line.startsWith(constAlbumArtistSortKey)) {
-                song.setAlbumArtistSort(QString::fromUtf8(line.mid(constAlbumArtistSortKey.length())));
+        }
+        break;
+    case 9:
+        if (keyIs(line, "Performer", 9)) {
+            if (MPDParseUtils::Loc_Search==location || MPDParseUtils::Loc_Playlists==location || MPDParseUtils::Loc_PlayQueue==location) {
+                appendPerformer(song, value, valueLen);
             }
+        } else if (keyIs(line, "AlbumSort", 9) && MPDParseUtils::Loc_Library==location) {
+            song.setAlbumSort(toString(value, valueLen));
+        }
+        break;
+    case 10:
+        if (keyIs(line, "ArtistSort", 10) && MPDParseUtils::Loc_Library==location) {
+            song.setArtistSort(toString(value, valueLen));
+        }
+        break;
+    case 11:
+        if (keyIs(line, "AlbumArtist", 11)) {
+            song.albumartist=toString(value, valueLen);
+        }
+        break;
+    case 12:
+        if (keyIs(line, "OriginalDate", 12)) {
+            song.origYear=toYear(value, valueLen);
+        }
+        break;
+    case 13:
+        if (keyIs(line, "Last-Modified", 13) && (MPDParseUtils::Loc_Search==location || MPDParseUtils::Loc_Library==location)) {
+            song.lastModified=toTime(value, valueLen);
         }
+        break;
+    case 15:
+        if (keyIs(line, "AlbumArtistSort", 15) && MPDParseUtils::Loc_Library==location) {
+            song.setAlbumArtistSort(toString(value, valueLen));
+        }
+        break;
+    case 19:
+        if (keyIs(line, "MUSICBRAINZ_ALBUMID", 19)) {
+            song.setMbAlbumId(toString(value, valueLen));
+        }
+        break;
+    default:
+        break;
     }
+}
 
+static void finishSong(Song &song, MPDParseUtils::Location location)
+{
+    using namespace MPDParseUtils;
     if (Song::Playlist!=song.type && song.genres[0].isEmpty()) {
         song.addGenre(Song::unknown());
     }
@@ -441,31 +574,45 @@ Song MPDParseUtils::parseSong(const QList<QByteArray> &lines, Location location)
             song.albumartist=song.artist=PodcastService::constName;
         }
     }
+}
+
+Song MPDParseUtils::parseSong(const char *data, int len, Location location)
+{
+    Song song;
+    LineIterator it(data, len);
+    while (it.next()) {
+        parseSongLine(song, it.line, it.len, location);
+    }
+    finishSong(song, location);
     return song;
 }
 
 QList<Song> MPDParseUtils::parseSongs(const QByteArray &data, Location location)
 {
     QList<Song> songs;
-    QList<QByteArray> currentItem;
-    QList<QByteArray> lines = data.split('\n');
-    int amountOfLines = lines.size();
-
-    for (int i = 0; i < amountOfLines; i++) {
-        const QByteArray &line=lines.at(i);
-        // Skip the "OK" line, this is NOT a song!!!
-        if (constOkValue==line) {
-            continue;
+    LineIterator it(data.constData(), data.length());
+    Song song;
+    bool haveSong=false;
+
+    while (it.next()) {
+        if (it.startsWith(constFileKey)) {
+            if (haveSong) {
+                finishSong(song, location);
+                if (!song.file.isEmpty()) {
+                    songs.append(song);
+                }
+                song=Song();
+            }
+            haveSong=true;
         }
-        if (!line.isEmpty()) {
-            currentItem.append(line);
+        if (haveSong) {
+            parseSongLine(song, it.line, it.len, location);
         }
-        if (i == lines.size() - 1 || lines.at(i + 1).startsWith(constFileKey)) {
-            Song song=parseSong(currentItem, location);
-            if (!song.file.isEmpty()) {
-                songs.append(song);
-            }
-            currentItem.clear();
+    }
+    if (haveSong) {
+        finishSong(song, location);
+        if (!song.file.isEmpty()) {
+            songs.append(song);
         }
     }
 
@@ -552,201 +699,251 @@ MPDParseUtils::MessageMap MPDParseUtils::parseMessages(const QByteArray &data)
 
 void MPDParseUtils::parseDirItems(const QByteArray &data, const QString &mpdDir, long mpdVersion, QList<Song> &songList, const QString &dir, QStringList &subDirs, Location loc)
 {
-    QList<QByteArray> currentItem;
-    QList<QByteArray> lines = data.split('\n');
-    int amountOfLines = lines.size();
     bool parsePlaylists="/"!=dir && ""!=dir;
     bool setSingleTracks=parsePlaylists && singleTracksFolders.contains(dir) && Loc_Browse!=loc;
     QList<Song> songs;
+    QVector<QPair<int, int> > items; // Offset, and length, of each item within data
+    int itemStart=0;
+    LineIterator it(data.constData(), data.length());
+
+    while (it.next()) {
+        if (it.startsWith(constDirectoryKey)) {
+            subDirs.append(toString(it.line+constDirectoryKey.length(), it.len-constDirectoryKey.length()));
+        } else if (it.startsWith(constFileKey) || it.startsWith(constPlaylistKey)) {
+            int pos=it.line-data.constData();
+            if (pos>itemStart) {
+                items.append(qMakePair(itemStart, pos-itemStart));
+            }
+            itemStart=pos;
+        }
+    }
+    if (itemStart<data.length()) {
+        items.append(qMakePair(itemStart, data.length()-itemStart));
+    }
 
-    for (int i = 0; i < amountOfLines; i++) {
-        const QByteArray &line=lines.at(i);
-        if (line.startsWith(constDirectoryKey)) {
-            subDirs.append(QString::fromUtf8(line.mid(constDirectoryKey.length())));
-        }
-        currentItem.append(line);
-        if (i == amountOfLines - 1 || lines.at(i + 1).startsWith(constFileKey) || lines.at(i + 1).startsWith(constPlaylistKey)) {
-            Song currentSong = parseSong(currentItem, Loc_Library);
-            currentItem.clear();
-            if (currentSong.file.isEmpty()) {
+    for (const QPair<int, int> &item: items) {
+        Song currentSong = parseSong(data.constData()+item.first, item.second, Loc_Library);
+        if (currentSong.file.isEmpty()) {
+            continue;
+        }
+
+        if (Song::Playlist==currentSong.type) {
+            // lsinfo will return all stored playlists - but this is deprecated.
+            if (!parsePlaylists) {
                 continue;
             }
 
-            if (Song::Playlist==currentSong.type) {
-                // lsinfo will return all stored playlists - but this is deprecated.
-                if (!parsePlaylists) {
-                    continue;
+            if (!currentSong.isCueFile()) {
+                // In Folders/Browse, we can list all playlists
+                if (Loc_Browse==loc) {
+                    songs.append(currentSong);
                 }
+                // Only add CUE files to library listing...
+                continue;
+            }
 
-                if (!currentSong.isCueFile()) {
-                    // In Folders/Browse, we can list all playlists
-                    if (Loc_Browse==loc) {
-                        songs.append(currentSong);
-                    }
-                    // Only add CUE files to library listing...
+            switch (cueSupport) {
+            case Cue_Ignore:
+                continue;
+                break;
+            case Cue_Parse:
+                if (Loc_Browse==loc) {
+                    songs.append(currentSong);
+                }
+                if (Loc_Library!=loc) {
                     continue;
                 }
+                break;
+            case Cue_ListButDontParse:
+                if (Loc_Browse==loc) {
+                    songs.append(currentSong);
+                }
+            default:
+                continue;
+                break;
+            }
+
+            // No source files for CUE file..
+            if (songs.isEmpty()) {
+                continue;
+            }
+
+            Song firstSong=songs.at(0);
+            QList<Song> cueSongs; // List of songs from cue file
+            QSet<QString> cueFiles; // List of source (flac, mp3, etc) files referenced in cue file
+
+            DBUG << "Got playlist item" << currentSong.file;
 
-                switch (cueSupport) {
-                case Cue_Ignore:
+            bool canSplitCue=mpdVersion>=CANTATA_MAKE_VERSION(0,17,0);
+            bool parseCue=canSplitCue && currentSong.isCueFile() && !mpdDir.startsWith(constHttpProtocol) && QFile::exists(mpdDir+currentSong.file);
+            bool cueParseStatus=false;
+            if (parseCue) {
+                DBUG << "Parsing cue file:" << currentSong.file << "mpdDir:" << mpdDir;
+                cueParseStatus=CueFile::parse(currentSong.file, mpdDir, cueSongs, cueFiles);
+                if (!cueParseStatus) {
+                    DBUG << "Failed to parse cue file!";
                     continue;
-                    break;
-                case Cue_Parse:
-                    if (Loc_Browse==loc) {
-                        songs.append(currentSong);
-                    }
-                    if (Loc_Library!=loc) {
-                        continue;
-                    }
-                    break;
-                case Cue_ListButDontParse:
-                    if (Loc_Browse==loc) {
-                        songs.append(currentSong);
+                } else DBUG << "Parsed cue file, songs:" << cueSongs.count() << "files:" << cueFiles;
+            }
+            if (cueParseStatus && cueSongs.count()>=songs.count() &&
+                    (cueFiles.count()<cueSongs.count() || (firstSong.albumArtist().isEmpty() && firstSong.album.isEmpty()))) {
+
+                bool canUseThisCueFile=true;
+                for (const Song &s: cueSongs) {
+                    if (!QFile::exists(mpdDir+s.name())) {
+                        DBUG << QString(mpdDir+s.name()) << "is referenced in cue file, but does not exist in MPD folder";
+                        canUseThisCueFile=false;
+                        break;
                     }
-                default:
-                    continue;
-                    break;
                 }
 
-                // No source files for CUE file..
-                if (songs.isEmpty()) {
+                if (!canUseThisCueFile) {
                     continue;
                 }
 
-                Song firstSong=songs.at(0);
-                QList<Song> cueSongs; // List of songs from cue file
-                QSet<QString> cueFiles; // List of source (flac, mp3, etc) files referenced in cue file
-
-                DBUG << "Got playlist item" << currentSong.file;
-
-                bool canSplitCue=mpdVersion>=CANTATA_MAKE_VERSION(0,17,0);
-                bool parseCue=canSplitCue && currentSong.isCueFile() && !mpdDir.startsWith(constHttpProtocol) && QFile::exists(mpdDir+currentSong.file);
-                bool cueParseStatus=false;
-                if (parseCue) {
-                    DBUG << "Parsing cue file:" << currentSong.file << "mpdDir:" << mpdDir;
-                    cueParseStatus=CueFile::parse(currentSong.file, mpdDir, cueSongs, cueFiles);
-                    if (!cueParseStatus) {
-                        DBUG << "Failed to parse cue file!";
-                        continue;
-                    } else DBUG << "Parsed cue file, songs:" << cueSongs.count() << "files:" << cueFiles;
-                }
-                if (cueParseStatus && cueSongs.count()>=songs.count() &&
-                        (cueFiles.count()<cueSongs.count() || (firstSong.albumArtist().isEmpty() && firstSong.album.isEmpty()))) {
-
-                    bool canUseThisCueFile=true;
-                    for (const Song &s: cueSongs) {
-                        if (!QFile::exists(mpdDir+s.name())) {
-                            DBUG << QString(mpdDir+s.name()) << "is referenced in cue file, but does not exist in MPD folder";
-                            canUseThisCueFile=false;
-                            break;
-                        }
-                    }
+                bool canUseCueFileTracks=false;
+                QList<Song> fixedCueSongs; // Songs taken from cueSongs that have been updated...
 
-                    if (!canUseThisCueFile) {
-                        continue;
+                if (songs.size()==cueFiles.size()) {
+                    quint32 albumTime=0;
+                    QMap<QString, Song> origFiles;
+                    for (const Song &s: songs) {
+                        origFiles.insert(s.file, s);
+                        albumTime+=s.time;
                     }
-
-                    bool canUseCueFileTracks=false;
-                    QList<Song> fixedCueSongs; // Songs taken from cueSongs that have been updated...
-
-                    if (songs.size()==cueFiles.size()) {
-                        quint32 albumTime=0;
-                        QMap<QString, Song> origFiles;
-                        for (const Song &s: songs) {
-                            origFiles.insert(s.file, s);
-                            albumTime+=s.time;
+                    DBUG << "Original files:" << origFiles.keys();
+
+                    bool setTimeFromSource=origFiles.size()==cueSongs.size();
+                    DBUG << "setTimeFromSource" << setTimeFromSource << "at" << albumTime << "#c" << cueFiles.size();
+                    quint32 usedAlbumTime=0;
+                    for (const Song &orig: cueSongs) {
+                        Song s=orig;
+                        Song albumSong=origFiles[s.name()];
+                        s.setName(QString()); // CueFile has placed source file name here!
+                        if (s.artist.isEmpty() && !albumSong.artist.isEmpty()) {
+                            s.artist=albumSong.artist;
+                            DBUG << "Get artist from album" << albumSong.artist;
                         }
-                        DBUG << "Original files:" << origFiles.keys();
-
-                        bool setTimeFromSource=origFiles.size()==cueSongs.size();
-                        DBUG << "setTimeFromSource" << setTimeFromSource << "at" << albumTime << "#c" << cueFiles.size();
-                        quint32 usedAlbumTime=0;
-                        for (const Song &orig: cueSongs) {
-                            Song s=orig;
-                            Song albumSong=origFiles[s.name()];
-                            s.setName(QString()); // CueFile has placed source file name here!
-                            if (s.artist.isEmpty() && !albumSong.artist.isEmpty()) {
-                                s.artist=albumSong.artist;
-                                DBUG << "Get artist from album" << albumSong.artist;
-                            }
-                            if (s.composer().isEmpty() && !albumSong.composer().isEmpty()) {
-                                s.setComposer(albumSong.composer());
-                                DBUG << "Get composer from album" << albumSong.composer();
-                            }
-                            if (s.album.isEmpty() && !albumSong.album.isEmpty()) {
-                                s.album=albumSong.album;
-                                DBUG << "Get album from album" << albumSong.album;
-                            }
-                            if (s.albumartist.isEmpty() && !albumSong.albumartist.isEmpty()) {
-                                s.albumartist=albumSong.albumartist;
-                                DBUG << "Get albumartist from album" << albumSong.albumartist;
-                            }
-                            if (0==s.year && 0!=albumSong.year) {
-                                s.year=albumSong.year;
-                                DBUG << "Get year from album" << albumSong.year;
-                            }
-                            if (0==s.time && setTimeFromSource) {
-                                s.time=albumSong.time;
-                            } else if (0!=albumTime && 1==cueFiles.size()) {
-                                DBUG << s.title << s.time << albumTime << usedAlbumTime;
-                                // Try to set duration of last track by subtracting previous track durations from album duration...
-                                if (0==s.time) {
-                                    s.time=albumTime-usedAlbumTime;
-                                } else {
-                                    usedAlbumTime+=s.time;
-                                }
-                            }
-                            DBUG << s.title << s.time;
-                            fixedCueSongs.append(s);
+                        if (s.composer().isEmpty() && !albumSong.composer().isEmpty()) {
+                            s.setComposer(albumSong.composer());
+                            DBUG << "Get composer from album" << albumSong.composer();
                         }
-                        canUseCueFileTracks=true;
-                    } else DBUG << "ERROR: file count mismatch" << songs.size() << cueFiles.size();
-
-                    if (!canUseCueFileTracks) {
-                        // Album had a different number of source files to the CUE file. If so, then we need to ensure
-                        // all tracks have meta data - otherwise just fallback to listing file + cue
-                        for (const Song &orig: cueSongs) {
-                            Song s=orig;
-                            s.setName(QString()); // CueFile has placed source file name here!
-                            if (s.artist.isEmpty() || s.album.isEmpty()) {
-                                break;
+                        if (s.album.isEmpty() && !albumSong.album.isEmpty()) {
+                            s.album=albumSong.album;
+                            DBUG << "Get album from album" << albumSong.album;
+                        }
+                        if (s.albumartist.isEmpty() && !albumSong.albumartist.isEmpty()) {
+                            s.albumartist=albumSong.albumartist;
+                            DBUG << "Get albumartist from album" << albumSong.albumartist;
+                        }
+                        if (0==s.year && 0!=albumSong.year) {
+                            s.year=albumSong.year;
+                            DBUG << "Get year from album" << albumSong.year;
+                        }
+                        if (0==s.time && setTimeFromSource) {
+                            s.time=albumSong.time;
+                        } else if (0!=albumTime && 1==cueFiles.size()) {
+                            DBUG << s.title << s.time << albumTime << usedAlbumTime;
+                            // Try to set duration of last track by subtracting previous track durations from album duration...
+                            if (0==s.time) {
+                                s.time=albumTime-usedAlbumTime;
+                            } else {
+                                usedAlbumTime+=s.time;
                             }
-                            fixedCueSongs.append(s);
                         }
-
-                        if (fixedCueSongs.count()==cueSongs.count()) {
-                            canUseCueFileTracks=true;
-                        } else DBUG << "ERROR: Not all cue tracks had meta data";
+                        DBUG << s.title << s.time;
+                        fixedCueSongs.append(s);
                     }
-
-                    if (canUseCueFileTracks) {
-                        songs = fixedCueSongs;
+                    canUseCueFileTracks=true;
+                } else DBUG << "ERROR: file count mismatch" << songs.size() << cueFiles.size();
+
+                if (!canUseCueFileTracks) {
+                    // Album had a different number of source files to the CUE file. If so, then we need to ensure
+                    // all tracks have meta data - otherwise just fallback to listing file + cue
+                    for (const Song &orig: cueSongs) {
+                        Song s=orig;
+                        s.setName(QString()); // CueFile has placed source file name here!
+                        if (s.artist.isEmpty() || s.album.isEmpty()) {
+                            break;
+                        }
+                        fixedCueSongs.append(s);
                     }
-                    continue;
-                }
 
-                if (!firstSong.albumArtist().isEmpty() && !firstSong.album.isEmpty()) {
-                    currentSong.albumartist=firstSong.albumArtist();
-                    currentSong.album=firstSong.album;
-                    songs.append(currentSong);
+                    if (fixedCueSongs.count()==cueSongs.count()) {
+                        canUseCueFileTracks=true;
+                    } else DBUG << "ERROR: Not all cue tracks had meta data";
                 }
-            } else {
-                if (setSingleTracks) {
-                    currentSong.albumartist=Song::variousArtists();
-                    currentSong.album=Song::singleTracks();
-                    currentSong.type=Song::SingleTracks;
-                    currentSong.setAlbumArtistSort(QString());
-                    currentSong.setAlbumSort(QString());
-                    currentSong.setMbAlbumId(QString());
+
+                if (canUseCueFileTracks) {
+                    songs = fixedCueSongs;
                 }
-                currentSong.fillEmptyFields();
+                continue;
+            }
+
+            if (!firstSong.albumArtist().isEmpty() && !firstSong.album.isEmpty()) {
+                currentSong.albumartist=firstSong.albumArtist();
+                currentSong.album=firstSong.album;
                 songs.append(currentSong);
             }
+        } else {
+            if (setSingleTracks) {
+                currentSong.albumartist=Song::variousArtists();
+                currentSong.album=Song::singleTracks();
+                currentSong.type=Song::SingleTracks;
+                currentSong.setAlbumArtistSort(QString());
+                currentSong.setAlbumSort(QString());
+                currentSong.setMbAlbumId(QString());
+            }
+            currentSong.fillEmptyFields();
+            songs.append(currentSong);
         }
     }
     songList+=songs;
 }
 
+void MPDParseUtils::LibraryParser::parse(const char *data, int len)
+{
+    LineIterator it(data, len);
+    while (it.next()) {
+        bool isFile=it.startsWith(constFileKey);
+        if (isFile || it.startsWith(constPlaylistKey)) {
+            int keyLen=isFile ? constFileKey.length() : constPlaylistKey.length();
+            const char *path=it.line+keyLen;
+            int dirLen=it.len-keyLen;
+            while (dirLen>0 && '/'!=path[dirLen-1]) {
+                --dirLen;
+            }
+            if (dirLen>0) {
+                --dirLen; // Remove slash
+            }
+            if (currentDir.length()!=dirLen || 0!=memcmp(currentDir.constData(), path, dirLen)) {
+                parseCurrentDir();
+                currentDir=QByteArray(path, dirLen);
+            }
+            skip=false;
+        } else if (it.startsWith(constDirectoryKey) || it==constOkValue) {
+            // Skip directory entries, and their Last-Modified lines.
+            skip=true;
+            continue;
+        }
+        if (!skip && it.len>0) {
+            currentItems.append(it.line, it.len);
+            currentItems.append('\n');
+        }
+    }
+}
+
+void MPDParseUtils::LibraryParser::parseCurrentDir()
+{
+    if (!currentItems.isEmpty()) {
+        QStringList subDirs;
+        QString dir=currentDir.isEmpty() ? QString(QLatin1String("/")) : QString::fromUtf8(currentDir);
+        parseDirItems(currentItems, mpdDir, mpdVersion, songList, dir, subDirs, Loc_Library);
+        dirs.insert(dir);
+        currentItems.clear();
+    }
+}
+
 QList<Output> MPDParseUtils::parseOuputs(const QByteArray &data)
 {
     QList<Output> outputs;
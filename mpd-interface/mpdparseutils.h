@@ -80,8 +80,8 @@ namespace MPDParseUtils
     extern QList<Playlist> parsePlaylists(const QByteArray &data);
     extern MPDStatsValues parseStats(const QByteArray &data);
     extern MPDStatusValues parseStatus(const QByteArray &data);
-    extern Song parseSong(const QList<QByteArray> &lines, Location location);
-    inline Song parseSong(const QByteArray &data, Location location) { return parseSong(data.split('\n'), location); }
+    extern Song parseSong(const char *data, int len, Location location);
+    inline Song parseSong(const QByteArray &data, Location location) { return parseSong(data.constData(), data.length(), location); }
     extern QList<Song> parseSongs(const QByteArray &data, Location location);
     extern QList<IdPos> parseChanges(const QByteArray &data);
     extern QStringList parseList(const QByteArray &data, const QByteArray &key);
@@ -92,6 +92,37 @@ namespace MPDParseUtils
     extern QByteArray parseSticker(const QByteArray &data, const QByteArray &sticker);
     extern QList<Sticker> parseStickers(const QByteArray &data, const QByteArray &sticker);
     extern QString addStreamName(const QString &url, const QString &name);
+
+    // Parse 'listallinfo' output as it is read from MPD. Items are grouped by folder, and each folder
+    // is parsed (via parseDirItems) as soon as all of its items have been received.
+    class LibraryParser
+    {
+    public:
+        LibraryParser(const QString &dir, long version)
+            : mpdDir(dir)
+            , mpdVersion(version)
+            , skip(true) {
+        }
+
+        // Only complete lines should be passed in.
+        void parse(const char *data, int len);
+        void finish() { parseCurrentDir(); }
+        QList<Song> & songs() { return songList; }
+        // Folders whose songs have been parsed, i.e. all except the one currently being read
+        const QSet<QString> & parsedDirs() const { return dirs; }
+
+    private:
+        void parseCurrentDir();
+
+    private:
+        QString mpdDir;
+        long mpdVersion;
+        bool skip;
+        QByteArray currentDir;
+        QByteArray currentItems;
+        QList<Song> songList;
+        QSet<QString> dirs;
+    };
     extern QString getStreamName(const QString &url);
     extern QString getAndRemoveStreamName(QString &url);
 };
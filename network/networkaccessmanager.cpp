@@ -141,6 +141,7 @@ void NetworkJob::jobFinished()
         for (const QByteArray &header: headers) {
             newReq.setRawHeader(header, origReq.rawHeader(header));
         }
+        newReq.setPriority(origReq.priority());
         QNetworkReply *newJob=static_cast<QNetworkAccessManager *>(j->manager())->get(newReq);
         DBUG << j->url().toString() << "redirected to" << newJob->url().toString();
 
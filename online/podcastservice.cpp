@@ -25,6 +25,8 @@
 #include "podcastsettingsdialog.h"
 #include "rssparser.h"
 #include "support/utils.h"
+#include "support/thread.h"
+#include "support/configuration.h"
 #include "gui/settings.h"
 #include "widgets/icons.h"
 #include "mpd-interface/mpdconnection.h"
@@ -37,12 +39,16 @@
 #include <QCoreApplication>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QSet>
 #include <QTimer>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
 #include <QCryptographicHash>
 #include <QMimeData>
+#include <QBuffer>
+#include <QScopedPointer>
 #include <stdio.h>
 
 PodcastService::Proxy::Proxy(QObject *parent)
@@ -122,7 +128,48 @@ static const QLatin1String constExt(".xml.gz");
 static const char * constNewFeedProperty="new-feed";
 static const char * constRssUrlProperty="rss-url";
 static const char * constDestProperty="dest";
+static const char * constOffsetProperty="offset";
 static const QLatin1String constPartialExt(".partial");
+// Partial downloads are kept so that they may be resumed, but are removed at start-up if not touched for this long.
+static const int constPartialMaxAge=7*24*60*60;
+// Number of episodes to download at once, this can be changed via a hidden config item.
+static const int constMaxDownloads=2;
+
+static int httpStatus(const NetworkJob *job)
+{
+    return job->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+PodcastRssParser::PodcastRssParser()
+{
+    thread=new Thread(metaObject()->className());
+    moveToThread(thread);
+    thread->start();
+    qRegisterMetaType<PodcastRssParser::Feed *>("PodcastRssParser::Feed*");
+    connect(this, SIGNAL(startParsing(PodcastRssParser::Feed*)), this, SLOT(doParsing(PodcastRssParser::Feed*)), Qt::QueuedConnection);
+}
+
+PodcastRssParser::~PodcastRssParser()
+{
+    thread->stop();
+    thread->wait();
+}
+
+void PodcastRssParser::parse(Feed *feed)
+{
+    emit startParsing(feed);
+}
+
+void PodcastRssParser::doParsing(Feed *feed)
+{
+    QBuffer buffer(&feed->data);
+    if (buffer.open(QIODevice::ReadOnly)) {
+        feed->channel=RssParser::parse(&buffer);
+    }
+    buffer.close();
+    feed->data=QByteArray();
+    emit parsed(feed);
+}
 
 static QString generateFileName(const QUrl &url, bool creatingNew)
 {
@@ -216,6 +263,8 @@ PodcastService::Podcast::Podcast(const QString &f)
 static QLatin1String constTopTag("podcast");
 static QLatin1String constImageAttribute("img");
 static QLatin1String constRssAttribute("rss");
+static QLatin1String constEtagAttribute("etag");
+static QLatin1String constModifiedAttribute("modified");
 static QLatin1String constEpisodeTag("episode");
 static QLatin1String constNameAttribute("name");
 static QLatin1String constDescrAttribute("descr");
@@ -252,6 +301,8 @@ bool PodcastService::Podcast::load()
                 url=attributes.value(constRssAttribute).toString();
                 name=attributes.value(constNameAttribute).toString();
                 descr=attributes.value(constDescrAttribute).toString();
+                etag=attributes.value(constEtagAttribute).toString();
+                lastModified=attributes.value(constModifiedAttribute).toString();
                 if (url.isEmpty() || name.isEmpty()) {
                     return false;
                 }
@@ -301,6 +352,12 @@ bool PodcastService::Podcast::save() const
     writer.writeAttribute(constRssAttribute, url.toString()); // ??
     writer.writeAttribute(constNameAttribute, name);
     writer.writeAttribute(constDateAttribute, descr);
+    if (!etag.isEmpty()) {
+        writer.writeAttribute(constEtagAttribute, etag);
+    }
+    if (!lastModified.isEmpty()) {
+        writer.writeAttribute(constModifiedAttribute, lastModified);
+    }
     for (Episode *ep: episodes) {
         writer.writeStartElement(constEpisodeTag);
         writer.writeAttribute(constNameAttribute, ep->name);
@@ -386,9 +443,11 @@ const Song & PodcastService::Podcast::coverSong()
 
 PodcastService::PodcastService(QObject *p)
     : ActionModel(p)
-    , downloadJob(0)
+    , rssParser(0)
     , rssUpdateTimer(0)
 {
+    Configuration cfg(metaObject()->className());
+    maxDownloads=cfg.get("maxDownloads", constMaxDownloads, 1, 10);
     QMetaObject::invokeMethod(this, "loadAll", Qt::QueuedConnection);
     icn.addFile(":"+constName);
     useCovers(name(), true);
@@ -396,6 +455,12 @@ PodcastService::PodcastService(QObject *p)
     connect(MPDConnection::self(), SIGNAL(currentSongUpdated(const Song &)), this, SLOT(currentMpdSong(const Song &)));
 }
 
+PodcastService::~PodcastService()
+{
+    cancelAll();
+    delete rssParser;
+}
+
 QString PodcastService::name() const
 {
     return constName;
@@ -702,6 +767,7 @@ void PodcastService::cancelAll()
         j->cancelAndDelete();
     }
     rssJobs.clear();
+    parsingUrls.clear();
     cancelAllDownloads();
 }
 
@@ -726,114 +792,147 @@ void PodcastService::rssJobFinished()
             }
         }
 
-        RssParser::Channel ch=RssParser::parse(j->actualJob());
-
-        if (!ch.isValid()) {
-            if (isNew) {
-                emit newError(tr("Failed to parse %1").arg(j->origUrl().toString()));
-            } else {
-                emit error(tr("Failed to parse %1").arg(j->origUrl().toString()));
-            }
+        // Feed has not changed since it was last downloaded
+        if (304==httpStatus(j)) {
             return;
         }
 
-        if (ch.video) {
-            if (isNew) {
-                emit newError(tr("Cantata only supports audio podcasts! %1 contains only video podcasts.").arg(j->origUrl().toString()));
-            } else {
-                emit error(tr("Cantata only supports audio podcasts! %1 contains only video podcasts.").arg(j->origUrl().toString()));
-            }
-            return;
+        if (!rssParser) {
+            rssParser=new PodcastRssParser();
+            connect(rssParser, SIGNAL(parsed(PodcastRssParser::Feed*)), this, SLOT(rssParsed(PodcastRssParser::Feed*)), Qt::QueuedConnection);
         }
+        PodcastRssParser::Feed *feed=new PodcastRssParser::Feed(j->origUrl(), isNew);
+        feed->etag=QString::fromLatin1(j->actualJob()->rawHeader("ETag"));
+        feed->lastModified=QString::fromLatin1(j->actualJob()->rawHeader("Last-Modified"));
+        feed->data=j->readAll();
+        parsingUrls.insert(feed->url);
+        rssParser->parse(feed);
+    } else {
+        if (isNew) {
+            emit newError(tr("Failed to download %1").arg(j->origUrl().toString()));
+        } else {
+            emit error(tr("Failed to download %1").arg(j->origUrl().toString()));
+        }
+    }
+}
 
-        int autoDownload=Settings::self()->podcastAutoDownloadLimit();
+void PodcastService::rssParsed(PodcastRssParser::Feed *feed)
+{
+    QScopedPointer<PodcastRssParser::Feed> cleanup(feed);
+    // Ignore results for feeds that were cancelled whilst being parsed
+    if (!parsingUrls.remove(feed->url)) {
+        return;
+    }
 
+    const RssParser::Channel &ch=feed->channel;
+    bool isNew=feed->isNew;
+
+    if (!ch.isValid()) {
         if (isNew) {
-            Podcast *podcast=new Podcast();
-            podcast->url=j->origUrl();
-            podcast->fileName=podcast->imageFile=generateFileName(podcast->url, true);
-            podcast->imageFile=podcast->imageFile.replace(constExt, ".jpg");
-            podcast->imageUrl=ch.image.toString();
-            podcast->name=ch.name;
-            podcast->descr=ch.description;
-            podcast->unplayedCount=ch.episodes.count();
-            for (const RssParser::Episode &ep: ch.episodes) {
-                Episode *episode=new Episode(ep.publicationDate, ep.name, ep.url, podcast);
-                episode->duration=ep.duration;
-                episode->descr=ep.description;
-                podcast->add(episode);
-            }
-            podcast->save();
-            beginInsertRows(QModelIndex(), podcasts.count(), podcasts.count());
-            podcasts.append(podcast);
-            emit dataChanged(QModelIndex(), QModelIndex());
-            if (autoDownload) {
-                int ep=0;
-                for (Episode *episode: podcast->episodes) {
-                    downloadEpisode(podcast, QUrl(episode->url));
-                    if (autoDownload<1000 && ++ep>=autoDownload) {
-                        break;
-                    }
-                }
-            }
-            endInsertRows();
+            emit newError(tr("Failed to parse %1").arg(feed->url.toString()));
         } else {
-            Podcast *podcast = getPodcast(j->origUrl());
-            if (!podcast) {
-                return;
-            }
-            QSet<QUrl> newEpisodes;
-            QSet<QUrl> oldEpisodes;
+            emit error(tr("Failed to parse %1").arg(feed->url.toString()));
+        }
+        return;
+    }
+
+    if (ch.video) {
+        if (isNew) {
+            emit newError(tr("Cantata only supports audio podcasts! %1 contains only video podcasts.").arg(feed->url.toString()));
+        } else {
+            emit error(tr("Cantata only supports audio podcasts! %1 contains only video podcasts.").arg(feed->url.toString()));
+        }
+        return;
+    }
+
+    int autoDownload=Settings::self()->podcastAutoDownloadLimit();
+
+    if (isNew) {
+        Podcast *podcast=new Podcast();
+        podcast->url=feed->url;
+        podcast->fileName=podcast->imageFile=generateFileName(podcast->url, true);
+        podcast->imageFile=podcast->imageFile.replace(constExt, ".jpg");
+        podcast->imageUrl=ch.image.toString();
+        podcast->name=ch.name;
+        podcast->descr=ch.description;
+        podcast->etag=feed->etag;
+        podcast->lastModified=feed->lastModified;
+        podcast->unplayedCount=ch.episodes.count();
+        for (const RssParser::Episode &ep: ch.episodes) {
+            Episode *episode=new Episode(ep.publicationDate, ep.name, ep.url, podcast);
+            episode->duration=ep.duration;
+            episode->descr=ep.description;
+            podcast->add(episode);
+        }
+        podcast->save();
+        beginInsertRows(QModelIndex(), podcasts.count(), podcasts.count());
+        podcasts.append(podcast);
+        emit dataChanged(QModelIndex(), QModelIndex());
+        if (autoDownload) {
+            int ep=0;
             for (Episode *episode: podcast->episodes) {
-                newEpisodes.insert(episode->url);
-            }
-            for (const RssParser::Episode &ep: ch.episodes) {
-                oldEpisodes.insert(ep.url);
+                downloadEpisode(podcast, QUrl(episode->url));
+                if (autoDownload<1000 && ++ep>=autoDownload) {
+                    break;
+                }
             }
+        }
+        endInsertRows();
+    } else {
+        Podcast *podcast = getPodcast(feed->url);
+        if (!podcast) {
+            return;
+        }
+        QSet<QUrl> newEpisodes;
+        QSet<QUrl> oldEpisodes;
+        for (Episode *episode: podcast->episodes) {
+            newEpisodes.insert(episode->url);
+        }
+        for (const RssParser::Episode &ep: ch.episodes) {
+            oldEpisodes.insert(ep.url);
+        }
 
-            QSet<QUrl> added=oldEpisodes-newEpisodes;
-            QSet<QUrl> removed=newEpisodes-oldEpisodes;
-            if (added.count() || removed.count()) {
-                QModelIndex podcastIndex=createIndex(podcasts.indexOf(podcast), 0, (void *)podcast);
-                if (removed.count()) {
-                    for (const QUrl &s: removed) {
-                        Episode *episode=podcast->getEpisode(s);
-                        if (episode->localFile.isEmpty() || !QFile::exists(episode->localFile)) {
-                            int idx=podcast->episodes.indexOf(episode);
-                            if (-1!=idx) {
-                                beginRemoveRows(podcastIndex, idx, idx);
-                                podcast->episodes.removeAt(idx);
-                                delete episode;
-                                endRemoveRows();
-                            }
+        QSet<QUrl> added=oldEpisodes-newEpisodes;
+        QSet<QUrl> removed=newEpisodes-oldEpisodes;
+        bool validatorsChanged=podcast->etag!=feed->etag || podcast->lastModified!=feed->lastModified;
+        podcast->etag=feed->etag;
+        podcast->lastModified=feed->lastModified;
+        if (added.count() || removed.count()) {
+            QModelIndex podcastIndex=createIndex(podcasts.indexOf(podcast), 0, (void *)podcast);
+            if (removed.count()) {
+                for (const QUrl &s: removed) {
+                    Episode *episode=podcast->getEpisode(s);
+                    if (episode->localFile.isEmpty() || !QFile::exists(episode->localFile)) {
+                        int idx=podcast->episodes.indexOf(episode);
+                        if (-1!=idx) {
+                            beginRemoveRows(podcastIndex, idx, idx);
+                            podcast->episodes.removeAt(idx);
+                            delete episode;
+                            endRemoveRows();
                         }
                     }
                 }
-                if (added.count()) {
-                    beginInsertRows(podcastIndex, podcast->episodes.count(), (podcast->episodes.count()+added.count())-1);
-
-                    for (const RssParser::Episode &ep: ch.episodes) {
-                        QString epUrl=ep.url.toString();
-                        if (added.contains(epUrl)) {
-                            Episode *episode=new Episode(ep.publicationDate, ep.name, ep.url, podcast);
-                            episode->duration=ep.duration;
-                            episode->descr=ep.description;
-                            podcast->add(episode);
-                        }
+            }
+            if (added.count()) {
+                beginInsertRows(podcastIndex, podcast->episodes.count(), (podcast->episodes.count()+added.count())-1);
+
+                for (const RssParser::Episode &ep: ch.episodes) {
+                    QString epUrl=ep.url.toString();
+                    if (added.contains(epUrl)) {
+                        Episode *episode=new Episode(ep.publicationDate, ep.name, ep.url, podcast);
+                        episode->duration=ep.duration;
+                        episode->descr=ep.description;
+                        podcast->add(episode);
                     }
-                    endInsertRows();
                 }
-
-                podcast->setUnplayedCount();
-                podcast->save();
-                emit dataChanged(podcastIndex, podcastIndex);
+                endInsertRows();
             }
-        }
-    } else {
-        if (isNew) {
-            emit newError(tr("Failed to download %1").arg(j->origUrl().toString()));
-        } else {
-            emit error(tr("Failed to download %1").arg(j->origUrl().toString()));
+
+            podcast->setUnplayedCount();
+            podcast->save();
+            emit dataChanged(podcastIndex, podcastIndex);
+        } else if (validatorsChanged) {
+            podcast->save();
         }
     }
 }
@@ -911,6 +1010,9 @@ void PodcastService::refreshSubscription(Podcast *item)
 
 bool PodcastService::processingUrl(const QUrl &url) const
 {
+    if (parsingUrls.contains(url)) {
+        return true;
+    }
     for (NetworkJob *j: rssJobs) {
         if (j->origUrl()==url) {
             return true;
@@ -921,7 +1023,16 @@ bool PodcastService::processingUrl(const QUrl &url) const
 
 void PodcastService::addUrl(const QUrl &url, bool isNew)
 {
-    NetworkJob *job=NetworkAccessManager::self()->get(url);
+    QNetworkRequest req(url);
+    Podcast *podcast=isNew ? 0 : getPodcast(url);
+    // Only download the feed if it has changed since it was last downloaded
+    if (podcast && !podcast->etag.isEmpty()) {
+        req.setRawHeader("If-None-Match", podcast->etag.toLatin1());
+    }
+    if (podcast && !podcast->lastModified.isEmpty()) {
+        req.setRawHeader("If-Modified-Since", podcast->lastModified.toLatin1());
+    }
+    NetworkJob *job=NetworkAccessManager::self()->get(req);
     connect(job, SIGNAL(finished()), this, SLOT(rssJobFinished()));
     job->setProperty(constNewFeedProperty, isNew);
     rssJobs.append(job);
@@ -929,8 +1040,10 @@ void PodcastService::addUrl(const QUrl &url, bool isNew)
 
 bool PodcastService::downloadingEpisode(const QUrl &url) const
 {
-    if (downloadJob && downloadJob->origUrl()==url) {
-        return true;
+    for (NetworkJob *job: downloadJobs) {
+        if (job->origUrl()==url) {
+            return true;
+        }
     }
     return toDownload.contains(url);
 }
@@ -942,7 +1055,10 @@ void PodcastService::cancelAllDownloads()
     }
 
     toDownload.clear();
-    cancelDownload();
+    // Keep any partially downloaded files, so that these downloads may be resumed later.
+    for (NetworkJob *job: QList<NetworkJob *>(downloadJobs)) {
+        cancelDownload(job, false);
+    }
 }
 
 void PodcastService::downloadPodcasts(Podcast *pod, const QList<Episode *> &episodes)
@@ -1032,69 +1148,60 @@ void PodcastService::downloadEpisode(const Podcast *podcast, const QUrl &episode
 
 void PodcastService::cancelDownloads(const QList<Episode *> episodes)
 {
-    bool cancelDl=false;
+    bool cancelled=false;
     for (Episode *e: episodes) {
         toDownload.removeAll(e->url);
         e->downloadProg=Episode::NotDownloading;
         QModelIndex idx=createIndex(e->parent->episodes.indexOf(e), 0, (void *)e);
         emit dataChanged(idx, idx);
-        if (!cancelDl && downloadJob && downloadJob->url()==e->url) {
-            cancelDl=true;
+        for (NetworkJob *job: QList<NetworkJob *>(downloadJobs)) {
+            if (job->origUrl()==e->url) {
+                cancelDownload(job, true);
+                cancelled=true;
+            }
         }
     }
-    if (cancelDl) {
-        cancelDownload();
-    }
-}
-
-void PodcastService::cancelDownload(const QUrl &url)
-{
-    if (downloadJob && downloadJob->origUrl()==url) {
-        cancelDownload();
+    if (cancelled) {
         doNextDownload();
     }
 }
 
-void PodcastService::cancelDownload()
+void PodcastService::cancelDownload(NetworkJob *job, bool removePartial)
 {
-    if (downloadJob) {
-        downloadJob->cancelAndDelete();
-        disconnect(downloadJob, SIGNAL(finished()), this, SLOT(downloadJobFinished()));
-        disconnect(downloadJob, SIGNAL(readyRead()), this, SLOT(downloadReadyRead()));
-        disconnect(downloadJob, SIGNAL(downloadPercent(int)), this, SLOT(downloadPercent(int)));
+    disconnect(job, SIGNAL(finished()), this, SLOT(downloadJobFinished()));
+    disconnect(job, SIGNAL(readyRead()), this, SLOT(downloadReadyRead()));
+    disconnect(job, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(downloadProgress(qint64,qint64)));
+    job->cancelAndDelete();
+    downloadJobs.removeAll(job);
 
-        QString dest=downloadJob->property(constDestProperty).toString();
-        QString partial=dest.isEmpty() ? QString() : QString(dest+constPartialExt);
-        if (!partial.isEmpty() && QFile::exists(partial)) {
-            QFile::remove(partial);
-        }
-        updateEpisode(downloadJob->property(constRssUrlProperty).toUrl(), downloadJob->origUrl(), Episode::NotDownloading);
-        downloadJob=0;
+    QString dest=job->property(constDestProperty).toString();
+    QString partial=dest.isEmpty() ? QString() : QString(dest+constPartialExt);
+    if (removePartial && !partial.isEmpty() && QFile::exists(partial)) {
+        QFile::remove(partial);
     }
+    updateEpisode(job->property(constRssUrlProperty).toUrl(), job->origUrl(), Episode::NotDownloading);
 }
 
 void PodcastService::doNextDownload()
 {
-    if (downloadJob) {
-        return;
-    }
-
-    if (toDownload.isEmpty()) {
-        return;
-    }
-
-    DownloadEntry entry=toDownload.takeFirst();
-    downloadJob=NetworkAccessManager::self()->get(entry.url);
-    connect(downloadJob, SIGNAL(finished()), this, SLOT(downloadJobFinished()));
-    connect(downloadJob, SIGNAL(readyRead()), this, SLOT(downloadReadyRead()));
-    connect(downloadJob, SIGNAL(downloadPercent(int)), this, SLOT(downloadPercent(int)));
-    downloadJob->setProperty(constRssUrlProperty, entry.rssUrl);
-    downloadJob->setProperty(constDestProperty, entry.dest);
-    updateEpisode(entry.rssUrl, entry.url, 0);
+    while (downloadJobs.count()<maxDownloads && !toDownload.isEmpty()) {
+        DownloadEntry entry=toDownload.takeFirst();
+        QNetworkRequest req(entry.url);
+        // If a previous download of this episode was interrupted, then only request the remainder.
+        qint64 offset=QFileInfo(entry.dest+constPartialExt).size();
+        if (offset>0) {
+            req.setRawHeader("Range", "bytes="+QByteArray::number(offset)+"-");
+        }
 
-    QString partial=entry.dest+constPartialExt;
-    if (QFile::exists(partial)) {
-        QFile::remove(partial);
+        NetworkJob *job=NetworkAccessManager::self()->get(req);
+        connect(job, SIGNAL(finished()), this, SLOT(downloadJobFinished()));
+        connect(job, SIGNAL(readyRead()), this, SLOT(downloadReadyRead()));
+        connect(job, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(downloadProgress(qint64,qint64)));
+        job->setProperty(constRssUrlProperty, entry.rssUrl);
+        job->setProperty(constDestProperty, entry.dest);
+        job->setProperty(constOffsetProperty, offset);
+        downloadJobs.append(job);
+        updateEpisode(entry.rssUrl, entry.url, 0);
     }
 }
 
@@ -1118,12 +1225,16 @@ void PodcastService::clearPartialDownloads()
         return;
     }
 
+    // Recent partials are kept, so that their downloads can be resumed
+    QDateTime now=QDateTime::currentDateTime();
     dest=Utils::fixPath(dest);
     QStringList sub=QDir(dest).entryList(QDir::Dirs|QDir::NoDotAndDotDot);
     for (const QString &d: sub) {
-        QStringList partials=QDir(dest+d).entryList(QStringList() << QLatin1Char('*')+constPartialExt, QDir::Files);
-        for (const QString &p: partials) {
-            QFile::remove(dest+d+Utils::constDirSep+p);
+        QFileInfoList partials=QDir(dest+d).entryInfoList(QStringList() << QLatin1Char('*')+constPartialExt, QDir::Files);
+        for (const QFileInfo &p: partials) {
+            if (p.lastModified().secsTo(now)>constPartialMaxAge) {
+                QFile::remove(p.absoluteFilePath());
+            }
         }
     }
 }
@@ -1131,27 +1242,23 @@ void PodcastService::clearPartialDownloads()
 void PodcastService::downloadJobFinished()
 {
     NetworkJob *job=dynamic_cast<NetworkJob *>(sender());
-    if (!job || job!=downloadJob) {
+    if (!job || !downloadJobs.contains(job)) {
         return;
     }
     job->deleteLater();
+    downloadJobs.removeAll(job);
 
+    QUrl rssUrl=job->property(constRssUrlProperty).toUrl();
     QString dest=job->property(constDestProperty).toString();
     QString partial=dest.isEmpty() ? QString() : QString(dest+constPartialExt);
 
     if (job->ok()) {
-        QString dest=job->property(constDestProperty).toString();
-        if (dest.isEmpty()) {
-            return;
-        }
-
-        QString partial=dest+constPartialExt;
-        if (QFile::exists(partial)) {
+        if (!partial.isEmpty() && QFile::exists(partial)) {
             if (QFile::exists(dest)) {
                 QFile::remove(dest);
             }
             if (QFile::rename(partial, dest)) {
-                Podcast *pod=getPodcast(job->property(constRssUrlProperty).toUrl());
+                Podcast *pod=getPodcast(rssUrl);
                 if (pod) {
                     Episode *episode=pod->getEpisode(job->origUrl());
                     if (episode) {
@@ -1163,23 +1270,39 @@ void PodcastService::downloadJobFinished()
                 }
             }
         }
-    } else if (!partial.isEmpty() && QFile::exists(partial)) {
+    } else if (416==httpStatus(job) && !partial.isEmpty()) {
+        // Partial file does not match the episode on the server, so download it all again.
         QFile::remove(partial);
+        toDownload.prepend(DownloadEntry(job->origUrl(), rssUrl, dest));
+        updateEpisode(rssUrl, job->origUrl(), Episode::QueuedForDownload);
+        doNextDownload();
+        return;
     }
-    updateEpisode(job->property(constRssUrlProperty).toUrl(), job->origUrl(), Episode::NotDownloading);
-    downloadJob=0;
+    // For other errors the partial file is kept, so that the download may be resumed.
+    updateEpisode(rssUrl, job->origUrl(), Episode::NotDownloading);
     doNextDownload();
 }
 
 void PodcastService::downloadReadyRead()
 {
     NetworkJob *job=dynamic_cast<NetworkJob *>(sender());
-    if (!job || job!=downloadJob) {
+    if (!job || !downloadJobs.contains(job)) {
+        return;
+    }
+    int status=httpStatus(job);
+    if (0!=status && 200!=status && 206!=status) {
+        // Don't append error pages to the episode!
+        job->readAll();
         return;
     }
     QString dest=job->property(constDestProperty).toString();
     QString partial=dest.isEmpty() ? QString() : QString(dest+constPartialExt);
     if (!partial.isEmpty()) {
+        if (206!=status && job->property(constOffsetProperty).toLongLong()>0) {
+            // Server ignored the range request, and is sending the whole episode - so start the file again.
+            job->setProperty(constOffsetProperty, 0);
+            QFile::remove(partial);
+        }
         QString dir=Utils::getDir(partial);
         if (!QDir(dir).exists()) {
             QDir(dir).mkpath(dir);
@@ -1203,13 +1326,16 @@ void PodcastService::downloadReadyRead()
     }
 }
 
-void PodcastService::downloadPercent(int pc)
+void PodcastService::downloadProgress(qint64 bytesReceived, qint64 bytesTotal)
 {
     NetworkJob *job=dynamic_cast<NetworkJob *>(sender());
-    if (!job || job!=downloadJob) {
+    if (!job || !downloadJobs.contains(job)) {
         return;
     }
-    updateEpisode(job->property(constRssUrlProperty).toUrl(), job->origUrl(), pc);
+    // Progress of a resumed download is reported relative to the whole episode.
+    qint64 offset=job->property(constOffsetProperty).toLongLong();
+    int pc=bytesTotal>0 ? (int)(((bytesReceived+offset)*100)/(bytesTotal+offset)) : 0;
+    updateEpisode(job->property(constRssUrlProperty).toUrl(), job->origUrl(), qMin(pc, 100));
 }
 
 void PodcastService::startRssUpdateTimer()
@@ -28,6 +28,7 @@
 #include "models/actionmodel.h"
 #include "models/proxymodel.h"
 #include "mpd-interface/song.h"
+#include "rssparser.h"
 #include <QLatin1String>
 #include <QList>
 #include <QDateTime>
@@ -36,6 +37,39 @@
 
 class QTimer;
 class NetworkJob;
+class Thread;
+
+// Parses RSS feeds in a background thread.
+class PodcastRssParser : public QObject
+{
+    Q_OBJECT
+public:
+    struct Feed
+    {
+        Feed(const QUrl &u=QUrl(), bool n=false) : url(u), isNew(n) { }
+        QUrl url;
+        bool isNew;
+        QString etag;
+        QString lastModified;
+        QByteArray data;
+        RssParser::Channel channel;
+    };
+
+    PodcastRssParser();
+    virtual ~PodcastRssParser();
+    // Takes ownership of 'feed', which is returned - with its data replaced by the parsed channel - via parsed()
+    void parse(Feed *feed);
+
+Q_SIGNALS:
+    void startParsing(PodcastRssParser::Feed *feed);
+    void parsed(PodcastRssParser::Feed *feed);
+
+private Q_SLOTS:
+    void doParsing(PodcastRssParser::Feed *feed);
+
+private:
+    Thread *thread;
+};
 
 class PodcastService : public ActionModel, public OnlineService
 {
@@ -91,6 +125,9 @@ public:
         QString fileName;
         QString imageFile;
         QUrl imageUrl;
+        // HTTP validators of the last RSS download, used for conditional refreshes
+        QString etag;
+        QString lastModified;
         Song song;
     };
 
@@ -114,7 +151,7 @@ public:
     static const QLatin1String constName;
 
     PodcastService(QObject *p);
-    virtual ~PodcastService() { cancelAll(); }
+    virtual ~PodcastService();
 
     Song & fixPath(Song &song) const;
     QString name() const;
@@ -147,7 +184,7 @@ public:
     static QUrl fixUrl(const QUrl &orig);
     static bool isUrlOk(const QUrl &u) { return QLatin1String("http")==u.scheme() || QLatin1String("https")==u.scheme(); }
 
-    bool isDownloading() const { return 0!=downloadJob; }
+    bool isDownloading() const { return !downloadJobs.isEmpty(); }
     void cancelAllDownloads();
     void downloadPodcasts(Podcast *pod, const QList<Episode *> &episodes);
     void deleteDownloadedPodcasts(Podcast *pod, const QList<Episode *> &episodes);
@@ -166,8 +203,7 @@ private:
     bool downloadingEpisode(const QUrl &url) const;
     void downloadEpisode(const Podcast *podcast, const QUrl &episode);
     void cancelDownloads(const QList<Episode *> episodes);
-    void cancelDownload(const QUrl &url);
-    void cancelDownload();
+    void cancelDownload(NetworkJob *job, bool removePartial);
     void doNextDownload();
     void updateEpisode(const QUrl &rssUrl, const QUrl &url, int pc);
     void clearPartialDownloads();
@@ -175,11 +211,12 @@ private:
 private Q_SLOTS:
     void loadAll();
     void rssJobFinished();
+    void rssParsed(PodcastRssParser::Feed *feed);
     void updateRss();
     void currentMpdSong(const Song &s);
     void downloadJobFinished();
     void downloadReadyRead();
-    void downloadPercent(int pc);
+    void downloadProgress(qint64 bytesReceived, qint64 bytesTotal);
 
 private:
     struct DownloadEntry
@@ -194,7 +231,10 @@ private:
 
     QList<Podcast *> podcasts;
     QList<NetworkJob *> rssJobs;
-    NetworkJob * downloadJob;
+    PodcastRssParser *rssParser;
+    QSet<QUrl> parsingUrls;
+    QList<NetworkJob *> downloadJobs;
+    int maxDownloads;
     QList<DownloadEntry> toDownload;
     QTimer *rssUpdateTimer;
     QDateTime lastRssUpdate;
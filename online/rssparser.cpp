@@ -24,7 +24,6 @@
 #include "rssparser.h"
 #include <QXmlStreamReader>
 #include <QStringList>
-#include <QSet>
 
 static const char * constITunesNameSpace = "http://www.itunes.com/dtds/podcast-1.0.dtd";
 static const char * constMediaNameSpace = "http://search.yahoo.com/mrss/";
@@ -102,6 +101,14 @@ static QUrl parseImage(QXmlStreamReader &reader)
     return url;
 }
 
+// Feeds are parsed in a background thread, so this must not use a lazily initialised static set.
+static bool isAudioFormat(const QString &type)
+{
+    return 0==type.compare(QLatin1String("mp3"), Qt::CaseInsensitive) ||
+           0==type.compare(QLatin1String("ogg"), Qt::CaseInsensitive) ||
+           0==type.compare(QLatin1String("wma"), Qt::CaseInsensitive);
+}
+
 static Episode parseEpisode(QXmlStreamReader &reader)
 {
     Episode ep;
@@ -125,14 +132,8 @@ static Episode parseEpisode(QXmlStreamReader &reader)
                 ep.duration=reader.attributes().value(QLatin1String("duration")).toString().toUInt();
                 consumeCurrentElement(reader);
             } else if (QLatin1String("enclosure")==name) {
-                static QSet<QString> audioFormats;
-                if (audioFormats.isEmpty()) {
-                    audioFormats.insert(QLatin1String("mp3")); audioFormats.insert(QLatin1String("MP3"));
-                    audioFormats.insert(QLatin1String("ogg")); audioFormats.insert(QLatin1String("OGG"));
-                    audioFormats.insert(QLatin1String("wma")); audioFormats.insert(QLatin1String("WMA"));
-                }
                 QString type=reader.attributes().value(QLatin1String("type")).toString();
-                if (type.startsWith(QLatin1String("audio/")) || audioFormats.contains(type)) {
+                if (type.startsWith(QLatin1String("audio/")) || isAudioFormat(type)) {
                     isAudio=true;
                     ep.url=QUrl::fromEncoded(reader.attributes().value(QLatin1String("url")).toString().toLatin1());
                 } else if (type.startsWith(QLatin1String("video/")) ) {
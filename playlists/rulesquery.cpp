@@ -0,0 +1,320 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "rulesquery.h"
+#include "mpd-interface/mpdconnection.h"
+#include "models/mpdlibrarymodel.h"
+#include <QRegularExpression>
+#include <QSet>
+#include <QDebug>
+
+static bool debugEnabled=false;
+#define DBUG if (debugEnabled) qWarning() << "RulesQuery" << __FUNCTION__
+
+void RulesQuery::enableDebug()
+{
+    debugEnabled=true;
+}
+
+QString RulesQuery::planStr(Plan p)
+{
+    switch (p) {
+    case Plan_MpdFilter: return QLatin1String("mpd-filter");
+    case Plan_LocalDb:   return QLatin1String("local-db");
+    default:
+    case Plan_MpdFind:   return QLatin1String("mpd-find");
+    }
+}
+
+// Quote a value for use within an MPD filter expression
+static QString filterValue(const QString &val)
+{
+    return QLatin1Char('\'')+QString(val).replace(QLatin1String("\\"), QLatin1String("\\\\")).replace(QLatin1String("'"), QLatin1String("\\'"))+QLatin1Char('\'');
+}
+
+// Create a regular expression to match years from..to, using decades where possible - e.g. 1958-1971
+// becomes ^(1958|1959|196[0-9]|1970|1971)
+static QString yearRegex(int from, int to)
+{
+    QStringList parts;
+    for (int y=from; y<=to; ) {
+        if (0==y%10 && y+9<=to) {
+            parts.append(QString::number(y/10)+QLatin1String("[0-9]"));
+            y+=10;
+        } else {
+            parts.append(QString::number(y));
+            ++y;
+        }
+    }
+    return QLatin1String("^(")+parts.join(QLatin1String("|"))+QLatin1Char(')');
+}
+
+// Escape characters that have special meaning in SQL 'like' patterns
+static QString likeValue(const QString &val)
+{
+    return QLatin1Char('%')+QString(val).replace(QLatin1String("\\"), QLatin1String("\\\\"))
+                                        .replace(QLatin1String("%"), QLatin1String("\\%"))
+                                        .replace(QLatin1String("_"), QLatin1String("\\_"))+QLatin1Char('%');
+}
+
+static QString sqlColumn(const QString &key)
+{
+    if (RulesPlaylists::constArtistKey==key) {
+        return QLatin1String("artist");
+    }
+    if (RulesPlaylists::constAlbumArtistKey==key) {
+        return QLatin1String("albumArtist");
+    }
+    if (RulesPlaylists::constComposerKey==key) {
+        return QLatin1String("composer");
+    }
+    if (RulesPlaylists::constAlbumKey==key) {
+        // If album name is the same as its ID, then only the ID is stored. See LibraryDb::insertSong
+        return QLatin1String("coalesce(nullif(album, ''), albumId)");
+    }
+    if (RulesPlaylists::constTitleKey==key) {
+        return QLatin1String("title");
+    }
+    if (RulesPlaylists::constFileKey==key) {
+        return QLatin1String("file");
+    }
+    return QString(); // Comment, etc, are not stored in DB
+}
+
+RulesQuery::RulesQuery(const RulesPlaylists::Entry &e)
+    : queryPlan(Plan_MpdFind)
+{
+    bool canUseDb=true;
+    QList<RulesPlaylists::Rule>::ConstIterator it = e.rules.constBegin();
+    QList<RulesPlaylists::Rule>::ConstIterator end = e.rules.constEnd();
+
+    for (; it!=end; ++it) {
+        Rule rule;
+        RulesPlaylists::Rule::ConstIterator rIt = (*it).constBegin();
+        RulesPlaylists::Rule::ConstIterator rEnd = (*it).constEnd();
+
+        for (; rIt!=rEnd; ++rIt) {
+            if (RulesPlaylists::constDateKey==rIt.key()) {
+                QStringList parts=rIt.value().trimmed().split(RulesPlaylists::constRangeSep);
+                if (2==parts.length()) {
+                    int from = parts.at(0).toInt();
+                    int to = parts.at(1).toInt();
+                    rule.dateFrom = qMin(from, to);
+                    rule.dateTo = qMax(from, to);
+                } else if (1==parts.length()) {
+                    rule.dateFrom = rule.dateTo = parts.at(0).toInt();
+                }
+            } else if (RulesPlaylists::constGenreKey==rIt.key() && rIt.value().trimmed().endsWith("*")) {
+                rule.genrePrefix=rIt.value().left(rIt.value().length()-1);
+            } else if (RulesPlaylists::constArtistKey==rIt.key() || RulesPlaylists::constAlbumKey==rIt.key() ||
+                       RulesPlaylists::constAlbumArtistKey==rIt.key() || RulesPlaylists::constComposerKey==rIt.key() ||
+                       RulesPlaylists::constCommentKey==rIt.key() || RulesPlaylists::constTitleKey==rIt.key() ||
+                       RulesPlaylists::constGenreKey==rIt.key() || RulesPlaylists::constFileKey==rIt.key()) {
+                rule.tags.append(qMakePair(rIt.key(), rIt.value()));
+                if (RulesPlaylists::constGenreKey!=rIt.key() && sqlColumn(rIt.key()).isEmpty()) {
+                    canUseDb=false;
+                }
+            } else if (RulesPlaylists::constExactKey==rIt.key()) {
+                if ("false" == rIt.value()) {
+                    rule.exact = false;
+                }
+            } else if (RulesPlaylists::constExcludeKey==rIt.key()) {
+                if ("true" == rIt.value()) {
+                    rule.include = false;
+                }
+            }
+        }
+
+        if (!rule.isEmpty()) {
+            rules.append(rule);
+        }
+    }
+
+    // Genre prefixes and date ranges are matched with '=~', which needs MPD to have been built with PCRE
+    bool needRegex=false;
+    for (const Rule &rule: rules) {
+        if (!rule.genrePrefix.isEmpty() || 0!=rule.dateFrom) {
+            needRegex=true;
+            break;
+        }
+    }
+
+    MPDConnection *conn=MPDConnection::self();
+    if (conn->isMpd() && conn->version()>=CANTATA_MAKE_VERSION(0, 21, 0) && (!needRegex || conn->regexFilterSupported())) {
+        queryPlan=Plan_MpdFilter;
+    } else if (canUseDb && MpdLibraryModel::self()->trackCount()>0) {
+        queryPlan=Plan_LocalDb;
+    } else {
+        queryPlan=Plan_MpdFind;
+    }
+    DBUG << e.name << "rules:" << rules.count() << "regex:" << needRegex << "plan:" << planStr(queryPlan);
+}
+
+void RulesQuery::mpdCommands(QList<QByteArray> &include, QList<QByteArray> &exclude) const
+{
+    for (const Rule &rule: rules) {
+        QList<QByteArray> cmds;
+        if (Plan_MpdFilter==queryPlan) {
+            cmds.append(mpdFilter(rule));
+        } else {
+            cmds=mpdFind(rule);
+        }
+        DBUG << (rule.include ? "include" : "exclude") << cmds.count() << "command(s)" << cmds.mid(0, 5);
+        if (rule.include) {
+            include+=cmds;
+        } else {
+            exclude+=cmds;
+        }
+    }
+}
+
+QString RulesQuery::sqlWhere(QVariantList &values) const
+{
+    QStringList include;
+    QStringList exclude;
+
+    for (const Rule &rule: rules) {
+        QString clause=sqlWhere(rule, values);
+        if (rule.include) {
+            include.append(clause);
+        } else {
+            exclude.append(clause);
+        }
+    }
+
+    QString where=QString("type!=%1").arg((int)Song::Playlist);
+    if (!include.isEmpty()) {
+        where+=QLatin1String(" AND (")+include.join(QLatin1String(" OR "))+QLatin1Char(')');
+    }
+    if (!exclude.isEmpty()) {
+        where+=QLatin1String(" AND NOT (")+exclude.join(QLatin1String(" OR "))+QLatin1Char(')');
+    }
+    DBUG << where << values;
+    return where;
+}
+
+QByteArray RulesQuery::mpdFilter(const Rule &rule) const
+{
+    QStringList parts;
+    for (const auto &tag: rule.tags) {
+        parts.append(QLatin1Char('(')+tag.first+(rule.exact ? QLatin1String(" == ") : QLatin1String(" contains "))+filterValue(tag.second)+QLatin1Char(')'));
+    }
+    if (!rule.genrePrefix.isEmpty()) {
+        parts.append(QLatin1String("(Genre =~ ")+filterValue(QLatin1Char('^')+QRegularExpression::escape(rule.genrePrefix))+QLatin1Char(')'));
+    }
+    if (0!=rule.dateFrom) {
+        parts.append(QLatin1String("(Date =~ ")+filterValue(yearRegex(rule.dateFrom, rule.dateTo))+QLatin1Char(')'));
+    }
+
+    // 'search' is the case-insensitive version of 'find'
+    QByteArray cmd=rule.exact ? "find " : "search ";
+    return cmd+MPDConnection::encodeName(1==parts.count() ? parts.first() : (QLatin1Char('(')+parts.join(QLatin1String(" AND "))+QLatin1Char(')')));
+}
+
+QList<QByteArray> RulesQuery::mpdFind(const Rule &rule) const
+{
+    QByteArray match = rule.exact ? "find" : "search";
+    QByteArray baseRule;
+    QList<int> dates;
+    QStringList genres;
+
+    for (const auto &tag: rule.tags) {
+        baseRule += " " + tag.first.toLatin1() + " " + MPDConnection::encodeName(tag.second);
+    }
+    if (0!=rule.dateFrom) {
+        for (int i=rule.dateFrom; i<=rule.dateTo; ++i) {
+            dates.append(i);
+        }
+    }
+    if (!rule.genrePrefix.isEmpty()) {
+        for (const QString &g: MpdLibraryModel::self()->getGenres()) {
+            if (g.startsWith(rule.genrePrefix)) {
+                genres.append(g);
+            }
+        }
+    }
+
+    QList<QByteArray> cmds;
+    if (genres.isEmpty()) {
+        if (dates.isEmpty()) {
+            if (!baseRule.isEmpty()) {
+                cmds.append(match + baseRule);
+            }
+        } else {
+            for (int d: dates) {
+                cmds.append(match + baseRule + " Date \"" + QByteArray::number(d) + "\"");
+            }
+        }
+    } else {
+        for (const QString &genre: genres) {
+            QByteArray cmd = match + baseRule + " Genre " + MPDConnection::encodeName(genre);
+            if (dates.isEmpty()) {
+                cmds.append(cmd);
+            } else {
+                for (int d: dates) {
+                    cmds.append(cmd + " Date \"" + QByteArray::number(d) + "\"");
+                }
+            }
+        }
+    }
+    return cmds;
+}
+
+QString RulesQuery::sqlWhere(const Rule &rule, QVariantList &values) const
+{
+    QStringList parts;
+    for (const auto &tag: rule.tags) {
+        QStringList columns;
+        if (RulesPlaylists::constGenreKey==tag.first) {
+            for (int i=0; i<Song::constNumGenres; ++i) {
+                columns.append(QLatin1String("genre")+QString::number(i+1));
+            }
+        } else {
+            columns.append(sqlColumn(tag.first));
+        }
+        QStringList checks;
+        for (const QString &col: columns) {
+            if (rule.exact) {
+                checks.append(col+QLatin1String("=?"));
+                values.append(tag.second);
+            } else {
+                checks.append(col+QLatin1String(" like ? escape '\\'"));
+                values.append(likeValue(tag.second));
+            }
+        }
+        parts.append(QLatin1Char('(')+checks.join(QLatin1String(" OR "))+QLatin1Char(')'));
+    }
+    if (!rule.genrePrefix.isEmpty()) {
+        QStringList checks;
+        for (int i=0; i<Song::constNumGenres; ++i) {
+            checks.append(QString("substr(genre%1, 1, %2)=?").arg(i+1).arg(rule.genrePrefix.length()));
+            values.append(rule.genrePrefix);
+        }
+        parts.append(QLatin1Char('(')+checks.join(QLatin1String(" OR "))+QLatin1Char(')'));
+    }
+    if (0!=rule.dateFrom) {
+        // Integers are placed inline, as sqlite can get confused with bound integers
+        parts.append(QString("(year>=%1 AND year<=%2)").arg(rule.dateFrom).arg(rule.dateTo));
+    }
+    return QLatin1Char('(')+parts.join(QLatin1String(" AND "))+QLatin1Char(')');
+}
@@ -0,0 +1,86 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef RULES_QUERY_H
+#define RULES_QUERY_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+#include "rulesplaylists.h"
+
+/*
+ * Compile the rules of a rules (smart) playlist into queries. Depending upon the capabilities of the MPD
+ * server, and whether the local library DB can be used, this produces either:
+ *
+ *   Plan_MpdFilter  - one MPD filter expression per rule, e.g. ((Date =~ '^(196[0-9])') AND (Genre =~ '^Rock'))
+ *                     ('=~' is only used if MPD supports it, i.e. was built with PCRE)
+ *   Plan_LocalDb    - a single SQL statement, evaluated against the LibraryDb songs table
+ *   Plan_MpdFind    - the old style find/search commands, one per genre/year combination
+ */
+class RulesQuery
+{
+public:
+    static void enableDebug();
+
+    enum Plan {
+        Plan_MpdFilter,
+        Plan_LocalDb,
+        Plan_MpdFind
+    };
+
+    static QString planStr(Plan p);
+
+    RulesQuery(const RulesPlaylists::Entry &e);
+
+    Plan plan() const { return queryPlan; }
+    bool isEmpty() const { return rules.isEmpty(); }
+    // MPD commands - only valid for Plan_MpdFilter, and Plan_MpdFind
+    void mpdCommands(QList<QByteArray> &include, QList<QByteArray> &exclude) const;
+    // Where clause for songs table - only valid for Plan_LocalDb
+    QString sqlWhere(QVariantList &values) const;
+
+private:
+    struct Rule {
+        Rule() : include(true), exact(true), dateFrom(0), dateTo(0) { }
+        bool isEmpty() const { return tags.isEmpty() && genrePrefix.isEmpty() && 0==dateFrom; }
+        bool include;
+        bool exact;
+        QList<QPair<QString, QString> > tags;
+        QString genrePrefix;
+        int dateFrom;
+        int dateTo;
+    };
+
+    QByteArray mpdFilter(const Rule &rule) const;
+    QList<QByteArray> mpdFind(const Rule &rule) const;
+    QString sqlWhere(const Rule &rule, QVariantList &values) const;
+
+private:
+    Plan queryPlan;
+    QList<Rule> rules;
+};
+
+#endif
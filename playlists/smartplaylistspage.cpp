@@ -31,6 +31,10 @@
 #include "support/messagebox.h"
 #include "gui/stdactions.h"
 #include "models/mpdlibrarymodel.h"
+#include "rulesquery.h"
+#include "db/librarydb.h"
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 SmartPlaylistsPage::SmartPlaylistsPage(QWidget *p)
     : SinglePageWidget(p)
@@ -49,8 +53,7 @@ SmartPlaylistsPage::SmartPlaylistsPage(QWidget *p)
 
     connect(this, SIGNAL(search(QByteArray,QString)), MPDConnection::self(), SLOT(search(QByteArray,QString)));
     connect(MPDConnection::self(), SIGNAL(searchResponse(QString,QList<Song>)), this, SLOT(searchResponse(QString,QList<Song>)));
-    connect(this, SIGNAL(getRating(QString)), MPDConnection::self(), SLOT(getRating(QString)));
-    connect(MPDConnection::self(), SIGNAL(rating(QString,quint8)), this, SLOT(rating(QString,quint8)));
+    connect(this, SIGNAL(addRatings(QList<Song>,QString)), MPDConnection::self(), SLOT(addRatings(QList<Song>,QString)));
     connect(view, SIGNAL(itemsSelected(bool)), this, SLOT(controlActions()));
     connect(view, SIGNAL(headerClicked(int)), SLOT(headerClicked(int)));
     connect(addAction, SIGNAL(triggered()), SLOT(addNew()));
@@ -155,7 +158,7 @@ void SmartPlaylistsPage::searchResponse(const QString &id, const QList<Song> &so
         return;
     }
 
-    if (id.startsWith("I:")) {
+    if (id.startsWith("I:") || id.startsWith("L:")) {
         command.songs.unite(songs.toSet());
     } else if (id.startsWith("E:")) {
         command.songs.subtract(songs.toSet());
@@ -179,59 +182,25 @@ void SmartPlaylistsPage::searchResponse(const QString &id, const QList<Song> &so
 
 void SmartPlaylistsPage::filterCommand()
 {
-    if (command.minDuration>0 || command.maxDuration>0) {
+    // Search results already have their ratings set, from MPDConnection's rating cache, so there is no
+    // need to query these per song.
+    if (command.minDuration>0 || command.maxDuration>0 || command.filterRating) {
         QSet<Song> toRemove;
         for (const auto &s: command.songs) {
-            if (command.minDuration>s.time || (command.maxDuration>0 && s.time>command.maxDuration)) {
+            if ((command.minDuration>0 || command.maxDuration>0) &&
+                (command.minDuration>s.time || (command.maxDuration>0 && s.time>command.maxDuration))) {
                 toRemove.insert(s);
-            } else {
-                command.toCheck.append(s.file);
+            } else if (command.filterRating) {
+                int r=s.rating>Song::Rating_Max ? 0 : s.rating;
+                if (r<command.ratingFrom || r>command.ratingTo) {
+                    toRemove.insert(s);
+                }
             }
         }
         command.songs.subtract(toRemove);
-        if (command.songs.isEmpty()) {
-            command.clear();
-            MessageBox::error(this, tr("Failed to locate any matching songs"));
-            return;
-        }
     }
 
-    if (command.filterRating || command.fetchRatings) {
-        if (command.toCheck.isEmpty()) {
-            for (const auto &s: command.songs) {
-                command.toCheck.append(s.file);
-            }
-        }
-        command.checking=command.toCheck.takeFirst();
-        emit getRating(command.checking);
-    } else {
-        addSongsToPlayQueue();
-    }
-}
-
-void SmartPlaylistsPage::rating(const QString &file, quint8 val)
-{
-    if (command.isEmpty() || file!=command.checking) {
-        return;
-    }
-
-    for (auto &s: command.songs) {
-        if (s.file==file) {
-            s.rating=val;
-            if (command.filterRating && (val<command.ratingFrom || val>command.ratingTo)) {
-                command.songs.remove(s);
-            }
-            break;
-        }
-    }
-
-    if (command.toCheck.isEmpty()) {
-        command.checking.clear();
-        addSongsToPlayQueue();
-    } else {
-        command.checking=command.toCheck.takeFirst();
-        emit getRating(command.checking);
-    }
+    addSongsToPlayQueue();
 }
 
 static bool sortAscending = true;
@@ -343,6 +312,31 @@ void SmartPlaylistsPage::addSongsToPlayQueue()
     command.clear();
 }
 
+QList<Song> SmartPlaylistsPage::localDbSongs(QString where, QVariantList values)
+{
+    return MpdLibraryModel::self()->songs(where, values);
+}
+
+void SmartPlaylistsPage::localDbResponse()
+{
+    QFutureWatcher<QList<Song> > *watcher=static_cast<QFutureWatcher<QList<Song> > *>(sender());
+    if (!watcher) {
+        return;
+    }
+    watcher->deleteLater();
+    quint32 id=watcher->property("id").toUInt();
+    if (command.isEmpty() || id!=command.id) {
+        return;
+    }
+
+    // MPDConnection needs to set ratings if we require these
+    if (command.filterRating || RulesPlaylists::Order_Rating==command.order) {
+        emit addRatings(watcher->result(), "L:"+QString::number(id));
+    } else {
+        searchResponse("L:"+QString::number(id), watcher->result());
+    }
+}
+
 void SmartPlaylistsPage::addSelectionToPlaylist(const QString &name, int action, quint8 priority, bool decreasePriority)
 {
     if (!name.isEmpty()) {
@@ -365,105 +359,26 @@ void SmartPlaylistsPage::addSelectionToPlaylist(const QString &name, int action,
 
     command = Command(pl, action, priority, decreasePriority, command.id+1);
 
-    QList<RulesPlaylists::Rule>::ConstIterator it = pl.rules.constBegin();
-    QList<RulesPlaylists::Rule>::ConstIterator end = pl.rules.constEnd();
-    QSet<QString> mpdGenres;
-
-    for (; it!=end; ++it) {
-        QList<int> dates;
-        QByteArray match = "find";
-        bool isInclude = true;
-        RulesPlaylists::Rule::ConstIterator rIt = (*it).constBegin();
-        RulesPlaylists::Rule::ConstIterator rEnd = (*it).constEnd();
-        QByteArray baseRule;
-        QStringList genres;
-
-        for (; rIt!=rEnd; ++rIt) {
-            if (RulesPlaylists::constDateKey==rIt.key()) {
-                QStringList parts=rIt.value().trimmed().split(RulesPlaylists::constRangeSep);
-                if (2==parts.length()) {
-                    int from = parts.at(0).toInt();
-                    int to = parts.at(1).toInt();
-                    if (from > to) {
-                        for (int i=to; i<=from; ++i) {
-                            dates.append(i);
-                        }
-                    } else {
-                        for (int i=from; i<=to; ++i) {
-                            dates.append(i);
-                        }
-                    }
-                } else if (1==parts.length()) {
-                    dates.append(parts.at(0).toInt());
-                }
-            } else if (RulesPlaylists::constGenreKey==rIt.key() && rIt.value().trimmed().endsWith("*")) {
-                QString find=rIt.value().left(rIt.value().length()-1);
-                if (!find.isEmpty()) {
-                    if (mpdGenres.isEmpty()) {
-                        mpdGenres = MpdLibraryModel::self()->getGenres();
-                    }
-                    for (const QString &g: mpdGenres) {
-                        if (g.startsWith(find)) {
-                            genres.append(g);
-                        }
-                    }
-                }
-            } else if (RulesPlaylists::constArtistKey==rIt.key() || RulesPlaylists::constAlbumKey==rIt.key() ||
-                       RulesPlaylists::constAlbumArtistKey==rIt.key() || RulesPlaylists::constComposerKey==rIt.key() ||
-                       RulesPlaylists::constCommentKey==rIt.key() || RulesPlaylists::constTitleKey==rIt.key() ||
-                       RulesPlaylists::constArtistKey==rIt.key() || RulesPlaylists::constGenreKey==rIt.key() ||
-                       RulesPlaylists::constFileKey==rIt.key()) {
-                baseRule += " " + rIt.key() + " " + MPDConnection::encodeName(rIt.value());
-            } else if (RulesPlaylists::constExactKey==rIt.key()) {
-                if ("false" == rIt.value()) {
-                    match = "search";
-                }
-            } else if (RulesPlaylists::constExcludeKey==rIt.key()) {
-                if ("true" == rIt.value()) {
-                    isInclude = false;
-                }
-            }
-        }
+    RulesQuery query(pl);
+    command.filterRating = command.haveRating();
 
-        if (!baseRule.isEmpty() || !genres.isEmpty() || !dates.isEmpty()) {
-            QList<QByteArray> rules;
-            if (genres.isEmpty()) {
-                if (dates.isEmpty()) {
-                    rules.append(match + baseRule);
-                } else {
-                    for(int d: dates) {
-                        rules.append(match + baseRule + " Date \"" + QByteArray::number(d) + "\"");
-                    }
-                }
-            } else {
-                for (const QString &genre: genres) {
-                    QByteArray rule = match + baseRule + " Genre  " + MPDConnection::encodeName(genre);
-                    if (dates.isEmpty()) {
-                        rules.append(rule);
-                    } else {
-                        for (int d: dates) {
-                            rules.append(rule + " Date \"" + QByteArray::number(d) + "\"");
-                        }
-                    }
-                }
-            }
-            if (!rules.isEmpty()) {
-                if (isInclude) {
-                    command.includeRules += rules;
-                } else {
-                    command.excludeRules += rules;
-                }
-            }
-        }
+    if (RulesQuery::Plan_LocalDb==query.plan()) {
+        // All rules evaluated by a single SQL query. This may well return the whole library (e.g. no rules),
+        // so run it on the DB query pool and not the GUI thread.
+        QVariantList values;
+        QString where=query.sqlWhere(values);
+        QFutureWatcher<QList<Song> > *watcher=new QFutureWatcher<QList<Song> >(this);
+        watcher->setProperty("id", command.id);
+        connect(watcher, SIGNAL(finished()), this, SLOT(localDbResponse()));
+        watcher->setFuture(QtConcurrent::run(LibraryDb::queryPool(), &SmartPlaylistsPage::localDbSongs, where, values));
+        return;
     }
 
-    command.filterRating = command.haveRating();
-    command.fetchRatings = RulesPlaylists::Order_Rating == command.order;
+    query.mpdCommands(command.includeRules, command.excludeRules);
     if (command.includeRules.isEmpty()) {
         if (command.haveRating()) {
             command.includeRules.append("RATING:"+QByteArray::number(command.ratingFrom)+":"+QByteArray::number(command.ratingTo));
             command.filterRating = false;
-            command.fetchRatings = false;
         } else {
             command.includeRules.append(QByteArray());
         }
@@ -27,6 +27,7 @@
 #include "widgets/singlepagewidget.h"
 #include "playlistproxymodel.h"
 #include "rulesplaylists.h"
+#include <QVariant>
 
 class Action;
 class QLabel;
@@ -41,7 +42,7 @@ class SmartPlaylistsPage : public SinglePageWidget
               minDuration(e.minDuration), maxDuration(e.maxDuration), numTracks(e.numTracks), order(e.order), orderAscending(e.orderAscending),
               id(i) { }
         bool isEmpty() const { return playlist.isEmpty(); }
-        void clear() { playlist.clear(); includeRules.clear(); excludeRules.clear(); songs.clear(); toCheck.clear(); checking.clear(); }
+        void clear() { playlist.clear(); includeRules.clear(); excludeRules.clear(); songs.clear(); }
         bool haveRating() const { return ratingFrom>=0 && ratingTo>0; }
 
         QString playlist;
@@ -54,7 +55,6 @@ class SmartPlaylistsPage : public SinglePageWidget
         QList<QByteArray> excludeRules;
 
         bool filterRating = false;
-        bool fetchRatings = false;
 
         int ratingFrom = 0;
         int ratingTo = 0;
@@ -66,9 +66,7 @@ class SmartPlaylistsPage : public SinglePageWidget
 
         quint32 id;
 
-        QString checking;
         QSet<Song> songs;
-        QStringList toCheck;
     };
 
 public:
@@ -78,7 +76,7 @@ public:
 
 Q_SIGNALS:
     void search(const QByteArray &query, const QString &id);
-    void getRating(const QString &file);
+    void addRatings(const QList<Song> &songs, const QString &id);
 
 private Q_SLOTS:
     void addNew();
@@ -86,9 +84,10 @@ private Q_SLOTS:
     void remove();
     void headerClicked(int level);
     void searchResponse(const QString &id, const QList<Song> &songs);
-    void rating(const QString &file, quint8 val);
+    void localDbResponse();
 
 private:
+    static QList<Song> localDbSongs(QString where, QVariantList values);
     void doSearch();
     void controlActions();
     void enableWidgets(bool enable);
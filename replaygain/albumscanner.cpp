@@ -23,18 +23,34 @@
 
 #include "albumscanner.h"
 #include "config.h"
+#include "support/utils.h"
+#include "support/configuration.h"
 #include <QProcess>
 #include <QApplication>
 
-AlbumScanner::AlbumScanner(const QMap<int, QString> &files)
+const QString AlbumScanner::constCacheDir=QLatin1String("replaygain/");
+static const QString constCacheFile=QLatin1String("tracks.cache");
+static const QString constTruePeakCacheFile=QLatin1String("tracks-truepeak.cache");
+
+AlbumScanner::AlbumScanner(const QList<QMap<int, QString> > &albumFiles)
     : proc(0)
 {
-    QMap<int, QString>::ConstIterator it=files.constBegin();
-    QMap<int, QString>::ConstIterator end=files.constEnd();
+    // File names are passed via stdin, one per line with an empty line after each album,
+    // as a library-wide scan would exceed the command-line length limit.
+    int i=0;
+    for (const QMap<int, QString> &files: albumFiles) {
+        QMap<int, QString>::ConstIterator it=files.constBegin();
+        QMap<int, QString>::ConstIterator end=files.constEnd();
+        QList<int> indexes;
 
-    for (int i=0; it!=end; ++it, ++i) {
-        fileNames.append(it.value());
-        trackIndexMap[i]=it.key();
+        for (; it!=end; ++it, ++i) {
+            input+=it.value().toUtf8()+'\n';
+            trackIndexMap[i]=it.key();
+            indexes.append(it.key());
+        }
+        input+='\n';
+        albumTracks.append(indexes);
+        albums.append(Values());
     }
 }
 
@@ -51,7 +67,19 @@ void AlbumScanner::start()
         proc->setReadChannel(QProcess::StandardOutput);
         connect(proc, SIGNAL(finished(int)), this, SLOT(procFinished()));
         connect(proc, SIGNAL(readyReadStandardOutput()), this, SLOT(read()));
-        proc->start(Utils::helper(QLatin1String("cantata-replaygain")), fileNames, QProcess::ReadOnly);
+        // True-peak detection is a hidden option, as it is much slower. Peaks differ, so results are cached separately.
+        Configuration cfg(metaObject()->className());
+        bool truePeak=cfg.get("truePeak", false);
+        QStringList args;
+        if (truePeak) {
+            args << QLatin1String("--true-peak");
+        }
+        args << QLatin1String("--cache") << Utils::cacheDir(constCacheDir, true)+(truePeak ? constTruePeakCacheFile : constCacheFile)
+             << QLatin1String("--albums");
+        proc->start(Utils::helper(QLatin1String("cantata-replaygain")), args, QProcess::ReadWrite);
+        proc->write(input);
+        proc->closeWriteChannel();
+        input.clear();
     }
 }
 
@@ -70,20 +98,24 @@ static const QString constProgLine=QLatin1String("PROGRESS: ");
 static const QString constTrackLine=QLatin1String("TRACK: ");
 static const QString constAlbumLine=QLatin1String("ALBUM: ");
 
-void AlbumScanner::read()
+QMap<int, AlbumScanner::Values> AlbumScanner::trackValues(int album) const
 {
-    if (!proc) {
-        return;
+    QMap<int, Values> vals;
+    for (int index: albumTracks.at(album)) {
+        vals.insert(index, tracks.value(index));
     }
+    return vals;
+}
 
-    QString output = proc->readAllStandardOutput().data();
-    if (output.isEmpty()) {
+void AlbumScanner::read()
+{
+    if (!proc) {
         return;
     }
 
-    QStringList lines=output.split("\n", QString::SkipEmptyParts);
-
-    for (const QString &line: lines) {
+    // Only handle complete lines, as output is now spread over the whole scan
+    while (proc->canReadLine()) {
+        QString line=QString::fromUtf8(proc->readLine()).trimmed();
         if (line.startsWith(constProgLine)) {
             emit progress(line.mid(constProgLine.length()).toUInt());
         } else if (line.startsWith(constTrackLine)) {
@@ -99,11 +131,17 @@ void AlbumScanner::read()
                 tracks[trackIndexMap[num]]=vals;
             }
         } else if (line.startsWith(constAlbumLine)) {
+            // When more than 1 album is scanned, the album's index preceeds its values
             QStringList parts=line.mid(constAlbumLine.length()).split(" ", QString::SkipEmptyParts);
-            if (parts.length()>=2) {
-                album.gain=parts[0].toDouble();
-                album.peak=parts[1].toDouble();
-                album.ok=true;
+            int album=albums.count()>1 && !parts.isEmpty() ? parts.takeFirst().toInt() : 0;
+            if (album>=0 && album<albums.count()) {
+                if (parts.length()>=2) {
+                    albums[album].gain=parts[0].toDouble();
+                    albums[album].peak=parts[1].toDouble();
+                    albums[album].ok=true;
+                }
+                doneAlbums.insert(album);
+                emit albumDone(album);
             }
         }
     }
@@ -111,6 +149,7 @@ void AlbumScanner::read()
 
 void AlbumScanner::procFinished()
 {
+    read();
     setFinished(true);
     emit done();
 }
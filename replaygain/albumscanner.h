@@ -26,6 +26,7 @@
 
 #include "jobcontroller.h"
 #include <QMap>
+#include <QSet>
 #include <QStringList>
 
 class QProcess;
@@ -42,12 +43,20 @@ public:
         bool ok;
     };
 
-    AlbumScanner(const QMap<int, QString> &files);
+    static const QString constCacheDir;
+
+    // All albums are scanned by a single helper process, which spreads their tracks over all cores.
+    AlbumScanner(const QList<QMap<int, QString> > &albumFiles);
     ~AlbumScanner();
     virtual void start();
     virtual void stop();
-    const Values & albumValues() const { return album; }
-    const QMap<int, Values> trackValues() const { return tracks; }
+    int albumCount() const { return albums.count(); }
+    const Values & albumValues(int album) const { return albums.at(album); }
+    bool isAlbumDone(int album) const { return doneAlbums.contains(album); }
+    QMap<int, Values> trackValues(int album) const;
+
+Q_SIGNALS:
+    void albumDone(int album);
 
 private Q_SLOTS:
     void read();
@@ -55,10 +64,12 @@ private Q_SLOTS:
 
 private:
     QProcess *proc;
-    Values album;
+    QList<Values> albums;
+    QList<QList<int> > albumTracks;
+    QSet<int> doneAlbums;
     QMap<int, Values> tracks;
     QMap<int, int> trackIndexMap;
-    QStringList fileNames;
+    QByteArray input;
 };
 
 #endif
@@ -27,10 +27,9 @@ extern "C" {
 }
 #endif
 #include <QMutex>
+#include <QMap>
 #include <QFile>
 #include <QString>
-#include <QList>
-#include <QByteArray>
 #include "ebur128/ebur128.h"
 #include "ffmpeginput.h"
 
@@ -59,25 +58,26 @@ struct FfmpegInput::Handle {
         , packetLeft(false)
         , flushing(false)
         #endif
-        , audioStream(0)
-        , currentBytes(0) {
-        av_init_packet(&packet);
+        , audioStream(0) {
+        #if LIBAVCODEC_VERSION_MAJOR < 54
         audioBuffer = (int16_t*)av_malloc(BUFFER_SIZE);
+        plane = (unsigned char *)buffer;
+        #endif
         #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 35, 0)
         #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(55, 39, 101)
         frame = avcodec_alloc_frame();
         #else
         frame = av_frame_alloc();
-        packet.data = NULL;
-        origPacket.size = 0;
-        origPacket.data=NULL;
         #endif
         #endif
+        reset();
     }
     ~Handle() {
+        #if LIBAVCODEC_VERSION_MAJOR < 54
         if (audioBuffer) {
             av_free(audioBuffer);
         }
+        #endif
         #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 35, 0)
         if (frame) {
             #if LIBAVCODEC_VERSION_INT <= AV_VERSION_INT(54, 23, 100)
@@ -90,6 +90,20 @@ struct FfmpegInput::Handle {
         }
         #endif
     }
+    // Decoding state is per file, everything else is kept for the next one
+    void reset() {
+        av_init_packet(&packet);
+        #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 35, 0)
+        gotFrame=0;
+        packetLeft=false;
+        flushing=false;
+        #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55, 39, 101)
+        packet.data = NULL;
+        origPacket.size = 0;
+        origPacket.data=NULL;
+        #endif
+        #endif
+    }
     AVFormatContext *formatContext;
     AVCodecContext *codecContext;
     AVCodec *codec;
@@ -102,12 +116,36 @@ struct FfmpegInput::Handle {
     #endif
     AVPacket packet;
     int audioStream;
+    #if LIBAVCODEC_VERSION_MAJOR < 54
+    // Older versions decode into audioBuffer, and are then converted into buffer
     int16_t *audioBuffer;
     float buffer[BUFFER_SIZE / 2 + 1];
-    QList<QByteArray> bufferList;
-    size_t currentBytes;
+    unsigned char *plane;
+    #endif
 };
 
+// Decoder to use for each codec ID - the float variant, if there is one
+static QMap<int, AVCodec *> decoders;
+
+static AVCodec * findDecoder(AVCodecContext *context)
+{
+    QMap<int, AVCodec *>::ConstIterator it=decoders.constFind((int)context->codec_id);
+    if (it!=decoders.constEnd()) {
+        return it.value();
+    }
+
+    AVCodec *codec = avcodec_find_decoder(context->codec_id);
+    if (codec) {
+        QString floatCodec=QLatin1String(codec->name)+QLatin1String("float");
+        AVCodec *possibleFloatCodec = avcodec_find_decoder_by_name(floatCodec.toLatin1().constData());
+        if (possibleFloatCodec) {
+            codec = possibleFloatCodec;
+        }
+    }
+    decoders.insert((int)context->codec_id, codec);
+    return codec;
+}
+
 void FfmpegInput::init()
 {
     static int i=false;
@@ -118,10 +156,27 @@ void FfmpegInput::init()
     }
 }
 
-FfmpegInput::FfmpegInput(const QString &fileName)
+FfmpegInput::FfmpegInput()
 {
-    mutex.lock();
     handle=new Handle;
+}
+
+FfmpegInput::~FfmpegInput()
+{
+    close();
+    delete handle;
+    handle=0;
+}
+
+bool FfmpegInput::open(const QString &fileName)
+{
+    close();
+    if (!handle) {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    handle->reset();
 
     bool ok=true;
     #if LIBAVFORMAT_VERSION_MAJOR >= 54 || \
@@ -132,10 +187,8 @@ FfmpegInput::FfmpegInput(const QString &fileName)
     if (av_open_input_file(&handle->formatContext, QFile::encodeName(fileName).constData(), NULL, 0, NULL) != 0)
     #endif
         {
-        mutex.unlock();
-        delete handle;
-        handle=0;
-        return;
+        handle->formatContext=0;
+        return false;
     }
     #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53, 21, 0)
     if (ok && avformat_find_stream_info(handle->formatContext, 0) < 0) {
@@ -178,14 +231,8 @@ FfmpegInput::FfmpegInput(const QString &fileName)
         #elif(LIBAVCODEC_VERSION_MAJOR == 53 && LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 4, 0))
         handle->codecContext->request_sample_fmt = SAMPLE_FMT_FLT;
         #endif
-        // Find the decoder for the video stream, and open codec...
-        handle->codec = avcodec_find_decoder(handle->codecContext->codec_id);
-
-        QString floatCodec=QLatin1String(handle->codec->name)+QLatin1String("float");
-        AVCodec *possibleFloatCodec = avcodec_find_decoder_by_name(floatCodec.toLatin1().constData());
-        if (possibleFloatCodec) {
-            handle->codec = possibleFloatCodec;
-        }
+        // Find the decoder for the audio stream, and open codec...
+        handle->codec = findDecoder(handle->codecContext);
 
         if (!handle->codec ||
             #if LIBAVCODEC_VERSION_MAJOR >= 53
@@ -198,39 +245,53 @@ FfmpegInput::FfmpegInput(const QString &fileName)
         }
     }
 
-    if (ok) {
-        mutex.unlock();
-    } else {
+    if (!ok) {
         #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53, 21, 0)
         avformat_close_input(&handle->formatContext);
         #else
         av_close_input_file(handle->formatContext);
         #endif
-        mutex.unlock();
-        delete handle;
-        handle=0;
+        handle->formatContext=0;
+        handle->codecContext=0;
+        handle->codec=0;
     }
+    return ok;
 }
 
-FfmpegInput::~FfmpegInput()
+void FfmpegInput::close()
 {
-    if (handle) {
-        mutex.lock();
-        avcodec_close(handle->codecContext);
+    if (handle && handle->formatContext) {
+        QMutexLocker locker(&mutex);
+        #if LIBAVCODEC_VERSION_MAJOR >= 54
+        // Scanning may have been aborted part way through a packet
+        if (handle->packetLeft) {
+            AV_FREE(&handle->origPacket);
+            handle->packetLeft=false;
+        }
+        #endif
+        if (handle->codec) {
+            avcodec_close(handle->codecContext);
+        }
         #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53, 21, 0)
         avformat_close_input(&handle->formatContext);
         #else
         av_close_input_file(handle->formatContext);
         #endif
-        mutex.unlock();
-        delete handle;
-        handle=0;
+        handle->formatContext=0;
+        handle->codecContext=0;
+        handle->codec=0;
+        decoded=Frames();
     }
 }
 
+FfmpegInput::operator bool() const
+{
+    return handle && handle->formatContext;
+}
+
 size_t FfmpegInput::totalFrames() const
 {
-    if (!handle) {
+    if (!*this) {
         return 0;
     }
 
@@ -244,22 +305,17 @@ size_t FfmpegInput::totalFrames() const
 
 unsigned int FfmpegInput::channels() const
 {
-    return handle ? handle->codecContext->channels : 0;
+    return *this ? handle->codecContext->channels : 0;
 }
 
 unsigned long FfmpegInput::sampleRate() const
 {
-    return handle ? handle->codecContext->sample_rate : 0;
-}
-
-float * FfmpegInput::buffer() const
-{
-    return handle ? handle->buffer : 0;
+    return *this ? handle->codecContext->sample_rate : 0;
 }
 
 bool FfmpegInput::setChannelMap(int *st) const
 {
-    if (handle && handle->codecContext->channel_layout) {
+    if (*this && handle->codecContext->channel_layout) {
         unsigned int mapIndex = 0;
         int bitCounter = 0;
         while (mapIndex < (unsigned) handle->codecContext->channels) {
@@ -316,30 +372,8 @@ bool FfmpegInput::setChannelMap(int *st) const
 
 size_t FfmpegInput::readFrames()
 {
-    if (!handle || !channels()) {
-        return 0;
-    }
-
-    size_t bufferPosition=0, numberRead=0;
-
-    while (handle->currentBytes < BUFFER_SIZE) {
-        numberRead = readOnePacket();
-        if (!numberRead) {
-            break;
-        }
-        size_t bufferSize=numberRead * channels() * sizeof(float);
-        handle->bufferList.append(QByteArray((const char *)(handle->buffer), bufferSize));
-        handle->currentBytes += bufferSize;
-    }
-
-    while (handle->bufferList.count() && handle->bufferList.first().size() + bufferPosition <= BUFFER_SIZE) {
-        QByteArray b=handle->bufferList.takeAt(0);
-        memcpy((char *) handle->buffer + bufferPosition, b.constData(), b.size());
-        bufferPosition += b.size();
-        handle->currentBytes -= b.size();
-    }
-
-    return bufferPosition / sizeof(float) / channels();
+    // Each packet is analysed as decoded, rather than first being gathered into a larger buffer
+    return channels() ? readOnePacket() : 0;
 }
 
 #if LIBAVCODEC_VERSION_MAJOR >= 54
@@ -354,7 +388,7 @@ static int decodePacket(FfmpegInput::Handle *handle)
 
 size_t FfmpegInput::readOnePacket()
 {
-    if (!handle) {
+    if (!*this) {
         return 0;
     }
 
@@ -410,90 +444,43 @@ free_packet:
     }
 
 write_to_buffer: ;
-    size_t numberRead=handle->frame->nb_samples;
-    /* TODO: fix this */
-    int numChannels = handle->codecContext->channels;
-    // channels = handle->frame->channels;
-
-    if (handle->frame->nb_samples * numChannels > (int)sizeof handle->buffer) {
-        return 0;
-    }
-
+    /* TODO: handle frame->channels differing from the codec's? */
+    // Frames are passed on in the decoder's own format, and converted as they are analysed
+    Frames f;
     switch (handle->codecContext->sample_fmt) {
-    case AV_SAMPLE_FMT_S16: {
-        int16_t *dataShort = (int16_t*)handle->frame->extended_data[0];
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            handle->buffer[i] = ((float) dataShort[i])/qMax(-(float) SHRT_MIN, (float) SHRT_MAX);
-        }
-        break;
-    }
-    case AV_SAMPLE_FMT_S32: {
-        int32_t *dataInt = (int32_t*)handle->frame->extended_data[0];
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            handle->buffer[i] = ((float) dataInt[i])/qMax(-(float) INT_MIN, (float) INT_MAX);
-        }
+    case AV_SAMPLE_FMT_S16P:
+        f.planar=true;
+        // fall through
+    case AV_SAMPLE_FMT_S16:
+        f.format=Int16;
         break;
-    }
-    case AV_SAMPLE_FMT_FLT: {
-        float *dataFloat = (float*)handle->frame->extended_data[0];
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            handle->buffer[i] = dataFloat[i];
-        }
-        break;
-    }
-    case AV_SAMPLE_FMT_DBL: {
-        double *dataDouble = (double*)handle->frame->extended_data[0];
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            handle->buffer[i] = (float)dataDouble[i];
-        }
-        break;
-    }
-    case AV_SAMPLE_FMT_S16P: {
-        uint8_t **ed = handle->frame->extended_data;
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            int currentChannel = i / handle->frame->nb_samples;
-            int currentSample = i % handle->frame->nb_samples;
-            handle->buffer[currentSample * numChannels + currentChannel] = ((float)((int16_t*) ed[currentChannel])[currentSample])/qMax(-(float)SHRT_MIN, (float)SHRT_MAX);
-        }
-        break;
-    }
-    case AV_SAMPLE_FMT_S32P: {
-        uint8_t **ed = handle->frame->extended_data;
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            int currentChannel = i / handle->frame->nb_samples;
-            int currentSample = i % handle->frame->nb_samples;
-            handle->buffer[currentSample * numChannels + currentChannel] = ((float) ((int32_t*) ed[currentChannel])[currentSample])/qMax(-(float)INT_MIN, (float)INT_MAX);
-        }
+    case AV_SAMPLE_FMT_S32P:
+        f.planar=true;
+        // fall through
+    case AV_SAMPLE_FMT_S32:
+        f.format=Int32;
         break;
-    }
-    case AV_SAMPLE_FMT_FLTP: {
-        uint8_t **ed = handle->frame->extended_data;
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            int currentChannel = i / handle->frame->nb_samples;
-            int currentSample = i % handle->frame->nb_samples;
-            handle->buffer[currentSample * numChannels + currentChannel] = ((float*) ed[currentChannel])[currentSample];
-        }
+    case AV_SAMPLE_FMT_FLTP:
+        f.planar=true;
+        // fall through
+    case AV_SAMPLE_FMT_FLT:
+        f.format=Float;
         break;
-    }
-    case AV_SAMPLE_FMT_DBLP:{
-        uint8_t **ed = handle->frame->extended_data;
-        for (int i = 0; i < handle->frame->nb_samples * numChannels; ++i) {
-            int currentChannel = i / handle->frame->nb_samples;
-            int currentSample = i % handle->frame->nb_samples;
-            handle->buffer[currentSample * numChannels + currentChannel] = ((double*) ed[currentChannel])[currentSample];
-        }
+    case AV_SAMPLE_FMT_DBLP:
+        f.planar=true;
+        // fall through
+    case AV_SAMPLE_FMT_DBL:
+        f.format=Double;
         break;
-    }
     case AV_SAMPLE_FMT_U8:
     case AV_SAMPLE_FMT_NONE:
     case AV_SAMPLE_FMT_NB:
     default:
-        numberRead=0;
-        goto out;
+        return 0;
     }
-
-    out:
-    return numberRead;
+    f.planes=handle->frame->extended_data;
+    decoded=f;
+    return handle->frame->nb_samples;
 }
 #else
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(53, 35, 0)
@@ -543,7 +530,7 @@ static int decodeAudio(FfmpegInput::Handle *handle, int *frame_size_ptr)
 
 size_t FfmpegInput::readOnePacket()
 {
-    if (!handle) {
+    if (!*this) {
         return 0;
     }
 
@@ -620,6 +607,9 @@ size_t FfmpegInput::readOnePacket()
 
     out:
     AV_FREE(&handle->packet);
+    decoded.format=Float;
+    decoded.planar=false;
+    decoded.planes=&handle->plane;
     return numberRead;
 }
 #endif
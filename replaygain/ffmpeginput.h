@@ -19,15 +19,16 @@ public:
 
     static void init();
 
-    FfmpegInput(const QString &fileName);
+    FfmpegInput();
     ~FfmpegInput();
 
-    operator bool() const { return 0!=handle; }
+    bool open(const QString &fileName);
+    void close();
+    operator bool() const;
 
     size_t totalFrames() const;
     unsigned int channels() const;
     unsigned long sampleRate() const;
-    float * buffer() const;
     bool setChannelMap(int *st) const;
     size_t readFrames();
     bool isFloatCodec() const;
@@ -0,0 +1,80 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "input.h"
+#include <stdint.h>
+
+// Integer samples are scaled by a power of two, so multiplying gives the same result as dividing.
+static const float constInt16Scale=1.0f/32768.0f;
+static const float constInt32Scale=1.0f/2147483648.0f;
+
+template<typename T>
+static void toFloat(const Input::Frames &frames, size_t offset, size_t count, unsigned int channels, float scale, float *dst)
+{
+    if (frames.planar) {
+        for (unsigned int c=0; c<channels; ++c) {
+            const T *src=((const T *)frames.planes[c])+offset;
+            float *d=dst+c;
+            for (size_t i=0; i<count; ++i, d+=channels) {
+                *d=((float)src[i])*scale;
+            }
+        }
+    } else {
+        const T *src=((const T *)frames.planes[0])+(offset*channels);
+        for (size_t i=0; i<count*channels; ++i) {
+            dst[i]=((float)src[i])*scale;
+        }
+    }
+}
+
+const float * Input::floatFrames(size_t offset, size_t count)
+{
+    unsigned int ch=channels();
+    if (!decoded.planes || !ch) {
+        return 0;
+    }
+
+    if (Float==decoded.format && (!decoded.planar || 1==ch)) {
+        return ((const float *)decoded.planes[0])+(offset*ch);
+    }
+
+    if ((size_t)converted.size()<count*ch) {
+        converted.resize(count*ch);
+    }
+    float *dst=converted.data();
+    switch (decoded.format) {
+    case Float:
+        toFloat<float>(decoded, offset, count, ch, 1.0f, dst);
+        break;
+    case Double:
+        toFloat<double>(decoded, offset, count, ch, 1.0f, dst);
+        break;
+    case Int16:
+        toFloat<int16_t>(decoded, offset, count, ch, constInt16Scale, dst);
+        break;
+    case Int32:
+        toFloat<int32_t>(decoded, offset, count, ch, constInt32Scale, dst);
+        break;
+    }
+    return dst;
+}
@@ -10,27 +10,56 @@
 #ifndef _INPUT_H_
 #define _INPUT_H_
 
+#include <QVector>
+#include <stddef.h>
+
 class QString;
 
 class Input
 {
 public:
+    enum SampleFormat {
+        Float,
+        Double,
+        Int16,
+        Int32
+    };
+
+    // Frames as output by the decoder - either interleaved in planes[0], or one plane per channel.
+    struct Frames {
+        Frames() : format(Float), planar(false), planes(0) { }
+        SampleFormat format;
+        bool planar;
+        const unsigned char * const *planes;
+    };
+
     Input() {
     }
     virtual ~Input() {
     }
 
+    // Inputs are re-used for several files (see InputPool), so that decoder setup is only done once.
+    virtual bool open(const QString &fileName)=0;
+    virtual void close()=0;
     virtual operator bool() const=0;
 
     virtual size_t totalFrames() const=0;
     virtual unsigned int channels() const=0;
     virtual unsigned long sampleRate() const=0;
-    virtual bool allocateBuffer() {
-        return true;
-    }
-    virtual float * buffer() const=0;
     virtual bool setChannelMap(int *st) const=0;
+    // Decodes the next chunk, and returns its number of frames. These are described by 'decoded',
+    // and remain valid until the next call.
     virtual size_t readFrames()=0;
+
+    // 'count' frames, from 'offset' within the last chunk, as interleaved floats. Interleaved float
+    // data is returned in place, anything else is converted into a buffer that is re-used.
+    const float * floatFrames(size_t offset, size_t count);
+
+protected:
+    Frames decoded;
+
+private:
+    QVector<float> converted;
 };
 
 #endif
@@ -0,0 +1,102 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "inputpool.h"
+#include "config.h"
+#ifdef MPG123_FOUND
+#include "mpg123input.h"
+#endif
+#ifdef FFMPEG_FOUND
+#include "ffmpeginput.h"
+#endif
+#include "support/globalstatic.h"
+#include <QString>
+
+GLOBAL_STATIC(InputPool, instance)
+
+InputPool::~InputPool()
+{
+    qDeleteAll(ffmpeg);
+    qDeleteAll(mpg123);
+}
+
+template<class T> T * InputPool::take(QList<Input *> &list)
+{
+    QMutexLocker locker(&mutex);
+    return list.isEmpty() ? new T() : static_cast<T *>(list.takeLast());
+}
+
+Input * InputPool::open(const QString &fileName)
+{
+    Input *input=0;
+    bool ffmpegIsFloat=false;
+    #ifdef FFMPEG_FOUND
+    FfmpegInput *ff=take<FfmpegInput>(ffmpeg);
+    if (ff->open(fileName)) {
+        input=ff;
+        ffmpegIsFloat=ff->isFloatCodec();
+    } else {
+        release(ff);
+    }
+    #endif
+
+    #ifdef MPG123_FOUND
+    if (fileName.endsWith(".mp3", Qt::CaseInsensitive) && (!input || !ffmpegIsFloat)) {
+        Mpg123Input *mp=take<Mpg123Input>(mpg123);
+        if (mp->open(fileName)) {
+            if (input) {
+                release(input);
+            }
+            input=mp;
+        } else {
+            release(mp);
+        }
+    }
+    #else
+    Q_UNUSED(ffmpegIsFloat)
+    #endif
+
+    return input;
+}
+
+void InputPool::release(Input *input)
+{
+    if (!input) {
+        return;
+    }
+    input->close();
+    QMutexLocker locker(&mutex);
+    #ifdef FFMPEG_FOUND
+    if (dynamic_cast<FfmpegInput *>(input)) {
+        ffmpeg.append(input);
+        return;
+    }
+    #endif
+    #ifdef MPG123_FOUND
+    if (dynamic_cast<Mpg123Input *>(input)) {
+        mpg123.append(input);
+        return;
+    }
+    #endif
+    delete input;
+}
@@ -0,0 +1,57 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _INPUT_POOL_H_
+#define _INPUT_POOL_H_
+
+#include <QList>
+#include <QMutex>
+
+class QString;
+class Input;
+
+// Decoders that are not currently in use. Scanning several files in one process then
+// only allocates (and sets up) as many decoders as there are concurrent scanners.
+class InputPool
+{
+public:
+    static InputPool * self();
+
+    InputPool() { }
+    ~InputPool();
+
+    // Returns a decoder opened for fileName, or 0 if it cannot be read.
+    Input * open(const QString &fileName);
+    // Closes input, and keeps it for the next file.
+    void release(Input *input);
+
+private:
+    template<class T> T * take(QList<Input *> &list);
+
+private:
+    QMutex mutex;
+    QList<Input *> ffmpeg;
+    QList<Input *> mpg123;
+};
+
+#endif
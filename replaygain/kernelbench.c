@@ -0,0 +1,184 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Micro-benchmark for the bundled libebur128 kernels. Runs each kernel, of each
+ * instruction set supported by this CPU, over the same generated audio and
+ * reports frames/second. Results are compared against the scalar kernels, as
+ * all sets are expected to produce identical values.
+ *
+ * Usage: cantata-replaygain-benchmark [seconds of audio] [channels]
+ */
+
+#include "ebur128/ebur128.h"
+#include "ebur128/ebur128_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLE_RATE 44100
+#define REPEATS 5
+
+typedef struct {
+    double samplePeak[8];
+    double truePeak[8];
+    double energy[8];
+    double *filtered;
+} Results;
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock()-start)/CLOCKS_PER_SEC;
+}
+
+static void report(const char *kernel, const char *set, size_t frames, double secs, int same)
+{
+    printf("%-12s %-8s %10.2f Mframes/s%s\n", kernel, set, secs>0.0 ? (frames*REPEATS)/secs/1000000.0 : 0.0,
+           same ? "" : "  ** differs from scalar **");
+}
+
+/* BS.1770 K-weighting at 48kHz, pre-filter and RLB high-pass combined */
+static void filterCoeffs(double *a, double *b)
+{
+    const double pb[3]={1.53512485958697, -2.69169618940638, 1.19839281085285};
+    const double pa[3]={1.0, -1.69065929318241, 0.73248077421585};
+    const double rb[3]={1.0, -2.0, 1.0};
+    const double ra[3]={1.0, -1.99004745483398, 0.99007225036621};
+    int i, j;
+    for (i=0; i<5; ++i) {
+        a[i]=b[i]=0.0;
+    }
+    for (i=0; i<3; ++i) {
+        for (j=0; j<3; ++j) {
+            b[i+j]+=pb[i]*rb[j];
+            a[i+j]+=pa[i]*ra[j];
+        }
+    }
+}
+
+static void run(const ebur128_kernels *k, const float *audio, size_t frames, unsigned int channels,
+                Results *res, const Results *ref)
+{
+    /* Only 5 filter states, so further channels are unused - as per libebur128 */
+    const int channelMap[8]={EBUR128_LEFT, EBUR128_RIGHT, EBUR128_CENTER, EBUR128_LEFT_SURROUND,
+                             EBUR128_RIGHT_SURROUND, EBUR128_UNUSED, EBUR128_UNUSED, EBUR128_UNUSED};
+    double a[5], b[5], v[5][5];
+    clock_t start;
+    int r;
+
+    filterCoeffs(a, b);
+
+    memset(res->samplePeak, 0, sizeof(res->samplePeak));
+    start=clock();
+    for (r=0; r<REPEATS; ++r) {
+        k->sample_peak(audio, frames, channels, res->samplePeak);
+    }
+    report("sample peak", k->name, frames, elapsed(start), !ref || 0==memcmp(res->samplePeak, ref->samplePeak, sizeof(res->samplePeak)));
+
+    memset(res->truePeak, 0, sizeof(res->truePeak));
+    start=clock();
+    for (r=0; r<REPEATS; ++r) {
+        interpolator *interp=ebur128_interp_create(49, 4, channels);
+        k->true_peak(interp, audio, frames, res->truePeak);
+        ebur128_interp_destroy(interp);
+    }
+    report("true peak", k->name, frames, elapsed(start), !ref || 0==memcmp(res->truePeak, ref->truePeak, sizeof(res->truePeak)));
+
+    memset(res->filtered, 0, frames*channels*sizeof(double));
+    start=clock();
+    for (r=0; r<REPEATS; ++r) {
+        memset(v, 0, sizeof(v));
+        k->filter(audio, frames, channels, channelMap, a, b, v, res->filtered);
+    }
+    report("k-weighting", k->name, frames, elapsed(start), !ref || 0==memcmp(res->filtered, ref->filtered, frames*channels*sizeof(double)));
+
+    start=clock();
+    for (r=0; r<REPEATS; ++r) {
+        memset(res->energy, 0, sizeof(res->energy));
+        k->energy(res->filtered, frames, channels, res->energy);
+    }
+    report("energy", k->name, frames, elapsed(start), !ref || 0==memcmp(res->energy, ref->energy, sizeof(res->energy)));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seconds=argc>1 ? (unsigned int)atoi(argv[1]) : 60;
+    unsigned int channels=argc>2 ? (unsigned int)atoi(argv[2]) : 2;
+    const ebur128_kernels *sets[3];
+    Results results[3];
+    size_t frames;
+    size_t i;
+    float *audio;
+    unsigned int seed=12345;
+    int s;
+
+    if (seconds<1 || channels<1 || channels>8) {
+        printf("Usage: %s [seconds of audio] [channels (1..8)]\n", argv[0]);
+        return -1;
+    }
+
+    frames=(size_t)seconds*SAMPLE_RATE;
+    audio=(float *)malloc(frames*channels*sizeof(float));
+    if (!audio) {
+        return -1;
+    }
+    /* Noise, with the occasional full scale sample, so that peaks are exercised */
+    for (i=0; i<frames*channels; ++i) {
+        seed=seed*1103515245+12345;
+        audio[i]=(float)((((seed>>8)&0xFFFF)/32768.0)-1.0)*(0==i%9973 ? 1.0f : 0.5f);
+    }
+
+    sets[0]=ebur128_kernels_scalar();
+    sets[1]=ebur128_kernels_sse2();
+    sets[2]=ebur128_kernels_avx2();
+    printf("%u seconds of %u channel audio at %dHz, best of this CPU: %s\n\n", seconds, channels, SAMPLE_RATE,
+           ebur128_kernels_select()->name);
+
+    for (s=0; s<3; ++s) {
+        results[s].filtered=(double *)malloc(frames*channels*sizeof(double));
+        if (sets[s] && results[s].filtered) {
+            run(sets[s], audio, frames, channels, &results[s], s ? &results[0] : 0);
+        }
+    }
+
+    {
+        /* Whole library, as used by cantata-replaygain, with true-peak enabled */
+        ebur128_state *state=ebur128_init(channels, SAMPLE_RATE, EBUR128_MODE_I|EBUR128_MODE_SAMPLE_PEAK|EBUR128_MODE_TRUE_PEAK);
+        clock_t start=clock();
+        double loudness=0.0;
+        for (i=0; i<REPEATS; ++i) {
+            ebur128_add_frames_float(state, audio, frames);
+        }
+        ebur128_loudness_global(state, &loudness);
+        report("ebur128", ebur128_kernels_select()->name, frames, elapsed(start), 1);
+        printf("\nIntegrated loudness: %.2f LUFS\n", loudness);
+        ebur128_destroy(&state);
+    }
+
+    for (s=0; s<3; ++s) {
+        free(results[s].filtered);
+    }
+    free(audio);
+    return 0;
+}
@@ -25,22 +25,63 @@
 #include <QFile>
 #include <QTimer>
 #include <stdio.h>
+#include <string.h>
 #include "replaygain.h"
 
-int main(int argc, char *argv[])
+// In albums mode, file names are read from stdin - one per line, with an empty line between albums.
+static QList<QStringList> readAlbums()
 {
-    if (argc<2) {
-        printf("Usage: %s <file 1..N>\n", argv[0]);
-        return -1;
+    QList<QStringList> albums;
+    QStringList album;
+    QFile in;
+    if (in.open(stdin, QIODevice::ReadOnly)) {
+        while (!in.atEnd()) {
+            QByteArray line=in.readLine();
+            if (line.endsWith('\n')) {
+                line.chop(1);
+            }
+            if (line.isEmpty()) {
+                if (!album.isEmpty()) {
+                    albums.append(album);
+                    album.clear();
+                }
+            } else {
+                album.append(QString::fromUtf8(line));
+            }
+        }
+    }
+    if (!album.isEmpty()) {
+        albums.append(album);
     }
+    return albums;
+}
 
+int main(int argc, char *argv[])
+{
+    QString cacheFile;
+    bool albumsMode=false;
     QStringList fileNames;
-    for (int i=0; i<argc-1; ++i) {
-        fileNames.append(QString::fromUtf8(argv[i+1]));
+    for (int i=1; i<argc; ++i) {
+        if (fileNames.isEmpty() && 0==strcmp(argv[i], "--cache") && i+1<argc) {
+            cacheFile=QString::fromUtf8(argv[++i]);
+        } else if (fileNames.isEmpty() && 0==strcmp(argv[i], "--albums")) {
+            albumsMode=true;
+        } else if (fileNames.isEmpty() && 0==strcmp(argv[i], "--true-peak")) {
+            TrackScanner::setTruePeak(true);
+        } else {
+            fileNames.append(QString::fromUtf8(argv[i]));
+        }
+    }
+
+    if (albumsMode==!fileNames.isEmpty()) {
+        printf("Usage: %s [--true-peak] [--cache <cache file>] <file 1..N>\n"
+               "       %s [--true-peak] [--cache <cache file>] --albums < <files, with empty line between albums>\n", argv[0], argv[0]);
+        return -1;
     }
 
+    QList<QStringList> albums=albumsMode ? readAlbums() : (QList<QStringList>() << fileNames);
     QCoreApplication app(argc, argv);
-    ReplayGain *rg=new ReplayGain(fileNames);
+    ReplayGain *rg=new ReplayGain(albums, cacheFile);
     QTimer::singleShot(0, rg, SLOT(scan()));
     return app.exec();
 }
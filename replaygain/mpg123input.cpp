@@ -27,17 +27,14 @@ struct Mpg123Input::Handle {
         , rate(0)
         , channels(0)
         , encoding(0)
-        , buffer(0) {
-    }
-    ~Handle() {
-        if (buffer) {
-            free(buffer);
-        }
+        , opened(false)
+        , plane(0) {
     }
     mpg123_handle *mpg123;
     long rate;
     int channels, encoding;
-    float *buffer;
+    bool opened;
+    unsigned char *plane;
 };
 
 void Mpg123Input::init()
@@ -45,39 +42,15 @@ void Mpg123Input::init()
     static int i=false;
     if (!i) {
         mpg123_init();
+        i=true;
     }
 }
 
-Mpg123Input::Mpg123Input(const QString &fileName)
+Mpg123Input::Mpg123Input()
 {
     handle=new Handle;
-
-    QByteArray fName=QFile::encodeName(fileName);
-    bool ok=false;
     int result;
     handle->mpg123 = mpg123_new(NULL, &result);
-    if (handle->mpg123 &&
-        MPG123_OK==mpg123_open(handle->mpg123, fName.constData()) &&
-        MPG123_OK==mpg123_getformat(handle->mpg123, &handle->rate, &handle->channels, &handle->encoding) &&
-        MPG123_OK==mpg123_format_none(handle->mpg123) &&
-        MPG123_OK==mpg123_format(handle->mpg123, handle->rate, handle->channels, MPG123_ENC_FLOAT_32)) {
-
-        mpg123_close(handle->mpg123);
-        if (MPG123_OK==mpg123_open(handle->mpg123, fName.constData()) &&
-            MPG123_OK==mpg123_getformat(handle->mpg123, &handle->rate, &handle->channels, &handle->encoding)) {
-            ok=true;
-        }
-    }
-
-    if (!ok) {
-        if (handle->mpg123) {
-            mpg123_close(handle->mpg123);
-            mpg123_delete(handle->mpg123);
-            handle->mpg123 = NULL;
-        }
-        delete handle;
-        handle = 0;
-    }
 }
 
 Mpg123Input::~Mpg123Input()
@@ -93,41 +66,68 @@ Mpg123Input::~Mpg123Input()
     }
 }
 
-size_t Mpg123Input::totalFrames() const
+bool Mpg123Input::open(const QString &fileName)
 {
-    if (!handle) {
-        return 0;
+    close();
+    if (!handle || !handle->mpg123) {
+        return false;
     }
 
-    off_t length = mpg123_length(handle->mpg123);
-    return MPG123_ERR==length ? 0 : (size_t) length;
+    QByteArray fName=QFile::encodeName(fileName);
+    // The previous file restricted output to its own rate, so all formats need to be allowed again to probe this one.
+    if (MPG123_OK==mpg123_format_all(handle->mpg123) &&
+        MPG123_OK==mpg123_open(handle->mpg123, fName.constData()) &&
+        MPG123_OK==mpg123_getformat(handle->mpg123, &handle->rate, &handle->channels, &handle->encoding) &&
+        MPG123_OK==mpg123_format_none(handle->mpg123) &&
+        MPG123_OK==mpg123_format(handle->mpg123, handle->rate, handle->channels, MPG123_ENC_FLOAT_32)) {
+
+        mpg123_close(handle->mpg123);
+        if (MPG123_OK==mpg123_open(handle->mpg123, fName.constData()) &&
+            MPG123_OK==mpg123_getformat(handle->mpg123, &handle->rate, &handle->channels, &handle->encoding)) {
+            handle->opened=true;
+            decoded.format=Float;
+            decoded.planar=false;
+            decoded.planes=&handle->plane;
+            return true;
+        }
+    }
+
+    mpg123_close(handle->mpg123);
+    return false;
 }
 
-unsigned int Mpg123Input::channels() const
+void Mpg123Input::close()
 {
-    return handle ? (unsigned int)handle->channels : 0;
+    if (handle && handle->opened) {
+        mpg123_close(handle->mpg123);
+        handle->opened=false;
+        handle->plane=0;
+    }
 }
 
-unsigned long Mpg123Input::sampleRate() const
+Mpg123Input::operator bool() const
 {
-    return handle ? (unsigned long)handle->rate : 0;
+    return handle && handle->opened;
 }
 
-bool Mpg123Input::allocateBuffer()
+size_t Mpg123Input::totalFrames() const
 {
-    if (!handle) {
-        return false;
+    if (!handle || !handle->opened) {
+        return 0;
     }
 
-    handle->buffer = (float*) malloc((size_t) handle->rate *
-                                     (size_t) handle->channels *
-                                      sizeof(float));
-    return handle->buffer;
+    off_t length = mpg123_length(handle->mpg123);
+    return MPG123_ERR==length ? 0 : (size_t) length;
+}
+
+unsigned int Mpg123Input::channels() const
+{
+    return handle && handle->opened ? (unsigned int)handle->channels : 0;
 }
 
-float * Mpg123Input::buffer() const
+unsigned long Mpg123Input::sampleRate() const
 {
-    return handle ? handle->buffer : 0;
+    return handle && handle->opened ? (unsigned long)handle->rate : 0;
 }
 
 bool Mpg123Input::setChannelMap(int *st) const
@@ -138,18 +138,23 @@ bool Mpg123Input::setChannelMap(int *st) const
 
 size_t Mpg123Input::readFrames()
 {
-    if (!handle) {
+    if (!handle || !handle->opened) {
         return 0;
     }
 
-    size_t numberRead;
-    int result = mpg123_read(handle->mpg123, (unsigned char*) handle->buffer,
-                            (size_t) handle->rate *
-                            (size_t) handle->channels * sizeof(float),
-                            &numberRead);
-    if (MPG123_OK!=result && MPG123_DONE!=result) {
-        return 0;
+    // Decoded frames are used straight from mpg123's own buffer, rather than copied out of it.
+    for (;;) {
+        off_t num;
+        unsigned char *audio=0;
+        size_t bytes=0;
+        int result = mpg123_decode_frame(handle->mpg123, &num, &audio, &bytes);
+        if (MPG123_OK!=result && MPG123_NEW_FORMAT!=result) {
+            return 0;
+        }
+        // Nothing is returned for the format change, or for frames removed by gapless decoding.
+        if (bytes && audio) {
+            handle->plane=audio;
+            return bytes / ((size_t) handle->channels * sizeof(float));
+        }
     }
-    numberRead /= (size_t) handle->channels * sizeof(float);
-    return numberRead;
 }
@@ -19,16 +19,16 @@ class Mpg123Input : public Input
 public:
     static void init();
 
-    Mpg123Input(const QString &fileName);
+    Mpg123Input();
     ~Mpg123Input();
 
-    operator bool() const { return 0!=handle; }
+    bool open(const QString &fileName);
+    void close();
+    operator bool() const;
 
     size_t totalFrames() const;
     unsigned int channels() const;
     unsigned long sampleRate() const;
-    bool allocateBuffer();
-    float * buffer() const;
     bool setChannelMap(int *st) const;
     size_t readFrames();
 
@@ -22,8 +22,10 @@
  */
 
 #include "replaygain.h"
+#include "trackcache.h"
 #include "jobcontroller.h"
 #include <QCoreApplication>
+#include <QThread>
 #include <stdio.h>
 
 // Work-around possible locale issues by forcing usage of '.' as separator
@@ -32,30 +34,61 @@ static QString formatDouble(double d)
     return QString::number(d, 'f', 10).replace(",", ".");
 }
 
-ReplayGain::ReplayGain(const QStringList &fileNames)
+ReplayGain::ReplayGain(const QList<QStringList> &albumFiles, const QString &cacheFile)
     : QObject(0)
-    , files(fileNames)
+    , cache(cacheFile.isEmpty() ? 0 : new TrackCache(cacheFile))
     , lastProgress(-1)
     , totalScanned(0)
 {
     TrackScanner::init();
-    JobController::self()->setMaxActive(8);
+    for (const QStringList &albumTracks: albumFiles) {
+        Album album;
+        for (const QString &f: albumTracks) {
+            Track track;
+            track.album=albums.count();
+            album.tracks.append(files.count());
+            files.append(f);
+            tracks.append(track);
+        }
+        album.remaining=album.tracks.count();
+        albums.append(album);
+    }
+
+    // Tracks from all albums share one queue, so keep every core busy. Only a few scanners
+    // are created ahead of those running, as each holds an open decoder once started.
+    int threads=qMax(1, QThread::idealThreadCount());
+    JobController::self()->setMaxActive(threads);
+    maxScanners=threads*2;
 }
 
 ReplayGain::~ReplayGain()
 {
     clearScanners();
+    delete cache;
 }
 
 void ReplayGain::scan()
 {
     for (int i=0; i<files.count(); ++i) {
-        if (scanners.count()<100) {
-            createScanner(i);
+        TrackScanner::Data data;
+        if (cache && cache->get(files.at(i), data)) {
+            trackDone(i, true, data);
         } else {
             toScan.append(i);
         }
     }
+    showProgress();
+    startScanners();
+}
+
+void ReplayGain::startScanners()
+{
+    while (scanners.count()<maxScanners && !toScan.isEmpty()) {
+        createScanner(toScan.takeFirst());
+    }
+    if (totalScanned==files.count()) {
+        QCoreApplication::exit(0);
+    }
 }
 
 void ReplayGain::createScanner(int index)
@@ -79,23 +112,33 @@ void ReplayGain::clearScanners()
     }
     scanners.clear();
     toScan.clear();
-    tracks.clear();
+}
+
+void ReplayGain::trackDone(int index, bool success, const TrackScanner::Data &data)
+{
+    Track &track=tracks[index];
+    if (track.finished) {
+        return;
+    }
+    track.finished=true;
+    track.success=success;
+    track.progress=100;
+    track.data=data;
+    totalScanned++;
+
+    Album &album=albums[track.album];
+    if (0==--album.remaining) {
+        showResults(track.album);
+    }
 }
 
 void ReplayGain::showProgress()
 {
-    int finished=0;
     quint64 totalProgress=0;
-    QMap<int, Track>::iterator it=tracks.begin();
-    QMap<int, Track>::iterator end=tracks.end();
-
-    for (; it!=end; ++it) {
-        if ((*it).finished) {
-            finished++;
-        }
-        totalProgress+=(*it).finished ? 100 : (*it).progress;
+    for (const Track &t: tracks) {
+        totalProgress+=t.progress;
     }
-    int progress=(totalProgress/files.count())+0.5;
+    int progress=files.isEmpty() ? 100 : ((totalProgress/files.count())+0.5);
     progress=(progress/5)*5;
     if (progress!=lastProgress) {
         lastProgress=progress;
@@ -104,31 +147,31 @@ void ReplayGain::showProgress()
     }
 }
 
-void ReplayGain::showResults()
+void ReplayGain::showResults(int album)
 {
-    QList<TrackScanner *> okScanners;
-    for (int i=0; i<files.count(); ++i) {
-        TrackScanner *s=scanners[i];
-        const Track &t=tracks[i];
-        if (t.success && s->ok()) {
-            printf("TRACK: %d %s %s\n", i, formatDouble(TrackScanner::reference(s->results().loudness)).toLatin1().constData(),
-                                           formatDouble(s->results().peakValue()).toLatin1().constData());
-            okScanners.append(s);
+    QList<TrackScanner::Data> okTracks;
+    for (int i: albums.at(album).tracks) {
+        Track &t=tracks[i];
+        if (t.success) {
+            printf("TRACK: %d %s %s\n", i, formatDouble(TrackScanner::reference(t.data.loudness)).toLatin1().constData(),
+                                           formatDouble(t.data.peakValue()).toLatin1().constData());
+            okTracks.append(t.data);
         } else {
             printf("TRACK: %d FAILED\n", i);
         }
+        // Histogram is no longer required once the album has been output
+        t.data.histogram=TrackScanner::Histogram();
     }
 
-    if (okScanners.isEmpty()) {
-        printf("ALBUM: FAILED\n");
+    QByteArray prefix=albums.count()>1 ? QByteArray::number(album)+' ' : QByteArray();
+    if (okTracks.isEmpty()) {
+        printf("ALBUM: %sFAILED\n", prefix.constData());
     } else {
-        TrackScanner::Data album=TrackScanner::global(okScanners);
-        printf("ALBUM: %s %s\n", formatDouble(TrackScanner::reference(album.loudness)).toLatin1().constData(),
-                                 formatDouble(album.peak).toLatin1().constData());
+        TrackScanner::Data data=TrackScanner::global(okTracks);
+        printf("ALBUM: %s%s %s\n", prefix.constData(), formatDouble(TrackScanner::reference(data.loudness)).toLatin1().constData(),
+                                   formatDouble(data.peak).toLatin1().constData());
     }
     fflush(stdout);
-
-    QCoreApplication::exit(0);
 }
 
 void ReplayGain::scannerProgress(int p)
@@ -145,24 +188,17 @@ void ReplayGain::scannerProgress(int p)
 void ReplayGain::scannerDone()
 {
     TrackScanner *s=qobject_cast<TrackScanner *>(sender());
-    if (!s) {
+    if (!s || !scanners.contains(s->index())) {
         return;
     }
-    Track &track=tracks[s->index()];
-    if (!track.finished) {
-        track.finished=true;
-        track.success=s->success();
-        track.progress=100;
-        showProgress();
-        totalScanned++;
-    }
 
-    if (toScan.isEmpty()) {
-        if (totalScanned==files.count()) {
-            showResults();
-        }
-    } else {
-        int index=toScan.takeAt(0);
-        createScanner(index);
+    bool ok=s->success() && s->ok();
+    if (ok && cache) {
+        cache->insert(files.at(s->index()), s->results());
     }
+    trackDone(s->index(), ok, s->results());
+    showProgress();
+    scanners.remove(s->index());
+    JobController::self()->finishedWith(s);
+    startScanners();
 }
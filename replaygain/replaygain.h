@@ -27,26 +27,32 @@
 #include <QObject>
 #include <QList>
 #include <QMap>
+#include <QVector>
 #include <QStringList>
 #include "trackscanner.h"
 #include "config.h"
 
+class TrackCache;
+
 class ReplayGain : public QObject
 {
     Q_OBJECT
 
 public:
-    ReplayGain(const QStringList &fileNames);
+    // If more than 1 album is passed, then ALBUM lines are prefixed with the album's index
+    ReplayGain(const QList<QStringList> &albumFiles, const QString &cacheFile=QString());
     virtual ~ReplayGain();
 
 public Q_SLOTS:
     void scan();
 
 private:
+    void startScanners();
     void createScanner(int index);
     void clearScanners();
+    void trackDone(int index, bool success, const TrackScanner::Data &data);
     void showProgress();
-    void showResults();
+    void showResults(int album);
 
 private Q_SLOTS:
     void scannerProgress(int p);
@@ -54,16 +60,27 @@ private Q_SLOTS:
 
 private:
     struct Track {
-        Track() : progress(0), finished(false), success(false) { }
+        Track() : album(0), progress(0), finished(false), success(false) { }
+        int album;
         unsigned char progress;
         bool finished : 1;
         bool success : 1;
+        TrackScanner::Data data;
+    };
+
+    struct Album {
+        Album() : remaining(0) { }
+        QList<int> tracks;
+        int remaining;
     };
 
     QStringList files;
+    QList<Album> albums;
+    TrackCache *cache;
     QMap<int, TrackScanner *> scanners;
     QList<int> toScan;
-    QMap<int, Track> tracks;
+    QVector<Track> tracks;
+    int maxScanners;
     int lastProgress;
     int totalScanned;
 };
@@ -278,11 +278,8 @@ void RgDialog::startScanning()
             groupedTracks[sng.albumArtist()+" -- "+sng.album].append(i);
         }
     }
-    QMap<QString, QList<int> >::ConstIterator it(groupedTracks.constBegin());
-    QMap<QString, QList<int> >::ConstIterator end(groupedTracks.constEnd());
-
-    for (; it!=end; ++it) {
-        createScanner(*it);
+    if (!groupedTracks.isEmpty()) {
+        createScanner(groupedTracks.values());
         totalToScan++;
     }
     progress->setRange(0, 100*totalToScan);
@@ -300,15 +297,20 @@ void RgDialog::stopScanning()
     setButtonGuiItem(Cancel, StdGuiItem::close());
 }
 
-void RgDialog::createScanner(const QList<int> &indexes)
+void RgDialog::createScanner(const QList<QList<int> > &albums)
 {
-    QMap<int, QString> fileMap;
-    for (int i: indexes) {
-        fileMap[i]=origSongs.at(i).filePath(base);
+    QList<QMap<int, QString> > albumFiles;
+    for (const QList<int> &indexes: albums) {
+        QMap<int, QString> fileMap;
+        for (int i: indexes) {
+            fileMap[i]=origSongs.at(i).filePath(base);
+        }
+        albumFiles.append(fileMap);
     }
 
-    AlbumScanner *s=new AlbumScanner(fileMap);
+    AlbumScanner *s=new AlbumScanner(albumFiles);
     connect(s, SIGNAL(progress(int)), this, SLOT(scannerProgress(int)));
+    connect(s, SIGNAL(albumDone(int)), this, SLOT(albumScanned(int)));
     connect(s, SIGNAL(done()), this, SLOT(scannerDone()));
     scanners[s]=0;
     JobController::self()->add(s);
@@ -372,29 +374,31 @@ bool RgDialog::saveTags()
 
     progress->setVisible(true);
     progress->setRange(0, tagsToSave.count());
+    progress->setValue(0);
 
-    int count=0;
     bool someTimedout=false;
+    QStringList files;
+    QList<Tags::ReplayGain> tags;
     QMap<int, Tags::ReplayGain>::ConstIterator it=tagsToSave.constBegin();
     QMap<int, Tags::ReplayGain>::ConstIterator end=tagsToSave.constEnd();
 
     for (; it!=end; ++it) {
-        QString filePath=origSongs.at(it.key()).filePath(base);
-        switch (Tags::updateReplaygain(filePath, it.value())) {
+        files.append(origSongs.at(it.key()).filePath(base));
+        tags.append(it.value());
+    }
+
+    QList<int> status=TagHelperPool::self()->updateReplaygain(files, tags, this);
+    for (int i=0; i<status.count(); ++i) {
+        switch (status.at(i)) {
         case Tags::Update_Failed:
-            failed.append(filePath);
+            failed.append(files.at(i));
             break;
         case Tags::Update_BadFile:
-            failed.append(tr("%1 (Corrupt tags?)", "filename (Corrupt tags?)").arg(filePath));
+            failed.append(tr("%1 (Corrupt tags?)", "filename (Corrupt tags?)").arg(files.at(i)));
             break;
         default:
             break;
         }
-
-        progress->setValue(progress->value()+1);
-        if (0==count++%10) {
-            QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        }
     }
 
     if (failed.count()) {
@@ -404,6 +408,15 @@ bool RgDialog::saveTags()
     return !someTimedout;
 }
 
+void RgDialog::tagProgress(int done, int total)
+{
+    Q_UNUSED(total)
+    progress->setValue(done);
+    if (0==done%10) {
+        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    }
+}
+
 void RgDialog::updateView()
 {
     int finished=0;
@@ -463,6 +476,16 @@ void RgDialog::scannerProgress(int p)
     updateView();
 }
 
+void RgDialog::albumScanned(int album)
+{
+    AlbumScanner *s=qobject_cast<AlbumScanner *>(sender());
+    if (!s) {
+        return;
+    }
+
+    showResults(s, album, true);
+}
+
 void RgDialog::scannerDone()
 {
     AlbumScanner *s=qobject_cast<AlbumScanner *>(sender());
@@ -470,13 +493,28 @@ void RgDialog::scannerDone()
         return;
     }
 
-    const QMap<int, AlbumScanner::Values> &trackValues=s->trackValues();
+    // Albums not reported by the helper (e.g. it crashed) have failed
+    for (int a=0; a<s->albumCount(); ++a) {
+        if (!s->isAlbumDone(a)) {
+            showResults(s, a, false);
+        }
+    }
+
+    scanners[s]=100;
+    updateView();
+    JobController::self()->finishedWith(s);
+}
+
+void RgDialog::showResults(AlbumScanner *s, int album, bool scanned)
+{
+    const QMap<int, AlbumScanner::Values> trackValues=s->trackValues(album);
+    const AlbumScanner::Values &albumValues=s->albumValues(album);
     QMap<int, AlbumScanner::Values>::ConstIterator it(trackValues.constBegin());
     QMap<int, AlbumScanner::Values>::ConstIterator end(trackValues.constEnd());
 
-    if (s->success()) {
+    if (scanned) {
         for(; it!=end; ++it) {
-            Tags::ReplayGain updatedTags(it.value().gain, s->albumValues().gain, it.value().peak, s->albumValues().peak);
+            Tags::ReplayGain updatedTags(it.value().gain, albumValues.gain, it.value().peak, albumValues.peak);
             QTreeWidgetItem *item=view->topLevelItem(it.key());
             if (it.value().ok) {
                 item->setText(COL_TRACKGAIN, tr("%1 dB").arg(Utils::formatNumber(updatedTags.trackGain, 2)));
@@ -485,7 +523,7 @@ void RgDialog::scannerDone()
                 item->setText(COL_TRACKGAIN, tr("Failed"));
                 item->setText(COL_TRACKPEAK, tr("Failed"));
             }
-            if (s->albumValues().ok) {
+            if (albumValues.ok) {
                 item->setText(COL_ALBUMGAIN, tr("%1 dB").arg(Utils::formatNumber(updatedTags.albumGain, 2)));
                 item->setText(COL_ALBUMPEAK, Utils::formatNumber(updatedTags.albumPeak, 6));
             } else {
@@ -552,10 +590,6 @@ void RgDialog::scannerDone()
             tagsToSave.remove(it.key());
         }
     }
-
-    scanners[s]=100;
-    updateView();
-    JobController::self()->finishedWith(s);
 }
 
 void RgDialog::songTags(int index, Tags::ReplayGain tags)
@@ -40,7 +40,7 @@ class Device;
 class TagReader;
 class Action;
 
-class RgDialog : public SongDialog
+class RgDialog : public SongDialog, TagHelperPool::Progress
 {
     Q_OBJECT
 
@@ -60,7 +60,8 @@ private:
     void slotButtonClicked(int button);
     void startScanning();
     void stopScanning();
-    void createScanner(const QList<int> &indexes);
+    void createScanner(const QList<QList<int> > &albums);
+    void showResults(AlbumScanner *s, int album, bool scanned);
     void clearScanners();
     void startReadingTags();
     void stopReadingTags();
@@ -70,9 +71,11 @@ private:
     Device * getDevice(const QString &udi, QWidget *p);
     #endif
     void closeEvent(QCloseEvent *event);
+    void tagProgress(int done, int total);
 
 private Q_SLOTS:
     void scannerProgress(int p);
+    void albumScanned(int album);
     void scannerDone();
     void songTags(int index, Tags::ReplayGain tags);
     void tagReaderDone();
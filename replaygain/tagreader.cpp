@@ -22,6 +22,10 @@
  */
 
 #include "tagreader.h"
+#include "tags/taghelperpool.h"
+
+// Tags are read in batches, so that an abort does not have to wait for all files
+static const int constBatchSize=64;
 
 void TagReader::setDetails(const QList<Song> &s, const QString &dir)
 {
@@ -31,13 +35,20 @@ void TagReader::setDetails(const QList<Song> &s, const QString &dir)
 
 void TagReader::run()
 {
-    for(int i=0; i<songs.count(); ++i) {
+    for (int start=0; start<songs.count(); start+=constBatchSize) {
         if (abortRequested) {
             setFinished(false);
             return;
         }
 
-        emit progress(i, Tags::readReplaygain(baseDir+songs.at(i).file));
+        QStringList files;
+        for (int i=start; i<songs.count() && i<start+constBatchSize; ++i) {
+            files.append(baseDir+songs.at(i).file);
+        }
+        QList<Tags::ReplayGain> tags=TagHelperPool::self()->readReplaygain(files);
+        for (int i=0; i<tags.count(); ++i) {
+            emit progress(start+i, tags.at(i));
+        }
     }
     setFinished(true);
 }
@@ -0,0 +1,189 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "trackcache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QDir>
+
+static const quint32 constMagic=0x52474354;
+static const quint32 constVersion=1;
+// Rewrite the file when it holds this many more records than there are entries
+static const int constCompactSlack=256;
+
+static void writeRecord(QDataStream &stream, const QString &file, qint64 mtime, qint64 size, const TrackScanner::Data &data)
+{
+    // Most bins are empty, so only store those that are used
+    QList<quint16> bins;
+    for (int i=0; i<data.histogram.count(); ++i) {
+        if (data.histogram.at(i)) {
+            bins.append(i);
+        }
+    }
+    stream << file << mtime << size << data.loudness << data.peak << data.truePeak << (quint16)bins.count();
+    for (quint16 bin: bins) {
+        stream << bin << data.histogram.at(bin);
+    }
+}
+
+static bool readRecord(QDataStream &stream, QString &file, qint64 &mtime, qint64 &size, TrackScanner::Data &data)
+{
+    quint16 count=0;
+    stream >> file >> mtime >> size >> data.loudness >> data.peak >> data.truePeak >> count;
+    if (QDataStream::Ok!=stream.status() || count>TrackScanner::constHistogramBins) {
+        return false;
+    }
+    data.histogram=TrackScanner::Histogram(TrackScanner::constHistogramBins, 0);
+    for (quint16 i=0; i<count; ++i) {
+        quint16 bin=0;
+        quint32 blocks=0;
+        stream >> bin >> blocks;
+        if (QDataStream::Ok!=stream.status() || bin>=TrackScanner::constHistogramBins) {
+            return false;
+        }
+        data.histogram[bin]=blocks;
+    }
+    return true;
+}
+
+static bool fileDetails(const QString &file, qint64 &mtime, qint64 &size)
+{
+    QFileInfo info(file);
+    if (!info.exists()) {
+        return false;
+    }
+    mtime=info.lastModified().toMSecsSinceEpoch();
+    size=info.size();
+    return true;
+}
+
+TrackCache::TrackCache(const QString &cacheFile)
+    : fileName(cacheFile)
+    , file(0)
+{
+    load();
+}
+
+TrackCache::~TrackCache()
+{
+    delete file;
+}
+
+bool TrackCache::get(const QString &path, TrackScanner::Data &data) const
+{
+    QHash<QString, Entry>::ConstIterator it=entries.constFind(path);
+    if (it==entries.constEnd()) {
+        return false;
+    }
+    qint64 mtime=0;
+    qint64 size=0;
+    if (!fileDetails(path, mtime, size) || mtime!=it.value().mtime || size!=it.value().size) {
+        return false;
+    }
+    data=it.value().data;
+    return true;
+}
+
+void TrackCache::insert(const QString &path, const TrackScanner::Data &data)
+{
+    Entry entry;
+    if (!fileDetails(path, entry.mtime, entry.size)) {
+        return;
+    }
+    entry.data=data;
+    entries.insert(path, entry);
+
+    if (file) {
+        QDataStream stream(file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        writeRecord(stream, path, entry.mtime, entry.size, data);
+        file->flush();
+    }
+}
+
+void TrackCache::load()
+{
+    int records=0;
+    bool valid=false;
+    QFile f(fileName);
+    if (f.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&f);
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic=0;
+        quint32 version=0;
+        stream >> magic >> version;
+        valid=constMagic==magic && constVersion==version;
+        while (valid && !stream.atEnd()) {
+            QString path;
+            Entry entry;
+            if (!readRecord(stream, path, entry.mtime, entry.size, entry.data)) {
+                // Truncated record, probably due to scan being killed - file will be rewritten.
+                valid=false;
+                break;
+            }
+            entries.insert(path, entry);
+            records++;
+        }
+        f.close();
+    }
+
+    if (!valid || records>entries.count()+constCompactSlack) {
+        if (!compact()) {
+            return;
+        }
+    }
+
+    file=new QFile(fileName);
+    if (!file->open(QIODevice::WriteOnly|QIODevice::Append)) {
+        delete file;
+        file=0;
+    }
+}
+
+bool TrackCache::compact()
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QString tmpName=fileName+QLatin1String(".tmp");
+    QFile f(tmpName);
+    if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        return false;
+    }
+
+    QDataStream stream(&f);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << constMagic << constVersion;
+    QHash<QString, Entry>::ConstIterator it=entries.constBegin();
+    QHash<QString, Entry>::ConstIterator end=entries.constEnd();
+    for (; it!=end; ++it) {
+        writeRecord(stream, it.key(), it.value().mtime, it.value().size, it.value().data);
+    }
+    f.close();
+    if (QDataStream::Ok!=stream.status()) {
+        QFile::remove(tmpName);
+        return false;
+    }
+    QFile::remove(fileName);
+    return QFile::rename(tmpName, fileName);
+}
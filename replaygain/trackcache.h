@@ -0,0 +1,62 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _TRACK_CACHE_H_
+#define _TRACK_CACHE_H_
+
+#include "trackscanner.h"
+#include <QHash>
+#include <QString>
+
+class QFile;
+
+// Persistent store of per-track scan results. Entries are keyed on file path, and are only
+// used if the file's modification time and size are unchanged. Records are appended as each
+// track is scanned (so an aborted scan keeps its results), the last record for a path wins.
+class TrackCache
+{
+public:
+    TrackCache(const QString &cacheFile);
+    ~TrackCache();
+
+    bool get(const QString &path, TrackScanner::Data &data) const;
+    void insert(const QString &path, const TrackScanner::Data &data);
+
+private:
+    struct Entry {
+        Entry(qint64 m=0, qint64 s=0) : mtime(m), size(s) { }
+        qint64 mtime;
+        qint64 size;
+        TrackScanner::Data data;
+    };
+
+    void load();
+    bool compact();
+
+private:
+    QString fileName;
+    QHash<QString, Entry> entries;
+    QFile *file;
+};
+
+#endif
@@ -22,6 +22,8 @@
  */
 
 #include "trackscanner.h"
+#include "inputpool.h"
+#include "input.h"
 #include "config.h"
 #ifdef MPG123_FOUND
 #include "mpg123input.h"
@@ -30,8 +32,12 @@
 #include "ffmpeginput.h"
 #endif
 
+#include <math.h>
+
 #define RG_REFERENCE_LEVEL -18.0
 
+static bool truePeak=false;
+
 double TrackScanner::clamp(double v)
 {
     return v < -51.0 ? -51.0
@@ -45,34 +51,74 @@ double TrackScanner::reference(double v)
     return clamp(RG_REFERENCE_LEVEL-v);
 }
 
-TrackScanner::Data TrackScanner::global(const QList<TrackScanner *> &scanners)
+static double binLoudness(int bin)
+{
+    // Centre of the 0.1 LU wide bin
+    return (bin/10.0)-69.95;
+}
+
+static double gatedLoudness(const TrackScanner::Histogram &histogram)
+{
+    double energy=0.0;
+    quint64 blocks=0;
+    for (int i=0; i<histogram.count(); ++i) {
+        if (histogram.at(i)) {
+            energy+=histogram.at(i)*pow(10.0, (binLoudness(i)+0.691)/10.0);
+            blocks+=histogram.at(i);
+        }
+    }
+
+    if (!blocks) {
+        return 0.0;
+    }
+
+    // Relative gate is 10 LU below the (absolute gated) mean...
+    double relativeThreshold=(10.0*log10(energy/blocks))-0.691-10.0;
+    energy=0.0;
+    blocks=0;
+    for (int i=0; i<histogram.count(); ++i) {
+        if (histogram.at(i) && binLoudness(i)>=relativeThreshold) {
+            energy+=histogram.at(i)*pow(10.0, (binLoudness(i)+0.691)/10.0);
+            blocks+=histogram.at(i);
+        }
+    }
+
+    return blocks ? (10.0*log10(energy/blocks))-0.691 : 0.0;
+}
+
+TrackScanner::Data TrackScanner::global(const QList<Data> &tracks)
 {
     Data d;
-    if (scanners.count()<1) {
+    if (tracks.count()<1) {
         return d;
-    } else if(scanners.count()==1) {
-        return scanners.first()->results();
+    } else if(tracks.count()==1) {
+        return tracks.first();
     } else {
-        ebur128_state **states = new ebur128_state * [scanners.count()];
-        for (int i=0; i<scanners.count(); ++i) {
-            TrackScanner *s=scanners.at(i);
-            states[i]=s->state;
-            if (s->results().peak>d.peak) {
-                d.peak=s->results().peak;
+        d.histogram=Histogram(constHistogramBins, 0);
+        for (const Data &t: tracks) {
+            if (t.peak>d.peak) {
+                d.peak=t.peak;
+            }
+            if (t.truePeak>d.truePeak) {
+                d.truePeak=t.truePeak;
             }
-            if (s->results().truePeak>d.truePeak) {
-                d.truePeak=s->results().truePeak;
+            if (constHistogramBins==t.histogram.count()) {
+                for (int i=0; i<constHistogramBins; ++i) {
+                    d.histogram[i]+=t.histogram.at(i);
+                }
             }
         }
 
-        double l=0.0;
-        int rv=ebur128_loudness_global_multiple(states, scanners.count(), &l);
-        delete [] states;
-        d.loudness=0==rv ? l : 0.0;
+        d.loudness=gatedLoudness(d.histogram);
         return d;
     }
 }
 
+void TrackScanner::setTruePeak(bool tp)
+{
+    truePeak=tp;
+}
+
 void TrackScanner::init()
 {
     static bool doneInit=false;
@@ -86,6 +132,8 @@ void TrackScanner::init()
     #ifdef FFMPEG_FOUND
     FfmpegInput::init();
     #endif
+    // Create the pool here, as scanners use it from their own threads
+    InputPool::self();
 }
 
 TrackScanner::TrackScanner(int i)
@@ -97,7 +145,7 @@ TrackScanner::TrackScanner(int i)
 
 TrackScanner::~TrackScanner()
 {
-    delete input;
+    InputPool::self()->release(input);
     if (state) {
         ebur128_destroy(&state);
         state=0;
@@ -111,40 +159,14 @@ void TrackScanner::setFile(const QString &fileName)
 
 void TrackScanner::run()
 {
-    bool ffmpegIsFloat=false;
-    #ifdef FFMPEG_FOUND
-    FfmpegInput *ffmpeg=new FfmpegInput(file);
-    if (*ffmpeg) {
-        input=ffmpeg;
-        ffmpegIsFloat=ffmpeg->isFloatCodec();
-    } else {
-        delete ffmpeg;
-        ffmpeg=0;
-    }
-    #endif
-
-    #if MPG123_FOUND
-    if (file.endsWith(".mp3", Qt::CaseInsensitive) && (!input || !ffmpegIsFloat)) {
-        Mpg123Input *mpg123=new Mpg123Input(file);
-        if (*mpg123) {
-            input=mpg123;
-            #ifdef FFMPEG_FOUND
-            if (ffmpeg) {
-                delete ffmpeg;
-            }
-            #endif
-        } else {
-            delete mpg123;
-        }
-    }
-    #endif
-
+    input=InputPool::self()->open(file);
     if (!input) {
         setFinishedStatus(false);
         return;
     }
 
-    state=ebur128_init(input->channels(), input->sampleRate(), EBUR128_MODE_M|EBUR128_MODE_I|EBUR128_MODE_SAMPLE_PEAK);
+    state=ebur128_init(input->channels(), input->sampleRate(),
+                       EBUR128_MODE_M|EBUR128_MODE_I|EBUR128_MODE_SAMPLE_PEAK|(truePeak ? EBUR128_MODE_TRUE_PEAK : 0));
 
     int *channelMap=new int [state->channels];
     if (input->setChannelMap(channelMap)) {
@@ -159,19 +181,45 @@ void TrackScanner::run()
     //    ebur128_set_channel(state, 0, EBUR128_DUAL_MONO);
     //}
 
+    // Frames are fed in 100ms steps, so that the momentary loudness can be sampled
+    // for each gating block as it completes.
+    size_t blockFrames=(input->sampleRate()+5)/10;
+    size_t blockFill=0;
     size_t numFramesRead=0;
     size_t totalRead=0;
-    input->allocateBuffer();
+    size_t totalFrames=input->totalFrames();
+    int lastProgress=-1;
+    data.histogram=Histogram(constHistogramBins, 0);
     while ((numFramesRead = input->readFrames())) {
         if (abortRequested) {
             setFinishedStatus(false);
             return;
         }
+        size_t offset=0;
+        while (offset<numFramesRead) {
+            size_t frames=qMin(numFramesRead-offset, blockFrames-blockFill);
+            // Samples are converted (if required) one block at a time, so are still cached when analysed
+            const float *buffer=input->floatFrames(offset, frames);
+            if (!buffer || ebur128_add_frames_float(state, buffer, frames)) {
+                setFinishedStatus(false);
+                return;
+            }
+            offset+=frames;
+            blockFill+=frames;
+            if (blockFill==blockFrames) {
+                blockFill=0;
+                // First gating block is only complete after 400ms
+                if (totalRead+offset>=blockFrames*4) {
+                    addBlock();
+                }
+            }
+        }
         totalRead+=numFramesRead;
-        emit progress((int)((totalRead*100.0/input->totalFrames())+0.5));
-        if (ebur128_add_frames_float(state, input->buffer(), numFramesRead)) {
-            setFinishedStatus(false);
-            return;
+        // Decoders may return only a single (e.g. MP3) frame at a time, so only emit changes
+        int p=totalFrames ? (int)((totalRead*100.0/totalFrames)+0.5) : 0;
+        if (p!=lastProgress) {
+            lastProgress=p;
+            emit progress(p);
         }
     }
 
@@ -207,9 +255,24 @@ void TrackScanner::run()
     setFinishedStatus(true);
 }
 
+void TrackScanner::addBlock()
+{
+    double l=0.0;
+    if (0!=ebur128_loudness_momentary(state, &l) || !(l>=-70.0)) {
+        return;
+    }
+    int bin=(int)((l+70.0)*10.0);
+    data.histogram[bin<constHistogramBins ? bin : constHistogramBins-1]++;
+}
+
 void TrackScanner::setFinishedStatus(bool f)
 {
-    delete input;
+    InputPool::self()->release(input);
     input=0;
+    // Album values are computed from the histogram, so the (large) block list is no longer required
+    if (state) {
+        ebur128_destroy(&state);
+        state=0;
+    }
     setFinished(f);
 }
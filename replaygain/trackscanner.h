@@ -26,6 +26,7 @@
 
 #include "jobcontroller.h"
 #include "ebur128/ebur128.h"
+#include <QVector>
 
 class Input;
 
@@ -34,6 +35,12 @@ class TrackScanner : public StandardJob
     Q_OBJECT
 
 public:
+    // Gating blocks (400ms, 75% overlap) binned in 0.1 LU steps from -70 LUFS upwards.
+    // Merging the histograms of several tracks gives the same gated loudness as scanning
+    // them together, so album values can be computed from (cached) per-track results.
+    typedef QVector<quint32> Histogram;
+    static const int constHistogramBins=1000;
+
     struct Data
     {
         Data()
@@ -45,13 +52,16 @@ public:
         double loudness;
         double peak;
         double truePeak;
+        Histogram histogram;
     };
 
-    static Data global(const QList<TrackScanner *> &scanners);
+    static Data global(const QList<Data> &tracks);
     static double clamp(double v);
     static double reference(double v);
 
     static void init();
+    // True-peak (4x oversampled) detection is slower, so is only used if requested
+    static void setTruePeak(bool tp);
 
     TrackScanner(int i);
     ~TrackScanner();
@@ -63,6 +73,7 @@ public:
 
 private:
     void run();
+    void addBlock();
     void setFinishedStatus(bool f);
 
 private:
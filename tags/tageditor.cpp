@@ -124,6 +124,7 @@ TagEditor::TagEditor(QWidget *parent, const QList<Song> &songs,
     , commentSupport(false)
     , readRatingsAct(0)
     , writeRatingsAct(0)
+    , tagsDone(0)
 {
     iCount++;
     bool ratingsSupport=false;
@@ -503,21 +504,19 @@ void TagEditor::readComments()
     bool updated=false;
     bool multipleComments=false;
     QString allComment;
+    int first=haveMultiple ? 1 : 0;
+    QStringList files;
 
-    for (int i=0; i<original.count(); ++i) {
-        if (0!=i || !haveMultiple) {
-            progress->setValue(progress->value()+1);
-        }
-        if (i && 0==i%10) {
-            QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        }
+    for (int i=first; i<original.count(); ++i) {
+        files.append(original.at(i).filePath(baseDir));
+    }
+    tagsDone=0;
+    QStringList comments=TagHelperPool::self()->readComment(files, this);
 
-        if (0==i && haveMultiple) {
-            continue;
-        }
-        Song song=original.at(i);
-        QString comment=Tags::readComment(song.filePath(baseDir));
+    for (int i=first; i<original.count(); ++i) {
+        const QString &comment=comments.at(i-first);
         if (!comment.isEmpty()) {
+            Song song=original.at(i);
             song.setComment(comment);
             original.replace(i, song);
             haveComments=true;
@@ -754,14 +753,17 @@ void TagEditor::readRatings()
     if (isAll) {
         progress->setVisible(true);
         progress->setRange(0, original.count());
+        progress->setValue(1);
+        QStringList files;
+        for (int i=1; i<original.count(); ++i) {
+            files.append(edited.at(i).filePath(baseDir));
+        }
+        tagsDone=0;
+        QList<int> ratings=TagHelperPool::self()->readRating(files, this);
         QStringList updated;
         for (int i=1; i<original.count(); ++i) {
-            progress->setValue(i+1);
-            if (i && 0==i%10) {
-                QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-            }
             Song s=edited.at(i);
-            int r=Tags::readRating(s.filePath(baseDir));
+            int r=ratings.at(i-1);
             if (r>=0 && r<=Song::Rating_Max && s.rating!=r) {
                 s.rating=r;
                 edited.replace(i, s);
@@ -821,19 +823,25 @@ void TagEditor::writeRatings()
 
     if (isAll) {
         progress->setVisible(true);
-        progress->setRange(0, edited.count());
-        QStringList failed;
+        QStringList files;
+        QStringList names;
+        QList<int> ratings;
         for (int i=1; i<edited.count(); ++i) {
-            progress->setValue(i+1);
-            if (i && 0==i%10) {
-                QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-            }
-            Song s=edited.at(i);
+            const Song &s=edited.at(i);
             if (s.rating<=Song::Rating_Max) {
-                Tags::Update status=Tags::updateRating(s.filePath(baseDir), s.rating);
-                if (Tags::Update_Failed==status || Tags::Update_BadFile==status){
-                    failed.append(s.file);
-                }
+                files.append(s.filePath(baseDir));
+                names.append(s.file);
+                ratings.append(s.rating);
+            }
+        }
+        progress->setRange(0, files.count());
+        progress->setValue(0);
+        tagsDone=0;
+        QList<int> status=TagHelperPool::self()->updateRating(files, ratings, this);
+        QStringList failed;
+        for (int i=0; i<status.count(); ++i) {
+            if (Tags::Update_Failed==status.at(i) || Tags::Update_BadFile==status.at(i)){
+                failed.append(names.at(i));
             }
         }
         progress->setVisible(false);
@@ -1142,17 +1150,14 @@ bool TagEditor::applyUpdates()
     enableButton(User2, false);
     enableButton(User3, false);
     progress->setVisible(true);
-    progress->setRange(1, toSave);
+    progress->setRange(0, toSave);
+    progress->setValue(0);
 
-    int count=0;
-    bool someTimedout=false;
+    // Tags are all written in one go, so first work out which files need updating
+    QList<Song> toUpdate;
+    QList<Song> updates;
+    QStringList files;
     for (int idx: editedIndexes) {
-        progress->setValue(progress->value()+1);
-
-        if (0==count++%10) {
-            QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-        }
-
         if (skipFirst && 0==idx) {
             continue;
         }
@@ -1164,14 +1169,25 @@ bool TagEditor::applyUpdates()
         }
 
         if (equalTags(orig, edit, false, composerSupport, commentSupport)) {
+            progress->setValue(progress->value()+1);
             continue;
         }
 
-        QString file=orig.filePath();
-        QString afile=orig.filePath(baseDir);
+        files.append(orig.filePath(baseDir));
         splitGenres(orig);
         splitGenres(edit);
-        switch(Tags::update(afile, orig, edit, -1, commentSupport)) {
+        toUpdate.append(orig);
+        updates.append(edit);
+    }
+
+    bool someTimedout=false;
+    tagsDone=0;
+    QList<int> status=TagHelperPool::self()->update(files, toUpdate, updates, -1, commentSupport, this);
+    for (int i=0; i<status.count(); ++i) {
+        const Song &orig=toUpdate.at(i);
+        Song edit=updates.at(i);
+        QString file=orig.filePath();
+        switch(status.at(i)) {
         case Tags::Update_Modified:
             edit.setComment(QString());
             #ifdef ENABLE_DEVICES_SUPPORT
@@ -1316,3 +1332,14 @@ void TagEditor::controlInitialActionsState()
         }
     }
 }
+
+void TagEditor::tagProgress(int done, int total)
+{
+    Q_UNUSED(total)
+    // Ratings may also be updating the progress bar, so increment rather than set
+    progress->setValue(progress->value()+(done-tagsDone));
+    tagsDone=done;
+    if (0==done%10) {
+        QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+    }
+}
@@ -27,6 +27,7 @@
 #include "config.h"
 #include "widgets/songdialog.h"
 #include "ui_tageditor.h"
+#include "taghelperpool.h"
 #include <QSet>
 #include <QList>
 
@@ -34,7 +35,7 @@
 class Device;
 #endif
 
-class TagEditor : public SongDialog, Ui::TagEditor
+class TagEditor : public SongDialog, Ui::TagEditor, TagHelperPool::Progress
 {
     Q_OBJECT
 
@@ -66,6 +67,7 @@ private:
     #endif
     void closeEvent(QCloseEvent *event);
     void controlInitialActionsState();
+    void tagProgress(int done, int total);
 
 private Q_SLOTS:
     void readComments();
@@ -107,6 +109,7 @@ private:
     bool commentSupport;
     QAction *readRatingsAct;
     QAction *writeRatingsAct;
+    int tagsDone;
 };
 
 #endif
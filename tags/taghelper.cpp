@@ -123,6 +123,37 @@ void TagHelper::process()
     inStream >> request >> fileName;
 
     DBUG << "REQ" << request << fileName;
+    if (QLatin1String("batch")==request) {
+        // Same request for several files - each file's response is sent as soon as it has been
+        // processed (prefixed by its index), followed by an index of -1 once all are done.
+        qint32 count=0;
+        inStream >> request >> count;
+        DBUG << "BATCH" << request << count;
+        for (qint32 i=0; i<count; ++i) {
+            inStream >> fileName;
+            response.clear();
+            QDataStream fileStream(&response, QIODevice::WriteOnly);
+            fileStream << i;
+            if (!handle(request, fileName, inStream, fileStream)) {
+                qApp->exit();
+                return;
+            }
+            send(response);
+        }
+        response.clear();
+        QDataStream endStream(&response, QIODevice::WriteOnly);
+        endStream << qint32(-1);
+    } else if (!handle(request, fileName, inStream, outStream)) {
+        qApp->exit();
+    }
+
+    send(response);
+    data.clear();
+    dataSize=0;
+}
+
+bool TagHelper::handle(const QString &request, const QString &fileName, QDataStream &inStream, QDataStream &outStream)
+{
     if (QLatin1String("read")==request) {
         outStream << Tags::read(fileName);
     } else if (QLatin1String("readImage")==request) {
@@ -133,6 +164,7 @@ void TagHelper::process()
         outStream << Tags::readComment(fileName);
     } else if (QLatin1String("updateArtistAndTitle")==request) {
         Song song;
+        inStream >> song;
         outStream << (int)Tags::updateArtistAndTitle(fileName, song);
     } else if (QLatin1String("update")==request) {
         Song from;
@@ -163,9 +195,13 @@ void TagHelper::process()
     } else if (QLatin1String("readAll")==request) {
         outStream << Tags::readAll(fileName);
     } else {
-        qApp->exit();
+        return false;
     }
+    return true;
+}
 
+void TagHelper::send(const QByteArray &response)
+{
     DBUG << "RESP" << response.size();
     QDataStream writeStream(socket);
     writeStream << qint32(response.length());
@@ -173,6 +209,4 @@ void TagHelper::process()
         writeStream.writeRawData(response.data(), response.length());
     }
     socket->flush();
-    data.clear();
-    dataSize=0;
 }
@@ -28,6 +28,7 @@
 #include <QByteArray>
 
 class QLocalSocket;
+class QDataStream;
 
 class TagHelper : public QObject
 {
@@ -45,6 +46,8 @@ private Q_SLOTS:
 
 private:
     void process();
+    bool handle(const QString &request, const QString &fileName, QDataStream &inStream, QDataStream &outStream);
+    void send(const QByteArray &response);
 
 private:
     int parentPid;
@@ -52,6 +52,7 @@ TagHelperIface::TagHelperIface()
     , proc(0)
     , server(0)
     , sock(0)
+    , batchQueue(0)
 {
     qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
     thread=new Thread(metaObject()->className());
@@ -290,6 +291,39 @@ TagHelperIface::Reply TagHelperIface::sendMessage(const QByteArray &msg)
     return reply;
 }
 
+void TagHelperIface::BatchQueue::add(const Reply &reply)
+{
+    QMutexLocker locker(&mutex);
+    replies.append(reply);
+    sema.release();
+}
+
+TagHelperIface::BatchQueue::Reply TagHelperIface::BatchQueue::take()
+{
+    sema.acquire();
+    QMutexLocker locker(&mutex);
+    return replies.takeFirst();
+}
+
+void TagHelperIface::startBatch(const QString &request, int count, const QByteArray &files, BatchQueue *queue)
+{
+    DBUG << request << count;
+    mutex.lock();
+    QByteArray message;
+    QDataStream outStream(&message, QIODevice::WriteOnly);
+    outStream << QString("batch") << QString() << request << qint32(count);
+    message+=files;
+    data=message;
+    batchQueue=queue;
+    metaObject()->invokeMethod(this, "sendMsg", Qt::QueuedConnection);
+}
+
+void TagHelperIface::endBatch()
+{
+    DBUG;
+    mutex.unlock();
+}
+
 static const int constMaxWait=5000;
 
 bool TagHelperIface::startHelper()
@@ -397,6 +431,11 @@ void TagHelperIface::sendMsg()
         DBUG << "Message sent";
         data.clear();
         dataSize=0;
+    } else if (batchQueue) {
+        BatchQueue *queue=batchQueue;
+        batchQueue=0;
+        data.clear();
+        queue->add(BatchQueue::Reply(this, BatchQueue::NotStarted));
     } else {
         awaitingResponse=true;
         setStatus(false);
@@ -425,6 +464,13 @@ void TagHelperIface::dataReady()
 
         data+=sock->read(dataSize-data.length());
         if (data.length() == dataSize) {
+            if (batchQueue) {
+                batchReply();
+                if (!awaitingResponse) {
+                    break;
+                }
+                continue;
+            }
             DBUG << "Response fully received";
             setStatus(true);
             break;
@@ -443,7 +489,32 @@ void TagHelperIface::setStatus(bool st)
     DBUG << st << awaitingResponse;
     if (awaitingResponse) {
         awaitingResponse=false;
+        if (batchQueue) {
+            // Batches only complete via batchReply(), so this is a failure - e.g. the helper crashed
+            BatchQueue *queue=batchQueue;
+            batchQueue=0;
+            queue->add(BatchQueue::Reply(this, BatchQueue::Failed));
+            return;
+        }
         msgStatus=st;
         sema.release();
     }
 }
+
+void TagHelperIface::batchReply()
+{
+    qint32 index=BatchQueue::Done;
+    QDataStream stream(data);
+    stream >> index;
+    DBUG << "Batch response" << index;
+    if (index<0) {
+        BatchQueue *queue=batchQueue;
+        awaitingResponse=false;
+        batchQueue=0;
+        queue->add(BatchQueue::Reply(this, BatchQueue::Done));
+    } else {
+        batchQueue->add(BatchQueue::Reply(this, index, data.mid(sizeof(qint32))));
+    }
+    data.clear();
+    dataSize=0;
+}
@@ -30,6 +30,7 @@
 #include <QMutex>
 #include <QSemaphore>
 #include <QMap>
+#include <QList>
 
 class QLocalServer;
 class QLocalSocket;
@@ -55,6 +56,33 @@ public:
         QByteArray data;
     };
 
+    // Responses to batch requests, queued by each helper's thread as each file is processed.
+    class BatchQueue
+    {
+    public:
+        struct Reply
+        {
+            Reply(TagHelperIface *h=0, int i=Done, const QByteArray &d=QByteArray()) : helper(h), index(i), data(d) { }
+            TagHelperIface *helper;
+            int index; // Index of file within batch, or Done/Failed/NotStarted
+            QByteArray data;
+        };
+
+        enum Status {
+            Done = -1,
+            Failed = -2,
+            NotStarted = -3 // Helper process could not be started, so no files were processed
+        };
+
+        void add(const Reply &reply);
+        Reply take();
+
+    private:
+        QMutex mutex;
+        QSemaphore sema;
+        QList<Reply> replies;
+    };
+
     TagHelperIface();
     void stop();
     Song read(const QString &fileName);
@@ -71,11 +99,17 @@ public:
     int updateRating(const QString &fileName, int rating);
     QMap<QString, QString> readAll(const QString &fileName);
 
+    // Send 'request' (and its per-file arguments) for several files, responses are added to 'queue'.
+    // The helper is reserved for the caller until endBatch() is called, after Done, Failed, or NotStarted is taken.
+    void startBatch(const QString &request, int count, const QByteArray &files, BatchQueue *queue);
+    void endBatch();
+
 private:
     bool helperIsRunning();
     Reply sendMessage(const QByteArray &msg);
     bool startHelper();
     void setStatus(bool st);
+    void batchReply();
 
 private Q_SLOTS:
     void close();
@@ -95,6 +129,7 @@ private:
     QProcess *proc;
     QLocalServer *server;
     QLocalSocket *sock;
+    BatchQueue *batchQueue;
 };
 
 #endif
@@ -0,0 +1,277 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "taghelperpool.h"
+#include "taghelperiface.h"
+#include "tags.h"
+#include "support/configuration.h"
+#include "support/globalstatic.h"
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QThread>
+#include <QMap>
+
+// More than one helper is only used if there are enough files to make this worthwhile
+static const int constFilesPerHelper=16;
+static const int constMaxHelpers=4;
+// Each helper is sent several smaller batches, so that helpers that finish early can take more
+static const int constBatchesPerHelper=4;
+static const int constMaxBatchSize=64;
+
+namespace
+{
+struct Range
+{
+    Range(int s=0, int c=0) : start(s), count(c), received(0) { }
+    int start;
+    int count;
+    int received;
+};
+
+template<typename R>
+class FileRequest : public TagHelperPool::Request
+{
+public:
+    FileRequest(const QStringList &f, const R &failed) : files(f) {
+        results.reserve(files.count());
+        for (int i=0; i<files.count(); ++i) {
+            results.append(failed);
+        }
+    }
+    int count() const { return files.count(); }
+    void write(QDataStream &stream, int index) const {
+        stream << files.at(index);
+        writeArgs(stream, index);
+    }
+    void read(QDataStream &stream, int index) { stream >> results[index]; }
+    virtual void writeArgs(QDataStream &, int) const { }
+
+    const QStringList &files;
+    QList<R> results;
+};
+
+template<typename A>
+class UpdateRequest : public FileRequest<int>
+{
+public:
+    UpdateRequest(const QStringList &f, const QList<A> &a) : FileRequest<int>(f, Tags::Update_BadFile), args(a) { }
+    void writeArgs(QDataStream &stream, int index) const { stream << args.at(index); }
+
+    const QList<A> &args;
+};
+
+class SongUpdateRequest : public FileRequest<int>
+{
+public:
+    SongUpdateRequest(const QStringList &f, const QList<Song> &fr, const QList<Song> &t, int v, bool c)
+        : FileRequest<int>(f, Tags::Update_BadFile), from(fr), to(t), id3Ver(v), saveComment(c) { }
+    void writeArgs(QDataStream &stream, int index) const { stream << from.at(index) << to.at(index) << id3Ver << saveComment; }
+
+    const QList<Song> &from;
+    const QList<Song> &to;
+    int id3Ver;
+    bool saveComment;
+};
+}
+
+static void startBatch(TagHelperIface *helper, const QString &request, const TagHelperPool::Request *req, const Range &range,
+                       TagHelperIface::BatchQueue *queue)
+{
+    QByteArray files;
+    QDataStream stream(&files, QIODevice::WriteOnly);
+    for (int i=0; i<range.count; ++i) {
+        req->write(stream, range.start+i);
+    }
+    helper->startBatch(request, range.count, files, queue);
+}
+
+GLOBAL_STATIC(TagHelperPool, instance)
+
+TagHelperPool::TagHelperPool()
+{
+    // Number of helper processes used for bulk operations is a hidden option
+    Configuration cfg(QLatin1String("TagHelperPool"));
+    maxHelpers=qBound(1, cfg.get("maxHelpers", qMin(QThread::idealThreadCount(), constMaxHelpers)), 16);
+}
+
+void TagHelperPool::stop()
+{
+    QMutexLocker locker(&mutex);
+    for (TagHelperIface *helper: all) {
+        helper->stop();
+        helper->deleteLater();
+    }
+    all.clear();
+    idle.clear();
+}
+
+QList<Song> TagHelperPool::read(const QStringList &files, Progress *prog)
+{
+    FileRequest<Song> req(files, Song());
+    run(QLatin1String("read"), &req, prog);
+    return req.results;
+}
+
+QStringList TagHelperPool::readComment(const QStringList &files, Progress *prog)
+{
+    FileRequest<QString> req(files, QString());
+    run(QLatin1String("readComment"), &req, prog);
+    return req.results;
+}
+
+QList<int> TagHelperPool::readRating(const QStringList &files, Progress *prog)
+{
+    FileRequest<int> req(files, -1);
+    run(QLatin1String("readRating"), &req, prog);
+    return req.results;
+}
+
+QList<Tags::ReplayGain> TagHelperPool::readReplaygain(const QStringList &files, Progress *prog)
+{
+    FileRequest<Tags::ReplayGain> req(files, Tags::ReplayGain());
+    run(QLatin1String("readReplaygain"), &req, prog);
+    return req.results;
+}
+
+QList<int> TagHelperPool::update(const QStringList &files, const QList<Song> &from, const QList<Song> &to, int id3Ver, bool saveComment, Progress *prog)
+{
+    SongUpdateRequest req(files, from, to, id3Ver, saveComment);
+    run(QLatin1String("update"), &req, prog);
+    return req.results;
+}
+
+QList<int> TagHelperPool::updateRating(const QStringList &files, const QList<int> &ratings, Progress *prog)
+{
+    UpdateRequest<int> req(files, ratings);
+    run(QLatin1String("updateRating"), &req, prog);
+    return req.results;
+}
+
+QList<int> TagHelperPool::updateReplaygain(const QStringList &files, const QList<Tags::ReplayGain> &rg, Progress *prog)
+{
+    UpdateRequest<Tags::ReplayGain> req(files, rg);
+    run(QLatin1String("updateReplaygain"), &req, prog);
+    return req.results;
+}
+
+void TagHelperPool::run(const QString &request, Request *req, Progress *prog)
+{
+    int total=req->count();
+    if (0==total) {
+        return;
+    }
+
+    QList<TagHelperIface *> helpers=take(total);
+    int batchSize=qBound(1, total/(helpers.count()*constBatchesPerHelper), constMaxBatchSize);
+    QList<Range> pending;
+    for (int start=0; start<total; start+=batchSize) {
+        pending.append(Range(start, qMin(batchSize, total-start)));
+    }
+
+    TagHelperIface::BatchQueue queue;
+    QMap<TagHelperIface *, Range> running;
+    for (TagHelperIface *helper: helpers) {
+        if (pending.isEmpty()) {
+            break;
+        }
+        running.insert(helper, pending.takeFirst());
+        startBatch(helper, request, req, running[helper], &queue);
+    }
+
+    int done=0;
+    while (!running.isEmpty()) {
+        TagHelperIface::BatchQueue::Reply reply=queue.take();
+        Range &range=running[reply.helper];
+        if (reply.index>=0) {
+            if (reply.index<range.count) {
+                QDataStream stream(reply.data);
+                req->read(stream, range.start+reply.index);
+                range.received++;
+                done++;
+                if (prog) {
+                    prog->tagProgress(done, total);
+                }
+            }
+            continue;
+        }
+
+        reply.helper->endBatch();
+        if (TagHelperIface::BatchQueue::NotStarted==reply.index) {
+            // Starting a helper waits several seconds before failing, so don't use this one again for this
+            // request. Its files are left for the remaining helpers - if there are none, they are all failed.
+            pending.prepend(range);
+            running.remove(reply.helper);
+            if (running.isEmpty()) {
+                if (prog) {
+                    prog->tagProgress(total, total);
+                }
+                break;
+            }
+            continue;
+        }
+        if (TagHelperIface::BatchQueue::Failed==reply.index && range.received<range.count) {
+            // Files are processed in order, so the helper most likely crashed on the next file. Leave that
+            // as failed, and re-send the rest - the helper is restarted when it is next sent a message.
+            done++;
+            if (prog) {
+                prog->tagProgress(done, total);
+            }
+            int next=range.received+1;
+            if (next<range.count) {
+                pending.prepend(Range(range.start+next, range.count-next));
+            }
+        }
+        if (pending.isEmpty()) {
+            running.remove(reply.helper);
+        } else {
+            range=pending.takeFirst();
+            startBatch(reply.helper, request, req, range, &queue);
+        }
+    }
+
+    release(helpers);
+}
+
+QList<TagHelperIface *> TagHelperPool::take(int files)
+{
+    int wanted=qBound(1, (files+constFilesPerHelper-1)/constFilesPerHelper, maxHelpers);
+    QMutexLocker locker(&mutex);
+    QList<TagHelperIface *> helpers;
+    while (helpers.count()<wanted && !idle.isEmpty()) {
+        helpers.append(idle.takeLast());
+    }
+    // Never wait for a helper, as a bulk operation may be started (e.g. via processEvents) whilst another
+    // in the same thread is waiting for its replies. So, if all are busy, start another.
+    while (helpers.isEmpty() || (helpers.count()<wanted && all.count()<maxHelpers)) {
+        TagHelperIface *helper=new TagHelperIface;
+        all.append(helper);
+        helpers.append(helper);
+    }
+    return helpers;
+}
+
+void TagHelperPool::release(const QList<TagHelperIface *> &helpers)
+{
+    QMutexLocker locker(&mutex);
+    idle+=helpers;
+}
@@ -0,0 +1,90 @@
+/*
+ * Cantata
+ *
+ * Copyright (c) 2011-2018 Craig Drummond <craig.p.drummond@gmail.com>
+ *
+ * ----
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TAG_HELPER_POOL_H
+#define TAG_HELPER_POOL_H
+
+#include "mpd-interface/song.h"
+#include <QList>
+#include <QStringList>
+#include <QMutex>
+
+class TagHelperIface;
+class QDataStream;
+
+namespace Tags
+{
+    struct ReplayGain;
+}
+
+// Bulk tag operations. Files are sent to cantata-tags helpers in batches, and spread over several
+// helper processes - so that TagLib can use more than one core, whilst still being isolated from the
+// UI. These helpers are separate from TagHelperIface::self(), so that single file requests are not
+// held up. Results are in the same order as 'files'. Functions block until all files have been
+// processed, calling 'prog' (if set) from the calling thread as each file completes.
+class TagHelperPool
+{
+public:
+    static TagHelperPool * self();
+
+    class Progress
+    {
+    public:
+        virtual ~Progress() { }
+        virtual void tagProgress(int done, int total)=0;
+    };
+
+    class Request
+    {
+    public:
+        virtual ~Request() { }
+        virtual int count() const=0;
+        virtual void write(QDataStream &stream, int index) const=0;
+        virtual void read(QDataStream &stream, int index)=0;
+    };
+
+    TagHelperPool();
+    void stop();
+
+    QList<Song> read(const QStringList &files, Progress *prog=0);
+    QStringList readComment(const QStringList &files, Progress *prog=0);
+    QList<int> readRating(const QStringList &files, Progress *prog=0);
+    QList<Tags::ReplayGain> readReplaygain(const QStringList &files, Progress *prog=0);
+    QList<int> update(const QStringList &files, const QList<Song> &from, const QList<Song> &to, int id3Ver, bool saveComment, Progress *prog=0);
+    QList<int> updateRating(const QStringList &files, const QList<int> &ratings, Progress *prog=0);
+    QList<int> updateReplaygain(const QStringList &files, const QList<Tags::ReplayGain> &rg, Progress *prog=0);
+
+    void run(const QString &request, Request *req, Progress *prog=0);
+
+private:
+    QList<TagHelperIface *> take(int files);
+    void release(const QList<TagHelperIface *> &helpers);
+
+private:
+    QMutex mutex;
+    int maxHelpers;
+    QList<TagHelperIface *> idle;
+    QList<TagHelperIface *> all;
+};
+
+#endif
@@ -33,6 +33,7 @@
 
 #ifndef CANTATA_TAG_SERVER
 #include "taghelperiface.h"
+#include "taghelperpool.h"
 #endif
 
 namespace Tags
@@ -68,7 +69,7 @@ namespace Tags
     void enableDebug();
     #ifndef CANTATA_TAG_SERVER
     inline void init() { TagHelperIface::self(); }
-    inline void stop() { TagHelperIface::self()->stop(); }
+    inline void stop() { TagHelperPool::self()->stop(); TagHelperIface::self()->stop(); }
     inline Song read(const QString &fileName) { return TagHelperIface::self()->read(fileName); }
     inline QImage readImage(const QString &fileName) { return TagHelperIface::self()->readImage(fileName); }
     inline QString readLyrics(const QString &fileName) { return TagHelperIface::self()->readLyrics(fileName); }
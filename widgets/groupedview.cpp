@@ -44,6 +44,7 @@
 #include <QAction>
 #include <QDropEvent>
 #include <QPixmap>
+#include <QScrollBar>
 
 static int constCoverSize=32;
 static int constIconSize=16;
@@ -478,6 +479,7 @@ GroupedView::GroupedView(QWidget *parent, bool isPlayQueue)
     setSelectionBehavior(SelectRows);
     setForceSingleColumn(true);
     connect(this, SIGNAL(clicked(const QModelIndex &)), this, SLOT(itemClicked(const QModelIndex &)));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), Covers::self(), SLOT(viewScrolled()));
     GroupedViewDelegate *delegate=new GroupedViewDelegate(this);
     setItemDelegate(delegate);
     if (isPlayQueue) {
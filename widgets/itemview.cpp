@@ -48,6 +48,7 @@
 #include <QTimer>
 #include <QKeyEvent>
 #include <QProxyStyle>
+#include <QScrollBar>
 #include <QDebug>
 
 #define COVERS_DBUG if (Covers::verboseDebugEnabled()) qWarning() << metaObject()->className() << QThread::currentThread()->objectName() << __FUNCTION__
@@ -656,6 +657,8 @@ ItemView::ItemView(QWidget *p)
     connect(title, SIGNAL(addToPlayQueue()), this, SLOT(addTitleButtonClicked()));
     connect(title, SIGNAL(replacePlayQueue()), this, SLOT(replaceTitleButtonClicked()));
     connect(Covers::self(), SIGNAL(loaded(Song,int)), this, SLOT(coverLoaded(Song,int)));
+    connect(treeView->verticalScrollBar(), SIGNAL(valueChanged(int)), Covers::self(), SLOT(viewScrolled()));
+    connect(listView->verticalScrollBar(), SIGNAL(valueChanged(int)), Covers::self(), SLOT(viewScrolled()));
     searchWidget->setVisible(false);
     #ifdef Q_OS_MAC
     treeView->setAttribute(Qt::WA_MacShowFocusRect, 0);